@@ -370,7 +370,9 @@ void BGM_Stop (void)
 		bgmstream->status = STREAM_NONE;
 		S_CodecCloseStream(bgmstream);
 		bgmstream = NULL;
+		S_LockMixer ();
 		s_rawend = 0;
+		S_UnlockMixer ();
 	}
 }
 
@@ -411,13 +413,18 @@ static void BGM_UpdateStream (void)
 	if (bgmvolume.value <= 0)
 		return;
 
-	/* see how many samples should be copied into the raw buffer */
-	if (s_rawend < paintedtime)
-		s_rawend = paintedtime;
-
-	while (s_rawend < paintedtime + MAX_RAW_SAMPLES)
+	for (;;)
 	{
+		/* see how many samples should be copied into the raw buffer.
+		 * the mixer thread only advances paintedtime, so this much
+		 * room is still there once the decode below is done */
+		S_LockMixer ();
+		if (s_rawend < paintedtime)
+			s_rawend = paintedtime;
 		bufferSamples = MAX_RAW_SAMPLES - (s_rawend - paintedtime);
+		S_UnlockMixer ();
+		if (bufferSamples <= 0)
+			return;
 
 		/* ramp up volume after stream was paused */
 		if (bgmstream->volume < 1.f)
@@ -450,10 +457,12 @@ static void BGM_UpdateStream (void)
 
 		if (res > 0)	/* data: add to raw buffer */
 		{
+			S_LockMixer ();
 			S_RawSamples(fileSamples, bgmstream->info.rate,
 							bgmstream->info.width,
 							bgmstream->info.channels,
 							raw, bgmvolume.value * bgmstream->volume);
+			S_UnlockMixer ();
 			did_rewind = false;
 		}
 		else if (res == 0)	/* EOF */
@@ -502,6 +511,11 @@ void BGM_Update (void)
 		old_volume = bgmvolume.value;
 	}
 	if (bgmstream)
+	{
+	/* decoding stays on the main thread (the codecs print and use the
+	 * zone), BGM_UpdateStream only holds the mixer off while
+	 * s_rawsamples is refilled */
 		BGM_UpdateStream ();
+	}
 }
 
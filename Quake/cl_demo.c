@@ -22,6 +22,10 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "quakedef.h"
 
 static void CL_FinishTimeDemo (void);
+static void CL_ClearDemoKeyframes (void);
+static void CL_UpdateDemoKeyframes (void);
+static void CL_WriteDemoIndex (void);
+static void CL_LoadDemoIndex (void);
 
 /*
 ==============================================================================
@@ -80,6 +84,72 @@ static struct
 	}				prev;
 }					demo_rewind;
 
+// Demo seeking
+typedef struct
+{
+	double			time;			// cl.mtime[0] when taken
+	qfileofs_t		fileofs;		// next message to read
+	qfileofs_t		mapofs;			// first signon message of the map it was taken on
+	size_t			numframes;		// rewind history at this point, (size_t)-1 if loaded from the index
+	size_t			numevents;
+	int				numentities;
+	size_t			datasize;
+	cshift_t		cshift;
+	lightstyle_t	lightstyles[MAX_LIGHTSTYLES];
+	byte			*data;			// client state, scores, entities, then model/colormap refs
+} demokeyframe_t;
+
+static demokeyframe_t	*demo_keyframes;	// sorted by map, then time
+
+static struct
+{
+	qfileofs_t		mapofs;			// first signon message of the current map
+	qboolean		insignon;
+	qboolean		dirty;			// keyframes were added since the index was loaded
+	time_t			demotime;		// modification time of the demo (or the pak holding it), 0 if unknown
+}					demo_index;
+
+// on-disk keyframe index, <demo>.dem.idx in the game dir
+#define DEMOINDEX_IDENT		(('X'<<24)+('D'<<16)+('I'<<8)+'Q')
+#define DEMOINDEX_VERSION	1
+
+typedef struct
+{
+	int			ident;
+	int			version;
+	int64_t		demosize;
+	int64_t		demotime;
+	int			clsize;			// layout of the saved state, must match this build
+	int			entsize;
+	int			scoresize;
+	int			numkeyframes;
+} demoindexheader_t;
+
+typedef struct
+{
+	double			time;
+	int64_t			fileofs;
+	int64_t			mapofs;
+	int				numentities;
+	int				datasize;
+	cshift_t		cshift;
+	lightstyle_t	lightstyles[MAX_LIGHTSTYLES];
+} demoindexkeyframe_t;
+
+// the parts of client_state_t that change during a map, see CL_SaveDemoState
+static const struct
+{
+	size_t	begin, end;
+} demo_clstate[] =
+{
+	{0,											offsetof (client_state_t, model_precache)},
+	{offsetof (client_state_t, viewentity),		offsetof (client_state_t, qcvm)},
+	{offsetof (client_state_t, zoom),			sizeof (client_state_t)},
+};
+
+cvar_t	cl_demokeyframes = {"cl_demokeyframes", "20", CVAR_ARCHIVE};	// seconds between seek keyframes, 0 disables
+cvar_t	cl_benchmarkfile = {"cl_benchmarkfile", "benchmark.json", CVAR_NONE};	// relative to the game dir
+
 /*
 ==============
 CL_ClearSignons
@@ -104,6 +174,8 @@ void CL_StopPlayback (void)
 	if (!cls.demoplayback)
 		return;
 
+	CL_WriteDemoIndex ();
+
 	fclose (cls.demofile);
 	cls.demoplayback = false;
 	cls.demopaused = false;
@@ -118,6 +190,8 @@ void CL_StopPlayback (void)
 	VEC_CLEAR (demo_rewind.frame_events);
 	VEC_CLEAR (demo_rewind.pending_sounds);
 	demo_rewind.backstop = false;
+	CL_ClearDemoKeyframes ();
+	memset (&demo_index, 0, sizeof (demo_index));
 
 	if (cls.timedemo)
 		CL_FinishTimeDemo ();
@@ -251,11 +325,20 @@ static qboolean CL_NextDemoFrame (void)
 		{
 			VEC_CLEAR (demo_rewind.frames);
 			VEC_CLEAR (demo_rewind.frame_events);
+
+			// keyframes are grouped by the offset of the map's first signon message
+			if (!demo_index.insignon)
+			{
+				demo_index.mapofs = Sys_ftell (cls.demofile);
+				demo_index.insignon = true;
+			}
 		}
 		else
 		{
 			demoframe_t newframe;
 
+			demo_index.insignon = false;
+
 			memset (&newframe, 0, sizeof (newframe));
 			newframe.fileofs = Sys_ftell (cls.demofile);
 			newframe.intermission = cl.intermission;
@@ -305,7 +388,10 @@ void CL_FinishDemoFrame (void)
 	// so we only track state changes from the second one onwards
 	numframes = VEC_SIZE (demo_rewind.frames);
 	if (numframes < 2)
+	{
+		CL_UpdateDemoKeyframes ();
 		return;
+	}
 
 	lastframe = &demo_rewind.frames[numframes - 1];
 
@@ -344,6 +430,8 @@ void CL_FinishDemoFrame (void)
 			lastframe->datasize += 1 + sizeof (*snd);
 		}
 		VEC_CLEAR (demo_rewind.pending_sounds);
+
+		CL_UpdateDemoKeyframes ();
 	}
 	else // rewinding
 	{
@@ -417,6 +505,540 @@ void CL_FinishDemoFrame (void)
 	}
 }
 
+/*
+==============================================================================
+
+DEMO SEEKING
+
+While playing forward, a snapshot of the client state is taken every
+cl_demokeyframes seconds (server time) at a message boundary.  Seeking
+restores the closest snapshot of the current map at or before the target
+and parses the remaining messages without rendering.
+
+Keyframes hold no pointers: models and colormaps are stored as precache
+and scoreboard indices and resolved against the current map on restore.
+They're kept for the whole demo and saved next to it as <demo>.dem.idx,
+keyed by the demo's size and modification time, so seeking is immediate
+the next time the demo is played.
+
+==============================================================================
+*/
+
+/*
+===============
+CL_ClearDemoKeyframes
+===============
+*/
+static void CL_ClearDemoKeyframes (void)
+{
+	size_t i;
+
+	for (i = 0; i < VEC_SIZE (demo_keyframes); i++)
+		free (demo_keyframes[i].data);
+	VEC_CLEAR (demo_keyframes);
+}
+
+/*
+===============
+CL_DemoStateSize
+===============
+*/
+static size_t CL_DemoStateSize (void)
+{
+	size_t i, size;
+
+	for (i = 0, size = 0; i < countof (demo_clstate); i++)
+		size += demo_clstate[i].end - demo_clstate[i].begin;
+
+	return size;
+}
+
+/*
+===============
+CL_DemoStateOffset
+
+Where a client_state_t field ends up in the saved state
+===============
+*/
+static size_t CL_DemoStateOffset (size_t ofs)
+{
+	size_t i, pos;
+
+	for (i = 0, pos = 0; i < countof (demo_clstate); i++)
+	{
+		if (ofs >= demo_clstate[i].begin && ofs < demo_clstate[i].end)
+			return pos + ofs - demo_clstate[i].begin;
+		pos += demo_clstate[i].end - demo_clstate[i].begin;
+	}
+
+	Sys_Error ("CL_DemoStateOffset: %u not saved", (unsigned) ofs);
+	return 0;
+}
+
+/*
+===============
+CL_DemoKeyframeSize
+
+Size of the data of a keyframe with the given number of entities,
+for the current map
+===============
+*/
+static size_t CL_DemoKeyframeSize (int numentities)
+{
+	return CL_DemoStateSize () + cl.maxclients * sizeof (scoreboard_t) +
+		numentities * sizeof (entity_t) + (1 + numentities) * 2 * sizeof (int);
+}
+
+/*
+===============
+CL_EncodeDemoEntity
+
+Replaces the pointers of a saved entity (which may be unaligned)
+with a model precache index and a colormap index
+===============
+*/
+static void CL_EncodeDemoEntity (byte *data, int refs[2])
+{
+	entity_t	ent;
+	int			i;
+
+	memcpy (&ent, data, sizeof (ent));
+
+	refs[0] = -1;
+	if (!ent.model)
+		refs[0] = 0;
+	for (i = 1; i < MAX_MODELS && cl.model_precache[i] && refs[0] < 0; i++)
+		if (cl.model_precache[i] == ent.model)
+			refs[0] = i;
+
+	refs[1] = 1;
+	if (!ent.colormap)
+		refs[1] = 0;
+	for (i = 0; i < cl.maxclients && refs[1] == 1; i++)
+		if (ent.colormap == cl.scores[i].translations)
+			refs[1] = 2 + i;
+
+	ent.model = NULL;
+	ent.colormap = NULL;
+	memset (&ent.lightcache, 0, sizeof (ent.lightcache));
+	memcpy (data, &ent, sizeof (ent));
+}
+
+/*
+===============
+CL_DecodeDemoEntity
+===============
+*/
+static void CL_DecodeDemoEntity (entity_t *ent, const byte *refdata)
+{
+	int refs[2];
+
+	memcpy (refs, refdata, sizeof (refs));
+
+	if (refs[0] > 0 && refs[0] < MAX_MODELS)
+		ent->model = cl.model_precache[refs[0]];
+	else
+		ent->model = NULL;
+
+	if (refs[1] == 0)
+		ent->colormap = NULL;
+	else if (refs[1] >= 2 && refs[1] - 2 < cl.maxclients)
+		ent->colormap = cl.scores[refs[1] - 2].translations;
+	else
+		ent->colormap = vid.colormap;
+}
+
+/*
+===============
+CL_UpdateDemoKeyframes
+
+Called at the end of each demo message during forward playback
+===============
+*/
+static void CL_UpdateDemoKeyframes (void)
+{
+	demokeyframe_t	kf;
+	size_t			i, pos, scoresize, entsize;
+	byte			*dst, *refs;
+	int				ref[2];
+
+	if (cls.signon < SIGNONS || cls.demospeed <= 0.f || cls.timedemo || cl_demokeyframes.value <= 0.f || !cls.demofile)
+		return;
+
+	// keyframes of earlier runs or seeks may lie on either side
+	for (i = 0, pos = VEC_SIZE (demo_keyframes); i < VEC_SIZE (demo_keyframes); i++)
+	{
+		const demokeyframe_t *other = &demo_keyframes[i];
+		if (other->mapofs == demo_index.mapofs && fabs (other->time - cl.mtime[0]) < cl_demokeyframes.value)
+			return;
+		if (pos == VEC_SIZE (demo_keyframes) &&
+			(other->mapofs > demo_index.mapofs || (other->mapofs == demo_index.mapofs && other->time > cl.mtime[0])))
+			pos = i;
+	}
+
+	scoresize = cl.maxclients * sizeof (scoreboard_t);
+	entsize = cl.num_entities * sizeof (entity_t);
+
+	memset (&kf, 0, sizeof (kf));
+	kf.time = cl.mtime[0];
+	kf.fileofs = Sys_ftell (cls.demofile);
+	kf.mapofs = demo_index.mapofs;
+	kf.numframes = VEC_SIZE (demo_rewind.frames);
+	kf.numevents = VEC_SIZE (demo_rewind.frame_events);
+	kf.numentities = cl.num_entities;
+	kf.datasize = CL_DemoKeyframeSize (cl.num_entities);
+	memcpy (&kf.cshift, &cshift_empty, sizeof (cshift_t));
+	memcpy (kf.lightstyles, cl_lightstyle, sizeof (kf.lightstyles));
+
+	kf.data = (byte *) malloc (kf.datasize);
+	if (!kf.data)
+	{
+		Con_DWarning ("CL_UpdateDemoKeyframes: out of memory\n");
+		Cvar_SetQuick (&cl_demokeyframes, "0");
+		return;
+	}
+
+	dst = kf.data;
+	for (i = 0; i < countof (demo_clstate); i++)
+	{
+		memcpy (dst, (byte *) &cl + demo_clstate[i].begin, demo_clstate[i].end - demo_clstate[i].begin);
+		dst += demo_clstate[i].end - demo_clstate[i].begin;
+	}
+	memcpy (dst, cl.scores, scoresize);
+	memcpy (dst + scoresize, cl_entities, entsize);
+
+	// drop the pointers, they're restored from the current map
+	refs = dst + scoresize + entsize;
+	CL_EncodeDemoEntity (kf.data + CL_DemoStateOffset (offsetof (client_state_t, viewent)), ref);
+	memcpy (refs, ref, sizeof (ref));
+	for (i = 0; i < (size_t) cl.num_entities; i++)
+	{
+		CL_EncodeDemoEntity (dst + scoresize + i * sizeof (entity_t), ref);
+		memcpy (refs + (1 + i) * sizeof (ref), ref, sizeof (ref));
+	}
+	memset (kf.data + CL_DemoStateOffset (offsetof (client_state_t, statss)), 0, sizeof (cl.statss));
+	memset (kf.data + CL_DemoStateOffset (offsetof (client_state_t, worldmodel)), 0, sizeof (cl.worldmodel));
+	memset (kf.data + CL_DemoStateOffset (offsetof (client_state_t, scores)), 0, sizeof (cl.scores));
+
+	VEC_PUSH (demo_keyframes, kf);
+	memmove (demo_keyframes + pos + 1, demo_keyframes + pos, (VEC_SIZE (demo_keyframes) - 1 - pos) * sizeof (kf));
+	demo_keyframes[pos] = kf;
+	demo_index.dirty = true;
+}
+
+/*
+===============
+CL_RestoreDemoKeyframe
+===============
+*/
+static qboolean CL_RestoreDemoKeyframe (const demokeyframe_t *kf)
+{
+	char			*statss[MAX_CL_STATS];
+	struct qmodel_s	*worldmodel;
+	scoreboard_t	*scores;
+	const byte		*src, *refs;
+	size_t			i, size;
+
+	if (kf->numentities < 0 || kf->numentities > cl_max_edicts || kf->datasize != CL_DemoKeyframeSize (kf->numentities))
+		return false;
+
+	Sys_fseek (cls.demofile, kf->fileofs, SEEK_SET);
+
+	// pointers are owned by the current state, keep them
+	memcpy (statss, cl.statss, sizeof (statss));
+	worldmodel = cl.worldmodel;
+	scores = cl.scores;
+
+	src = kf->data;
+	for (i = 0; i < countof (demo_clstate); i++)
+	{
+		size = demo_clstate[i].end - demo_clstate[i].begin;
+		memcpy ((byte *) &cl + demo_clstate[i].begin, src, size);
+		src += size;
+	}
+	memcpy (cl.statss, statss, sizeof (statss));
+	cl.worldmodel = worldmodel;
+	cl.scores = scores;
+
+	size = cl.maxclients * sizeof (scoreboard_t);
+	memcpy (cl.scores, src, size);
+	src += size;
+
+	// entities that first showed up after the keyframe go back to their initial state
+	memcpy (cl_entities, src, kf->numentities * sizeof (entity_t));
+	memset (cl_entities + kf->numentities, 0, (cl_max_edicts - kf->numentities) * sizeof (entity_t));
+	refs = src + kf->numentities * sizeof (entity_t);
+
+	CL_DecodeDemoEntity (&cl.viewent, refs);
+	for (i = 0; i < (size_t) kf->numentities; i++)
+		CL_DecodeDemoEntity (&cl_entities[i], refs + (1 + i) * 2 * sizeof (int));
+
+	memcpy (cl_lightstyle, kf->lightstyles, sizeof (cl_lightstyle));
+	memcpy (&cshift_empty, &kf->cshift, sizeof (cshift_t));
+
+	// keep the rewind history if it still leads up to the keyframe
+	if (kf->numframes <= VEC_SIZE (demo_rewind.frames) && kf->numevents <= VEC_SIZE (demo_rewind.frame_events))
+	{
+		VEC_POP_N (demo_rewind.frames, VEC_SIZE (demo_rewind.frames) - kf->numframes);
+		VEC_POP_N (demo_rewind.frame_events, VEC_SIZE (demo_rewind.frame_events) - kf->numevents);
+	}
+	else
+	{
+		VEC_CLEAR (demo_rewind.frames);
+		VEC_CLEAR (demo_rewind.frame_events);
+	}
+
+	return true;
+}
+
+/*
+===============
+CL_DemoIndexPath
+===============
+*/
+static void CL_DemoIndexPath (char *path, size_t size)
+{
+	q_snprintf (path, size, "%s/%s.idx", com_gamedir, cls.demofilename);
+}
+
+/*
+===============
+CL_WriteDemoIndex
+
+Saves the keyframes of the current demo if any were added
+===============
+*/
+static void CL_WriteDemoIndex (void)
+{
+	demoindexheader_t	header;
+	demoindexkeyframe_t	out;
+	char				path[MAX_OSPATH];
+	FILE				*f;
+	size_t				i;
+	qboolean			ok;
+
+	if (!demo_index.dirty || !demo_index.demotime || !cls.demofilename[0] || !VEC_SIZE (demo_keyframes))
+		return;
+	demo_index.dirty = false;
+
+	CL_DemoIndexPath (path, sizeof (path));
+	COM_CreatePath (path);
+	f = Sys_fopen (path, "wb");
+	if (!f)
+	{
+		Con_DPrintf ("Couldn't write %s\n", path);
+		return;
+	}
+
+	memset (&header, 0, sizeof (header));
+	header.ident = DEMOINDEX_IDENT;
+	header.version = DEMOINDEX_VERSION;
+	header.demosize = cls.demofilesize;
+	header.demotime = (int64_t) demo_index.demotime;
+	header.clsize = (int) CL_DemoStateSize ();
+	header.entsize = (int) sizeof (entity_t);
+	header.scoresize = (int) sizeof (scoreboard_t);
+	header.numkeyframes = (int) VEC_SIZE (demo_keyframes);
+	ok = fwrite (&header, sizeof (header), 1, f) == 1;
+
+	for (i = 0; i < VEC_SIZE (demo_keyframes) && ok; i++)
+	{
+		const demokeyframe_t *kf = &demo_keyframes[i];
+
+		memset (&out, 0, sizeof (out));
+		out.time = kf->time;
+		out.fileofs = kf->fileofs;
+		out.mapofs = kf->mapofs;
+		out.numentities = kf->numentities;
+		out.datasize = (int) kf->datasize;
+		memcpy (&out.cshift, &kf->cshift, sizeof (out.cshift));
+		memcpy (out.lightstyles, kf->lightstyles, sizeof (out.lightstyles));
+
+		ok = fwrite (&out, sizeof (out), 1, f) == 1 && fwrite (kf->data, kf->datasize, 1, f) == 1;
+	}
+
+	ok = (fclose (f) == 0) && ok;
+	if (!ok)
+	{
+		Con_DPrintf ("Couldn't write %s\n", path);
+		Sys_remove (path);
+	}
+}
+
+/*
+===============
+CL_LoadDemoIndex
+
+Reads the keyframes saved by an earlier run of the current demo,
+unless the demo changed since
+===============
+*/
+static void CL_LoadDemoIndex (void)
+{
+	demoindexheader_t	header;
+	demoindexkeyframe_t	in;
+	demokeyframe_t		kf;
+	char				path[MAX_OSPATH];
+	FILE				*f;
+	int					i;
+
+	if (!demo_index.demotime)
+		return;
+
+	CL_DemoIndexPath (path, sizeof (path));
+	f = Sys_fopen (path, "rb");
+	if (!f)
+		return;
+
+	if (fread (&header, sizeof (header), 1, f) != 1 ||
+		header.ident != DEMOINDEX_IDENT ||
+		header.version != DEMOINDEX_VERSION ||
+		header.demosize != cls.demofilesize ||
+		header.demotime != (int64_t) demo_index.demotime ||
+		header.clsize != (int) CL_DemoStateSize () ||
+		header.entsize != (int) sizeof (entity_t) ||
+		header.scoresize != (int) sizeof (scoreboard_t) ||
+		header.numkeyframes < 0)
+	{
+		Con_DPrintf ("Ignoring stale demo index %s\n", path);
+		fclose (f);
+		return;
+	}
+
+	for (i = 0; i < header.numkeyframes; i++)
+	{
+		if (fread (&in, sizeof (in), 1, f) != 1 || in.datasize <= 0 || in.numentities < 0 ||
+			in.fileofs < cls.demofilestart || in.fileofs > cls.demofilestart + cls.demofilesize)
+			break;
+
+		memset (&kf, 0, sizeof (kf));
+		kf.time = in.time;
+		kf.fileofs = in.fileofs;
+		kf.mapofs = in.mapofs;
+		kf.numframes = (size_t) -1;		// no rewind history to keep
+		kf.numevents = (size_t) -1;
+		kf.numentities = in.numentities;
+		kf.datasize = in.datasize;
+		memcpy (&kf.cshift, &in.cshift, sizeof (kf.cshift));
+		memcpy (kf.lightstyles, in.lightstyles, sizeof (kf.lightstyles));
+
+		kf.data = (byte *) malloc (kf.datasize);
+		if (!kf.data)
+			break;
+		if (fread (kf.data, kf.datasize, 1, f) != 1)
+		{
+			free (kf.data);
+			break;
+		}
+		VEC_PUSH (demo_keyframes, kf);
+	}
+
+	fclose (f);
+
+	if (i != header.numkeyframes)
+	{
+		Con_DPrintf ("Ignoring truncated demo index %s\n", path);
+		CL_ClearDemoKeyframes ();
+	}
+}
+
+/*
+===============
+CL_DemoSeek_f
+
+demoseek <time> : jump to an absolute server time, or +/-seconds from now
+===============
+*/
+void CL_DemoSeek_f (void)
+{
+	const char		*arg;
+	double			target;
+	float			speed;
+	size_t			i;
+	demokeyframe_t	*kf;
+
+	if (cmd_source != src_command)
+		return;
+
+	if (Cmd_Argc () != 2)
+	{
+		Con_Printf ("demoseek <time> : jump to the given server time, or +/- seconds from now\n");
+		return;
+	}
+
+	if (!cls.demoplayback || cls.signon < SIGNONS)
+	{
+		Con_Printf ("Not playing a demo.\n");
+		return;
+	}
+
+	if (cls.timedemo)
+	{
+		Con_Printf ("Can't seek during timedemo\n");
+		return;
+	}
+
+	arg = Cmd_Argv (1);
+	target = Q_atof (*arg == '+' ? arg + 1 : arg);
+	if (*arg == '+' || *arg == '-')
+		target += cl.mtime[0];
+	target = q_max (target, 0.0);
+
+	// pick the latest keyframe of this map at or before the target, unless playing forward from here is closer
+	kf = NULL;
+	for (i = 0; i < VEC_SIZE (demo_keyframes); i++)
+	{
+		if (demo_keyframes[i].mapofs != demo_index.mapofs)
+			continue;
+		if (!kf || demo_keyframes[i].time <= target)
+			kf = &demo_keyframes[i];
+	}
+	if (kf && target >= cl.mtime[0] && kf->time <= cl.mtime[0])
+		kf = NULL;
+
+	if (!kf && target < cl.mtime[0])
+	{
+		Con_Printf ("No keyframe before %.1f\n", target);
+		return;
+	}
+	if (kf && cl.qcvm.progs)
+	{
+		Con_Printf ("Can't seek backwards in CSQC demos\n");
+		return;
+	}
+
+	if (kf && !CL_RestoreDemoKeyframe (kf))
+	{
+		Con_Printf ("Keyframe at %.1f doesn't match this map\n", kf->time);
+		return;
+	}
+
+	// parse everything up to the target in one go
+	speed = cls.demospeed;
+	cls.demospeed = 1.f;
+	cls.demoseeking = true;
+	demo_rewind.backstop = false;
+	cl.time = target;
+
+	while (cls.demoplayback && cls.signon == SIGNONS && CL_GetMessage () == 1)
+		CL_ParseServerMessage ();
+
+	cls.demoseeking = false;
+	cls.demospeed = speed;
+	cl.oldtime = cl.time;
+
+	// don't lerp or trail across the jump
+	for (i = 0; i < (size_t) cl.num_entities; i++)
+	{
+		cl_entities[i].lerpflags |= LERP_RESETANIM | LERP_RESETMOVE;
+		cl_entities[i].traildelay = 1.f / 72.f;
+		VectorCopy (cl_entities[i].msg_origins[0], cl_entities[i].trailorg);
+	}
+	memset (cl_dlights, 0, sizeof (cl_dlights));
+	memset (cl_beams, 0, sizeof (cl_beams));
+	R_ClearParticles ();
+}
+
 static int CL_GetDemoMessage (void)
 {
 	int		i;
@@ -813,11 +1435,253 @@ void CL_PlayDemo_f (void)
 	cls.demofilestart = Sys_ftell (cls.demofile);
 	cls.demofilesize = com_filesize;
 
+// pick up the keyframes of earlier runs
+	memset (&demo_index, 0, sizeof (demo_index));
+	demo_index.mapofs = cls.demofilestart;
+	if (!Sys_GetFileTime (com_filepath, &demo_index.demotime))
+		demo_index.demotime = 0;
+	CL_LoadDemoIndex ();
+
 // if this is a player-initiated demo, get rid of the console
 	if (cls.demonum == -1 && key_dest == key_console)
 		key_dest = key_game;
 }
 
+/*
+==============================================================================
+
+TIMEDEMO STATISTICS
+
+Frame times are sorted into a histogram with TD_HISTOGRAM_STEPS buckets per
+doubling, starting at one microsecond, so percentiles are within about 2%.
+The benchmark command runs timedemo on a list of demos and writes the
+results to cl_benchmarkfile as JSON.
+==============================================================================
+*/
+
+#define TD_HISTOGRAM_STEPS	32
+#define TD_HISTOGRAM_SIZE	(TD_HISTOGRAM_STEPS * 24)	// up to 16 seconds
+
+typedef struct
+{
+	char		name[MAX_QPATH];
+	int			frames;			// 0 if the demo couldn't be played
+	double		seconds;
+	double		min, avg, p1, p99, max;		// frame times
+	double		stats[TDSTAT_COUNT];		// average cost per frame
+} tdresult_t;
+
+static const char *const td_statnames[TDSTAT_COUNT] = {"parse", "relink", "particles", "render"};
+
+static struct
+{
+	double		lasttime;		// end of the previous frame, 0 until the second frame is done
+	int			frames;
+	double		total, min, max;
+	double		stats[TDSTAT_COUNT];
+	int			histogram[TD_HISTOGRAM_SIZE];
+} td;
+
+static tdresult_t	*benchmark_results;
+static int			benchmark_current = -1;	// index into benchmark_results, -1 if not running
+static qboolean		benchmark_quit;		// started with -benchmark, quit when done
+
+/*
+====================
+CL_TimeDemoAddTime
+
+Adds to the cost of a subsystem for the current frame
+====================
+*/
+void CL_TimeDemoAddTime (tdstat_t stat, double seconds)
+{
+	if (cls.timedemo && td.lasttime)
+		td.stats[stat] += seconds;
+}
+
+/*
+====================
+CL_TimeDemoEndFrame
+====================
+*/
+void CL_TimeDemoEndFrame (void)
+{
+	double	now, frametime;
+	int		bucket;
+
+	if (!cls.timedemo)
+		return;
+
+	now = Sys_DoubleTime ();
+	if (!td.lasttime)
+	{
+	// the first frame includes the loading time, skip it like CL_FinishTimeDemo
+		if (host_framecount > cls.td_startframe)
+			td.lasttime = now;
+		return;
+	}
+
+	frametime = now - td.lasttime;
+	td.lasttime = now;
+
+	if (!td.frames || frametime < td.min)
+		td.min = frametime;
+	if (!td.frames || frametime > td.max)
+		td.max = frametime;
+	td.total += frametime;
+	td.frames++;
+
+	bucket = frametime > 1e-6 ? (int) (log2 (frametime * 1e6) * TD_HISTOGRAM_STEPS) : 0;
+	td.histogram[CLAMP (0, bucket, TD_HISTOGRAM_SIZE - 1)]++;
+}
+
+/*
+====================
+CL_TimeDemoPercentile
+====================
+*/
+static double CL_TimeDemoPercentile (double fraction)
+{
+	int		i, count, target;
+
+	target = (int) ceil (td.frames * fraction);
+	target = CLAMP (1, target, td.frames);
+	for (i = 0, count = 0; i < TD_HISTOGRAM_SIZE - 1; i++)
+	{
+		count += td.histogram[i];
+		if (count >= target)
+			break;
+	}
+
+	// bucket center, kept inside the measured range
+	return CLAMP (td.min, pow (2.0, (i + 0.5) / TD_HISTOGRAM_STEPS) * 1e-6, td.max);
+}
+
+/*
+====================
+CL_TimeDemoResult
+====================
+*/
+static void CL_TimeDemoResult (tdresult_t *result)
+{
+	int i;
+
+	result->frames = td.frames;
+	result->seconds = td.total;
+	if (!td.frames)
+		return;
+
+	result->min = td.min;
+	result->avg = td.total / td.frames;
+	result->p1 = CL_TimeDemoPercentile (0.01);
+	result->p99 = CL_TimeDemoPercentile (0.99);
+	result->max = td.max;
+	for (i = 0; i < TDSTAT_COUNT; i++)
+		result->stats[i] = td.stats[i] / td.frames;
+}
+
+/*
+====================
+CL_WriteJSONString
+====================
+*/
+static void CL_WriteJSONString (FILE *f, const char *str)
+{
+	fputc ('"', f);
+	for (; *str; str++)
+	{
+		if (*str == '"' || *str == '\\')
+			fprintf (f, "\\%c", *str);
+		else if ((unsigned char) *str < 32)
+			fprintf (f, "\\u%04x", (unsigned char) *str);
+		else
+			fputc (*str, f);
+	}
+	fputc ('"', f);
+}
+
+/*
+====================
+CL_WriteBenchmarkResults
+====================
+*/
+static void CL_WriteBenchmarkResults (void)
+{
+	char		path[MAX_OSPATH];
+	FILE		*f;
+	tdresult_t	*r;
+	int			i, j;
+
+	if (!cl_benchmarkfile.string[0])
+		return;
+
+	q_snprintf (path, sizeof (path), "%s/%s", com_gamedir, cl_benchmarkfile.string);
+	f = Sys_fopen (path, "w");
+	if (!f)
+	{
+		Con_Printf ("ERROR: couldn't open %s\n", path);
+		return;
+	}
+
+	fprintf (f, "{\n");
+	fprintf (f, "\t\"version\": \"%s\",\n", IRONWAIL_VER_STRING);
+	fprintf (f, "\t\"headless\": %s,\n", Host_IsHeadless () ? "true" : "false");
+	fprintf (f, "\t\"threads\": %d,\n", Tasks_NumWorkers () + 1);
+	fprintf (f, "\t\"demos\": [");
+	for (i = 0; i < (int) VEC_SIZE (benchmark_results); i++)
+	{
+		r = &benchmark_results[i];
+		fprintf (f, "%s\n\t\t{\n\t\t\t\"name\": ", i ? "," : "");
+		CL_WriteJSONString (f, r->name);
+		if (!r->frames)
+		{
+			fprintf (f, ",\n\t\t\t\"failed\": true\n\t\t}");
+			continue;
+		}
+		fprintf (f, ",\n\t\t\t\"frames\": %d,\n", r->frames);
+		fprintf (f, "\t\t\t\"seconds\": %.3f,\n", r->seconds);
+		fprintf (f, "\t\t\t\"fps\": %.1f,\n", r->frames / q_max (r->seconds, 1e-6));
+		fprintf (f, "\t\t\t\"frametime_ms\": {\"min\": %.3f, \"avg\": %.3f, \"p1\": %.3f, \"p99\": %.3f, \"max\": %.3f},\n",
+			r->min * 1000.0, r->avg * 1000.0, r->p1 * 1000.0, r->p99 * 1000.0, r->max * 1000.0);
+		fprintf (f, "\t\t\t\"subsystems_ms\": {");
+		for (j = 0; j < TDSTAT_COUNT; j++)
+			fprintf (f, "%s\"%s\": %.3f", j ? ", " : "", td_statnames[j], r->stats[j] * 1000.0);
+		fprintf (f, "}\n\t\t}");
+	}
+	fprintf (f, "\n\t]\n}\n");
+	fclose (f);
+
+	Con_Printf ("Wrote %s\n", path);
+}
+
+/*
+====================
+CL_NextBenchmark
+
+Starts the next demo of the benchmark, or finishes it
+====================
+*/
+static void CL_NextBenchmark (void)
+{
+	if (benchmark_current < 0)
+		return;
+
+	if (benchmark_current < (int) VEC_SIZE (benchmark_results))
+	{
+		Cbuf_AddText (va ("timedemo \"%s\"\n", benchmark_results[benchmark_current].name));
+		return;
+	}
+
+	CL_WriteBenchmarkResults ();
+	benchmark_current = -1;
+
+	if (benchmark_quit)
+	{
+		key_dest = key_console;	// skip the quit confirmation
+		Cbuf_AddText ("quit\n");
+	}
+}
+
 /*
 ====================
 CL_FinishTimeDemo
@@ -826,8 +1690,10 @@ CL_FinishTimeDemo
 */
 static void CL_FinishTimeDemo (void)
 {
-	int	frames;
-	float	time;
+	int			frames, i;
+	float		time;
+	tdresult_t	result;
+	char		line[256];
 
 	cls.timedemo = false;
 
@@ -837,6 +1703,25 @@ static void CL_FinishTimeDemo (void)
 	if (!time)
 		time = 1;
 	Con_Printf ("%i frames %5.1f seconds %5.1f fps\n", frames, time, frames/time);
+
+	memset (&result, 0, sizeof (result));
+	CL_TimeDemoResult (&result);
+	if (result.frames)
+	{
+		Con_Printf ("frame ms: min %.2f avg %.2f 1%% %.2f 99%% %.2f max %.2f\n",
+			result.min * 1000.0, result.avg * 1000.0, result.p1 * 1000.0, result.p99 * 1000.0, result.max * 1000.0);
+		q_strlcpy (line, "ms/frame:", sizeof (line));
+		for (i = 0; i < TDSTAT_COUNT; i++)
+			q_strlcat (line, va (" %s %.2f", td_statnames[i], result.stats[i] * 1000.0), sizeof (line));
+		Con_Printf ("%s\n", line);
+	}
+
+	if (benchmark_current >= 0 && benchmark_current < (int) VEC_SIZE (benchmark_results))
+	{
+		q_strlcpy (result.name, benchmark_results[benchmark_current].name, sizeof (result.name));
+		benchmark_results[benchmark_current++] = result;
+		CL_NextBenchmark ();
+	}
 }
 
 /*
@@ -859,7 +1744,15 @@ void CL_TimeDemo_f (void)
 
 	CL_PlayDemo_f ();
 	if (!cls.demofile)
+	{
+		// keep going with the rest of the benchmark, the demo is reported as failed
+		if (benchmark_current >= 0 && benchmark_current < (int) VEC_SIZE (benchmark_results))
+		{
+			benchmark_current++;
+			CL_NextBenchmark ();
+		}
 		return;
+	}
 
 // cls.td_starttime will be grabbed at the second frame of the demo, so
 // all the loading time doesn't get counted
@@ -867,5 +1760,76 @@ void CL_TimeDemo_f (void)
 	cls.timedemo = true;
 	cls.td_startframe = host_framecount;
 	cls.td_lastframe = -1;	// get a new message this frame
+
+	memset (&td, 0, sizeof (td));
+}
+
+/*
+====================
+CL_Benchmark_f
+
+benchmark <demoname> [demoname ...]
+====================
+*/
+void CL_Benchmark_f (void)
+{
+	tdresult_t	result;
+	int			i;
+
+	if (cmd_source != src_command)
+		return;
+
+	if (Cmd_Argc() < 2)
+	{
+		Con_Printf ("benchmark <demoname> [demoname ...] : runs timedemo on each demo, writes stats to cl_benchmarkfile\n");
+		return;
+	}
+
+	if (benchmark_current >= 0)
+	{
+		Con_Printf ("A benchmark is already running\n");
+		return;
+	}
+
+	VEC_CLEAR (benchmark_results);
+	memset (&result, 0, sizeof (result));
+	for (i = 1; i < Cmd_Argc (); i++)
+	{
+		q_strlcpy (result.name, Cmd_Argv (i), sizeof (result.name));
+		VEC_PUSH (benchmark_results, result);
+	}
+
+	cls.demonum = -1;	// stop demo loop
+	benchmark_current = 0;
+	CL_NextBenchmark ();
+}
+
+/*
+====================
+CL_QueueBenchmark
+
+-benchmark <demoname> [demoname ...] runs a benchmark after startup and quits
+====================
+*/
+void CL_QueueBenchmark (void)
+{
+	char	cmd[1024];
+	int		i;
+
+	i = COM_CheckParm ("-benchmark");
+	if (!i)
+		return;
+
+	q_strlcpy (cmd, "benchmark", sizeof (cmd));
+	for (i++; i < com_argc && com_argv[i][0] != '-' && com_argv[i][0] != '+'; i++)
+	{
+		q_strlcat (cmd, " \"", sizeof (cmd));
+		q_strlcat (cmd, com_argv[i], sizeof (cmd));
+		q_strlcat (cmd, "\"", sizeof (cmd));
+	}
+	q_strlcat (cmd, "\n", sizeof (cmd));
+
+	benchmark_quit = true;
+	Cbuf_AddText (cmd);
 }
 
@@ -725,9 +725,12 @@ int CL_ReadFromServer (void)
 	beam_t		*b; //johnfitz
 	dlight_t	*l; //johnfitz
 	int			i; //johnfitz
+	double		time1, time2;
 
 	CL_AdvanceTime ();
 
+	time1 = Sys_DoubleTime ();
+
 	do
 	{
 		ret = CL_GetMessage ();
@@ -743,9 +746,14 @@ int CL_ReadFromServer (void)
 	if (cl_shownet.value)
 		Con_Printf ("\n");
 
+	time2 = Sys_DoubleTime ();
+	CL_TimeDemoAddTime (TDSTAT_PARSE, time2 - time1);
+
 	CL_RelinkEntities ();
 	CL_UpdateTEnts ();
 
+	CL_TimeDemoAddTime (TDSTAT_RELINK, Sys_DoubleTime () - time2);
+
 //johnfitz -- devstats
 
 	//visedicts
@@ -1042,6 +1050,8 @@ void CL_Init (void)
 
 	Cvar_RegisterVariable (&cl_startdemos);
 	Cvar_RegisterVariable (&cl_confirmquit);
+	Cvar_RegisterVariable (&cl_demokeyframes);
+	Cvar_RegisterVariable (&cl_benchmarkfile);
 
 	Cmd_AddCommand ("entities", CL_PrintEntities_f);
 	Cmd_AddCommand ("disconnect", CL_Disconnect_f);
@@ -1049,6 +1059,8 @@ void CL_Init (void)
 	Cmd_AddCommand ("stop", CL_Stop_f);
 	Cmd_AddCommand ("playdemo", CL_PlayDemo_f);
 	Cmd_AddCommand ("timedemo", CL_TimeDemo_f);
+	Cmd_AddCommand ("benchmark", CL_Benchmark_f);
+	Cmd_AddCommand ("demoseek", CL_DemoSeek_f);
 
 	Cmd_AddCommand ("tracepos", CL_Tracepos_f); //johnfitz
 	cmd = Cmd_AddCommand ("viewpos", CL_Viewpos_f); //johnfitz
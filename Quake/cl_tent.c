@@ -35,6 +35,19 @@ sfx_t			*cl_sfx_ric2;
 sfx_t			*cl_sfx_ric3;
 sfx_t			*cl_sfx_r_exp3;
 
+/*
+=================
+CL_TEntSound
+
+Like CL_ParseStartSoundPacket, stays quiet while demoseek parses ahead
+=================
+*/
+static void CL_TEntSound (sfx_t *sfx, vec3_t pos)
+{
+	if (!cls.demoseeking)
+		S_StartSound (-1, 0, sfx, pos, 1, 1);
+}
+
 /*
 =================
 CL_ParseTEnt
@@ -131,7 +144,7 @@ void CL_ParseTEnt (void)
 		pos[1] = MSG_ReadCoord (cl.protocolflags);
 		pos[2] = MSG_ReadCoord (cl.protocolflags);
 		R_RunParticleEffect (pos, vec3_origin, 20, 30);
-		S_StartSound (-1, 0, cl_sfx_wizhit, pos, 1, 1);
+		CL_TEntSound (cl_sfx_wizhit, pos);
 		break;
 
 	case TE_KNIGHTSPIKE:			// spike hitting wall
@@ -139,7 +152,7 @@ void CL_ParseTEnt (void)
 		pos[1] = MSG_ReadCoord (cl.protocolflags);
 		pos[2] = MSG_ReadCoord (cl.protocolflags);
 		R_RunParticleEffect (pos, vec3_origin, 226, 20);
-		S_StartSound (-1, 0, cl_sfx_knighthit, pos, 1, 1);
+		CL_TEntSound (cl_sfx_knighthit, pos);
 		break;
 
 	case TE_SPIKE:			// spike hitting wall
@@ -148,16 +161,16 @@ void CL_ParseTEnt (void)
 		pos[2] = MSG_ReadCoord (cl.protocolflags);
 		R_RunParticleEffect (pos, vec3_origin, 0, 10);
 		if ( rand() % 5 )
-			S_StartSound (-1, 0, cl_sfx_tink1, pos, 1, 1);
+			CL_TEntSound (cl_sfx_tink1, pos);
 		else
 		{
 			rnd = rand() & 3;
 			if (rnd == 1)
-				S_StartSound (-1, 0, cl_sfx_ric1, pos, 1, 1);
+				CL_TEntSound (cl_sfx_ric1, pos);
 			else if (rnd == 2)
-				S_StartSound (-1, 0, cl_sfx_ric2, pos, 1, 1);
+				CL_TEntSound (cl_sfx_ric2, pos);
 			else
-				S_StartSound (-1, 0, cl_sfx_ric3, pos, 1, 1);
+				CL_TEntSound (cl_sfx_ric3, pos);
 		}
 		break;
 	case TE_SUPERSPIKE:			// super spike hitting wall
@@ -167,16 +180,16 @@ void CL_ParseTEnt (void)
 		R_RunParticleEffect (pos, vec3_origin, 0, 20);
 
 		if ( rand() % 5 )
-			S_StartSound (-1, 0, cl_sfx_tink1, pos, 1, 1);
+			CL_TEntSound (cl_sfx_tink1, pos);
 		else
 		{
 			rnd = rand() & 3;
 			if (rnd == 1)
-				S_StartSound (-1, 0, cl_sfx_ric1, pos, 1, 1);
+				CL_TEntSound (cl_sfx_ric1, pos);
 			else if (rnd == 2)
-				S_StartSound (-1, 0, cl_sfx_ric2, pos, 1, 1);
+				CL_TEntSound (cl_sfx_ric2, pos);
 			else
-				S_StartSound (-1, 0, cl_sfx_ric3, pos, 1, 1);
+				CL_TEntSound (cl_sfx_ric3, pos);
 		}
 		break;
 
@@ -197,7 +210,7 @@ void CL_ParseTEnt (void)
 		dl->radius = 350;
 		dl->die = cl.time + 0.5;
 		dl->decay = 300;
-		S_StartSound (-1, 0, cl_sfx_r_exp3, pos, 1, 1);
+		CL_TEntSound (cl_sfx_r_exp3, pos);
 		break;
 
 	case TE_TAREXPLOSION:			// tarbaby explosion
@@ -206,7 +219,7 @@ void CL_ParseTEnt (void)
 		pos[2] = MSG_ReadCoord (cl.protocolflags);
 		R_BlobExplosion (pos);
 
-		S_StartSound (-1, 0, cl_sfx_r_exp3, pos, 1, 1);
+		CL_TEntSound (cl_sfx_r_exp3, pos);
 		break;
 
 	case TE_LIGHTNING1:				// lightning bolts
@@ -253,7 +266,7 @@ void CL_ParseTEnt (void)
 		dl->radius = 350;
 		dl->die = cl.time + 0.5;
 		dl->decay = 300;
-		S_StartSound (-1, 0, cl_sfx_r_exp3, pos, 1, 1);
+		CL_TEntSound (cl_sfx_r_exp3, pos);
 		break;
 
 	default:
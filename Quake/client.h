@@ -132,6 +132,7 @@ typedef struct
 	float		basedemospeed;
 
 	qboolean	timedemo;
+	qboolean	demoseeking;	// demoseek is parsing ahead, skip sounds
 	int		forcetrack;		// -1 = use normal cd track
 	char		demofilename[MAX_OSPATH];
 	FILE		*demofile;
@@ -384,6 +385,26 @@ void CL_Stop_f (void);
 void CL_Record_f (void);
 void CL_PlayDemo_f (void);
 void CL_TimeDemo_f (void);
+void CL_DemoSeek_f (void);
+void CL_Benchmark_f (void);
+void CL_QueueBenchmark (void);
+
+// per-frame costs recorded during timedemo
+typedef enum
+{
+	TDSTAT_PARSE,
+	TDSTAT_RELINK,
+	TDSTAT_PARTICLES,
+	TDSTAT_RENDER,
+
+	TDSTAT_COUNT
+} tdstat_t;
+
+void CL_TimeDemoAddTime (tdstat_t stat, double seconds);
+void CL_TimeDemoEndFrame (void);
+
+extern cvar_t cl_demokeyframes;
+extern cvar_t cl_benchmarkfile;
 
 //
 // cl_parse.c
@@ -1623,8 +1623,8 @@ FIXME: make this buffer size safe someday
 
 static char *get_va_buffer(void)
 {
-	static char va_buffers[VA_NUM_BUFFS][VA_BUFFERLEN];
-	static int buffer_idx = 0;
+	static THREAD_LOCAL char va_buffers[VA_NUM_BUFFS][VA_BUFFERLEN];	// server instances format on workers
+	static THREAD_LOCAL int buffer_idx = 0;
 	buffer_idx = (buffer_idx + 1) & (VA_NUM_BUFFS - 1);
 	return va_buffers[buffer_idx];
 }
@@ -1678,6 +1678,7 @@ int		com_numbasedirs;
 char	com_nightdivedir[MAX_OSPATH];
 char	com_userprefdir[MAX_OSPATH];
 THREAD_LOCAL int	file_from_pak;		// ZOID: global indicating that file came from a pak
+THREAD_LOCAL char	com_filepath[MAX_OSPATH];	// OS path of the last file found, the pak for files inside one
 
 searchpath_t	*com_searchpaths;
 searchpath_t	*com_base_searchpaths;
@@ -1869,10 +1870,11 @@ Finds the file in the search path.
 Sets com_filesize and one of handle or file
 If neither of file or handle is set, this
 can be used for detecting a file's presence.
+Quiet lookups don't print misses, for use from worker tasks.
 ===========
 */
 static int COM_FindFile (const char *filename, int *handle, FILE **file,
-							unsigned int *path_id)
+							unsigned int *path_id, qboolean quiet)
 {
 	searchpath_t	*search;
 	char		netpath[MAX_OSPATH];
@@ -1899,6 +1901,7 @@ static int COM_FindFile (const char *filename, int *handle, FILE **file,
 				// found it!
 				com_filesize = pak->files[i].filelen;
 				file_from_pak = 1;
+				q_strlcpy (com_filepath, pak->filename, sizeof (com_filepath));
 				if (path_id)
 					*path_id = search->path_id;
 				if (handle)
@@ -1931,6 +1934,7 @@ static int COM_FindFile (const char *filename, int *handle, FILE **file,
 			q_snprintf (netpath, sizeof(netpath), "%s/%s",search->filename, filename);
 			if (! (Sys_FileType(netpath) & FS_ENT_FILE))
 				continue;
+			q_strlcpy (com_filepath, netpath, sizeof (com_filepath));
 
 			if (path_id)
 				*path_id = search->path_id;
@@ -1953,7 +1957,7 @@ static int COM_FindFile (const char *filename, int *handle, FILE **file,
 		}
 	}
 
-	if (developer.value)
+	if (developer.value && !quiet)
 	{
 		const char *ext = COM_FileGetExtension (filename);
 
@@ -1988,10 +1992,22 @@ Returns whether the file is found in the quake filesystem.
 */
 qboolean COM_FileExists (const char *filename, unsigned int *path_id)
 {
-	int ret = COM_FindFile (filename, NULL, NULL, path_id);
+	int ret = COM_FindFile (filename, NULL, NULL, path_id, false);
 	return (ret == -1) ? false : true;
 }
 
+/*
+===========
+COM_FileExistsQuiet
+
+COM_FileExists without console output, safe to call from worker tasks
+===========
+*/
+qboolean COM_FileExistsQuiet (const char *filename)
+{
+	return COM_FindFile (filename, NULL, NULL, NULL, true) != -1;
+}
+
 /*
 ===========
 COM_OpenFile
@@ -2003,7 +2019,7 @@ it may actually be inside a pak file
 */
 int COM_OpenFile (const char *filename, int *handle, unsigned int *path_id)
 {
-	return COM_FindFile (filename, handle, NULL, path_id);
+	return COM_FindFile (filename, handle, NULL, path_id, false);
 }
 
 /*
@@ -2016,7 +2032,19 @@ into the file.
 */
 int COM_FOpenFile (const char *filename, FILE **file, unsigned int *path_id)
 {
-	return COM_FindFile (filename, NULL, file, path_id);
+	return COM_FindFile (filename, NULL, file, path_id, false);
+}
+
+/*
+===========
+COM_FOpenFileQuiet
+
+COM_FOpenFile without console output, safe to call from worker tasks
+===========
+*/
+int COM_FOpenFileQuiet (const char *filename, FILE **file)
+{
+	return COM_FindFile (filename, NULL, file, NULL, true);
 }
 
 /*
@@ -2545,6 +2573,7 @@ void COM_SwitchGame (const char *paths)
 	//Kill the server
 	CL_Disconnect ();
 	Host_ShutdownServer(true);
+	SV_ShutdownInstances ();
 
 	//Write config file
 	Host_WriteConfiguration ();
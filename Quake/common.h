@@ -408,12 +408,15 @@ extern	char	com_basedirs[MAX_BASEDIRS][MAX_OSPATH];
 extern	char	com_gamedir[MAX_OSPATH];
 extern	char	com_nightdivedir[MAX_OSPATH];
 extern	THREAD_LOCAL int	file_from_pak;	// global indicating that file came from a pak
+extern	THREAD_LOCAL char	com_filepath[MAX_OSPATH];	// OS path of the last file found
 
 void COM_WriteFile (const char *filename, const void *data, int len);
 qboolean COM_WriteFile_OSPath (const char *filename, const void *data, size_t len);
 int COM_OpenFile (const char *filename, int *handle, unsigned int *path_id);
 int COM_FOpenFile (const char *filename, FILE **file, unsigned int *path_id);
 qboolean COM_FileExists (const char *filename, unsigned int *path_id);
+int COM_FOpenFileQuiet (const char *filename, FILE **file);	// no console output, for worker tasks
+qboolean COM_FileExistsQuiet (const char *filename);
 void COM_CloseFile (int h);
 
 // these procedures open a file using COM_FindFile and loads it into a proper
@@ -51,6 +51,8 @@ int		con_buffersize; //johnfitz -- user can now override default
 
 qboolean 	con_forcedup;		// because no entities to refresh
 
+THREAD_LOCAL void (*con_redirect) (const char *text);	// takes this thread's output instead
+
 int		con_totallines;		// total lines in console scrollback
 int		con_backscroll;		// lines up from bottom to display
 int		con_current;		// where next message will be printed
@@ -1277,6 +1279,12 @@ void Con_Printf (const char *fmt, ...)
 	q_vsnprintf (msg, sizeof(msg), fmt, argptr);
 	va_end (argptr);
 
+	if (con_redirect)
+	{
+		con_redirect (msg);
+		return;
+	}
+
 // also echo to debugging console
 	Sys_Printf ("%s", Con_StripControlPrefixes (msg));
 
@@ -1459,6 +1467,12 @@ void Con_SafePrintf (const char *fmt, ...)
 	q_vsnprintf (msg, sizeof(msg), fmt, argptr);
 	va_end (argptr);
 
+	if (con_redirect)
+	{
+		con_redirect (msg);
+		return;
+	}
+
 	temp = scr_disabled_for_loading;
 	scr_disabled_for_loading = true;
 	Con_Printf ("%s", msg);
@@ -1803,6 +1817,7 @@ static const arg_completion_type_t arg_completion_types[] =
 	{ "record",					CompleteFileListSingle,	&demolist },
 	{ "playdemo",				CompleteFileListSingle,	&demolist },
 	{ "timedemo",				CompleteFileListSingle,	&demolist },
+	{ "benchmark",				CompleteFileList,		&demolist },
 	{ "load",					CompleteFileListSingle,	&savelist },
 	{ "save",					CompleteFileListSingle,	&savelist },
 	{ "sky",					CompleteFileListSingle,	&skylist },
@@ -34,6 +34,8 @@ extern byte *con_chars;
 
 extern char con_lastcenterstring[]; //johnfitz
 
+extern THREAD_LOCAL void (*con_redirect) (const char *text);	// server instances buffer their output
+
 void Con_CheckResize (void);
 void Con_Scroll (int lines);
 void Con_Init (void);
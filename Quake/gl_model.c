@@ -34,18 +34,21 @@ static void Mod_LoadBrushModel (qmodel_t *mod, void *buffer);
 static void Mod_LoadAliasModel (qmodel_t *mod, void *buffer);
 static void Mod_LoadMD5MeshModel (qmodel_t *mod, const char *buffer);
 static qmodel_t *Mod_LoadModel (qmodel_t *mod, qboolean crash);
+static qmodel_t *Mod_FindName (const char *name);
 
 static void Mod_Print (void);
 
 static cvar_t	external_ents = {"external_ents", "1", CVAR_ARCHIVE};
 static cvar_t	external_vis = {"external_vis", "1", CVAR_ARCHIVE};
 cvar_t			r_md5 = {"r_md5", "1", CVAR_ARCHIVE};
+static cvar_t	mod_cachesize = {"mod_cachesize", "256", CVAR_ARCHIVE};	// MiB of brush models/sprites kept across maps, 0 = off
 
-static byte	*mod_novis;
-static int	mod_novis_capacity;
+// per thread, server instances query vis from their worker threads
+static THREAD_LOCAL byte	*mod_novis;
+static THREAD_LOCAL int	mod_novis_capacity;
 
-static byte	*mod_decompressed;
-static int	mod_decompressed_capacity;
+static THREAD_LOCAL byte	*mod_decompressed;
+static THREAD_LOCAL int	mod_decompressed_capacity;
 
 #define	MAX_MOD_KNOWN	4096 /*johnfitz -- was 512 */
 static qmodel_t	mod_known[MAX_MOD_KNOWN];
@@ -98,6 +101,8 @@ void Mod_Init (void)
 	Cvar_RegisterVariable (&r_md5);
 	Cvar_SetCallback (&r_md5, R_MD5_f);
 
+	Cvar_RegisterVariable (&mod_cachesize);
+
 	Cmd_AddCommand ("mcache", Mod_Print);
 
 	//johnfitz -- create notexture miptex
@@ -252,6 +257,320 @@ byte *Mod_NoVisPVS (qmodel_t *model)
 	return mod_novis;
 }
 
+/*
+===============================================================================
+
+MODEL CACHE
+
+Brush models and sprites live on the per-map hunk and normally get loaded
+again after every map change. With mod_cachesize set, Mod_LoadModel builds
+them in a hunk arena instead and keeps the result, keyed by name, game
+directory and file contents, so the next map using the same file gets the
+processed model (and submodels) back without running the loaders.
+
+Textures created while loading are handed to the cache entry. Anything the
+renderer later attaches to the model for one map (lightmaps, skyboxes) is
+still owned by the mod_known slot and freed by Mod_ClearAll as before.
+
+Only the .bsp/.spr contents are hashed; edits to .lit/.vis/.ent files next
+to a cached map are not picked up until the entry is evicted.
+
+Server instances pin the entries their world uses (Mod_PinCache), so those
+survive Mod_ClearAll and eviction until the instance lets go of them.
+
+===============================================================================
+*/
+
+typedef struct modcache_s
+{
+	char			name[MAX_QPATH];
+	unsigned int	path_id;
+	unsigned int	hash;
+	int				filesize;
+	int				variant;		// loader inputs besides the file, see Mod_CacheVariant
+	unsigned int	lastused;
+	size_t			size;
+	hunkarena_t		*arena;
+	int				nummodels;		// main model + submodels
+	qmodel_t		*models;		// as loaded; models[0] owns the textures
+	int				pins;			// server instances still using the arena
+	qboolean		evicted;		// already out of mod_cache, freed on the last unpin
+} modcache_t;
+
+#define	MODCACHE_MINTEXSLOTS	2048	// texture slots left free for the next map
+
+static modcache_t	**mod_cache;
+static size_t		mod_cachebytes;
+static unsigned int	mod_cachetick;
+static qmodel_t		*mod_arenaload;		// model being loaded into a cache arena
+
+/*
+===============
+Mod_CacheVariant
+===============
+*/
+static int Mod_CacheVariant (const qmodel_t *mod)
+{
+	int variant = 0;
+
+	if (!strcmp (mod->name, sv.modelname))
+		variant |= 1;	// local server world: clip bounds, external vis
+	if (external_vis.value)
+		variant |= 2;
+	if (external_ents.value)
+		variant |= 4;
+	if (r_novis.value)
+		variant |= 8;	// contentstransparent
+
+	return variant;
+}
+
+/*
+===============
+Mod_AbortLoad
+
+Drops the arena of a load that an error longjmp'd out of,
+the model is reloaded from scratch next time
+===============
+*/
+void Mod_AbortLoad (void)
+{
+	if (mod_arenaload)
+	{
+		Hunk_AbortArena ();	// only ours, the thread may be in a server instance's arena otherwise
+		mod_arenaload->needload = true;
+		mod_arenaload = NULL;
+	}
+}
+
+/*
+===============
+Mod_CacheFree
+===============
+*/
+static void Mod_CacheRelease (modcache_t *entry)
+{
+	Hunk_FreeArena (entry->arena);
+	free (entry->models);
+	free (entry);
+}
+
+static void Mod_CacheFree (int index)
+{
+	modcache_t *entry = mod_cache[index];
+
+	TexMgr_FreeTexturesForOwner (&entry->models[0]);
+	mod_cachebytes -= entry->size;
+	if (entry->pins)
+		entry->evicted = true;
+	else
+		Mod_CacheRelease (entry);
+
+	mod_cache[index] = VEC_LAST (mod_cache);
+	VEC_POP (mod_cache);
+}
+
+/*
+===============
+Mod_CacheFlush
+===============
+*/
+static void Mod_CacheFlush (void)
+{
+	while (VEC_SIZE (mod_cache))
+		Mod_CacheFree (VEC_SIZE (mod_cache) - 1);
+	VEC_FREE (mod_cache);
+}
+
+/*
+===============
+Mod_CacheTrim
+
+Evicts least recently used entries until the cache fits mod_cachesize
+and the texture manager has room for another map
+===============
+*/
+static void Mod_CacheTrim (void)
+{
+	size_t limit = (size_t) q_max (mod_cachesize.value, 0.f) * 1024 * 1024;
+
+	while (VEC_SIZE (mod_cache) && (mod_cachebytes > limit || TexMgr_FreeSlots () < MODCACHE_MINTEXSLOTS))
+	{
+		size_t i, oldest = VEC_SIZE (mod_cache);
+		for (i = 0; i < VEC_SIZE (mod_cache); i++)
+			if (!mod_cache[i]->pins && (oldest == VEC_SIZE (mod_cache) || mod_cache[i]->lastused < mod_cache[oldest]->lastused))
+				oldest = i;
+		if (oldest == VEC_SIZE (mod_cache))
+			break;	// everything left is pinned by a server instance
+		Mod_CacheFree (oldest);
+	}
+}
+
+/*
+===============
+Mod_CacheFind
+===============
+*/
+static int Mod_CacheFind (const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < VEC_SIZE (mod_cache); i++)
+		if (!strcmp (mod_cache[i]->name, name))
+			return i;
+
+	return -1;
+}
+
+/*
+===============
+Mod_CacheStore
+
+Takes over the arena and textures of a model that was just loaded
+===============
+*/
+static void Mod_CacheStore (qmodel_t *mod, hunkarena_t *arena, unsigned int hash, int filesize, int variant)
+{
+	modcache_t	*entry;
+	char		name[16];
+	int			i;
+
+	entry = (modcache_t *) calloc (1, sizeof (*entry));
+	if (!entry)
+		Sys_Error ("Mod_CacheStore: out of memory");
+
+	entry->nummodels = mod->type == mod_brush ? q_max (mod->numsubmodels, 1) : 1;
+	entry->models = (qmodel_t *) malloc (entry->nummodels * sizeof (qmodel_t));
+	if (!entry->models)
+		Sys_Error ("Mod_CacheStore: out of memory");
+
+	entry->models[0] = *mod;
+	for (i = 1; i < entry->nummodels; i++)
+	{
+		q_snprintf (name, sizeof (name), "*%i", i);
+		entry->models[i] = *Mod_FindName (name);
+	}
+
+	q_strlcpy (entry->name, mod->name, sizeof (entry->name));
+	entry->path_id = mod->path_id;
+	entry->hash = hash;
+	entry->filesize = filesize;
+	entry->variant = variant;
+	entry->lastused = mod_cachetick;
+	entry->arena = arena;
+	entry->size = Hunk_ArenaSize (arena) + sizeof (*entry) + entry->nummodels * sizeof (qmodel_t);
+
+	TexMgr_TransferTextures (mod, &entry->models[0]);
+
+	mod_cachebytes += entry->size;
+	VEC_PUSH (mod_cache, entry);
+}
+
+/*
+===============
+Mod_CacheRestore
+===============
+*/
+static void Mod_CacheRestore (qmodel_t *mod, modcache_t *entry)
+{
+	char	name[16];
+	int		i;
+
+	*mod = entry->models[0];
+	for (i = 1; i < entry->nummodels; i++)
+	{
+		q_snprintf (name, sizeof (name), "*%i", i);
+		*Mod_FindName (name) = entry->models[i];
+	}
+	entry->lastused = mod_cachetick;
+}
+
+/*
+===============
+Mod_PinCache
+
+Keeps the cache entry (and so the hunk arena) behind a loaded model alive
+until Mod_UnpinCache, returns NULL for models that aren't cached
+===============
+*/
+modcache_t *Mod_PinCache (const qmodel_t *mod)
+{
+	int index = Mod_CacheFind (mod->name);
+
+	if (index < 0)
+		return NULL;
+	mod_cache[index]->pins++;
+
+	return mod_cache[index];
+}
+
+/*
+===============
+Mod_UnpinCache
+===============
+*/
+void Mod_UnpinCache (modcache_t *entry)
+{
+	if (--entry->pins == 0 && entry->evicted)
+		Mod_CacheRelease (entry);
+}
+
+/*
+===============
+Mod_SaveKnown
+
+A server instance spawning its own map loads into the shared mod_known
+slots. The "*N" slots belong to whichever world was loaded last, and a
+slot the instance brought in from the cache would look loaded while the
+submodels next to it are someone else's. Mod_RestoreKnown puts the
+submodels back and marks every slot the instance loaded as needing a
+load again, so the main server and the client see mod_known as it was.
+===============
+*/
+struct modsnapshot_s
+{
+	int			numknown;
+	qmodel_t	*known;
+};
+
+modsnapshot_t *Mod_SaveKnown (void)
+{
+	modsnapshot_t *snap = (modsnapshot_t *) malloc (sizeof (*snap));
+
+	if (!snap)
+		Sys_Error ("Mod_SaveKnown: out of memory");
+	snap->numknown = mod_numknown;
+	snap->known = (qmodel_t *) malloc (q_max (mod_numknown, 1) * sizeof (qmodel_t));
+	if (!snap->known)
+		Sys_Error ("Mod_SaveKnown: out of memory on %d models", mod_numknown);
+	memcpy (snap->known, mod_known, mod_numknown * sizeof (qmodel_t));
+
+	return snap;
+}
+
+/*
+===============
+Mod_RestoreKnown
+===============
+*/
+void Mod_RestoreKnown (modsnapshot_t *snap)
+{
+	int i;
+
+	for (i = 0; i < mod_numknown; i++)
+	{
+		if (mod_known[i].type == mod_alias)
+			continue;
+		if (i < snap->numknown && mod_known[i].name[0] == '*')
+			mod_known[i] = snap->known[i];
+		else if (i >= snap->numknown || snap->known[i].needload)
+			mod_known[i].needload = true;
+	}
+
+	free (snap->known);
+	free (snap);
+}
+
 /*
 ===================
 Mod_ClearAll
@@ -270,6 +589,9 @@ void Mod_ClearAll (void)
 			TexMgr_FreeTexturesForOwner (mod); //johnfitz
 		}
 	}
+
+	mod_cachetick++;
+	Mod_CacheTrim ();
 }
 
 void Mod_ResetAll (void)
@@ -280,6 +602,8 @@ void Mod_ResetAll (void)
 	//ericw -- free alias model VBOs
 	GLMesh_DeleteVertexBuffers ();
 
+	Mod_CacheFlush ();
+
 	for (i=0 , mod=mod_known ; i<mod_numknown ; i++, mod++)
 	{
 		if (!mod->needload) //otherwise Mod_ClearAll() did it already
@@ -353,7 +677,9 @@ Loads a model into the cache
 static qmodel_t *Mod_LoadModel (qmodel_t *mod, qboolean crash)
 {
 	byte	*buf;
-	int		mod_type;
+	int		mod_type, filesize, variant = 0, index;
+	unsigned int	hash = 0;
+	qboolean	cacheable;
 
 	if (!mod->needload)
 	{
@@ -384,6 +710,32 @@ static qmodel_t *Mod_LoadModel (qmodel_t *mod, qboolean crash)
 			Host_Error ("Mod_LoadModel: %s not found", mod->name); //johnfitz -- was "Mod_NumForName"
 		return NULL;
 	}
+	filesize = com_filesize;
+	mod_type = (buf[0] | (buf[1] << 8) | (buf[2] << 16) | (buf[3] << 24));
+
+//
+// brush models and sprites may still be around from a previous map
+//
+	cacheable = mod_type != IDPOLYHEADER && mod->name[0] != '*' && mod_cachesize.value > 0;
+	if (cacheable)
+	{
+		hash = COM_HashBlock (buf, filesize);
+		variant = Mod_CacheVariant (mod);
+		index = Mod_CacheFind (mod->name);
+		if (index >= 0)
+		{
+			modcache_t *entry = mod_cache[index];
+			if (entry->path_id == mod->path_id && entry->hash == hash && entry->filesize == filesize && entry->variant == variant)
+			{
+				free (buf);
+				Mod_CacheRestore (mod, entry);
+				return mod;
+			}
+			Mod_CacheFree (index);
+		}
+		Hunk_BeginArena ();
+		mod_arenaload = mod;
+	}
 
 //
 // allocate a new model
@@ -399,7 +751,6 @@ static qmodel_t *Mod_LoadModel (qmodel_t *mod, qboolean crash)
 // call the apropriate loader
 	mod->needload = false;
 
-	mod_type = (buf[0] | (buf[1] << 8) | (buf[2] << 16) | (buf[3] << 24));
 	switch (mod_type)
 	{
 	case IDPOLYHEADER:
@@ -417,6 +768,12 @@ static qmodel_t *Mod_LoadModel (qmodel_t *mod, qboolean crash)
 
 	free (buf);
 
+	if (cacheable)
+	{
+		mod_arenaload = NULL;
+		Mod_CacheStore (mod, Hunk_EndArena (), hash, filesize, variant);
+	}
+
 	return mod;
 }
 
@@ -430,10 +787,16 @@ Loads in a model for the given name
 qmodel_t *Mod_ForName (const char *name, qboolean crash)
 {
 	qmodel_t	*mod;
+	hunkarena_t	*arena;
 
 	mod = Mod_FindName (name);
 
-	return Mod_LoadModel (mod, crash);
+	// models go on the shared hunk or in the model cache, never in a server instance's arena
+	arena = Hunk_SwitchArena (NULL);
+	mod = Mod_LoadModel (mod, crash);
+	Hunk_SwitchArena (arena);
+
+	return mod;
 }
 
 
@@ -508,6 +871,55 @@ static textype_t Mod_TextureTypeFromName (const char *texname)
 	return TEXTYPE_DEFAULT;
 }
 
+/*
+=================
+Mod_PrefetchExternalTextures
+
+queues the external replacements Mod_LoadTextures is going to look for,
+in the same order, so they can be decoded on the worker threads while the
+loop uploads
+=================
+*/
+static void Mod_PrefetchExternalTextures (dmiptexlump_t *m, int nummiptex)
+{
+	char		mapname[MAX_OSPATH], name[sizeof (((miptex_t *)0)->name) + 1];
+	miptex_t	*mt;
+	int			i, ofs, type;
+
+	if (!Tasks_NumWorkers ())
+		return;
+
+	COM_StripExtension (loadmodel->name + 5, mapname, sizeof(mapname));
+	for (i = 0; i < nummiptex; i++)
+	{
+		ofs = LittleLong (m->dataofs[i]);
+		if (ofs == -1)
+			continue;
+		mt = (miptex_t *)((byte *)m + ofs);
+		memcpy (name, mt->name, sizeof (mt->name));
+		name[sizeof (mt->name)] = 0;
+		if (!name[0])
+			continue;
+
+		type = Mod_TextureTypeFromName (name);
+		if (type == TEXTYPE_SKY)
+			continue;
+		// same lookup order as below: map dir, then root, then glow or luma next to the one found
+		if (TEXTYPE_ISLIQUID (type))
+		{
+			Image_AddPrefetch (va ("textures/%s/#%s", mapname, name + 1));
+			Image_AddPrefetchFallback (va ("textures/#%s", name + 1));
+			continue;
+		}
+		Image_AddPrefetch (va ("textures/%s/%s", mapname, name));
+		Image_AddPrefetchFallback (va ("textures/%s", name));
+		Image_AddPrefetchVariant ("_glow");
+		Image_AddPrefetchVariant ("_luma");
+	}
+
+	Image_StartPrefetch ();
+}
+
 /*
 =================
 Mod_LoadTextures
@@ -549,6 +961,9 @@ static void Mod_LoadTextures (lump_t *l)
 	loadmodel->numtextures = nummiptex + 2; //johnfitz -- need 2 dummy texture chains for missing textures
 	loadmodel->textures = (texture_t **) Hunk_AllocName (loadmodel->numtextures * sizeof(*loadmodel->textures) , loadname);
 
+	if (!isDedicated)
+		Mod_PrefetchExternalTextures (m, nummiptex);
+
 	for (i=0 ; i<nummiptex ; i++)
 	{
 		m->dataofs[i] = LittleLong(m->dataofs[i]);
@@ -720,6 +1135,8 @@ static void Mod_LoadTextures (lump_t *l)
 		//johnfitz
 	}
 
+	Image_EndPrefetch ();
+
 	//johnfitz -- last 2 slots in array should be filled with dummy textures
 	loadmodel->textures[loadmodel->numtextures-2] = r_notexture_mip; //for lightmapped surfs
 	loadmodel->textures[loadmodel->numtextures-1] = r_notexture_mip2; //for SURF_DRAWTILED surfs
@@ -3567,6 +3984,7 @@ static void Mod_Print (void)
 		Con_SafePrintf ("%8p : %s\n", mod->cache.data, mod->name); //johnfitz -- safeprint instead of print
 	}
 	Con_Printf ("%i models\n",mod_numknown); //johnfitz -- print the total too
+	Con_Printf ("%i kept across maps, %.1f MiB\n", (int) VEC_SIZE (mod_cache), mod_cachebytes / 1048576.0);
 }
 
 /*
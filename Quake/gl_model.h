@@ -515,6 +515,12 @@ typedef struct qmodel_s
 
 void	Mod_Init (void);
 void	Mod_ClearAll (void);
+void	Mod_AbortLoad (void);
+struct modcache_s *Mod_PinCache (const qmodel_t *mod);
+void	Mod_UnpinCache (struct modcache_s *entry);
+typedef struct modsnapshot_s modsnapshot_t;
+modsnapshot_t *Mod_SaveKnown (void);
+void	Mod_RestoreKnown (modsnapshot_t *snap);
 void	Mod_ResetAll (void); // for gamedir changes (Host_Game_f)
 qmodel_t *Mod_ForName (const char *name, qboolean crash);
 void	*Mod_Extradata (qmodel_t *mod);	// handles caching
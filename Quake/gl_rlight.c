@@ -26,6 +26,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 extern cvar_t r_flatlightstyles; //johnfitz
 extern cvar_t r_lerplightstyles;
 extern cvar_t r_dynamic;
+extern cvar_t r_lightgrid;
 
 gpulightbuffer_t r_lightbuffer;
 
@@ -210,7 +211,7 @@ LIGHT SAMPLING
 =============================================================================
 */
 
-vec3_t lightcolor; //johnfitz -- lit support via lordhavoc
+THREAD_LOCAL vec3_t lightcolor; //johnfitz -- lit support via lordhavoc, per thread for parallel alias setup
 
 static void InterpolateLightmap (vec3_t color, msurface_t *surf, int ds, int dt)
 {
@@ -353,6 +354,371 @@ loc0:
 	}
 }
 
+/*
+=============================================================================
+
+LIGHT GRID
+
+A sparse grid of light probes used by R_LightPoint instead of a trace per
+entity. Probes are filled on first use from the lightmap sample below them
+and keep one unscaled color per lightstyle, so animated styles are applied
+at lookup time. Lookups may happen on several threads at once: blocks are
+published with atomic pointers and each probe claims itself before filling,
+a probe that is still being filled by another thread counts as missing.
+The corners an entity blends and their weights are kept in its lightcache,
+so an entity that hasn't moved only reapplies the lightstyles.
+
+=============================================================================
+*/
+
+#define LIGHTGRID_SPACING	32		// units between probes
+#define LIGHTGRID_BLOCK		8		// probes per block side
+#define LIGHTGRID_HASHSIZE	4096	// max number of blocks, power of two
+
+enum
+{
+	LIGHTPROBE_EMPTY,
+	LIGHTPROBE_BUSY,
+	LIGHTPROBE_READY,
+	LIGHTPROBE_SOLID,				// inside a wall, ignored by lookups
+};
+
+typedef struct lightprobe_s
+{
+	SDL_atomic_t		state;
+	byte				styles[MAXLIGHTMAPS];
+	unsigned short		rgb[MAXLIGHTMAPS][3];	// 8.8 fixed point
+} lightprobe_t;
+
+typedef struct
+{
+	int					coords[3];
+	lightprobe_t		probes[LIGHTGRID_BLOCK * LIGHTGRID_BLOCK * LIGHTGRID_BLOCK];
+} lightblock_t;
+
+static lightblock_t		*lightgrid[LIGHTGRID_HASHSIZE];
+static SDL_mutex		*lightgrid_mutex;	// guards block insertion
+static int				lightgrid_gen;		// bumped on every clear, invalidates lightcaches
+
+/*
+=============
+R_ClearLightGrid -- called at map load time
+=============
+*/
+void R_ClearLightGrid (void)
+{
+	int i;
+
+	if (!lightgrid_mutex)
+	{
+		lightgrid_mutex = SDL_CreateMutex ();
+		if (!lightgrid_mutex)
+			Sys_Error ("R_ClearLightGrid: could not create mutex");
+	}
+
+	for (i = 0; i < LIGHTGRID_HASHSIZE; i++)
+	{
+		free (lightgrid[i]);
+		lightgrid[i] = NULL;
+	}
+	if (++lightgrid_gen <= 0)
+		lightgrid_gen = 1;
+}
+
+/*
+=============
+R_FindLightBlock -- returns NULL if the grid is full
+=============
+*/
+static lightblock_t *R_FindLightBlock (const int coords[3])
+{
+	unsigned	hash, i, slot;
+	lightblock_t *block;
+
+	hash = (coords[0] * 73856093u) ^ (coords[1] * 19349663u) ^ (coords[2] * 83492791u);
+
+	// lock-free search first
+	for (i = 0; i < LIGHTGRID_HASHSIZE; i++)
+	{
+		slot = (hash + i) & (LIGHTGRID_HASHSIZE - 1);
+		block = (lightblock_t *) SDL_AtomicGetPtr ((void **) &lightgrid[slot]);
+		if (!block)
+			break;
+		SDL_MemoryBarrierAcquire ();
+		if (block->coords[0] == coords[0] && block->coords[1] == coords[1] && block->coords[2] == coords[2])
+			return block;
+	}
+	if (i == LIGHTGRID_HASHSIZE)
+		return NULL;
+
+	// not found, search again under the lock and insert
+	SDL_LockMutex (lightgrid_mutex);
+	for (; i < LIGHTGRID_HASHSIZE; i++)
+	{
+		slot = (hash + i) & (LIGHTGRID_HASHSIZE - 1);
+		block = lightgrid[slot];
+		if (!block)
+		{
+			block = (lightblock_t *) calloc (1, sizeof (*block));
+			if (block)
+			{
+				block->coords[0] = coords[0];
+				block->coords[1] = coords[1];
+				block->coords[2] = coords[2];
+				SDL_MemoryBarrierRelease ();	// coords before the pointer
+				SDL_AtomicSetPtr ((void **) &lightgrid[slot], block);
+			}
+			break;
+		}
+		if (block->coords[0] == coords[0] && block->coords[1] == coords[1] && block->coords[2] == coords[2])
+			break;
+	}
+	SDL_UnlockMutex (lightgrid_mutex);
+
+	return i < LIGHTGRID_HASHSIZE ? block : NULL;
+}
+
+/*
+=============
+R_FillLightProbe
+=============
+*/
+static void R_FillLightProbe (lightprobe_t *probe, const vec3_t pos)
+{
+	lightcache_t	cache;
+	vec3_t			start, end;
+	float			maxdist = 8192.f;
+	msurface_t		*surf;
+	byte			*lightmap;
+	float			fs, ft;
+	int				maps, i, line3, facesize;
+
+	memset (probe->styles, 255, sizeof (probe->styles));
+	memset (probe->rgb, 0, sizeof (probe->rgb));
+
+	VectorCopy (pos, start);
+	if (Mod_PointInLeaf (start, cl.worldmodel)->contents == CONTENTS_SOLID)
+	{
+		SDL_MemoryBarrierRelease ();
+		SDL_AtomicSet (&probe->state, LIGHTPROBE_SOLID);
+		return;
+	}
+
+	VectorCopy (start, end);
+	end[2] -= maxdist;
+	memset (&cache, 0, sizeof (cache));
+	RecursiveLightPoint (&cache, cl.worldmodel->nodes, start, start, end, &maxdist);
+
+	// same bilinear filter as InterpolateLightmap, kept separate per style
+	if (cache.surfidx > 0)
+	{
+		surf = cl.worldmodel->surfaces + cache.surfidx - 1;
+		line3 = ((surf->extents[0]>>4)+1)*3;
+		facesize = ((surf->extents[0]>>4)+1) * ((surf->extents[1]>>4)+1)*3;
+		lightmap = surf->samples + ((cache.dt>>4) * ((surf->extents[0]>>4)+1) + (cache.ds>>4))*3;
+		fs = (cache.ds & 15) * (1.f/16.f);
+		ft = (cache.dt & 15) * (1.f/16.f);
+
+		for (maps = 0; maps < MAXLIGHTMAPS && surf->styles[maps] != 255; maps++, lightmap += facesize)
+		{
+			probe->styles[maps] = surf->styles[maps];
+			for (i = 0; i < 3; i++)
+			{
+				float top = lightmap[i] + (lightmap[i+3] - lightmap[i]) * fs;
+				float bottom = lightmap[line3+i] + (lightmap[line3+i+3] - lightmap[line3+i]) * fs;
+				probe->rgb[maps][i] = (unsigned short) ((top + (bottom - top) * ft) * 256.f + 0.5f);
+			}
+		}
+	}
+
+	SDL_MemoryBarrierRelease ();	// styles and rgb before the state
+	SDL_AtomicSet (&probe->state, LIGHTPROBE_READY);
+}
+
+/*
+=============
+R_GetLightProbe -- returns NULL if the probe can't be used right now, and
+sets *busy if it may become usable later
+=============
+*/
+static lightprobe_t *R_GetLightProbe (const int gridpos[3], qboolean *busy)
+{
+	int				coords[3], local[3], i, state;
+	lightblock_t	*block;
+	lightprobe_t	*probe;
+	vec3_t			pos;
+
+	for (i = 0; i < 3; i++)
+	{
+		coords[i] = gridpos[i] >= 0 ? gridpos[i] / LIGHTGRID_BLOCK : (gridpos[i] + 1) / LIGHTGRID_BLOCK - 1;
+		local[i] = gridpos[i] - coords[i] * LIGHTGRID_BLOCK;
+	}
+
+	block = R_FindLightBlock (coords);
+	if (!block)
+		return NULL;
+	probe = &block->probes[(local[2] * LIGHTGRID_BLOCK + local[1]) * LIGHTGRID_BLOCK + local[0]];
+
+	state = SDL_AtomicGet (&probe->state);
+	if (state == LIGHTPROBE_EMPTY && SDL_AtomicCAS (&probe->state, LIGHTPROBE_EMPTY, LIGHTPROBE_BUSY))
+	{
+		for (i = 0; i < 3; i++)
+			pos[i] = gridpos[i] * LIGHTGRID_SPACING;
+		R_FillLightProbe (probe, pos);
+		state = SDL_AtomicGet (&probe->state);
+	}
+	else
+		SDL_MemoryBarrierAcquire ();
+
+	if (state == LIGHTPROBE_EMPTY || state == LIGHTPROBE_BUSY)
+		*busy = true;
+	return state == LIGHTPROBE_READY ? probe : NULL;
+}
+
+/*
+=============
+R_LightGridVisible
+
+Returns false if the segment passes through solid space, so probes on the
+far side of a wall or floor don't leak light into the sample
+=============
+*/
+static qboolean R_LightGridVisible (mnode_t *node, const vec3_t start, const vec3_t end)
+{
+	float		front, back, frac;
+	vec3_t		mid;
+
+	while (node->contents >= 0)
+	{
+		if (node->plane->type < 3)
+		{
+			front = start[node->plane->type] - node->plane->dist;
+			back = end[node->plane->type] - node->plane->dist;
+		}
+		else
+		{
+			front = DotProduct (start, node->plane->normal) - node->plane->dist;
+			back = DotProduct (end, node->plane->normal) - node->plane->dist;
+		}
+
+		if ((back < 0) == (front < 0))
+		{
+			node = node->children[front < 0];
+			continue;
+		}
+
+		frac = front / (front - back);
+		mid[0] = start[0] + (end[0] - start[0]) * frac;
+		mid[1] = start[1] + (end[1] - start[1]) * frac;
+		mid[2] = start[2] + (end[2] - start[2]) * frac;
+
+		if (!R_LightGridVisible (node->children[front < 0], start, mid))
+			return false;
+		return R_LightGridVisible (node->children[front >= 0], mid, end);
+	}
+
+	return node->contents != CONTENTS_SOLID;
+}
+
+/*
+=============
+R_ResolveLightGrid
+
+Finds the surrounding probes p can see and their normalized trilinear
+weights
+=============
+*/
+static void R_ResolveLightGrid (const vec3_t p, lightcache_t *cache)
+{
+	int				base[3], gridpos[3], corner, i;
+	float			frac[3], weight, total;
+	qboolean		busy;
+	lightprobe_t	*probe;
+	vec3_t			pos;
+
+	for (i = 0; i < 3; i++)
+	{
+		float f = p[i] * (1.f / LIGHTGRID_SPACING);
+		base[i] = (int) floor (f);
+		frac[i] = f - base[i];
+	}
+
+	busy = false;
+	total = 0.f;
+	cache->numprobes = 0;
+	for (corner = 0; corner < 8; corner++)
+	{
+		weight = 1.f;
+		for (i = 0; i < 3; i++)
+		{
+			gridpos[i] = base[i] + ((corner >> i) & 1);
+			weight *= (corner >> i) & 1 ? frac[i] : 1.f - frac[i];
+		}
+		if (weight <= 0.f)
+			continue;
+
+		for (i = 0; i < 3; i++)
+			pos[i] = gridpos[i] * LIGHTGRID_SPACING;
+		if (!R_LightGridVisible (cl.worldmodel->nodes, p, pos))
+			continue;
+
+		probe = R_GetLightProbe (gridpos, &busy);
+		if (!probe)
+			continue;
+
+		cache->probes[cache->numprobes] = probe;
+		cache->weights[cache->numprobes] = weight;
+		cache->numprobes++;
+		total += weight;
+	}
+
+	for (i = 0; i < cache->numprobes; i++)
+		cache->weights[i] /= total;
+
+	VectorCopy (p, cache->gridpos);
+	// a corner another thread was still filling may be usable next frame
+	cache->gridgen = busy ? 0 : lightgrid_gen;
+}
+
+/*
+=============
+R_LightGridPoint
+
+Trilinear blend of the surrounding probes the point can see, returns false
+if none is usable
+=============
+*/
+static qboolean R_LightGridPoint (const vec3_t p, lightcache_t *cache, vec3_t color)
+{
+	int				i, maps;
+	lightprobe_t	*probe;
+
+	if (!cache->gridgen // no cache
+		|| cache->gridgen != lightgrid_gen
+		|| fabsf (cache->gridpos[0] - p[0]) >= 1.f
+		|| fabsf (cache->gridpos[1] - p[1]) >= 1.f
+		|| fabsf (cache->gridpos[2] - p[2]) >= 1.f)
+		R_ResolveLightGrid (p, cache);
+
+	if (!cache->numprobes)
+		return false;
+
+	color[0] = color[1] = color[2] = 0.f;
+	for (i = 0; i < cache->numprobes; i++)
+	{
+		probe = cache->probes[i];
+		for (maps = 0; maps < MAXLIGHTMAPS && probe->styles[maps] != 255; maps++)
+		{
+			float scale = cache->weights[i] * d_lightstylevalue[probe->styles[maps]] * (1.f / 65536.f);
+			color[0] += probe->rgb[maps][0] * scale;
+			color[1] += probe->rgb[maps][1] * scale;
+			color[2] += probe->rgb[maps][2] * scale;
+		}
+	}
+
+	return true;
+}
+
 /*
 =============
 R_LightPoint -- johnfitz -- replaced entire function for lit support via lordhavoc
@@ -376,6 +742,9 @@ int R_LightPoint (vec3_t p, float ofs, lightcache_t *cache)
 	end[1] = start[1];
 	end[2] = start[2] - maxdist;
 
+	if (r_lightgrid.value && R_LightGridPoint (start, cache, lightcolor))
+		return ((lightcolor[0] + lightcolor[1] + lightcolor[2]) * (1.0f / 3.0f));
+
 	lightcolor[0] = lightcolor[1] = lightcolor[2] = 0;
 
 	if (cache->surfidx <= 0 // no cache or pitch black
@@ -109,6 +109,7 @@ cvar_t	r_showfields = {"r_showfields", "0", CVAR_NONE};
 cvar_t	r_showfields_align = {"r_showfields_align", "1", CVAR_ARCHIVE}; // 0=entity pos; 1=bottom-right
 cvar_t	r_lerpmodels = {"r_lerpmodels", "1", CVAR_ARCHIVE};
 cvar_t	r_lerpmove = {"r_lerpmove", "1", CVAR_ARCHIVE};
+cvar_t	r_lightgrid = {"r_lightgrid", "1", CVAR_ARCHIVE};
 cvar_t	r_nolerp_list = {"r_nolerp_list", "progs/flame.mdl,progs/flame2.mdl,progs/braztall.mdl,progs/brazshrt.mdl,progs/longtrch.mdl,progs/flame_pyre.mdl,progs/v_saw.mdl,progs/v_xfist.mdl,progs/h2stuff/newfire.mdl", CVAR_NONE};
 cvar_t	r_noshadow_list = {"r_noshadow_list", "progs/flame2.mdl,progs/flame.mdl,progs/bolt1.mdl,progs/bolt2.mdl,progs/bolt3.mdl,progs/laser.mdl", CVAR_NONE};
 
@@ -1476,7 +1477,6 @@ draw bounding boxes -- the server-side boxes, not the renderer cullboxes
 */
 static void R_ShowBoundingBoxes (void)
 {
-	extern		edict_t *sv_player;
 	byte		*pvs;
 	vec3_t		mins,maxs;
 	edict_t		*ed, *focused;
@@ -44,6 +44,7 @@ extern cvar_t r_showfields;
 extern cvar_t r_showfields_align;
 extern cvar_t r_lerpmodels;
 extern cvar_t r_lerpmove;
+extern cvar_t r_lightgrid;
 extern cvar_t r_nolerp_list;
 extern cvar_t r_noshadow_list;
 //johnfitz
@@ -112,7 +113,6 @@ R_ShowbboxesFilter_Completion_f -- tab completion for r_showbboxes_filter
 */
 static void R_ShowbboxesFilter_Completion_f (const char *partial)
 {
-	extern edict_t *sv_player;
 	extern edict_t **bbox_linked;
 	qcvm_t	*oldvm;
 	edict_t	*ed;
@@ -343,6 +343,7 @@ void R_Init (void)
 	Cvar_RegisterVariable (&gl_overbright_models);
 	Cvar_RegisterVariable (&r_lerpmodels);
 	Cvar_RegisterVariable (&r_lerpmove);
+	Cvar_RegisterVariable (&r_lightgrid);
 	Cvar_RegisterVariable (&r_nolerp_list);
 	Cvar_SetCallback (&r_nolerp_list, R_Model_ExtraFlags_List_f);
 	Cvar_RegisterVariable (&r_noshadow_list);
@@ -517,6 +518,7 @@ void R_NewMap (void)
 	VEC_CLEAR (r_pointfile);
 
 	GL_BuildLightmaps ();
+	R_ClearLightGrid ();
 	GL_BuildBModelVertexBuffer ();
 	GL_BuildBModelMarkBuffers ();
 	//ericw -- no longer load alias models into a VBO here, it's done in Mod_LoadAliasModel
@@ -146,6 +146,9 @@ int	scr_tileclear_updates = 0; //johnfitz
 hudstyle_t	hudstyle;
 
 void SCR_ScreenShot_f (void);
+static void SCR_CaptureStart_f (void);
+static void SCR_CaptureStop_f (void);
+extern cvar_t capture_fps;
 
 /*
 ===============================================================================
@@ -640,6 +643,7 @@ void SCR_Init (void)
 	Cvar_RegisterVariable (&scr_showspeed_ofs);
 	Cvar_RegisterVariable (&scr_clock);
 	Cvar_RegisterVariable (&cl_screenshotname);
+	Cvar_RegisterVariable (&capture_fps);
 	Cvar_RegisterVariable (&scr_demobar_timeout);
 	//johnfitz
 	Cvar_RegisterVariable (&scr_usekfont); // 2021 re-release
@@ -668,6 +672,8 @@ void SCR_Init (void)
 	Cmd_AddCommand ("scr_autoscale",SCR_AutoScale_f);
 
 	Cmd_AddCommand ("screenshot",SCR_ScreenShot_f);
+	Cmd_AddCommand ("capture_start",SCR_CaptureStart_f);
+	Cmd_AddCommand ("capture_stop",SCR_CaptureStop_f);
 	Cmd_AddCommand ("sizeup",SCR_SizeUp_f);
 	Cmd_AddCommand ("sizedown",SCR_SizeDown_f);
 
@@ -1740,136 +1746,804 @@ static qboolean SCR_ExpandVariables (const char *fmt, char *dst, size_t maxchars
 	return numvars != 0;
 }
 
-static void SCR_ScreenShot_Usage (void)
+/*
+==============================================================================
+
+SCREEN CAPTURE
+
+Framebuffer reads go into a small ring of pixel pack buffers so glReadPixels
+returns right away. A few frames later, once the fence has signaled, the
+pixels are copied out and handed to an encoder thread through a bounded
+queue. Finished jobs are reported back on the main thread.
+
+==============================================================================
+*/
+
+#define CAPTURE_READBACKS	3		// pixel pack buffers in flight
+#define CAPTURE_QUEUE		8		// frames waiting for the encoder
+#define CAPTURE_PREFIX		"capture/%map%_%date%_%time%"
+
+typedef enum
 {
-	Con_Printf ("usage: screenshot <format> <quality>\n");
-	Con_Printf ("   format must be \"png\" or \"tga\" or \"jpg\"\n");
-	Con_Printf ("   quality must be 1-100\n");
+	CAPTURE_PNG,
+	CAPTURE_TGA,
+	CAPTURE_JPG,
+	CAPTURE_RAW,
+} captureformat_t;
+
+static const char *const capture_exts[] = {"png", "tga", "jpg", "rgb"};
+
+typedef struct capturejob_s
+{
+	captureformat_t			format;
+	int						quality;
+	int						width;
+	int						height;
+	qboolean				screenshot;
+	qboolean				ok;
+	const char				*error;			// encoder error text, reported on the main thread
+	byte					*pixels;		// bottom-up RGB
+	char					name[MAX_OSPATH];	// relative to com_gamedir
+	struct capturejob_s		*next;
+} capturejob_t;
+
+typedef struct
+{
+	GLuint					buffer;
+	size_t					size;
+	GLsync					fence;
+	capturejob_t			*job;
+} capturereadback_t;
+
+static capturereadback_t	capture_readbacks[CAPTURE_READBACKS];
+static int					capture_readhead;	// oldest readback in flight
+static int					capture_readtail;	// next readback slot
+
+static SDL_Thread			*capture_thread;
+static SDL_mutex			*capture_mutex;
+static SDL_cond				*capture_wake;		// job queued, or shutdown
+static SDL_cond				*capture_idle;		// job taken off the queue or finished
+static capturejob_t			*capture_queue[CAPTURE_QUEUE];
+static int					capture_queuehead;
+static int					capture_queuetail;
+static int					capture_busy;		// jobs queued or being encoded
+static capturejob_t			*capture_current;	// job being encoded
+static capturejob_t			*capture_done;		// finished jobs, oldest first
+static capturejob_t			**capture_donetail = &capture_done;
+static qboolean				capture_quit;
+
+static struct
+{
+	qboolean				active;
+	qboolean				failed;
+	captureformat_t			format;
+	int						quality;
+	int						width;
+	int						height;
+	int						frames;
+	float					fps;
+	char					basename[MAX_OSPATH];
+	FILE					*rawfile;		// written by the encoder thread only
+} capture;
+
+cvar_t		capture_fps = {"capture_fps", "30", CVAR_ARCHIVE};
+
+/*
+==================
+SCR_EncodeCapture
+
+Runs on the encoder thread, must not touch the console or GL
+==================
+*/
+static qboolean SCR_EncodeCapture (capturejob_t *job)
+{
+	int		y, rowsize;
+
+	switch (job->format)
+	{
+	case CAPTURE_PNG:
+		return Image_WritePNG (job->name, job->pixels, job->width, job->height, 24, false, &job->error);
+	case CAPTURE_TGA:
+		return Image_WriteTGA (job->name, job->pixels, job->width, job->height, 24, false);
+	case CAPTURE_JPG:
+		return Image_WriteJPG (job->name, job->pixels, job->width, job->height, 24, job->quality, false);
+	case CAPTURE_RAW:
+		// top-down rgb24, as expected by most raw video readers
+		rowsize = job->width * 3;
+		for (y = job->height - 1; y >= 0; y--)
+			if (fwrite (job->pixels + y * rowsize, 1, rowsize, capture.rawfile) != (size_t) rowsize)
+				return false;
+		return true;
+	default:
+		return false;
+	}
 }
 
 /*
 ==================
-SCR_ScreenShot_f
+SCR_CaptureThread
 ==================
 */
-void SCR_ScreenShot_f (void)
+static int SCR_CaptureThread (void *unused)
+{
+	capturejob_t *job;
+
+	SDL_LockMutex (capture_mutex);
+	while (1)
+	{
+		while (!capture_quit && capture_queuehead == capture_queuetail)
+			SDL_CondWait (capture_wake, capture_mutex);
+		if (capture_queuehead == capture_queuetail)
+			break;
+
+		job = capture_queue[capture_queuehead++ % CAPTURE_QUEUE];
+		capture_current = job;
+		SDL_CondBroadcast (capture_idle);
+		SDL_UnlockMutex (capture_mutex);
+
+		job->ok = SCR_EncodeCapture (job);
+		free (job->pixels);
+		job->pixels = NULL;
+
+		SDL_LockMutex (capture_mutex);
+		capture_current = NULL;
+		job->next = NULL;
+		*capture_donetail = job;
+		capture_donetail = &job->next;
+		capture_busy--;
+		SDL_CondBroadcast (capture_idle);
+	}
+	SDL_UnlockMutex (capture_mutex);
+
+	return 0;
+}
+
+/*
+==================
+SCR_StartCaptureThread
+
+The encoder thread is only started on first use
+==================
+*/
+static qboolean SCR_StartCaptureThread (void)
 {
-	byte	*buffer;
-	char	ext[4];
-	int		i, quality;
+	static qboolean failed = false;
+
+	if (capture_thread)
+		return true;
+	if (failed)
+		return false;
 
-	Q_strncpy (ext, "png", sizeof(ext));
+	capture_mutex = SDL_CreateMutex ();
+	capture_wake = SDL_CreateCond ();
+	capture_idle = SDL_CreateCond ();
+	if (capture_mutex && capture_wake && capture_idle)
+		capture_thread = SDL_CreateThread (SCR_CaptureThread, "Capture", NULL);
 
-	if (Cmd_Argc () >= 2)
+	if (!capture_thread)
 	{
-		const char	*requested_ext = Cmd_Argv (1);
+		Con_Warning ("Couldn't create capture thread, encoding on the main thread\n");
+		failed = true;
+		return false;
+	}
 
-		if (!q_strcasecmp ("png", requested_ext)
-		    || !q_strcasecmp ("tga", requested_ext)
-		    || !q_strcasecmp ("jpg", requested_ext))
-			Q_strncpy (ext, requested_ext, sizeof(ext));
-		else
+	return true;
+}
+
+/*
+==================
+SCR_ReportCapture
+==================
+*/
+static void SCR_ReportCapture (capturejob_t *job)
+{
+	char name[MAX_OSPATH];
+
+	if (job->screenshot)
+	{
+		UTF8_ToQuake (name, sizeof (name), job->name);
+		if (job->ok)
 		{
-			SCR_ScreenShot_Usage ();
-			return;
+			Con_SafePrintf ("Wrote ");
+			Con_LinkPrintf (va("%s/%s", com_gamedir, job->name), "%s", name);
+			Con_SafePrintf ("\n");
 		}
+		else if (job->error)
+			Con_Printf ("SCR_ScreenShot_f: Couldn't create %s: %s\n", name, job->error);
+		else
+			Con_Printf ("SCR_ScreenShot_f: Couldn't create %s\n", name);
+	}
+	else if (!job->ok && !capture.failed)
+	{
+		if (job->error)
+			Con_Printf ("Capture failed: couldn't write %s: %s\n", job->name, job->error);
+		else
+			Con_Printf ("Capture failed: couldn't write %s\n", capture.format == CAPTURE_RAW ? "frame" : job->name);
+		capture.failed = true;
 	}
 
-// read quality as the 3rd param (only used for JPG)
-	quality = 90;
-	if (Cmd_Argc () >= 3)
-		quality = Q_atoi (Cmd_Argv(2));
-	if (quality < 1 || quality > 100)
+	free (job->pixels);
+	free (job);
+}
+
+/*
+==================
+SCR_ReportFinishedCaptures
+==================
+*/
+static void SCR_ReportFinishedCaptures (void)
+{
+	capturejob_t *job, *next;
+
+	if (!capture_thread)
+		return;
+
+	SDL_LockMutex (capture_mutex);
+	job = capture_done;
+	capture_done = NULL;
+	capture_donetail = &capture_done;
+	SDL_UnlockMutex (capture_mutex);
+
+	for (; job; job = next)
 	{
-		SCR_ScreenShot_Usage ();
+		next = job->next;
+		SCR_ReportCapture (job);
+	}
+}
+
+/*
+==================
+SCR_QueueEncode
+
+Blocks while the encoder queue is full, so a slow encoder throttles the
+renderer instead of dropping frames
+==================
+*/
+static void SCR_QueueEncode (capturejob_t *job)
+{
+	if (!SCR_StartCaptureThread ())
+	{
+		job->ok = SCR_EncodeCapture (job);
+		SCR_ReportCapture (job);
 		return;
 	}
 
-//get data
-	if (!(buffer = (byte *) malloc(glwidth*glheight*3)))
+	SDL_LockMutex (capture_mutex);
+	while (capture_queuetail - capture_queuehead >= CAPTURE_QUEUE)
+		SDL_CondWait (capture_idle, capture_mutex);
+	capture_queue[capture_queuetail++ % CAPTURE_QUEUE] = job;
+	capture_busy++;
+	SDL_CondSignal (capture_wake);
+	SDL_UnlockMutex (capture_mutex);
+}
+
+/*
+==================
+SCR_CaptureNamePending
+
+Returns true if a file with this name is still waiting to be written
+==================
+*/
+static qboolean SCR_CaptureNamePending (const char *name)
+{
+	qboolean	pending = false;
+	int			i;
+
+	if (!capture_thread)
+		return false;
+
+	SDL_LockMutex (capture_mutex);
+	if (capture_current && !strcmp (capture_current->name, name))
+		pending = true;
+	for (i = capture_queuehead; i != capture_queuetail && !pending; i++)
+		if (!strcmp (capture_queue[i % CAPTURE_QUEUE]->name, name))
+			pending = true;
+	SDL_UnlockMutex (capture_mutex);
+
+	return pending;
+}
+
+/*
+==================
+SCR_ScreenShotName
+
+Picks an unused file name for a screenshot, returns false if there is none
+==================
+*/
+static qboolean SCR_ScreenShotName (char *imagename, size_t maxchars, const char *ext)
+{
+	char		basename[MAX_OSPATH];
+	char		checkname[MAX_OSPATH];
+	qboolean	has_vars;
+	int			i;
+
+	has_vars = SCR_ExpandVariables (cl_screenshotname.string, basename, sizeof (basename));
+	if (!basename[0])
+		q_strlcpy (basename, SCREENSHOT_PREFIX, sizeof (basename));
+
+	if (has_vars)
+	{
+		q_snprintf (imagename, maxchars, "%s.%s", basename, ext);
+		q_snprintf (checkname, sizeof (checkname), "%s/%s", com_gamedir, imagename);
+		if (Sys_FileType (checkname) == FS_ENT_NONE && !SCR_CaptureNamePending (imagename))
+			return true;
+	}
+
+	// base name already used (or has no variables), try appending an index
+	// append underscore if basename ends with a digit
+	i = (int) strlen (basename);
+	if (i && i + 1 < (int) countof (basename) && (unsigned int)(basename[i - 1] - '0') < 10u)
+	{
+		basename[i] = '_';
+		basename[i + 1] = '\0';
+	}
+
+	for (i = has_vars; i < 10000; i++)
+	{
+		q_snprintf (imagename, maxchars, "%s%04i.%s", basename, i, ext);
+		q_snprintf (checkname, sizeof (checkname), "%s/%s", com_gamedir, imagename);
+		if (Sys_FileType (checkname) == FS_ENT_NONE && !SCR_CaptureNamePending (imagename))
+			return true;	// file doesn't exist
+	}
+
+	return false;
+}
+
+/*
+==================
+SCR_FinishScreenShot
+
+Called once the pixels of a screenshot are back from the GPU
+==================
+*/
+static void SCR_FinishScreenShot (capturejob_t *job)
+{
+	if (Steam_SaveScreenshot (job->pixels, job->width, job->height))
 	{
-		Con_Printf ("SCR_ScreenShot_f: Couldn't allocate memory\n");
+		free (job->pixels);
+		free (job);
 		return;
 	}
 
-	if (scr_viewsize.value >= 130)
+	if (!SCR_ScreenShotName (job->name, sizeof (job->name), capture_exts[job->format]))
 	{
-		qboolean oldskip = scr_skipupdate;
-		Con_ClearNotify ();
-		SCR_ClearCenterString ();
-		scr_skipupdate = 1; // don't swap buffers at end of frame
-		SCR_UpdateScreen ();
-		scr_skipupdate = oldskip;
+		Con_Printf ("SCR_ScreenShot_f: Couldn't find an unused filename\n");
+		free (job->pixels);
+		free (job);
+		return;
 	}
 
-	glPixelStorei (GL_PACK_ALIGNMENT, 1);/* for widths that aren't a multiple of 4 */
-	glReadPixels (glx, gly, glwidth, glheight, GL_RGB, GL_UNSIGNED_BYTE, buffer);
+	SCR_QueueEncode (job);
+}
+
+/*
+==================
+SCR_FinishReadback
+
+Copies out the oldest readback once the GPU is done with it.
+Returns false if there was nothing to finish.
+==================
+*/
+static qboolean SCR_FinishReadback (qboolean wait)
+{
+	capturereadback_t	*rb;
+	capturejob_t		*job;
+	const byte			*src;
+	size_t				size;
+	GLenum				result;
+
+	if (capture_readhead == capture_readtail)
+		return false;
+
+	rb = &capture_readbacks[capture_readhead % CAPTURE_READBACKS];
+	result = GL_ClientWaitSyncFunc (rb->fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? 1000ull * 1000 * 1000 : 0);
+	if (result == GL_TIMEOUT_EXPIRED)
+	{
+		if (!wait)
+			return false;
+		glFinish ();
+	}
+	else if (result == GL_WAIT_FAILED)
+		Sys_Error ("SCR_FinishReadback: wait failed (0x%04X)", glGetError ());
+	GL_DeleteSyncFunc (rb->fence);
+	rb->fence = NULL;
+
+	job = rb->job;
+	rb->job = NULL;
+	capture_readhead++;
+
+	size = (size_t) job->width * job->height * 3;
+	job->pixels = (byte *) malloc (size);
+	src = NULL;
+	if (job->pixels)
+	{
+		GL_BindBuffer (GL_PIXEL_PACK_BUFFER, rb->buffer);
+		src = (const byte *) GL_MapBufferRangeFunc (GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+		if (src)
+		{
+			memcpy (job->pixels, src, size);
+			GL_UnmapBufferFunc (GL_PIXEL_PACK_BUFFER);
+		}
+		GL_BindBuffer (GL_PIXEL_PACK_BUFFER, 0);
+	}
 
-// now write the file
-	if (!Steam_SaveScreenshot (buffer, glwidth, glheight))
+	if (!src)
 	{
-		char		basename[MAX_OSPATH];
-		char		imagename[MAX_OSPATH];
-		char		checkname[MAX_OSPATH];
-		qboolean	ok, has_vars;
+		if (job->screenshot)
+			Con_Printf ("SCR_ScreenShot_f: Couldn't read back %dx%d pixels\n", job->width, job->height);
+		else
+			capture.failed = true;
+		free (job->pixels);
+		free (job);
+		return true;
+	}
 
-	// find a file name to save it to
-		has_vars = SCR_ExpandVariables (cl_screenshotname.string, basename, sizeof (basename));
-		if (!basename[0])
-			q_strlcpy (basename, SCREENSHOT_PREFIX, sizeof (basename));
+	if (job->screenshot)
+		SCR_FinishScreenShot (job);
+	else
+		SCR_QueueEncode (job);
 
-		if (!has_vars)
-			goto append_index;
+	return true;
+}
 
-		q_snprintf (imagename, sizeof (imagename), "%s.%s", basename, ext);
-		q_snprintf (checkname, sizeof (checkname), "%s/%s", com_gamedir, imagename);
-		if (Sys_FileType (checkname) != FS_ENT_NONE) // base name already used, try appending an index
+/*
+==================
+SCR_ReadPixelsAsync
+
+Starts reading the current framebuffer into a pixel pack buffer
+==================
+*/
+static void SCR_ReadPixelsAsync (capturejob_t *job)
+{
+	capturereadback_t	*rb;
+	size_t				size;
+
+	if (capture_readtail - capture_readhead >= CAPTURE_READBACKS)
+		SCR_FinishReadback (true);
+
+	rb = &capture_readbacks[capture_readtail++ % CAPTURE_READBACKS];
+	size = (size_t) job->width * job->height * 3;
+	if (!rb->buffer)
+	{
+		rb->buffer = GL_CreateBuffer (GL_PIXEL_PACK_BUFFER, GL_STREAM_READ, "capture readback", size, NULL);
+		rb->size = size;
+	}
+	else
+	{
+		GL_BindBuffer (GL_PIXEL_PACK_BUFFER, rb->buffer);
+		if (rb->size < size)
 		{
-		append_index:
-			// append underscore if basename ends with a digit
-			i = (int) strlen (basename);
-			if (i && i + 1 < (int) countof (basename) && (unsigned int)(basename[i - 1] - '0') < 10u)
-			{
-				basename[i] = '_';
-				basename[i + 1] = '\0';
-			}
+			GL_BufferDataFunc (GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+			rb->size = size;
+		}
+	}
 
-			for (i = has_vars; i < 10000; i++)
-			{
-				q_snprintf (imagename, sizeof (imagename), "%s%04i.%s", basename, i, ext);
-				q_snprintf (checkname, sizeof (checkname), "%s/%s", com_gamedir, imagename);
-				if (Sys_FileType (checkname) == FS_ENT_NONE)
-					break;	// file doesn't exist
-			}
-			if (i == 10000)
-			{
-				Con_Printf ("SCR_ScreenShot_f: Couldn't find an unused filename\n");
-				free (buffer);
-				return;
-			}
+	glPixelStorei (GL_PACK_ALIGNMENT, 1);/* for widths that aren't a multiple of 4 */
+	glReadPixels (glx, gly, job->width, job->height, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+	GL_BindBuffer (GL_PIXEL_PACK_BUFFER, 0);
+
+	rb->fence = GL_FenceSyncFunc (GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	if (!rb->fence)
+		Sys_Error ("glFenceSync failed (error code 0x%04X)", glGetError ());
+	rb->job = job;
+}
+
+/*
+==================
+SCR_FlushCapture
+
+Waits until every pending readback has been encoded
+==================
+*/
+static void SCR_FlushCapture (void)
+{
+	while (SCR_FinishReadback (true))
+		;
+
+	if (capture_thread)
+	{
+		SDL_LockMutex (capture_mutex);
+		while (capture_busy > 0)
+			SDL_CondWait (capture_idle, capture_mutex);
+		SDL_UnlockMutex (capture_mutex);
+	}
+
+	SCR_ReportFinishedCaptures ();
+}
+
+/*
+==================
+SCR_NewCaptureJob
+==================
+*/
+static capturejob_t *SCR_NewCaptureJob (captureformat_t format, int quality)
+{
+	capturejob_t *job = (capturejob_t *) calloc (1, sizeof (*job));
+	if (!job)
+		Sys_Error ("SCR_NewCaptureJob: out of memory");
+	job->format = format;
+	job->quality = quality;
+	job->width = glwidth;
+	job->height = glheight;
+	return job;
+}
+
+/*
+==================
+SCR_ParseCaptureFormat
+==================
+*/
+static qboolean SCR_ParseCaptureFormat (const char *ext, captureformat_t *format, qboolean allowraw)
+{
+	int i;
+
+	for (i = 0; i < (int) countof (capture_exts); i++)
+	{
+		if (i == CAPTURE_RAW && !allowraw)
+			continue;
+		if (!q_strcasecmp (ext, capture_exts[i]) || (i == CAPTURE_RAW && !q_strcasecmp (ext, "raw")))
+		{
+			*format = (captureformat_t) i;
+			return true;
 		}
+	}
 
-		if (!q_strncasecmp (ext, "png", sizeof(ext)))
-			ok = Image_WritePNG (imagename, buffer, glwidth, glheight, 24, false);
-		else if (!q_strncasecmp (ext, "tga", sizeof(ext)))
-			ok = Image_WriteTGA (imagename, buffer, glwidth, glheight, 24, false);
-		else if (!q_strncasecmp (ext, "jpg", sizeof(ext)))
-			ok = Image_WriteJPG (imagename, buffer, glwidth, glheight, 24, quality, false);
-		else
-			ok = false;
+	return false;
+}
+
+/*
+==================
+SCR_StopCapture
+==================
+*/
+static void SCR_StopCapture (void)
+{
+	if (!capture.active)
+		return;
+
+	SCR_FlushCapture ();
+	capture.active = false;
+
+	if (capture.rawfile)
+	{
+		fclose (capture.rawfile);
+		capture.rawfile = NULL;
+	}
+
+	Con_Printf ("Captured %i frame%s to %s\n", PLURAL (capture.frames), capture.basename);
+}
+
+/*
+==================
+SCR_UpdateCapture
+
+Called every frame to pick up finished readbacks and encoded files
+==================
+*/
+static void SCR_UpdateCapture (void)
+{
+	while (SCR_FinishReadback (false))
+		;
+	SCR_ReportFinishedCaptures ();
+
+	if (capture.active && capture.failed)
+		SCR_StopCapture ();
+}
+
+/*
+==================
+SCR_CaptureFrame
+
+Called by GL_EndRendering before the buffers are swapped
+==================
+*/
+void SCR_CaptureFrame (void)
+{
+	capturejob_t *job;
+
+	if (!capture.active)
+		return;
+
+	if (glwidth != capture.width || glheight != capture.height)
+	{
+		Con_Printf ("Capture stopped: video size changed\n");
+		SCR_StopCapture ();
+		return;
+	}
+
+	job = SCR_NewCaptureJob (capture.format, capture.quality);
+	if (capture.format != CAPTURE_RAW)
+		q_snprintf (job->name, sizeof (job->name), "%s%06d.%s", capture.basename, capture.frames, capture_exts[capture.format]);
+	capture.frames++;
+
+	SCR_ReadPixelsAsync (job);
+	SCR_UpdateCapture ();
+}
+
+/*
+==================
+SCR_CaptureFrameTime
+
+Fixed host frame time while capturing, 0 otherwise
+==================
+*/
+double SCR_CaptureFrameTime (void)
+{
+	return capture.active ? 1.0 / capture.fps : 0.0;
+}
+
+/*
+==================
+SCR_CaptureStart_f
+==================
+*/
+static void SCR_CaptureStart_f (void)
+{
+	char		name[MAX_OSPATH];
+	char		path[MAX_OSPATH];
+	int			quality;
+	captureformat_t	format = CAPTURE_PNG;
+
+	if (Cmd_Argc () >= 2 && !SCR_ParseCaptureFormat (Cmd_Argv (1), &format, true))
+	{
+		Con_Printf ("usage: capture_start <format> <name> <quality>\n");
+		Con_Printf ("   format must be \"png\", \"tga\", \"jpg\" or \"raw\"\n");
+		Con_Printf ("   quality must be 1-100 (jpg only)\n");
+		return;
+	}
+
+	quality = Cmd_Argc () >= 4 ? Q_atoi (Cmd_Argv (3)) : 90;
+	if (quality < 1 || quality > 100)
+	{
+		Con_Printf ("capture_start: quality must be 1-100\n");
+		return;
+	}
+
+	if (capture.active)
+		SCR_StopCapture ();
 
-		UTF8_ToQuake (basename, sizeof (basename), imagename);
-		if (ok)
+	SCR_ExpandVariables (Cmd_Argc () >= 3 ? Cmd_Argv (2) : CAPTURE_PREFIX, name, sizeof (name));
+	if (!name[0])
+		q_strlcpy (name, SCREENSHOT_PREFIX, sizeof (name));
+
+	memset (&capture, 0, sizeof (capture));
+	capture.format = format;
+	capture.quality = quality;
+	capture.width = glwidth;
+	capture.height = glheight;
+	capture.fps = CLAMP (1.f, capture_fps.value, 1000.f);
+
+	if (format == CAPTURE_RAW)
+	{
+		// a fifo created beforehand works too, for piping into an encoder
+		q_snprintf (capture.basename, sizeof (capture.basename), "%s.%s", name, capture_exts[format]);
+		q_snprintf (path, sizeof (path), "%s/%s", com_gamedir, capture.basename);
+		capture.rawfile = Sys_fopen (path, "wb");
+		if (!capture.rawfile)
 		{
-			Con_SafePrintf ("Wrote ");
-			Con_LinkPrintf (va("%s/%s", com_gamedir, imagename), "%s", basename);
-			Con_SafePrintf ("\n");
+			Con_Printf ("capture_start: couldn't open %s\n", capture.basename);
+			return;
 		}
-		else
-			Con_Printf ("SCR_ScreenShot_f: Couldn't create %s\n", basename);
+		Con_Printf ("Capturing raw video to %s\n", capture.basename);
+		Con_Printf ("   -f rawvideo -pix_fmt rgb24 -s %dx%d -r %g\n", capture.width, capture.height, capture.fps);
+	}
+	else
+	{
+		// frame numbers are appended, keep them apart from a trailing digit
+		q_strlcpy (capture.basename, name, sizeof (capture.basename));
+		if (name[0] && (unsigned int)(name[strlen (name) - 1] - '0') < 10u)
+			q_strlcat (capture.basename, "_", sizeof (capture.basename));
+		Con_Printf ("Capturing %dx%d at %g fps to %s######.%s\n", capture.width, capture.height, capture.fps, capture.basename, capture_exts[format]);
 	}
 
-	free (buffer);
+	capture.active = true;
+}
+
+/*
+==================
+SCR_CaptureStop_f
+==================
+*/
+static void SCR_CaptureStop_f (void)
+{
+	if (!capture.active)
+	{
+		Con_Printf ("Not capturing\n");
+		return;
+	}
+	SCR_StopCapture ();
+}
+
+/*
+==================
+SCR_ShutdownCapture
+
+Finishes pending screenshots and frames, must run before the GL context is gone
+==================
+*/
+void SCR_ShutdownCapture (void)
+{
+	int i;
+
+	if (!scr_initialized)
+		return;
+
+	SCR_StopCapture ();
+	SCR_FlushCapture ();
+
+	if (capture_thread)
+	{
+		SDL_LockMutex (capture_mutex);
+		capture_quit = true;
+		SDL_CondSignal (capture_wake);
+		SDL_UnlockMutex (capture_mutex);
+		SDL_WaitThread (capture_thread, NULL);
+		capture_thread = NULL;
+	}
+	if (capture_idle)
+		SDL_DestroyCond (capture_idle);
+	if (capture_wake)
+		SDL_DestroyCond (capture_wake);
+	if (capture_mutex)
+		SDL_DestroyMutex (capture_mutex);
+	capture_idle = capture_wake = NULL;
+	capture_mutex = NULL;
+
+	for (i = 0; i < CAPTURE_READBACKS; i++)
+	{
+		if (capture_readbacks[i].buffer)
+			GL_DeleteBuffer (capture_readbacks[i].buffer);
+		capture_readbacks[i].buffer = 0;
+		capture_readbacks[i].size = 0;
+	}
+}
+
+static void SCR_ScreenShot_Usage (void)
+{
+	Con_Printf ("usage: screenshot <format> <quality>\n");
+	Con_Printf ("   format must be \"png\" or \"tga\" or \"jpg\"\n");
+	Con_Printf ("   quality must be 1-100\n");
+}
+
+/*
+==================
+SCR_ScreenShot_f
+
+Only starts the readback, the file is written in the background
+==================
+*/
+void SCR_ScreenShot_f (void)
+{
+	captureformat_t	format = CAPTURE_PNG;
+	int				quality;
+
+	if (Cmd_Argc () >= 2 && !SCR_ParseCaptureFormat (Cmd_Argv (1), &format, false))
+	{
+		SCR_ScreenShot_Usage ();
+		return;
+	}
+
+// read quality as the 3rd param (only used for JPG)
+	quality = 90;
+	if (Cmd_Argc () >= 3)
+		quality = Q_atoi (Cmd_Argv(2));
+	if (quality < 1 || quality > 100)
+	{
+		SCR_ScreenShot_Usage ();
+		return;
+	}
+
+	if (scr_viewsize.value >= 130)
+	{
+		qboolean oldskip = scr_skipupdate;
+		Con_ClearNotify ();
+		SCR_ClearCenterString ();
+		scr_skipupdate = 1; // don't swap buffers at end of frame
+		SCR_UpdateScreen ();
+		scr_skipupdate = oldskip;
+	}
+
+	SCR_ReadPixelsAsync (SCR_NewCaptureJob (format, quality));
 }
 
 
@@ -2095,6 +2769,8 @@ void SCR_UpdateScreen (void)
 
 	GL_BeginRendering (&glx, &gly, &glwidth, &glheight);
 
+	SCR_UpdateCapture ();
+
 	//
 	// determine size of refresh window
 	//
@@ -29,6 +29,8 @@ glprogs_t glprogs;
 static GLuint gl_programs[128];
 static GLuint gl_current_program;
 static int gl_num_programs;
+static qboolean gl_shadercache;
+static int gl_num_cached_programs;
 
 /*
 =============
@@ -96,6 +98,25 @@ static qboolean AppendString (char **dst, const char *dstend, const char *str, i
 	return true;
 }
 
+/*
+=============
+GL_ShaderHeader
+
+Common preamble prepended to every shader
+=============
+*/
+static void GL_ShaderHeader (char *header, size_t size)
+{
+	q_snprintf (header, size,
+		"#version 430\n"
+		"\n"
+		"#define BINDLESS %d\n"
+		"#define REVERSED_Z %d\n",
+		gl_bindless_able,
+		gl_clipcontrol_able
+	);
+}
+
 /*
 =============
 GL_CreateShader
@@ -126,14 +147,7 @@ static GLuint GL_CreateShader (GLenum type, const char *source, const char *extr
 			break;
 	}
 
-	q_snprintf (header, sizeof (header),
-		"#version 430\n"
-		"\n"
-		"#define BINDLESS %d\n"
-		"#define REVERSED_Z %d\n",
-		gl_bindless_able,
-		gl_clipcontrol_able
-	);
+	GL_ShaderHeader (header, sizeof (header));
 	strings[numstrings++] = header;
 
 	if (extradefs && *extradefs)
@@ -157,6 +171,206 @@ static GLuint GL_CreateShader (GLenum type, const char *source, const char *extr
 	return shader;
 }
 
+/*
+=============
+GL_AddProgram
+=============
+*/
+static void GL_AddProgram (GLuint program)
+{
+	if (gl_num_programs == countof(gl_programs))
+		Sys_Error ("gl_programs overflow");
+	gl_programs[gl_num_programs] = program;
+	gl_num_programs++;
+}
+
+/*
+================================================================================
+
+	PROGRAM BINARY CACHE
+
+Linked programs are kept under <gamedir>/shadercache, one file per program
+variant. The header stores hashes of the sources, the generated #defines and
+the driver strings, so a shader edit or a driver update simply turns the
+next load into a miss that recompiles and overwrites the file. Binaries the
+driver rejects are dropped the same way. -noshadercache disables the cache.
+
+================================================================================
+*/
+
+#define SHADERCACHE_IDENT	(('C'<<24)+('H'<<16)+('S'<<8)+'G')
+#define SHADERCACHE_VERSION	1
+
+typedef struct
+{
+	unsigned	driver;			// engine version, GL vendor/renderer/version
+	unsigned	header;			// #version and global #defines
+	unsigned	macros;			// per-variant #defines
+	unsigned	types[2];
+	unsigned	sources[2];
+} shadercachekey_t;
+
+typedef struct
+{
+	int					ident;
+	int					version;
+	shadercachekey_t	key;
+	unsigned			format;
+	int					length;
+	unsigned			datahash;
+} shadercachehdr_t;
+
+/*
+=============
+GL_ProgramCacheKey
+=============
+*/
+static void GL_ProgramCacheKey (shadercachekey_t *key, int count, const GLchar **sources, const GLenum *types, const char *macros)
+{
+	char buf[1024];
+	int i;
+
+	memset (key, 0, sizeof (*key));
+
+	q_snprintf (buf, sizeof (buf), "%s|%d|%s|%s|%s", IRONWAIL_VER_STRING, (int) sizeof (void *), gl_vendor, gl_renderer, gl_version);
+	key->driver = COM_HashString (buf);
+	GL_ShaderHeader (buf, sizeof (buf));
+	key->header = COM_HashString (buf);
+	key->macros = COM_HashString (macros);
+
+	for (i = 0; i < count; i++)
+	{
+		if (!sources[i])
+			continue;
+		key->types[i] = types[i];
+		key->sources[i] = COM_HashString (sources[i]);
+	}
+}
+
+/*
+=============
+GL_ProgramCachePath
+=============
+*/
+static void GL_ProgramCachePath (char *path, size_t pathsize, const char *name)
+{
+	q_snprintf (path, pathsize, "%s/shadercache/%08x.bin", com_gamedir, COM_HashString (name));
+}
+
+/*
+=============
+GL_LoadProgramBinary -- returns 0 on a miss
+=============
+*/
+static GLuint GL_LoadProgramBinary (const char *name, const shadercachekey_t *key)
+{
+	char				path[MAX_OSPATH];
+	shadercachehdr_t	hdr;
+	FILE				*f;
+	byte				*data;
+	GLuint				program;
+	GLint				status;
+
+	GL_ProgramCachePath (path, sizeof (path), name);
+	f = Sys_fopen (path, "rb");
+	if (!f)
+		return 0;
+
+	if (fread (&hdr, sizeof (hdr), 1, f) != 1 ||
+		hdr.ident != SHADERCACHE_IDENT ||
+		hdr.version != SHADERCACHE_VERSION ||
+		memcmp (&hdr.key, key, sizeof (*key)) != 0 ||
+		hdr.length <= 0)
+	{
+		fclose (f);
+		return 0;
+	}
+
+	data = (byte *) malloc (hdr.length);
+	if (!data || fread (data, 1, hdr.length, f) != (size_t) hdr.length || COM_HashBlock (data, hdr.length) != hdr.datahash)
+	{
+		free (data);
+		fclose (f);
+		return 0;
+	}
+	fclose (f);
+
+	program = GL_CreateProgramFunc ();
+	GL_ObjectLabelFunc (GL_PROGRAM, program, -1, name);
+	GL_ProgramParameteriFunc (program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	GL_ProgramBinaryFunc (program, hdr.format, data, hdr.length);
+	free (data);
+
+	GL_GetProgramivFunc (program, GL_LINK_STATUS, &status);
+	if (status != GL_TRUE)
+	{
+		Con_DPrintf ("Cached binary for %s rejected by driver\n", name);
+		GL_DeleteProgramFunc (program);
+		Sys_remove (path);
+		return 0;
+	}
+
+	GL_AddProgram (program);
+	gl_num_cached_programs++;
+
+	return program;
+}
+
+/*
+=============
+GL_SaveProgramBinary
+=============
+*/
+static void GL_SaveProgramBinary (GLuint program, const char *name, const shadercachekey_t *key)
+{
+	char				path[MAX_OSPATH];
+	shadercachehdr_t	hdr;
+	FILE				*f;
+	byte				*data;
+	GLint				length = 0;
+	GLsizei				written = 0;
+	GLenum				format = 0;
+	qboolean			ok;
+
+	GL_GetProgramivFunc (program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+	data = (byte *) malloc (length);
+	if (!data)
+		return;
+
+	GL_GetProgramBinaryFunc (program, length, &written, &format, data);
+	if (written <= 0)
+	{
+		free (data);
+		return;
+	}
+
+	memset (&hdr, 0, sizeof (hdr));
+	hdr.ident = SHADERCACHE_IDENT;
+	hdr.version = SHADERCACHE_VERSION;
+	hdr.key = *key;
+	hdr.format = format;
+	hdr.length = written;
+	hdr.datahash = COM_HashBlock (data, written);
+
+	GL_ProgramCachePath (path, sizeof (path), name);
+	f = Sys_fopen (path, "wb");
+	if (!f)
+	{
+		free (data);
+		return;
+	}
+
+	ok = fwrite (&hdr, sizeof (hdr), 1, f) == 1 &&
+		fwrite (data, 1, written, f) == (size_t) written;
+	fclose (f);
+	free (data);
+
+	if (!ok)
+		Sys_remove (path);
+}
+
 /*
 =============
 GL_CreateProgramFromShaders
@@ -169,6 +383,8 @@ static GLuint GL_CreateProgramFromShaders (const GLuint *shaders, int numshaders
 
 	program = GL_CreateProgramFunc ();
 	GL_ObjectLabelFunc (GL_PROGRAM, program, -1, name);
+	if (gl_shadercache)
+		GL_ProgramParameteriFunc (program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 
 	while (numshaders-- > 0)
 	{
@@ -188,10 +404,7 @@ static GLuint GL_CreateProgramFromShaders (const GLuint *shaders, int numshaders
 		GL_InitError ("Error linking %s program:\n\n%s", name, infolog);
 	}
 
-	if (gl_num_programs == countof(gl_programs))
-		Sys_Error ("gl_programs overflow");
-	gl_programs[gl_num_programs] = program;
-	gl_num_programs++;
+	GL_AddProgram (program);
 
 	return program;
 }
@@ -208,6 +421,8 @@ static GLuint GL_CreateProgramFromSources (int count, const GLchar **sources, co
 	char *pipe;
 	int i, realcount;
 	GLuint shaders[2];
+	GLuint program;
+	shadercachekey_t key;
 
 	if (count <= 0 || count > 2)
 		Sys_Error ("GL_CreateProgramFromSources: invalid source count (%d)", count);
@@ -246,12 +461,25 @@ static GLuint GL_CreateProgramFromSources (int count, const GLchar **sources, co
 
 	name = eval;
 
+	if (gl_shadercache)
+	{
+		GL_ProgramCacheKey (&key, count, sources, types, macros);
+		program = GL_LoadProgramBinary (name, &key);
+		if (program)
+			return program;
+	}
+
 	realcount = 0;
 	for (i = 0; i < count; i++)
 		if (sources[i])
 			shaders[realcount++] = GL_CreateShader (types[i], sources[i], macros, name);
 
-	return GL_CreateProgramFromShaders (shaders, realcount, name);
+	program = GL_CreateProgramFromShaders (shaders, realcount, name);
+
+	if (gl_shadercache)
+		GL_SaveProgramBinary (program, name, &key);
+
+	return program;
 }
 
 /*
@@ -330,6 +558,13 @@ GL_CreateShaders
 void GL_CreateShaders (void)
 {
 	int palettize, dither, mode, alphatest, warp, oit, md5;
+	GLint numformats = 0;
+	double start;
+
+	start = Sys_DoubleTime ();
+	glGetIntegerv (GL_NUM_PROGRAM_BINARY_FORMATS, &numformats);
+	gl_shadercache = numformats > 0 && !COM_CheckParm ("-noshadercache");
+	gl_num_cached_programs = 0;
 
 	glprogs.gui = GL_CreateProgram (gui_vertex_shader, gui_fragment_shader, "gui");
 	glprogs.viewblend = GL_CreateProgram (viewblend_vertex_shader, viewblend_fragment_shader, "viewblend");
@@ -377,6 +612,9 @@ void GL_CreateShaders (void)
 	for (mode = 0; mode < 3; mode++)
 		glprogs.palette_init[mode] = GL_CreateComputeProgram (palette_init_compute_shader, "palette init|MODE %d", mode);
 	glprogs.palette_postprocess = GL_CreateComputeProgram (palette_postprocess_compute_shader, "palette postprocess");
+
+	Con_SafePrintf ("Created %d GLSL programs in %.0f ms (%d from cache)\n",
+		gl_num_programs, (Sys_DoubleTime () - start) * 1000.0, gl_num_cached_programs);
 }
 
 /*
@@ -434,7 +434,11 @@ void Sky_LoadSkyBox (const char *name)
 		}
 	}
 
-	//load textures
+	//load textures, decoding all faces in parallel
+	for (i = 0; i < 6; i++)
+		Image_AddPrefetch (va ("gfx/env/%s%s", name, suf[i]));
+	Image_StartPrefetch ();
+
 	mark = Hunk_LowMark ();
 	for (i = 0, numloaded = 0, samesize = 0; i < 6; i++)
 	{
@@ -458,6 +462,7 @@ void Sky_LoadSkyBox (const char *name)
 			Con_Printf ("Couldn't load %s\n", filename);
 		}
 	}
+	Image_EndPrefetch ();
 
 	if (numloaded == 0) // go back to scrolling sky if skybox is totally missing
 	{
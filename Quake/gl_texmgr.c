@@ -50,6 +50,7 @@ cvar_t			gl_lodbias = {"gl_lodbias", "auto", CVAR_ARCHIVE };
 cvar_t			gl_texturemode = {"gl_texturemode", "", CVAR_ARCHIVE};
 cvar_t			gl_texture_anisotropy = {"gl_texture_anisotropy", "8", CVAR_ARCHIVE};
 cvar_t			gl_compress_textures = {"gl_compress_textures", "0", CVAR_ARCHIVE};
+static cvar_t	gl_texcache = {"gl_texcache", "0", CVAR_ARCHIVE};
 GLint			gl_max_texture_size;
 
 static float	lodbias;
@@ -58,6 +59,7 @@ softemu_t		softemu;
 #define	MAX_GLTEXTURES	4096
 static int numgltextures;
 static gltexture_t	*active_gltextures, *free_gltextures;
+static unsigned	texcache_palhash; // hash of the current palette, part of the disk cache key
 gltexture_t		*notexture, *nulltexture, *whitetexture, *greytexture, *blacktexture;
 
 unsigned int d_8to24table_opaque[256];			//standard palette with alpha 255 for all colors
@@ -72,6 +74,7 @@ unsigned int d_8to24table_conchars[256];		//conchars palette, 0 and 255 are tran
 uint32_t is_fullbright[256/32];
 
 static void GL_DeleteTexture (gltexture_t *texture);
+static void TexMgr_Bench_f (void);
 
 /*
 ================================================================================
@@ -695,6 +698,32 @@ void TexMgr_FreeTexturesForOwner (qmodel_t *owner)
 	}
 }
 
+/*
+================
+TexMgr_FreeSlots
+================
+*/
+int TexMgr_FreeSlots (void)
+{
+	return MAX_GLTEXTURES - numgltextures;
+}
+
+/*
+================
+TexMgr_TransferTextures
+
+Hands every texture of one owner over to another
+================
+*/
+void TexMgr_TransferTextures (qmodel_t *from, qmodel_t *to)
+{
+	gltexture_t *glt;
+
+	for (glt = active_gltextures; glt; glt = glt->next)
+		if (glt->owner == from)
+			glt->owner = to;
+}
+
 /*
 ================
 TexMgr_DeleteTextureObjects
@@ -812,6 +841,9 @@ void TexMgr_LoadPalette (void)
 	memcpy(d_8to24table_conchars, d_8to24table, 256*4);
 	((byte *) &d_8to24table_conchars[0]) [3] = 0;
 
+	// the alphabright palette holds both the colors and the fullbright mask
+	texcache_palhash = COM_HashBlock (d_8to24table_alphabright, sizeof (d_8to24table_alphabright));
+
 	Hunk_FreeToLowMark (mark);
 }
 
@@ -862,6 +894,7 @@ void TexMgr_Init (void)
 
 	Cvar_RegisterVariable (&gl_max_size);
 	Cvar_RegisterVariable (&gl_picmip);
+	Cvar_RegisterVariable (&gl_texcache);
 	gl_texturemode.string = glmodes[glmode_idx].name;
 	Cvar_RegisterVariable (&gl_texturemode);
 	Cvar_SetCallback (&gl_texturemode, &TexMgr_TextureMode_f);
@@ -882,6 +915,7 @@ void TexMgr_Init (void)
 	cmd = Cmd_AddCommand ("imagedump", &TexMgr_Imagedump_f);
 	if (cmd)
 		cmd->completion = TexMgr_Imagelist_Completion_f;
+	Cmd_AddCommand ("gl_texbench", &TexMgr_Bench_f);
 
 	// poll max size from hardware
 	glGetIntegerv (GL_MAX_TEXTURE_SIZE, &gl_max_texture_size);
@@ -963,7 +997,7 @@ static unsigned *TexMgr_MipMapW (unsigned *data, int width, int height, int dept
 	size = ((width*height)>>1)*depth;
 
 #ifdef USE_SSE2
-	while (size >= 4)
+	while (use_simd && size >= 4)
 	{
 		__m128i v0, v1, v2, v3;
 
@@ -1015,7 +1049,7 @@ static unsigned *TexMgr_MipMapH (unsigned *data, int width, int height, int dept
 	{
 		j = 0;
 #ifdef USE_SSE2
-		while (j + 16 <= width)
+		while (use_simd && j + 16 <= width)
 		{
 			__m128i v0, v1;
 
@@ -1067,6 +1101,19 @@ static void TexMgr_AlphaEdgeFix (byte *data, int width, int height)
 
 		for (j = 0; j < width; j++, dest += 4)
 		{
+#ifdef USE_SSE2
+			// skip runs of four opaque pixels at once
+			if (use_simd && j + 4 <= width)
+			{
+				__m128i alpha = _mm_srli_epi32 (_mm_loadu_si128 ((const __m128i *)dest), 24);
+				if (!_mm_movemask_epi8 (_mm_cmpeq_epi32 (alpha, _mm_setzero_si128 ())))
+				{
+					j += 3;
+					dest += 12;
+					continue;
+				}
+			}
+#endif
 			if (dest[3]) //not transparent
 				continue;
 
@@ -1185,13 +1232,97 @@ static unsigned *TexMgr_8to32 (byte *in, int pixels, unsigned int *usepal)
 	unsigned *out, *data;
 
 	out = data = (unsigned *) Hunk_AllocNoFill (pixels*4);
+	i = 0;
+
+#ifdef USE_SSE2
+	// no gather in SSE2, but one 16-byte store per four lookups still beats four scalar stores
+	if (use_simd)
+	{
+		for (; i + 4 <= pixels; i += 4, in += 4, out += 4)
+			_mm_storeu_si128 ((__m128i *)out, _mm_setr_epi32 (usepal[in[0]], usepal[in[1]], usepal[in[2]], usepal[in[3]]));
+	}
+#endif
 
-	for (i = 0; i < pixels; i++)
+	for (; i < pixels; i++)
 		*out++ = usepal[*in++];
 
 	return data;
 }
 
+/*
+================
+TexMgr_Bench_f
+
+gl_texbench [size] [runs]: times palette expansion, alpha edge fix and a
+full mip chain on a synthetic size x size image, once with the scalar code
+and once with the SIMD code, and checks that both produce the same pixels.
+================
+*/
+static void TexMgr_Bench_f (void)
+{
+	qboolean	simd = use_simd;
+	unsigned	*data, seed, hash[2];
+	double		start, elapsed[2];
+	byte		*src;
+	int			i, w, h, size, runs, pixels, pass, run, mark, runmark;
+
+	size = Cmd_Argc () >= 2 ? TexMgr_Pad (CLAMP (4, Q_atoi (Cmd_Argv (1)), 8192)) : 1024;
+	runs = Cmd_Argc () >= 3 ? q_max (Q_atoi (Cmd_Argv (2)), 1) : 10;
+	pixels = size * size;
+
+	// deterministic noise with about 1/8 transparent pixels
+	mark = Hunk_LowMark ();
+	src = (byte *) Hunk_AllocNoFill (pixels);
+	for (i = 0, seed = 1; i < pixels; i++)
+	{
+		seed = seed * 1103515245u + 12345u;
+		src[i] = (seed >> 29) ? (byte)((seed >> 16) % 255) : 255;
+	}
+
+	for (pass = 0; pass < 2; pass++)
+	{
+		use_simd = pass && simd;
+		hash[pass] = 0;
+		start = Sys_DoubleTime ();
+		for (run = 0; run < runs; run++)
+		{
+			runmark = Hunk_LowMark ();
+			data = TexMgr_8to32 (src, pixels, d_8to24table);
+			TexMgr_AlphaEdgeFix ((byte *)data, size, size);
+			if (run == 0)
+				hash[pass] = COM_HashBlock (data, pixels * 4);
+			for (w = h = size; w > 1 || h > 1; )
+			{
+				if (h > 1)
+				{
+					TexMgr_MipMapH (data, w, h, 1);
+					h >>= 1;
+				}
+				if (w > 1)
+				{
+					TexMgr_MipMapW (data, w, h, 1);
+					w >>= 1;
+				}
+				if (run == 0)
+					hash[pass] = hash[pass] * 31 + COM_HashBlock (data, w * h * 4);
+			}
+			Hunk_FreeToLowMark (runmark);
+		}
+		elapsed[pass] = Sys_DoubleTime () - start;
+	}
+	use_simd = simd;
+	Hunk_FreeToLowMark (mark);
+
+	Con_Printf ("%dx%d texture, %d run%s\n", size, size, PLURAL (runs));
+	Con_Printf ("  scalar: %8.3f ms/run\n", elapsed[0] * 1000.0 / runs);
+	if (!simd)
+		Con_Printf ("  simd:   n/a (r_simd is 0 or unsupported)\n");
+	else
+		Con_Printf ("  simd:   %8.3f ms/run (%.1f%%)\n", elapsed[1] * 1000.0 / runs, elapsed[0] > 0.0 ? 100.0 * elapsed[1] / elapsed[0] : 100.0);
+	if (hash[0] != hash[1])
+		Con_Warning ("scalar and simd output differ\n");
+}
+
 /*
 ================
 TexMgr_PadImageW -- return image with width padded up to power-of-two dimentions
@@ -1467,6 +1598,294 @@ static void TexMgr_LoadLightmap (gltexture_t *glt, byte *data)
 	TexMgr_SetFilterModes (glt);
 }
 
+/*
+================================================================================
+
+	PROCESSED TEXTURE DISK CACHE
+
+Final mip chains are kept under <gamedir>/texcache, keyed by a hash of the
+source pixels plus everything that affects conversion (palette, flags,
+picmip, size limits, compression), so warm loads skip palette conversion,
+padding, edge fixes and mipmapping and upload the stored levels directly.
+Compressed textures are stored as the blocks the driver produced.
+
+================================================================================
+*/
+
+#define TEXCACHE_IDENT		(('C'<<24)+('X'<<16)+('E'<<8)+'T')
+#define TEXCACHE_VERSION	1
+#define TEXCACHE_MAXLEVELS	16
+#define TEXCACHE_MINPIXELS	(64*64) // smaller images are cheaper to rebuild than to open
+
+typedef struct
+{
+	int			ident;
+	int			version;
+	unsigned	srchash;		// COM_HashBlock of the source pixels
+	unsigned	keyhash;		// COM_HashBlock of the texcachekey_t
+	int			internalformat;
+	int			compressed;
+	int			compression;
+	int			flags;			// false alpha detection may clear TEXPREF_ALPHA
+	int			width;
+	int			height;
+	int			numlevels;
+	int			levelsize[TEXCACHE_MAXLEVELS];
+} texcachehdr_t;
+
+typedef struct
+{
+	char		name[64];		// some fixups are name-based
+	unsigned	width;
+	unsigned	height;
+	int			format;
+	unsigned	flags;
+	int			picmip;
+	int			maxsize;
+	int			hwmaxsize;
+	int			compress;
+	int			fullbrights;
+	unsigned	palhash;
+} texcachekey_t;
+
+/*
+================
+TexMgr_CanCache
+================
+*/
+static qboolean TexMgr_CanCache (gltexture_t *glt, const byte *data)
+{
+	if (!gl_texcache.value || !data || glt->target != GL_TEXTURE_2D)
+		return false;
+	if (glt->source_format != SRC_INDEXED && glt->source_format != SRC_RGBA)
+		return false;
+	if (glt->flags & (TEXPREF_PERSIST | TEXPREF_OVERWRITE))
+		return false;
+	return glt->source_width * glt->source_height >= TEXCACHE_MINPIXELS;
+}
+
+/*
+================
+TexMgr_TextureCacheHash
+================
+*/
+static void TexMgr_TextureCacheHash (gltexture_t *glt, const byte *data, unsigned *srchash, unsigned *keyhash)
+{
+	extern cvar_t gl_fullbrights;
+	texcachekey_t key;
+	size_t size;
+
+	memset (&key, 0, sizeof (key));
+	q_strlcpy (key.name, glt->name, sizeof (key.name));
+	key.width = glt->source_width;
+	key.height = glt->source_height;
+	key.format = glt->source_format;
+	key.flags = glt->flags;
+	key.picmip = (glt->flags & TEXPREF_NOPICMIP) ? 0 : q_max ((int)gl_picmip.value, 0);
+	key.maxsize = (int)gl_max_size.value;
+	key.hwmaxsize = gl_max_texture_size;
+	key.compress = gl_compress_textures.value && TexMgr_CanCompress (glt);
+	key.fullbrights = gl_fullbrights.value != 0.f;
+	key.palhash = glt->source_format == SRC_INDEXED ? texcache_palhash : 0;
+
+	size = glt->source_width * glt->source_height;
+	if (glt->source_format == SRC_RGBA)
+		size *= 4;
+
+	*srchash = COM_HashBlock (data, size);
+	*keyhash = COM_HashBlock (&key, sizeof (key));
+}
+
+static void TexMgr_TextureCachePath (char *path, size_t pathsize, unsigned srchash, unsigned keyhash)
+{
+	q_snprintf (path, pathsize, "%s/texcache/%08x%08x.tex", com_gamedir, keyhash, srchash);
+}
+
+/*
+================
+TexMgr_ReadTextureCache -- uploads a cached mip chain, returns false on a miss
+================
+*/
+static qboolean TexMgr_ReadTextureCache (gltexture_t *glt, unsigned srchash, unsigned keyhash)
+{
+	char			path[MAX_OSPATH];
+	texcachehdr_t	hdr;
+	FILE			*f;
+	byte			*data;
+	int				i, w, h, mark, total;
+
+	TexMgr_TextureCachePath (path, sizeof (path), srchash, keyhash);
+	f = Sys_fopen (path, "rb");
+	if (!f)
+		return false;
+
+	if (fread (&hdr, sizeof (hdr), 1, f) != 1 ||
+		hdr.ident != TEXCACHE_IDENT ||
+		hdr.version != TEXCACHE_VERSION ||
+		hdr.srchash != srchash ||
+		hdr.keyhash != keyhash ||
+		hdr.width <= 0 || hdr.height <= 0 ||
+		hdr.numlevels <= 0 || hdr.numlevels > TEXCACHE_MAXLEVELS)
+	{
+		fclose (f);
+		return false;
+	}
+
+	total = 0;
+	for (i = 0, w = hdr.width, h = hdr.height; i < hdr.numlevels; i++, w = q_max (w >> 1, 1), h = q_max (h >> 1, 1))
+	{
+		if (hdr.levelsize[i] <= 0 || (!hdr.compressed && hdr.levelsize[i] != w * h * 4))
+		{
+			fclose (f);
+			return false;
+		}
+		total += hdr.levelsize[i];
+	}
+
+	mark = Hunk_LowMark ();
+	data = (byte *) Hunk_AllocNoFill (total);
+	if (fread (data, total, 1, f) != 1)
+	{
+		fclose (f);
+		Hunk_FreeToLowMark (mark);
+		return false;
+	}
+	fclose (f);
+
+	glt->width = hdr.width;
+	glt->height = hdr.height;
+	glt->flags = hdr.flags;
+	glt->compression = hdr.compression;
+	GL_Bind (GL_TEXTURE0, glt);
+
+	total = 0;
+	for (i = 0, w = hdr.width, h = hdr.height; i < hdr.numlevels; i++, w = q_max (w >> 1, 1), h = q_max (h >> 1, 1))
+	{
+		if (hdr.compressed)
+			GL_CompressedTexImage2DFunc (GL_TEXTURE_2D, i, hdr.internalformat, w, h, 0, hdr.levelsize[i], data + total);
+		else
+			glTexImage2D (GL_TEXTURE_2D, i, hdr.internalformat, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, data + total);
+		total += hdr.levelsize[i];
+	}
+
+	Hunk_FreeToLowMark (mark);
+
+	TexMgr_SetFilterModes (glt);
+
+	return true;
+}
+
+/*
+================
+TexMgr_WriteTextureCache -- reads back a freshly uploaded texture and stores it
+================
+*/
+static void TexMgr_WriteTextureCache (gltexture_t *glt, unsigned srchash, unsigned keyhash)
+{
+	char			path[MAX_OSPATH];
+	texcachehdr_t	hdr;
+	FILE			*f;
+	byte			*data;
+	GLint			param;
+	int				i, w, h, mark, total;
+
+	memset (&hdr, 0, sizeof (hdr));
+	hdr.ident = TEXCACHE_IDENT;
+	hdr.version = TEXCACHE_VERSION;
+	hdr.srchash = srchash;
+	hdr.keyhash = keyhash;
+	hdr.compression = glt->compression;
+	hdr.flags = glt->flags;
+	hdr.width = glt->width;
+	hdr.height = glt->height;
+	hdr.numlevels = (glt->flags & TEXPREF_MIPMAP) ? Q_log2 (q_max (glt->width, glt->height)) + 1 : 1;
+	if (hdr.numlevels > TEXCACHE_MAXLEVELS)
+		return;
+
+	GL_Bind (GL_TEXTURE0, glt);
+	glGetTexLevelParameteriv (GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &param);
+	hdr.internalformat = param;
+	glGetTexLevelParameteriv (GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &param);
+	hdr.compressed = param != 0;
+
+	total = 0;
+	for (i = 0, w = hdr.width, h = hdr.height; i < hdr.numlevels; i++, w = q_max (w >> 1, 1), h = q_max (h >> 1, 1))
+	{
+		if (hdr.compressed)
+		{
+			glGetTexLevelParameteriv (GL_TEXTURE_2D, i, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &param);
+			if (param <= 0)
+				return;
+			hdr.levelsize[i] = param;
+		}
+		else
+			hdr.levelsize[i] = w * h * 4;
+		total += hdr.levelsize[i];
+	}
+
+	mark = Hunk_LowMark ();
+	data = (byte *) Hunk_AllocNoFill (total);
+	total = 0;
+	for (i = 0; i < hdr.numlevels; i++)
+	{
+		if (hdr.compressed)
+			GL_GetCompressedTexImageFunc (GL_TEXTURE_2D, i, data + total);
+		else
+			glGetTexImage (GL_TEXTURE_2D, i, GL_RGBA, GL_UNSIGNED_BYTE, data + total);
+		total += hdr.levelsize[i];
+	}
+
+	TexMgr_TextureCachePath (path, sizeof (path), srchash, keyhash);
+	COM_CreatePath (path);
+	f = Sys_fopen (path, "wb");
+	if (f)
+	{
+		if (fwrite (&hdr, sizeof (hdr), 1, f) != 1 || fwrite (data, total, 1, f) != 1)
+		{
+			fclose (f);
+			Sys_remove (path);
+		}
+		else
+			fclose (f);
+	}
+
+	Hunk_FreeToLowMark (mark);
+}
+
+/*
+================
+TexMgr_UploadImage -- converts and uploads source data, going through the disk cache when possible
+================
+*/
+static void TexMgr_UploadImage (gltexture_t *glt, byte *data)
+{
+	unsigned srchash = 0, keyhash = 0;
+	qboolean cache = TexMgr_CanCache (glt, data);
+
+	if (cache)
+	{
+		TexMgr_TextureCacheHash (glt, data, &srchash, &keyhash);
+		if (TexMgr_ReadTextureCache (glt, srchash, keyhash))
+			return;
+	}
+
+	switch (glt->source_format)
+	{
+	case SRC_INDEXED:
+		TexMgr_LoadImage8 (glt, data);
+		break;
+	case SRC_LIGHTMAP:
+		TexMgr_LoadLightmap (glt, data);
+		break;
+	case SRC_RGBA:
+		TexMgr_LoadImage32 (glt, (unsigned *)data);
+		break;
+	}
+
+	if (cache)
+		TexMgr_WriteTextureCache (glt, srchash, keyhash);
+}
+
 /*
 ================
 TexMgr_LoadImageEx -- the one entry point for loading all textures
@@ -1538,18 +1957,7 @@ gltexture_t *TexMgr_LoadImageEx (qmodel_t *owner, const char *name, int width, i
 	//upload it
 	mark = Hunk_LowMark();
 
-	switch (glt->source_format)
-	{
-	case SRC_INDEXED:
-		TexMgr_LoadImage8 (glt, data);
-		break;
-	case SRC_LIGHTMAP:
-		TexMgr_LoadLightmap (glt, data);
-		break;
-	case SRC_RGBA:
-		TexMgr_LoadImage32 (glt, (unsigned *)data);
-		break;
-	}
+	TexMgr_UploadImage (glt, data);
 
 	GL_ObjectLabelFunc (GL_TEXTURE, glt->texnum, -1, glt->name);
 	if (flags & TEXPREF_BINDLESS && gl_bindless_able)
@@ -1701,18 +2109,7 @@ invalid:	Con_Printf ("TexMgr_ReloadImage: invalid source for %s\n", glt->name);
 	GL_DeleteTexture (glt);
 	glGenTextures (1, &glt->texnum);
 
-	switch (glt->source_format)
-	{
-	case SRC_INDEXED:
-		TexMgr_LoadImage8 (glt, data);
-		break;
-	case SRC_LIGHTMAP:
-		TexMgr_LoadLightmap (glt, data);
-		break;
-	case SRC_RGBA:
-		TexMgr_LoadImage32 (glt, (unsigned *)data);
-		break;
-	}
+	TexMgr_UploadImage (glt, data);
 
 	GL_ObjectLabelFunc (GL_TEXTURE, glt->texnum, -1, glt->name);
 	if (glt->flags & TEXPREF_BINDLESS && gl_bindless_able)
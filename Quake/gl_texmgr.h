@@ -140,6 +140,8 @@ gltexture_t *TexMgr_NewTexture (void);
 void TexMgr_FreeTexture (gltexture_t *kill);
 void TexMgr_FreeTextures (unsigned int flags, unsigned int mask);
 void TexMgr_FreeTexturesForOwner (qmodel_t *owner);
+void TexMgr_TransferTextures (qmodel_t *from, qmodel_t *to);
+int TexMgr_FreeSlots (void);
 void TexMgr_NewGame (void);
 void TexMgr_Init (void);
 void TexMgr_DeleteTextureObjects (void);
@@ -1376,6 +1376,8 @@ GL_EndRendering
 void GL_EndRendering (void)
 {
 	GL_PostProcess ();
+	if (!scr_skipupdate)
+		SCR_CaptureFrame ();
 	GL_ReleaseFrameResources ();
 
 	if (!scr_skipupdate)
@@ -46,7 +46,8 @@ void R_ReadPointFile_f (void);
 texture_t *R_TextureAnimation (texture_t *base, int frame);
 
 typedef enum {
-	pt_static, pt_grav, pt_slowgrav, pt_fire, pt_explode, pt_explode2, pt_blob, pt_blob2
+	pt_static, pt_grav, pt_slowgrav, pt_fire, pt_explode, pt_explode2, pt_blob, pt_blob2,
+	pt_numtypes
 } ptype_t;
 
 // !!! if this is changed, it must be changed in d_ifacea.h too !!!
@@ -153,6 +154,9 @@ extern	const char	*gl_version;
 	x(void,			UseProgram, (GLuint program))\
 	x(void,			LinkProgram, (GLuint program))\
 	x(void,			GetProgramInfoLog, (GLuint program, GLsizei bufSize, GLsizei *length, GLchar *infoLog))\
+	x(void,			GetProgramBinary, (GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary))\
+	x(void,			ProgramBinary, (GLuint program, GLenum binaryFormat, const void *binary, GLsizei length))\
+	x(void,			ProgramParameteri, (GLuint program, GLenum pname, GLint value))\
 	x(GLuint,		CreateShader, (GLenum type))\
 	x(void,			DeleteShader, (GLuint shader))\
 	x(void,			ShaderSource, (GLuint shader, GLsizei count, const GLchar* const *string, const GLint *length))\
@@ -201,6 +205,8 @@ extern	const char	*gl_version;
 	x(void,			MinSampleShading, (GLfloat value))\
 	x(void,			TexImage3D, (GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLenum format, GLenum type, const GLvoid *pixels))\
 	x(void,			TexSubImage3D, (GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, const GLvoid *pixels))\
+	x(void,			CompressedTexImage2D, (GLenum target, GLint level, GLenum internalFormat, GLsizei width, GLsizei height, GLint border, GLsizei imageSize, const GLvoid *data))\
+	x(void,			GetCompressedTexImage, (GLenum target, GLint level, GLvoid *img))\
 	x(void,			BindImageTexture, (GLuint unit, GLuint texture, GLint level, GLboolean layered, GLint layer, GLenum access, GLenum format))\
 	x(void,			MemoryBarrier, (GLbitfield barriers))\
 	x(void,			DispatchCompute, (GLuint num_groups_x, GLuint num_groups_y, GLuint num_groups_z))\
@@ -506,6 +512,7 @@ void GLMesh_LoadVertexBuffers (void);
 void GLMesh_DeleteVertexBuffers (void);
 
 int R_LightPoint (vec3_t p, float ofs, lightcache_t *cache);
+void R_ClearLightGrid (void);
 
 #define WORLDSHADER_SOLID		0
 #define WORLDSHADER_ALPHATEST	1
@@ -55,8 +55,6 @@ int		host_hunklevel;
 
 int		minimum_memory;
 
-client_t	*host_client;			// current client
-
 jmp_buf 	host_abortserver;
 
 byte		*host_colormap;
@@ -167,6 +165,7 @@ void Host_EndGame (const char *message, ...)
 	Con_DPrintf ("Host_EndGame: %s\n",string);
 
 	PR_SwitchQCVM(NULL);
+	SV_WaitInstanceFrames ();
 
 	if (sv.active)
 		Host_ShutdownServer (false);
@@ -195,11 +194,24 @@ void Host_ReportError (const char *error, ...)
 	char		string[1024];
 	static	qboolean inerror = false;
 
+	if (sv_context->instance)
+	{
+		// only takes down that server instance, which may be on a worker thread
+		va_start (argptr,error);
+		q_vsnprintf (string, sizeof(string), error, argptr);
+		va_end (argptr);
+		SV_AbortInstance (string);
+	}
+
 	if (inerror)
 		Sys_Error ("Host_Error: recursively entered");
 	inerror = true;
 
 	PR_SwitchQCVM(NULL);
+	Mod_AbortLoad ();	// before anything else allocates into a half-built model cache arena
+	SV_WaitInstanceFrames ();	// after the qcvm and arena are let go, the wait may run instance ticks here
+	PR_AbortBench ();	// before shutting down the server runs QC again
+	PR_AotAbort ();
 
 	SCR_EndLoadingPlaque ();		// reenable screen updates
 
@@ -653,12 +665,16 @@ void Host_ClearMemory (void)
 	}
 
 	Con_DPrintf ("Clearing memory\n");
+	Mod_AbortLoad ();
 	Mod_ClearAll ();
 	Sky_ClearAll();
 	PR_ClearProgs(&sv.qcvm);
 	PR_ClearProgs(&cl.qcvm);
+	if (sv.name[0] || cl.mapname[0])
+		Hunk_ReportPeaks (sv.name[0] ? sv.name : cl.mapname);
 /* host_hunklevel MUST be set at this point */
 	Hunk_FreeToLowMark (host_hunklevel);
+	Hunk_DiscardFree ();
 	cls.signon = 0; // not CL_ClearSignons()
 	memset (&sv, 0, sizeof(sv));
 
@@ -781,6 +797,9 @@ Host_GetFrameInterval
 */
 double Host_GetFrameInterval (void)
 {
+	if (SCR_CaptureFrameTime () > 0.0) // render captured frames as fast as possible
+		return 0.0;
+
 	if ((host_maxfps.value || cls.state == ca_disconnected) && !cls.timedemo)
 	{
 		float maxfps;
@@ -821,6 +840,10 @@ static void Host_AdvanceTime (double dt)
 		host_frametime = host_framerate.value;
 	else if (host_maxfps.value)// don't allow really long or short frames
 		host_frametime = CLAMP (0.0001, host_frametime, 0.1); //johnfitz -- use CLAMP
+
+	// frame capture advances the game by a fixed step per rendered frame
+	if (SCR_CaptureFrameTime () > 0.0)
+		host_frametime = SCR_CaptureFrameTime ();
 }
 
 /*
@@ -945,7 +968,6 @@ Host_ServerFrame
 void Host_ServerFrame (void)
 {
 	int		i, active; //johnfitz
-	edict_t	*ent; //johnfitz
 
 // run the world state
 	pr_global_struct->frametime = host_frametime;
@@ -967,12 +989,9 @@ void Host_ServerFrame (void)
 //johnfitz -- devstats
 	if (cls.signon == SIGNONS)
 	{
+		ED_FlushHotFields ();
 		for (i=0, active=0; i<qcvm->num_edicts; i++)
-		{
-			ent = EDICT_NUM(i);
-			if (!ent->free)
-				active++;
-		}
+			active += !qcvm->hot.free[i];
 		if (active > 600 && dev_peakstats.edicts <= 600)
 			Con_DWarning ("%i edicts exceeds standard limit of 600 (max = %d).\n", active, qcvm->max_edicts);
 		dev_stats.edicts = active;
@@ -1205,7 +1224,7 @@ Runs all active servers
 void _Host_Frame (double time)
 {
 	static double	accumtime = 0;
-	double time1, time2, time3;
+	double time1, time2, time3, tdtime;
 	qboolean ranserver = false;
 
 	time1 = Sys_DoubleTime ();
@@ -1276,12 +1295,14 @@ void _Host_Frame (double time)
 		CL_SendCmd ();
 
 		// Run server frame (frontend binary doesn't link server code)
+		SV_BeginInstanceFrames ();
 		if (sv.active)
 		{
 			PR_SwitchQCVM(&sv.qcvm);
 			Host_ServerFrame ();
 			PR_SwitchQCVM(NULL);
 		}
+		SV_EndInstanceFrames ();
 		host_frametime = realframetime;
 		Cbuf_Waited();
 		ranserver = true;
@@ -1304,10 +1325,16 @@ void _Host_Frame (double time)
 
 	if (!Host_IsHeadless())
 	{
+		tdtime = Sys_DoubleTime ();
 		SCR_UpdateScreen ();
-		CL_RunParticles (); //johnfitz -- seperated from rendering
+		CL_TimeDemoAddTime (TDSTAT_RENDER, Sys_DoubleTime () - tdtime);
 	}
 
+	// particles are client simulation, keep them running headless so benchmarks include them
+	tdtime = Sys_DoubleTime ();
+	CL_RunParticles (); //johnfitz -- seperated from rendering
+	CL_TimeDemoAddTime (TDSTAT_PARTICLES, Sys_DoubleTime () - tdtime);
+
 	if (host_speeds.value)
 		time3 = Sys_DoubleTime ();
 
@@ -1327,6 +1354,8 @@ void _Host_Frame (double time)
 		UpdateWindowTitle();
 	}
 
+	CL_TimeDemoEndFrame ();
+
 	if (host_speeds.value)
 	{
 		static double pass[3] = {0.0, 0.0, 0.0};
@@ -1425,6 +1454,7 @@ void Host_Init (void)
 	LOG_Init (host_parms);
 	Cvar_Init (); //johnfitz
 	COM_Init ();
+	Tasks_Init ();
 	COM_InitFilesystem ();
 	Host_InitLocal ();
 	W_LoadWadFile (); //johnfitz -- filename is now hard-coded for honesty
@@ -1469,6 +1499,8 @@ void Host_Init (void)
 			CDAudio_Init ();
 			BGM_Init();
 		}
+		else
+			R_InitParticles ();	// client-side particle simulation still runs
 
 		Sbar_Init ();
 		CL_Init ();  // Client runs even in headless mode
@@ -1504,6 +1536,7 @@ void Host_Init (void)
 	// johnfitz -- in case the vid mode was locked during vid_init, we can unlock it now.
 		// note: two leading newlines because the command buffer swallows one of them.
 		Cbuf_AddText ("\n\nvid_unlock\n");
+		CL_QueueBenchmark ();
 	}
 
 	if (cls.state == ca_dedicated)
@@ -1572,9 +1605,12 @@ void Host_Shutdown(void)
 		CDAudio_Shutdown ();
 		S_Shutdown ();
 		IN_Shutdown ();
+		SCR_ShutdownCapture ();
 		VID_Shutdown();
 	}
 
+	Tasks_Shutdown ();
+
 	LOG_Close ();
 
 	PluQ_Backend_Shutdown (); // PluQ: Shutdown IPC subsystem
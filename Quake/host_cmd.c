@@ -2682,6 +2682,7 @@ static void Host_Loadgame_f (void)
 
 	qcvm->num_edicts = entnum;
 	qcvm->time = time;
+	ED_InvalidateHotFields ();
 	sv.autosave.time = time;
 
 	free (start);
@@ -2743,6 +2744,7 @@ static void Host_Name_f (void)
 	}
 	Q_strcpy (host_client->name, newName);
 	host_client->edict->v.netname = PR_SetEngineString(host_client->name);
+	ED_TouchFindIndex (host_client->edict);
 
 // send notification to all clients
 	MSG_WriteByte (&sv.reliable_datagram, svc_updatename);
@@ -3079,6 +3081,7 @@ static void Host_Spawn_f (void)
 		ent->v.colormap = NUM_FOR_EDICT(ent);
 		ent->v.team = (host_client->colors & 15) + 1;
 		ent->v.netname = PR_SetEngineString(host_client->name);
+		ED_TouchFindIndex (ent);
 
 		// copy spawn parms out of the client_t
 		for (i=0 ; i< NUM_SPAWN_PARMS ; i++)
@@ -54,6 +54,7 @@ void Host_Init_PluQ_Frontend (void)
 	Cmd_Init ();
 	Cvar_Init (); //johnfitz
 	COM_Init ();
+	Tasks_Init ();
 	COM_InitFilesystem ();
 	Host_InitLocal ();  // Stubbed in stubs_pluq_frontend.c
 	W_LoadWadFile (); //johnfitz -- filename is now hard-coded for honesty
@@ -164,7 +165,10 @@ void Host_Shutdown_PluQ_Frontend(void)
 	// Note: Audio shutdown handled by main shutdown path
 	S_Shutdown ();
 	IN_Shutdown ();
+	SCR_ShutdownCapture ();
 	VID_Shutdown();
 
+	Tasks_Shutdown ();
+
 	LOC_Shutdown ();
 }
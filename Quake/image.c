@@ -96,6 +96,398 @@ static inline int Buf_GetC(stdio_buffer_t *buf)
 	return buf->buffer[buf->pos++];
 }
 
+//==============================================================================
+//
+//  PREFETCH
+//
+//  Image_AddPrefetch queues a group: a name, fallbacks that are only probed
+//  if the earlier names are missing, and variant suffixes (_glow, _luma) of
+//  which the first one present next to the name found is decoded too. The
+//  worker threads run at most a few groups ahead of the Image_LoadImage
+//  calls asking for them and stop early once the decoded images waiting to
+//  be picked up reach IMAGE_PREFETCH_BUDGET. Images are freed as soon as
+//  they are consumed, and groups the caller skipped are freed when it asks
+//  for a later one. Only the stb_image formats are decoded ahead of time;
+//  pcx and lmp files are small and load on demand.
+//
+//==============================================================================
+
+static const char *const stbi_formats[] = {"png", "tga", "jpg", NULL};
+
+#define PREFETCH_MAXNAMES		2
+#define PREFETCH_MAXVARIANTS	2
+#define IMAGE_PREFETCH_BUDGET	(256 * 1024 * 1024)	// decoded bytes waiting to be consumed
+
+typedef enum
+{
+	PREFETCH_MISSING,		// no file with that name
+	PREFETCH_DECODED,		// data holds the decoded image
+	PREFETCH_FAILED,		// file found but could not be decoded
+	PREFETCH_ONDEMAND,		// pcx/lmp, or already consumed
+} prefetchstatus_t;
+
+enum
+{
+	PREFETCH_QUEUED,
+	PREFETCH_RUNNING,
+	PREFETCH_DONE,
+	PREFETCH_ABANDONED,		// skipped by the caller, data is freed by whoever sees this last
+};
+
+typedef struct
+{
+	prefetchstatus_t	status;
+	int					ext;		// index into stbi_formats
+	byte				*data;		// malloc'ed by stb_image
+	int					width;
+	int					height;
+	const char			*error;
+} prefetchimage_t;
+
+typedef struct
+{
+	char				*names[PREFETCH_MAXNAMES];
+	char				*variants[PREFETCH_MAXVARIANTS];
+	int					numnames;
+	int					numvariants;
+	SDL_atomic_t		state;
+	taskbatch_t			*batch;		// NULL until submitted
+	int					item;
+	int					found;		// index into names, -1 = none
+	int					variant;	// index into variants, -1 = none
+	prefetchimage_t		image;
+	prefetchimage_t		varimage;
+} imageprefetch_t;
+
+static imageprefetch_t	*image_prefetch;
+static taskbatch_t		**image_prefetchbatches;
+static qboolean			image_prefetching;
+static int				image_prefetchsubmitted;	// groups handed to the workers
+static int				image_prefetchcursor;		// first group the caller may still ask for
+static SDL_atomic_t		image_prefetchbytes;
+
+static prefetchimage_t	image_prefetchmissing;		// PREFETCH_MISSING
+
+/*
+============
+Image_PrefetchProbe
+
+Looks for name in every format and decodes it if stb_image can, returns
+false if there is no such file
+============
+*/
+static qboolean Image_PrefetchProbe (const char *name, prefetchimage_t *img)
+{
+	char	filename[MAX_OSPATH];
+	FILE	*f;
+	int		i;
+
+	for (i = 0; stbi_formats[i]; i++)
+	{
+		q_snprintf (filename, sizeof (filename), "%s.%s", name, stbi_formats[i]);
+		COM_FOpenFileQuiet (filename, &f);
+		if (f)
+		{
+			img->ext = i;
+			img->data = stbi_load_from_file (f, &img->width, &img->height, NULL, 4);
+			if (img->data)
+			{
+				img->status = PREFETCH_DECODED;
+				SDL_AtomicAdd (&image_prefetchbytes, img->width * img->height * 4);
+			}
+			else
+			{
+				img->status = PREFETCH_FAILED;
+				img->error = stbi_failure_reason ();
+			}
+			fclose (f);
+			return true;
+		}
+	}
+
+	q_snprintf (filename, sizeof (filename), "%s.pcx", name);
+	if (!COM_FileExistsQuiet (filename))
+	{
+		q_snprintf (filename, sizeof (filename), "%s.lmp", name);
+		if (!COM_FileExistsQuiet (filename))
+			return false;
+	}
+	img->status = PREFETCH_ONDEMAND;
+	return true;
+}
+
+/*
+============
+Image_FreePrefetchImage
+============
+*/
+static void Image_FreePrefetchImage (prefetchimage_t *img)
+{
+	if (img->data)
+	{
+		SDL_AtomicAdd (&image_prefetchbytes, -img->width * img->height * 4);
+		free (img->data);
+		img->data = NULL;
+	}
+	if (img->status == PREFETCH_DECODED)
+		img->status = PREFETCH_ONDEMAND;
+}
+
+/*
+============
+Image_PrefetchTask
+============
+*/
+static void Image_PrefetchTask (int index, void *first)
+{
+	imageprefetch_t	*p = &image_prefetch[(intptr_t) first + index];
+	char			name[MAX_OSPATH];
+	int				i;
+
+	if (!SDL_AtomicCAS (&p->state, PREFETCH_QUEUED, PREFETCH_RUNNING))
+		return;	// skipped before it started
+
+	for (i = 0; i < p->numnames && p->found < 0; i++)
+		if (Image_PrefetchProbe (p->names[i], &p->image))
+			p->found = i;
+
+	if (p->found >= 0)
+	{
+		for (i = 0; i < p->numvariants && p->variant < 0; i++)
+		{
+			q_snprintf (name, sizeof (name), "%s%s", p->names[p->found], p->variants[i]);
+			if (Image_PrefetchProbe (name, &p->varimage))
+				p->variant = i;
+		}
+	}
+
+	if (!SDL_AtomicCAS (&p->state, PREFETCH_RUNNING, PREFETCH_DONE))
+	{	// skipped while we were decoding
+		Image_FreePrefetchImage (&p->image);
+		Image_FreePrefetchImage (&p->varimage);
+	}
+}
+
+/*
+============
+Image_AbandonPrefetch
+============
+*/
+static void Image_AbandonPrefetch (imageprefetch_t *p)
+{
+	if (SDL_AtomicCAS (&p->state, PREFETCH_QUEUED, PREFETCH_ABANDONED) ||
+		SDL_AtomicCAS (&p->state, PREFETCH_RUNNING, PREFETCH_ABANDONED))
+		return;	// the task frees whatever it decodes
+
+	if (SDL_AtomicGet (&p->state) == PREFETCH_DONE)
+	{
+		Image_FreePrefetchImage (&p->image);
+		Image_FreePrefetchImage (&p->varimage);
+		SDL_AtomicSet (&p->state, PREFETCH_ABANDONED);
+	}
+}
+
+/*
+============
+Image_PumpPrefetch
+
+Hands more groups to the workers, at least up to and including group need
+============
+*/
+static void Image_PumpPrefetch (int need)
+{
+	int first, count, ahead, total;
+
+	total = VEC_SIZE (image_prefetch);
+	ahead = 2 * Tasks_NumWorkers () + 2;
+	first = image_prefetchsubmitted = q_max (image_prefetchsubmitted, image_prefetchcursor);
+	for (count = 0; first + count < total; count++)
+	{
+		if (first + count > need &&
+			(first + count >= image_prefetchcursor + ahead ||
+			 SDL_AtomicGet (&image_prefetchbytes) >= IMAGE_PREFETCH_BUDGET))
+			break;
+		image_prefetch[first + count].item = count;
+	}
+	if (!count)
+		return;
+
+	VEC_PUSH (image_prefetchbatches, Tasks_Submit (Image_PrefetchTask, count, (void *)(intptr_t) first));
+	for (; image_prefetchsubmitted < first + count; image_prefetchsubmitted++)
+		image_prefetch[image_prefetchsubmitted].batch = VEC_LAST (image_prefetchbatches);
+}
+
+/*
+============
+Image_AddPrefetch
+============
+*/
+void Image_AddPrefetch (const char *name)
+{
+	imageprefetch_t p;
+
+	if (!Tasks_NumWorkers ())
+		return;
+	if (image_prefetching)
+		Image_EndPrefetch ();
+
+	memset (&p, 0, sizeof (p));
+	p.found = p.variant = -1;
+	VEC_PUSH (image_prefetch, p);
+	Image_AddPrefetchFallback (name);
+}
+
+/*
+============
+Image_AddPrefetchFallback
+
+name is only probed if the earlier names of the group are missing
+============
+*/
+void Image_AddPrefetchFallback (const char *name)
+{
+	imageprefetch_t *p;
+
+	if (!Tasks_NumWorkers () || image_prefetching || !VEC_SIZE (image_prefetch))
+		return;
+
+	p = &VEC_LAST (image_prefetch);
+	if (p->numnames == PREFETCH_MAXNAMES)
+		Sys_Error ("Image_AddPrefetchFallback: too many names for %s", p->names[0]);
+	p->names[p->numnames] = strdup (name);
+	if (!p->names[p->numnames])
+		Sys_Error ("Image_AddPrefetchFallback: out of memory");
+	p->numnames++;
+}
+
+/*
+============
+Image_AddPrefetchVariant
+
+the first of the variants present next to the name found is decoded too
+============
+*/
+void Image_AddPrefetchVariant (const char *suffix)
+{
+	imageprefetch_t *p;
+
+	if (!Tasks_NumWorkers () || image_prefetching || !VEC_SIZE (image_prefetch))
+		return;
+
+	p = &VEC_LAST (image_prefetch);
+	if (p->numvariants == PREFETCH_MAXVARIANTS)
+		Sys_Error ("Image_AddPrefetchVariant: too many variants for %s", p->names[0]);
+	p->variants[p->numvariants] = strdup (suffix);
+	if (!p->variants[p->numvariants])
+		Sys_Error ("Image_AddPrefetchVariant: out of memory");
+	p->numvariants++;
+}
+
+/*
+============
+Image_StartPrefetch
+============
+*/
+void Image_StartPrefetch (void)
+{
+	if (image_prefetching || !VEC_SIZE (image_prefetch))
+		return;
+
+	image_prefetching = true;
+	image_prefetchsubmitted = 0;
+	image_prefetchcursor = 0;
+	Image_PumpPrefetch (0);
+}
+
+/*
+============
+Image_EndPrefetch
+
+waits for outstanding decodes and drops everything that wasn't used
+============
+*/
+void Image_EndPrefetch (void)
+{
+	size_t i;
+	int j;
+
+	for (i = 0; i < VEC_SIZE (image_prefetchbatches); i++)
+		Tasks_Wait (image_prefetchbatches[i]);
+	VEC_CLEAR (image_prefetchbatches);
+	image_prefetching = false;
+
+	for (i = 0; i < VEC_SIZE (image_prefetch); i++)
+	{
+		imageprefetch_t *p = &image_prefetch[i];
+		Image_FreePrefetchImage (&p->image);
+		Image_FreePrefetchImage (&p->varimage);
+		for (j = 0; j < p->numnames; j++)
+			free (p->names[j]);
+		for (j = 0; j < p->numvariants; j++)
+			free (p->variants[j]);
+	}
+	VEC_CLEAR (image_prefetch);
+}
+
+/*
+============
+Image_FindPrefetch
+
+Returns the prefetched result for name, or NULL if it has to be loaded
+the usual way
+============
+*/
+static prefetchimage_t *Image_FindPrefetch (const char *name)
+{
+	imageprefetch_t	*p = NULL;
+	int				g, i, n = 0, v = -1, len, total;
+
+	if (!image_prefetching)
+		return NULL;
+
+	total = VEC_SIZE (image_prefetch);
+	for (g = image_prefetchcursor; g < total; g++)
+	{
+		p = &image_prefetch[g];
+		for (n = 0, v = -1; n < p->numnames; n++)
+		{
+			len = strlen (p->names[n]);
+			if (strncmp (name, p->names[n], len))
+				continue;
+			if (!name[len])
+				break;
+			for (v = 0; v < p->numvariants && strcmp (name + len, p->variants[v]); v++)
+				;
+			if (v < p->numvariants)
+				break;
+			v = -1;
+		}
+		if (n < p->numnames)
+			break;
+	}
+	if (g == total)
+		return NULL;
+
+	// the caller moved on, groups it skipped won't be asked for again
+	for (i = image_prefetchcursor; i < g; i++)
+		Image_AbandonPrefetch (&image_prefetch[i]);
+	image_prefetchcursor = g;
+	Image_PumpPrefetch (g);
+	Tasks_WaitItem (p->batch, p->item);
+
+	if (v < 0)
+	{
+		if (p->found < 0 || n < p->found)
+			return &image_prefetchmissing;
+		return n == p->found ? &p->image : NULL;
+	}
+	if (n != p->found)
+		return NULL;
+	if (p->variant < 0 || v < p->variant)
+		return &image_prefetchmissing;
+	return v == p->variant ? &p->varimage : NULL;
+}
+
 /*
 ============
 Image_LoadImage
@@ -105,10 +497,35 @@ returns a pointer to hunk allocated RGBA data
 */
 byte *Image_LoadImage (const char *name, int *width, int *height, enum srcformat *fmt)
 {
-	static const char *const stbi_formats[] = {"png", "tga", "jpg", NULL};
+	prefetchimage_t	*p;
 	FILE	*f;
 	int		i;
 
+	p = Image_FindPrefetch (name);
+	if (p && p->status != PREFETCH_ONDEMAND)
+	{
+		const char *ext = stbi_formats[p->ext];
+		byte *data = NULL;
+
+		q_snprintf (loadfilename, sizeof(loadfilename), "%s.%s", name, ext);
+		if (p->status == PREFETCH_DECODED)
+		{
+			*width = p->width;
+			*height = p->height;
+			data = (byte *) Hunk_AllocNameNoFill (p->width * p->height * 4, ext);
+			memcpy (data, p->data, p->width * p->height * 4);
+			Image_FreePrefetchImage (p);
+			*fmt = SRC_RGBA;
+			if ((developer.value || map_checks.value) && strcmp (ext, "tga") != 0)
+				Con_Warning ("%s not supported by QS, consider tga\n", loadfilename);
+		}
+		else if (p->status == PREFETCH_FAILED)
+			Con_Warning ("couldn't load %s (%s)\n", loadfilename, p->error);
+		else // the task looked it up quietly, report the miss from here
+			Con_DPrintf2 ("FindFile: can't find %s\n", name);
+		return data;
+	}
+
 	for (i = 0; stbi_formats[i]; i++)
 	{
 		const char *ext = stbi_formats[i];
@@ -436,7 +853,7 @@ qboolean Image_WriteJPG (const char *name, byte *data, int width, int height, in
 	return (error != 0);
 }
 
-qboolean Image_WritePNG (const char *name, byte *data, int width, int height, int bpp, qboolean upsidedown)
+qboolean Image_WritePNG (const char *name, byte *data, int width, int height, int bpp, qboolean upsidedown, const char **errortext)
 {
 	unsigned error;
 	char	pathname[MAX_OSPATH];
@@ -484,7 +901,8 @@ qboolean Image_WritePNG (const char *name, byte *data, int width, int height, in
 	if (error == 0)
 		error = lodepng_save_file (png, pngsize, pathname);
 #ifdef LODEPNG_COMPILE_ERROR_TEXT
-	else Con_Printf("WritePNG: %s\n", lodepng_error_text (error));
+	else if (errortext)
+		*errortext = lodepng_error_text (error);	// static string
 #endif
 
 	lodepng_state_cleanup (&state);
@@ -29,10 +29,17 @@ enum srcformat;
 //be sure to free the hunk after using this loading function
 byte *Image_LoadImage (const char *name, int *width, int *height, enum srcformat *fmt);
 
+//decode images on the worker threads ahead of the Image_LoadImage calls asking for them
+void Image_AddPrefetch (const char *name);
+void Image_AddPrefetchFallback (const char *name);
+void Image_AddPrefetchVariant (const char *suffix);
+void Image_StartPrefetch (void);
+void Image_EndPrefetch (void);
+
 byte* Image_CopyFlipped (const void *src, int width, int height, int bpp);
 
 qboolean Image_WriteTGA (const char *name, byte *data, int width, int height, int bpp, qboolean upsidedown);
-qboolean Image_WritePNG (const char *name, byte *data, int width, int height, int bpp, qboolean upsidedown);
+qboolean Image_WritePNG (const char *name, byte *data, int width, int height, int bpp, qboolean upsidedown, const char **errortext);
 qboolean Image_WriteJPG (const char *name, byte *data, int width, int height, int bpp, int quality, qboolean upsidedown);
 
 #endif	/* GL_IMAGE_H */
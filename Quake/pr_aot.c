@@ -0,0 +1,1088 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2010-2014 QuakeSpasm developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// pr_aot.c -- ahead-of-time translation of progs to native code
+
+#include "quakedef.h"
+#include <setjmp.h>
+
+/*
+===============================================================================
+
+AHEAD-OF-TIME PROGS
+
+pr_aot_export translates the loaded server progs into one C function per
+QC function and writes it to <gamedir>/aot/progs_<crc>_<hash>.c. Once that
+is compiled into a shared library next to it, PR_LoadProgs picks it up when
+pr_aot is set, and PR_ExecuteProgram and OP_CALL run the native version of
+any function that has one.
+
+Native code only does the arithmetic, loads, stores and branches itself.
+Function entry and exit still go through PR_EnterFunction/PR_LeaveFunction,
+so locals, the profiler and PR_RunError stack traces behave as before, and
+builtins, entity addressing and string compares call back into the engine.
+Runaway loops are caught by counting backward jumps.
+
+The interpreter stays the reference: with pr_aot 2, every top-level call
+first runs as a native trial. Entity fields are saved on their first write
+(PR_AotTouch, from native and interpreted code alike) so the trial can be
+rolled back, interpreted callees run as usual, and builtins that only
+compute a result into globals or temp strings run normally; random() hands
+its trial results to the interpreter run. A trial stops early at any other
+builtin or at an error. Globals and entities are then rolled back, the
+interpreter runs the function for real, and for calls that completed
+natively the globals and written entities of both runs are compared.
+pr_aot_info reports how many calls were compared and what stopped the rest.
+
+===============================================================================
+*/
+
+#define	QCAOT_VERSION	1
+
+// shared with the generated code, which gets this struct verbatim
+#define	QCAOT_CTX_FIELDS																\
+	void			*globals;															\
+	unsigned char	**edicts;		/* &qcvm->edicts */									\
+	int				entvarsofs;		/* offsetof (edict_t, v) */							\
+	int				budget;			/* backward jumps left before a runaway error */	\
+	void			(*call) (int fnum, int argc, int st);								\
+	int				(*address) (int ent, int field, int st);							\
+	int				(*strcmp) (int a, int b);											\
+	int				(*strempty) (int s);												\
+	void			(*state) (float frame, int think);									\
+	void			(*runaway) (int st);												\
+	void			(*badop) (int st);
+
+#define	QCAOT_STR2(x)	#x
+#define	QCAOT_STR(x)	QCAOT_STR2(x)
+
+struct qcaotctx_s
+{
+	QCAOT_CTX_FIELDS
+};
+
+#define	QCAOT_BUDGET	0x1000000
+
+#ifdef _WIN32
+#define	QCAOT_LIBEXT	".dll"
+#else
+#define	QCAOT_LIBEXT	".so"
+#endif
+
+const char *PR_GlobalStringNoContents (int ofs);
+
+cvar_t pr_aot = {"pr_aot", "0", CVAR_NONE};	// 1 = run native code, 2 = compare against the interpreter
+
+typedef enum
+{
+	AOT_IDLE,
+	AOT_TRIAL,			// native run that must not leave any trace
+	AOT_REFERENCE,		// interpreter run it's compared against
+} aotphase_t;
+
+static struct
+{
+	jmp_buf		abort;
+	aotphase_t	phase;
+	int			maxglobals;
+	int			*before;		// [maxglobals] globals before the call
+	int			*native;		// [maxglobals] globals after the trial
+	int			maxmarks;
+	byte		*marks;			// [maxmarks] entities in touched
+	int			*touched;		// entities written since the call started
+	int			numtrial;		// how many of them the trial wrote
+	byte		*saved;			// fields of each touched entity before its first write
+	byte		*nativeents;	// fields of the entities the trial wrote, after the trial
+	float		*randoms;		// random() results of the trial, replayed by the interpreter
+	size_t		nextrandom;
+	int			skipreason;		// builtin number that stopped the trial, -1 for an error
+	qcaotfunc_t	*funcs;			// native code, hidden from the interpreter run
+	byte		replayable[MAX_BUILTINS];
+
+	int			compared;
+	int			mismatched;
+	int			skipped;
+	int			skiperrors;
+	int			skipbuiltins[MAX_BUILTINS];
+} aot_diff;
+
+THREAD_LOCAL qboolean pr_aot_tracking;	// only ever set on the main thread, instances never compare
+
+// builtins that only read the world and write globals or temp strings
+static const char *const pr_aot_replayable[] =
+{
+	"makevectors", "random", "normalize", "vlen", "vectoyaw", "vectoangles", "vectorvectors",
+	"traceline", "aim", "checkbottom", "pointcontents", "find", "nextent", "cvar",
+	"ftos", "vtos", "etos", "stof", "stov", "strlen", "strcat", "substring",
+	"str2chr", "chr2str", "strconv", "sprintf",
+	"rint", "floor", "ceil", "fabs", "sin", "cos", "sqrt", "pow", "min", "max", "bound",
+	"mod", "ftoi", "itof", "asin", "acos", "atan", "atan2", "tan",
+};
+
+/*
+=================
+PR_AotSkip
+
+Called before anything a trial run couldn't take back, errors included
+=================
+*/
+static void PR_AotSkip (int builtin)
+{
+	if (!pr_aot_tracking || aot_diff.phase != AOT_TRIAL)
+		return;
+	aot_diff.skipreason = builtin;
+	longjmp (aot_diff.abort, 1);
+}
+
+/*
+=================
+PR_AotRunError
+
+PR_RunError during a trial: leave raising it to the interpreter
+=================
+*/
+void PR_AotRunError (void)
+{
+	PR_AotSkip (-1);
+}
+
+/*
+=================
+PR_AotBuiltin
+
+Stops a trial before a builtin that does more than PR_AotTouch can take back
+=================
+*/
+void PR_AotBuiltin (int num)
+{
+	if (!aot_diff.replayable[num])
+		PR_AotSkip (num);
+}
+
+/*
+=================
+PR_AotTouch
+
+Saves the fields of an entity QC is about to write, once per compared call
+=================
+*/
+void PR_AotTouch (edict_t *ed)
+{
+	int num = NUM_FOR_EDICT (ed);
+
+	if (aot_diff.phase == AOT_IDLE || num >= aot_diff.maxmarks || aot_diff.marks[num])
+		return;
+	aot_diff.marks[num] = 1;
+	VEC_PUSH (aot_diff.touched, num);
+	Vec_Append ((void **) &aot_diff.saved, 1, &ed->v, qcvm->progs->entityfields * 4);
+}
+
+/*
+=================
+PR_AotRandom
+
+Makes the interpreter see the same random() results as the trial before it
+=================
+*/
+float PR_AotRandom (float num)
+{
+	if (!pr_aot_tracking)
+		return num;
+	if (aot_diff.phase == AOT_TRIAL)
+		VEC_PUSH (aot_diff.randoms, num);
+	else if (aot_diff.phase == AOT_REFERENCE && aot_diff.nextrandom < VEC_SIZE (aot_diff.randoms))
+		num = aot_diff.randoms[aot_diff.nextrandom++];
+	return num;
+}
+
+/*
+=================
+PR_AotRollback
+
+Restores the touched entities to their state before the call
+=================
+*/
+static void PR_AotRollback (void)
+{
+	size_t	i, fieldsize = qcvm->progs->entityfields * 4;
+
+	for (i = 0; i < VEC_SIZE (aot_diff.touched); i++)
+		memcpy (&EDICT_NUM (aot_diff.touched[i])->v, aot_diff.saved + i * fieldsize, fieldsize);
+}
+
+/*
+=================
+PR_AotForget
+=================
+*/
+static void PR_AotForget (void)
+{
+	size_t i;
+
+	for (i = 0; i < VEC_SIZE (aot_diff.touched); i++)
+		aot_diff.marks[aot_diff.touched[i]] = 0;
+	VEC_CLEAR (aot_diff.touched);
+	VEC_CLEAR (aot_diff.saved);
+	VEC_CLEAR (aot_diff.nativeents);
+	VEC_CLEAR (aot_diff.randoms);
+	aot_diff.nextrandom = 0;
+	aot_diff.numtrial = 0;
+	aot_diff.phase = AOT_IDLE;
+	pr_aot_tracking = false;
+}
+
+/*
+=================
+PR_AotAbort
+
+Host_Error during a compared call: put back what a trial changed
+=================
+*/
+void PR_AotAbort (void)
+{
+	if (aot_diff.phase == AOT_IDLE)
+		return;
+	if (aot_diff.phase == AOT_TRIAL && sv.qcvm.progs)
+	{
+		qcvm_t *oldvm;
+		PR_PushQCVM (&sv.qcvm, &oldvm);
+		PR_AotRollback ();
+		memcpy (qcvm->globals, aot_diff.before, qcvm->progs->numglobals * sizeof (int));
+		PR_PopQCVM (oldvm);
+	}
+	else if (aot_diff.phase == AOT_REFERENCE)
+		sv.qcvm.aotfuncs = aot_diff.funcs;
+	PR_AotForget ();
+}
+
+/*
+===============================================================================
+
+RUNTIME
+
+===============================================================================
+*/
+
+/*
+=================
+PR_AotRun
+
+Runs a function that has native code, stack frame and all
+=================
+*/
+void PR_AotRun (dfunction_t *f)
+{
+	int budget = qcvm->aotctx->budget;
+
+	if (qcvm->depth + 1 >= MAX_STACK_DEPTH || qcvm->localstack_used + f->locals > LOCALSTACK_SIZE)
+		PR_AotSkip (-1);	// let the interpreter raise the error
+
+	qcvm->aotctx->budget = QCAOT_BUDGET;
+	PR_EnterFunction (f);
+	qcvm->aotfuncs[f - qcvm->functions] (qcvm->aotctx);
+	PR_LeaveFunction ();
+	qcvm->aotctx->budget = budget;
+}
+
+static void PR_AotCall (int fnum, int argc, int st)
+{
+	dfunction_t *newf;
+
+	qcvm->xstatement = st;
+	qcvm->argc = argc;
+	if (!fnum || fnum < 0 || fnum >= qcvm->progs->numfunctions)
+		PR_AotSkip (-1);
+	if (!fnum)
+		PR_RunError ("NULL function");
+	if (fnum < 0 || fnum >= qcvm->progs->numfunctions)
+		PR_RunError ("Bad function number %d", fnum);
+
+	newf = &qcvm->functions[fnum];
+	if (newf->first_statement < 0)
+	{ // Built-in function
+		int i = -newf->first_statement;
+		if (i >= qcvm->numbuiltins)
+			PR_RunError ("Bad builtin call number %d", i);
+		PR_AotBuiltin (i);
+		PR_CheckBuiltinExtension (newf);
+		qcvm->builtins[i] ();
+		return;
+	}
+
+	if (qcvm->aotfuncs[fnum])
+		PR_AotRun (newf);
+	else
+		PR_ExecuteProgram (fnum);
+}
+
+static int PR_AotAddress (int ent, int field, int st)
+{
+	edict_t *ed;
+
+	ed = PROG_TO_EDICT (ent);
+	if (ed == (edict_t *)qcvm->edicts && sv.state == ss_active)
+	{
+		qcvm->xstatement = st;
+		PR_RunError ("assignment to world entity");
+	}
+	if (pr_aot_tracking)
+		PR_AotTouch (ed);
+	if ((unsigned int)field < ED_HOTFIELDTABLE && ed_hotfield[field])
+		ED_MarkHotFields (ed);
+	if (qcvm->find.fieldindex && (unsigned int)field < (unsigned int)qcvm->progs->entityfields && qcvm->find.fieldindex[field])
+		ED_FindIndexStore (ed, field);
+
+	return (byte *)((int *)&ed->v + field) - (byte *)qcvm->edicts;
+}
+
+static int PR_AotStrcmp (int a, int b)
+{
+	return strcmp (PR_GetString (a), PR_GetString (b));
+}
+
+static int PR_AotStrEmpty (int s)
+{
+	return !s || !*PR_GetString (s);
+}
+
+static void PR_AotState (float frame, int think)
+{
+	edict_t *ed;
+
+	ed = PROG_TO_EDICT (pr_global_struct->self);
+	if (pr_aot_tracking)
+		PR_AotTouch (ed);
+	ed->v.nextthink = pr_global_struct->time + 0.1;
+	ed->v.frame = frame;
+	ed->v.think = think;
+}
+
+static void PR_AotRunaway (int st)
+{
+	PR_AotSkip (-1);
+	qcvm->xstatement = st;
+	PR_RunError ("runaway loop error");
+}
+
+static void PR_AotBadOp (int st)
+{
+	PR_AotSkip (-1);
+	qcvm->xstatement = st;
+	PR_RunError ("Bad opcode %i", qcvm->statements[st].op);
+}
+
+/*
+=================
+PR_AotSameWord
+
+Temp strings get a new slot in each run, compare what they say
+=================
+*/
+static qboolean PR_AotSameWord (int a, int b)
+{
+	if (a == b)
+		return true;
+	if (a < 0 && b < 0 && a >= -qcvm->numknownstrings && b >= -qcvm->numknownstrings &&
+		qcvm->knownstrings[-1 - a] && qcvm->knownstrings[-1 - b])
+		return !strcmp (qcvm->knownstrings[-1 - a], qcvm->knownstrings[-1 - b]);
+	return false;
+}
+
+/*
+=================
+PR_AotCheck
+
+Compares the interpreter's results with the trial's, reports the first difference
+=================
+*/
+static void PR_AotCheck (dfunction_t *f)
+{
+	int		numglobals = qcvm->progs->numglobals;
+	int		numfields = qcvm->progs->entityfields;
+	int		i, j, num;
+	int		*words, *native;
+
+	for (i = 0; i < numglobals; i++)
+	{
+		if (PR_AotSameWord (aot_diff.native[i], ((int *)qcvm->globals)[i]))
+			continue;
+		aot_diff.mismatched++;
+		Con_Printf ("pr_aot: %s differs at global %d%s: interpreter %g, native %g\n",
+			PR_GetString (f->s_name), i, PR_GlobalStringNoContents (i),
+			qcvm->globals[i], *(float *)&aot_diff.native[i]);
+		return;
+	}
+
+	for (i = 0; i < (int) VEC_SIZE (aot_diff.touched); i++)
+	{
+		num = aot_diff.touched[i];
+		if (i >= aot_diff.numtrial)
+		{
+			aot_diff.mismatched++;
+			Con_Printf ("pr_aot: %s writes entity %d only when interpreted\n", PR_GetString (f->s_name), num);
+			return;
+		}
+
+		words = (int *) &EDICT_NUM (num)->v;
+		native = (int *) (aot_diff.nativeents + i * numfields * 4);
+		for (j = 0; j < numfields; j++)
+		{
+			if (PR_AotSameWord (native[j], words[j]))
+				continue;
+			aot_diff.mismatched++;
+			Con_Printf ("pr_aot: %s differs at entity %d field %d: interpreter %g, native %g\n",
+				PR_GetString (f->s_name), num, j, *(float *)&words[j], *(float *)&native[j]);
+			return;
+		}
+	}
+}
+
+/*
+=================
+PR_AotCompare
+
+pr_aot 2: trial native run, then the interpreter for real
+=================
+*/
+static void PR_AotCompare (dfunction_t *f)
+{
+	int			numglobals = qcvm->progs->numglobals;
+	size_t		fieldsize = qcvm->progs->entityfields * 4;
+	int			depth, localstack_used, xstatement, i;
+	dfunction_t	*xfunction;
+	qboolean	profiling, completed;
+
+	if (aot_diff.maxglobals < numglobals)
+	{
+		free (aot_diff.before);
+		aot_diff.before = (int *) malloc (numglobals * sizeof (int) * 2);
+		if (!aot_diff.before)
+			Sys_Error ("PR_AotCompare: out of memory");
+		aot_diff.native = aot_diff.before + numglobals;
+		aot_diff.maxglobals = numglobals;
+	}
+	if (aot_diff.maxmarks < qcvm->max_edicts)
+	{
+		free (aot_diff.marks);
+		aot_diff.marks = (byte *) calloc (qcvm->max_edicts, 1);
+		if (!aot_diff.marks)
+			Sys_Error ("PR_AotCompare: out of memory");
+		aot_diff.maxmarks = qcvm->max_edicts;
+	}
+
+	memcpy (aot_diff.before, qcvm->globals, numglobals * sizeof (int));
+	depth = qcvm->depth;
+	localstack_used = qcvm->localstack_used;
+	xfunction = qcvm->xfunction;
+	xstatement = qcvm->xstatement;
+	profiling = qcvm->profiling;
+	qcvm->profiling = false;
+
+	aot_diff.phase = AOT_TRIAL;
+	pr_aot_tracking = true;
+	completed = !setjmp (aot_diff.abort);
+	if (completed)
+	{
+		PR_AotRun (f);
+		memcpy (aot_diff.native, qcvm->globals, numglobals * sizeof (int));
+		aot_diff.numtrial = VEC_SIZE (aot_diff.touched);
+		for (i = 0; i < aot_diff.numtrial; i++)
+			Vec_Append ((void **) &aot_diff.nativeents, 1, &EDICT_NUM (aot_diff.touched[i])->v, fieldsize);
+	}
+
+	PR_AotRollback ();
+	memcpy (qcvm->globals, aot_diff.before, numglobals * sizeof (int));
+	qcvm->depth = depth;
+	qcvm->localstack_used = localstack_used;
+	qcvm->xfunction = xfunction;
+	qcvm->xstatement = xstatement;
+	qcvm->profiling = profiling;
+
+	// reference run, without native code anywhere below it
+	aot_diff.phase = AOT_REFERENCE;
+	aot_diff.funcs = qcvm->aotfuncs;
+	qcvm->aotfuncs = NULL;
+	PR_ExecuteProgram (f - qcvm->functions);
+	qcvm->aotfuncs = aot_diff.funcs;
+
+	if (completed)
+	{
+		aot_diff.compared++;
+		PR_AotCheck (f);
+	}
+	else
+	{
+		aot_diff.skipped++;
+		if (aot_diff.skipreason >= 0)
+			aot_diff.skipbuiltins[aot_diff.skipreason]++;
+		else
+			aot_diff.skiperrors++;
+	}
+
+	PR_AotForget ();
+}
+
+/*
+=================
+PR_AotExecute
+
+Returns false if the caller should interpret the function instead.
+Used for top-level calls and interpreted OP_CALLs alike, the reference
+half of a compare never gets here since it runs with aotfuncs cleared.
+=================
+*/
+qboolean PR_AotExecute (dfunction_t *f)
+{
+	if (pr_aot.value <= 0)
+		return false;
+
+	if (pr_aot.value >= 2 && !sv_context->instance && aot_diff.phase == AOT_IDLE)
+		PR_AotCompare (f);
+	else
+		PR_AotRun (f);
+
+	return true;
+}
+
+/*
+===============================================================================
+
+LOADING
+
+===============================================================================
+*/
+
+static unsigned PR_AotHash (void)
+{
+	unsigned hash = COM_HashBlock (qcvm->statements, qcvm->progs->numstatements * sizeof (dstatement_t));
+	return hash ^ (qcvm->progs->numfunctions * 2654435761u) ^ qcvm->progs->numglobals;
+}
+
+static void PR_AotPath (char *path, size_t size, const char *ext)
+{
+	q_snprintf (path, size, "%s/aot/progs_%04x_%08x%s", com_gamedir, qcvm->crc, PR_AotHash (), ext);
+}
+
+/*
+=================
+PR_AotLoad
+
+Looks for a compiled translation of the progs that were just loaded
+=================
+*/
+void PR_AotLoad (void)
+{
+	char		path[MAX_OSPATH];
+	void		*lib;
+	const int	*version, *numfunctions;
+	const unsigned *hash;
+	qcaotfunc_t	*funcs;
+	qcaotctx_t	*ctx;
+	int			i, count;
+
+	if (!pr_aot.value || qcvm != &sv.qcvm)
+		return;
+
+	PR_AotPath (path, sizeof (path), QCAOT_LIBEXT);
+	if (!Sys_FileExists (path))
+		return;
+
+	lib = Sys_LoadLibrary (path);
+	if (!lib)
+	{
+		Con_Warning ("pr_aot: couldn't load %s\n", path);
+		return;
+	}
+
+	version = (const int *) Sys_GetLibraryFunction (lib, "qcaot_version");
+	hash = (const unsigned *) Sys_GetLibraryFunction (lib, "qcaot_hash");
+	numfunctions = (const int *) Sys_GetLibraryFunction (lib, "qcaot_numfunctions");
+	funcs = (qcaotfunc_t *) Sys_GetLibraryFunction (lib, "qcaot_funcs");
+	if (!version || !hash || !numfunctions || !funcs ||
+		*version != QCAOT_VERSION || *hash != PR_AotHash () || *numfunctions != qcvm->progs->numfunctions)
+	{
+		Con_Warning ("pr_aot: %s doesn't match the loaded progs\n", path);
+		Sys_CloseLibrary (lib);
+		return;
+	}
+
+	ctx = (qcaotctx_t *) calloc (1, sizeof (*ctx));
+	if (!ctx)
+		Sys_Error ("PR_AotLoad: out of memory");
+	ctx->globals = qcvm->globals;
+	ctx->edicts = (unsigned char **) &qcvm->edicts;
+	ctx->entvarsofs = offsetof (edict_t, v);
+	ctx->budget = QCAOT_BUDGET;
+	ctx->call = PR_AotCall;
+	ctx->address = PR_AotAddress;
+	ctx->strcmp = PR_AotStrcmp;
+	ctx->strempty = PR_AotStrEmpty;
+	ctx->state = PR_AotState;
+	ctx->runaway = PR_AotRunaway;
+	ctx->badop = PR_AotBadOp;
+
+	for (i = 0, count = 0; i < qcvm->progs->numfunctions; i++)
+		count += funcs[i] != NULL;
+
+	memset (aot_diff.replayable, 0, sizeof (aot_diff.replayable));
+	for (i = 0; i < pr_numbuiltindefs; i++)
+	{
+		builtindef_t *def = &pr_builtindefs[i];
+		int j, k;
+
+		for (j = 0; j < (int) countof (pr_aot_replayable) && strcmp (def->name, pr_aot_replayable[j]); j++)
+			;
+		if (j == (int) countof (pr_aot_replayable) || !def->ssqcfunc)
+			continue;
+		for (k = 0; k < qcvm->numbuiltins; k++)
+			if (qcvm->builtins[k] == def->ssqcfunc)
+				aot_diff.replayable[k] = true;
+	}
+
+	qcvm->aotlib = lib;
+	qcvm->aotfuncs = funcs;
+	qcvm->aotctx = ctx;
+
+	Con_DPrintf ("pr_aot: %d native functions from %s\n", count, path);
+}
+
+/*
+=================
+PR_AotFree
+=================
+*/
+void PR_AotFree (qcvm_t *vm)
+{
+	if (vm->aotlib)
+		Sys_CloseLibrary (vm->aotlib);
+	free (vm->aotctx);
+	vm->aotlib = NULL;
+	vm->aotfuncs = NULL;
+	vm->aotctx = NULL;
+}
+
+/*
+===============================================================================
+
+TRANSLATION
+
+===============================================================================
+*/
+
+/*
+=================
+PR_AotFunctionBody
+
+Marks the statements reachable from the first one, and the jump targets
+among them, which all lie within [*lo, *hi]
+=================
+*/
+static qboolean PR_AotFunctionBody (int first, byte *reached, byte *target, int *stack, int *lo, int *hi)
+{
+	int numstatements = qcvm->progs->numstatements;
+	int sp = 0, n, next[2], count, i;
+
+	if (first <= 0 || first >= numstatements)
+		return false;
+
+	stack[sp++] = first;
+	reached[first] = 1;
+	target[first] = 1;	// entry point
+	*lo = *hi = first;
+	while (sp)
+	{
+		dstatement_t *st;
+
+		n = stack[--sp];
+		*lo = q_min (*lo, n);
+		*hi = q_max (*hi, n);
+		st = &qcvm->statements[n];
+		count = 0;
+		switch (st->op)
+		{
+		case OP_DONE:
+		case OP_RETURN:
+			break;
+		case OP_GOTO:
+			next[count++] = n + st->a;
+			break;
+		case OP_IF:
+		case OP_IFNOT:
+			next[count++] = n + st->b;
+			next[count++] = n + 1;
+			break;
+		default:
+			next[count++] = n + 1;
+			break;
+		}
+
+		for (i = 0; i < count; i++)
+		{
+			if (next[i] <= 0 || next[i] >= numstatements)
+				continue;	// emitted as a bad opcode error
+			if (next[i] != n + 1)
+				target[next[i]] = 1;
+			if (!reached[next[i]])
+			{
+				reached[next[i]] = 1;
+				stack[sp++] = next[i];
+			}
+		}
+	}
+
+	return true;
+}
+
+static void PR_AotJump (FILE *f, int from, int to)
+{
+	if (to <= 0 || to >= qcvm->progs->numstatements)
+	{
+		fprintf (f, "ctx->badop (%d); return;", from);
+		return;
+	}
+	if (to <= from)
+		fprintf (f, "{ if (--ctx->budget < 0) ctx->runaway (%d); goto L%d; }", from, to);
+	else
+		fprintf (f, "goto L%d;", to);
+}
+
+static void PR_AotStatement (FILE *f, int n)
+{
+	dstatement_t	*st = &qcvm->statements[n];
+	int				a = (unsigned short) st->a;
+	int				b = (unsigned short) st->b;
+	int				c = (unsigned short) st->c;
+
+	fprintf (f, "\t");
+	switch (st->op)
+	{
+	case OP_ADD_F:	fprintf (f, "F(%d) = F(%d) + F(%d);", c, a, b); break;
+	case OP_SUB_F:	fprintf (f, "F(%d) = F(%d) - F(%d);", c, a, b); break;
+	case OP_MUL_F:	fprintf (f, "F(%d) = F(%d) * F(%d);", c, a, b); break;
+	case OP_DIV_F:	fprintf (f, "F(%d) = F(%d) / F(%d);", c, a, b); break;
+	case OP_ADD_V:
+	case OP_SUB_V:
+		fprintf (f, "F(%d) = F(%d) %c F(%d); F(%d) = F(%d) %c F(%d); F(%d) = F(%d) %c F(%d);",
+			c, a, st->op == OP_ADD_V ? '+' : '-', b,
+			c + 1, a + 1, st->op == OP_ADD_V ? '+' : '-', b + 1,
+			c + 2, a + 2, st->op == OP_ADD_V ? '+' : '-', b + 2);
+		break;
+	case OP_MUL_V:
+		fprintf (f, "F(%d) = F(%d) * F(%d) + F(%d) * F(%d) + F(%d) * F(%d);", c, a, b, a + 1, b + 1, a + 2, b + 2);
+		break;
+	case OP_MUL_FV:
+		fprintf (f, "F(%d) = F(%d) * F(%d); F(%d) = F(%d) * F(%d); F(%d) = F(%d) * F(%d);",
+			c, a, b, c + 1, a, b + 1, c + 2, a, b + 2);
+		break;
+	case OP_MUL_VF:
+		fprintf (f, "F(%d) = F(%d) * F(%d); F(%d) = F(%d) * F(%d); F(%d) = F(%d) * F(%d);",
+			c, b, a, c + 1, b, a + 1, c + 2, b, a + 2);
+		break;
+	case OP_BITAND:	fprintf (f, "F(%d) = (int)F(%d) & (int)F(%d);", c, a, b); break;
+	case OP_BITOR:	fprintf (f, "F(%d) = (int)F(%d) | (int)F(%d);", c, a, b); break;
+	case OP_GE:		fprintf (f, "F(%d) = F(%d) >= F(%d);", c, a, b); break;
+	case OP_LE:		fprintf (f, "F(%d) = F(%d) <= F(%d);", c, a, b); break;
+	case OP_GT:		fprintf (f, "F(%d) = F(%d) > F(%d);", c, a, b); break;
+	case OP_LT:		fprintf (f, "F(%d) = F(%d) < F(%d);", c, a, b); break;
+	case OP_AND:	fprintf (f, "F(%d) = F(%d) && F(%d);", c, a, b); break;
+	case OP_OR:		fprintf (f, "F(%d) = F(%d) || F(%d);", c, a, b); break;
+	case OP_NOT_F:	fprintf (f, "F(%d) = !F(%d);", c, a); break;
+	case OP_NOT_V:	fprintf (f, "F(%d) = !F(%d) && !F(%d) && !F(%d);", c, a, a + 1, a + 2); break;
+	case OP_NOT_S:	fprintf (f, "F(%d) = ctx->strempty (I(%d));", c, a); break;
+	case OP_NOT_FNC:
+	case OP_NOT_ENT:fprintf (f, "F(%d) = !I(%d);", c, a); break;
+	case OP_EQ_F:	fprintf (f, "F(%d) = F(%d) == F(%d);", c, a, b); break;
+	case OP_NE_F:	fprintf (f, "F(%d) = F(%d) != F(%d);", c, a, b); break;
+	case OP_EQ_V:
+		fprintf (f, "F(%d) = (F(%d) == F(%d)) && (F(%d) == F(%d)) && (F(%d) == F(%d));", c, a, b, a + 1, b + 1, a + 2, b + 2);
+		break;
+	case OP_NE_V:
+		fprintf (f, "F(%d) = (F(%d) != F(%d)) || (F(%d) != F(%d)) || (F(%d) != F(%d));", c, a, b, a + 1, b + 1, a + 2, b + 2);
+		break;
+	case OP_EQ_S:	fprintf (f, "F(%d) = !ctx->strcmp (I(%d), I(%d));", c, a, b); break;
+	case OP_NE_S:	fprintf (f, "F(%d) = ctx->strcmp (I(%d), I(%d));", c, a, b); break;
+	case OP_EQ_E:
+	case OP_EQ_FNC:	fprintf (f, "F(%d) = I(%d) == I(%d);", c, a, b); break;
+	case OP_NE_E:
+	case OP_NE_FNC:	fprintf (f, "F(%d) = I(%d) != I(%d);", c, a, b); break;
+
+	case OP_STORE_F:
+	case OP_STORE_ENT:
+	case OP_STORE_FLD:
+	case OP_STORE_S:
+	case OP_STORE_FNC:
+		fprintf (f, "I(%d) = I(%d);", b, a);
+		break;
+	case OP_STORE_V:
+		fprintf (f, "I(%d) = I(%d); I(%d) = I(%d); I(%d) = I(%d);", b, a, b + 1, a + 1, b + 2, a + 2);
+		break;
+	case OP_STOREP_F:
+	case OP_STOREP_ENT:
+	case OP_STOREP_FLD:
+	case OP_STOREP_S:
+	case OP_STOREP_FNC:
+		fprintf (f, "PTR(%d)->i = I(%d);", b, a);
+		break;
+	case OP_STOREP_V:
+		fprintf (f, "{ qv_t *p = PTR(%d); p[0].f = F(%d); p[1].f = F(%d); p[2].f = F(%d); }", b, a, a + 1, a + 2);
+		break;
+
+	case OP_ADDRESS:
+		fprintf (f, "I(%d) = ctx->address (I(%d), I(%d), %d);", c, a, b, n);
+		break;
+	case OP_LOAD_F:
+	case OP_LOAD_FLD:
+	case OP_LOAD_ENT:
+	case OP_LOAD_S:
+	case OP_LOAD_FNC:
+		fprintf (f, "I(%d) = FLD(%d, %d)->i;", c, a, b);
+		break;
+	case OP_LOAD_V:
+		fprintf (f, "{ qv_t *p = FLD(%d, %d); F(%d) = p[0].f; F(%d) = p[1].f; F(%d) = p[2].f; }", a, b, c, c + 1, c + 2);
+		break;
+
+	case OP_IFNOT:
+		fprintf (f, "if (!I(%d)) ", a);
+		PR_AotJump (f, n, n + st->b);
+		break;
+	case OP_IF:
+		fprintf (f, "if (I(%d)) ", a);
+		PR_AotJump (f, n, n + st->b);
+		break;
+	case OP_GOTO:
+		PR_AotJump (f, n, n + st->a);
+		break;
+
+	case OP_CALL0:
+	case OP_CALL1:
+	case OP_CALL2:
+	case OP_CALL3:
+	case OP_CALL4:
+	case OP_CALL5:
+	case OP_CALL6:
+	case OP_CALL7:
+	case OP_CALL8:
+		fprintf (f, "ctx->call (I(%d), %d, %d);", a, st->op - OP_CALL0, n);
+		break;
+
+	case OP_DONE:
+	case OP_RETURN:
+		fprintf (f, "I(%d) = I(%d); I(%d) = I(%d); I(%d) = I(%d); return;",
+			OFS_RETURN, a, OFS_RETURN + 1, a + 1, OFS_RETURN + 2, a + 2);
+		break;
+
+	case OP_STATE:
+		fprintf (f, "ctx->state (F(%d), I(%d));", a, b);
+		break;
+
+	default:
+		fprintf (f, "ctx->badop (%d); return;", n);
+		break;
+	}
+	fprintf (f, "\n");
+}
+
+/*
+=================
+PR_AotExport_f
+
+pr_aot_export: writes a C translation of the server progs
+=================
+*/
+static void PR_AotExport_f (void)
+{
+	char		path[MAX_OSPATH];
+	byte		*reached, *target;
+	int			*stack;
+	int			i, n, numstatements, lo, hi, prev;
+	int			numnative;
+	qcvm_t		*oldvm;
+	FILE		*f;
+
+	if (!sv.qcvm.progs)
+	{
+		Con_Printf ("%s: no progs loaded\n", Cmd_Argv (0));
+		return;
+	}
+
+	PR_PushQCVM (&sv.qcvm, &oldvm);
+
+	q_snprintf (path, sizeof (path), "%s/aot", com_gamedir);
+	Sys_mkdir (path);
+	PR_AotPath (path, sizeof (path), ".c");
+	f = Sys_fopen (path, "w");
+	if (!f)
+	{
+		Con_Printf ("Couldn't write %s\n", path);
+		PR_PopQCVM (oldvm);
+		return;
+	}
+
+	numstatements = qcvm->progs->numstatements;
+	reached = (byte *) calloc (numstatements, 2);
+	stack = (int *) malloc (numstatements * sizeof (int));
+	if (!reached || !stack)
+		Sys_Error ("PR_AotExport_f: out of memory");
+	target = reached + numstatements;
+
+	fprintf (f, "/* %s translated by pr_aot_export, do not edit */\n\n", PR_GetString (qcvm->functions[0].s_name));
+	fprintf (f, "#include <stddef.h>\n\n");
+	fprintf (f, "#ifdef _WIN32\n#define QCAOT_EXPORT __declspec(dllexport)\n#else\n#define QCAOT_EXPORT __attribute__((visibility(\"default\")))\n#endif\n\n");
+	fprintf (f, "typedef union { float f; int i; } qv_t;\n");
+	fprintf (f, "typedef struct qcaotctx_s { %s } qcaotctx_t;\n\n", QCAOT_STR (QCAOT_CTX_FIELDS));
+	fprintf (f, "#define F(o)\t\t(g[o].f)\n");
+	fprintf (f, "#define I(o)\t\t(g[o].i)\n");
+	fprintf (f, "#define PTR(o)\t\t((qv_t *)(*ctx->edicts + I(o)))\n");
+	fprintf (f, "#define FLD(e,o)\t((qv_t *)(*ctx->edicts + ctx->entvarsofs + I(e)) + I(o))\n\n");
+
+	for (i = 1, numnative = 0; i < qcvm->progs->numfunctions; i++)
+	{
+		dfunction_t *func = &qcvm->functions[i];
+
+		if (!PR_AotFunctionBody (func->first_statement, reached, target, stack, &lo, &hi))
+			continue;
+		numnative++;
+
+		fprintf (f, "/* %s (%s) */\n", PR_GetString (func->s_name), PR_GetString (func->s_file));
+		fprintf (f, "static void qcf_%d (qcaotctx_t *ctx)\n{\n", i);
+		fprintf (f, "\tqv_t *g = (qv_t *) ctx->globals;\n");
+		fprintf (f, "\tgoto L%d;\n", func->first_statement);
+
+		for (n = lo, prev = -1; n <= hi; n++)
+		{
+			if (!reached[n])
+				continue;
+			if (prev >= 0 && prev != n - 1)
+			{	// previous statement fell through to one that isn't next
+				switch (qcvm->statements[prev].op)
+				{
+				case OP_DONE: case OP_RETURN: case OP_GOTO:
+					break;
+				default:
+					fprintf (f, "\t");
+					PR_AotJump (f, prev, prev + 1);
+					fprintf (f, "\n");
+					break;
+				}
+			}
+			if (target[n] || (prev >= 0 && prev != n - 1))
+				fprintf (f, "L%d:\n", n);
+			PR_AotStatement (f, n);
+			prev = n;
+		}
+		switch (qcvm->statements[prev].op)
+		{
+		case OP_DONE: case OP_RETURN: case OP_GOTO:
+			break;
+		default:	// ran off the end of the statements
+			fprintf (f, "\tctx->badop (%d);\n", prev);
+			break;
+		}
+		memset (reached + lo, 0, hi + 1 - lo);
+		memset (target + lo, 0, hi + 1 - lo);
+
+		fprintf (f, "}\n\n");
+	}
+
+	fprintf (f, "QCAOT_EXPORT const int qcaot_version = %d;\n", QCAOT_VERSION);
+	fprintf (f, "QCAOT_EXPORT const unsigned qcaot_hash = 0x%08xu;\n", PR_AotHash ());
+	fprintf (f, "QCAOT_EXPORT const int qcaot_numfunctions = %d;\n", qcvm->progs->numfunctions);
+	fprintf (f, "QCAOT_EXPORT void (*const qcaot_funcs[%d]) (qcaotctx_t *ctx) =\n{\n", qcvm->progs->numfunctions);
+	for (i = 0; i < qcvm->progs->numfunctions; i++)
+	{
+		dfunction_t *func = &qcvm->functions[i];
+		if (i > 0 && func->first_statement > 0 && func->first_statement < numstatements)
+			fprintf (f, "\tqcf_%d,\n", i);
+		else
+			fprintf (f, "\tNULL,\n");
+	}
+	fprintf (f, "};\n");
+
+	fclose (f);
+	free (reached);
+	free (stack);
+
+	Con_Printf ("Wrote %d functions to %s\n", numnative, path);
+	Con_Printf ("Build it next to the source with e.g.\n  cc -O2 -shared -fPIC -ffp-contract=off -fno-strict-aliasing -o progs_%04x_%08x" QCAOT_LIBEXT " progs_%04x_%08x.c\n",
+		qcvm->crc, PR_AotHash (), qcvm->crc, PR_AotHash ());
+	Con_Printf ("and set pr_aot 1 before loading a map.\n");
+
+	PR_PopQCVM (oldvm);
+}
+
+/*
+=================
+PR_AotInfo_f
+=================
+*/
+static void PR_AotInfo_f (void)
+{
+	int i, j, count, total, best;
+
+	if (!sv.qcvm.aotfuncs)
+		Con_Printf ("No native progs loaded\n");
+	else
+	{
+		for (i = 0, count = 0; i < sv.qcvm.progs->numfunctions; i++)
+			count += sv.qcvm.aotfuncs[i] != NULL;
+		Con_Printf ("%d of %d functions native\n", count, sv.qcvm.progs->numfunctions);
+	}
+
+	total = aot_diff.compared + aot_diff.skipped;
+	Con_Printf ("compared %d of %d calls (%.1f%%), %d mismatched\n",
+		aot_diff.compared, total, total ? 100.0 * aot_diff.compared / total : 0.0, aot_diff.mismatched);
+	if (!aot_diff.skipped)
+		return;
+
+	Con_Printf ("skipped %d: %d on errors", aot_diff.skipped, aot_diff.skiperrors);
+	for (count = 0; count < 5; count++)
+	{
+		for (i = 0, best = -1; i < MAX_BUILTINS; i++)
+			if (aot_diff.skipbuiltins[i] > 0 && (best < 0 || aot_diff.skipbuiltins[i] > aot_diff.skipbuiltins[best]))
+				best = i;
+		if (best < 0)
+			break;
+
+		// name it after the progs' declaration if the progs are still loaded
+		for (j = 1; j < (sv.qcvm.progs ? sv.qcvm.progs->numfunctions : 0); j++)
+			if (sv.qcvm.functions[j].first_statement == -best)
+				break;
+		if (sv.qcvm.progs && j < sv.qcvm.progs->numfunctions)
+			Con_Printf (", %d on %s", aot_diff.skipbuiltins[best], sv.qcvm.strings + sv.qcvm.functions[j].s_name);
+		else
+			Con_Printf (", %d on builtin #%d", aot_diff.skipbuiltins[best], best);
+		aot_diff.skipbuiltins[best] = -aot_diff.skipbuiltins[best];	// hide it from the next pass
+	}
+	Con_Printf ("\n");
+	for (i = 0; i < MAX_BUILTINS; i++)
+		aot_diff.skipbuiltins[i] = abs (aot_diff.skipbuiltins[i]);
+}
+
+/*
+=================
+PR_AotInit
+=================
+*/
+void PR_AotInit (void)
+{
+	Cvar_RegisterVariable (&pr_aot);
+	Cmd_AddCommand ("pr_aot_export", PR_AotExport_f);
+	Cmd_AddCommand ("pr_aot_info", PR_AotInfo_f);
+}
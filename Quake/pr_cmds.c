@@ -24,16 +24,6 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "quakedef.h"
 #include "q_ctype.h"
 
-#define	STRINGTEMP_BUFFERS		1024
-#define	STRINGTEMP_LENGTH		1024
-static	char	pr_string_temp[STRINGTEMP_BUFFERS][STRINGTEMP_LENGTH];
-static	byte	pr_string_tempindex = 0;
-
-static char *PR_GetTempString (void)
-{
-	return pr_string_temp[(STRINGTEMP_BUFFERS-1) & ++pr_string_tempindex];
-}
-
 int PR_MakeTempString (const char *val)
 {
 	char *tmp = PR_GetTempString();
@@ -68,7 +58,7 @@ static const char* PF_GetStringArg(int idx, void* userdata)
 static char *PF_VarString (int	first)
 {
 	int		i;
-	static char out[1024];
+	static THREAD_LOCAL char out[1024];
 	const char *format;
 	size_t s;
 
@@ -323,6 +313,7 @@ static void PF_setmodel (void)
 		PR_RunError ("no precache: %s", m);
 	}
 	e->v.model = PR_SetEngineString(*check);
+	ED_TouchFindIndex (e);
 	e->v.modelindex = i; //SV_ModelIndex (m);
 
 	mod = sv.models[ (int)e->v.modelindex];  // Mod_ForName (m, true);
@@ -556,7 +547,7 @@ static void PF_random (void)
 	else
 		num = (rand() & 0x7fff) / ((float)0x7fff);
 
-	G_FLOAT(OFS_RETURN) = num;
+	G_FLOAT(OFS_RETURN) = PR_AotRandom (num);
 }
 
 /*
@@ -765,9 +756,6 @@ static void PF_checkpos (void)
 
 //============================================================================
 
-static byte	*checkpvs;	//ericw -- changed to malloc
-static int	checkpvs_capacity;
-
 static int PF_newcheckclient (int check)
 {
 	int		i;
@@ -816,14 +804,14 @@ static int PF_newcheckclient (int check)
 	pvs = Mod_LeafPVS (leaf, sv.worldmodel);
 	
 	pvsbytes = (sv.worldmodel->numleafs+7)>>3;
-	if (checkpvs == NULL || pvsbytes > checkpvs_capacity)
+	if (sv_context->checkpvs == NULL || pvsbytes > sv_context->checkpvs_capacity)
 	{
-		checkpvs_capacity = pvsbytes;
-		checkpvs = (byte *) realloc (checkpvs, checkpvs_capacity);
-		if (!checkpvs)
-			Sys_Error ("PF_newcheckclient: realloc() failed on %d bytes", checkpvs_capacity);
+		sv_context->checkpvs_capacity = pvsbytes;
+		sv_context->checkpvs = (byte *) realloc (sv_context->checkpvs, sv_context->checkpvs_capacity); //ericw -- changed to malloc
+		if (!sv_context->checkpvs)
+			Sys_Error ("PF_newcheckclient: realloc() failed on %d bytes", sv_context->checkpvs_capacity);
 	}
-	memcpy (checkpvs, pvs, pvsbytes);
+	memcpy (sv_context->checkpvs, pvs, pvsbytes);
 
 	return i;
 }
@@ -872,7 +860,7 @@ static void PF_checkclient (void)
 	VectorAdd (self->v.origin, self->v.view_ofs, view);
 	leaf = Mod_PointInLeaf (view, sv.worldmodel);
 	l = (leaf - sv.worldmodel->leafs) - 1;
-	if ( (l < 0) || !(checkpvs[l>>3] & (1 << (l & 7))) )
+	if ( (l < 0) || !(sv_context->checkpvs[l>>3] & (1 << (l & 7))) )
 	{
 		c_notvis++;
 		RETURN_EDICT(qcvm->edicts);
@@ -927,7 +915,10 @@ static void PF_localcmd (void)
 	const char	*str;
 
 	str = G_STRING(OFS_PARM0);
-	Cbuf_AddText (str);
+	if (sv_context->instance)
+		SV_InstanceCommand (str);
+	else
+		Cbuf_AddText (str);
 }
 
 /*
@@ -960,7 +951,10 @@ static void PF_cvar_set (void)
 	var = G_STRING(OFS_PARM0);
 	val = G_STRING(OFS_PARM1);
 
-	Cvar_Set (var, val);
+	if (sv_context->instance)
+		SV_InstanceCommand (va ("\"%s\" \"%s\"\n", var, val));
+	else
+		Cvar_Set (var, val);
 }
 
 /*
@@ -975,6 +969,7 @@ findradius (origin, radius)
 static void PF_findradius (void)
 {
 	edict_t	*ent, *chain;
+	edicthot_t	*hot = &qcvm->hot;
 	float	rad;
 	float	*org;
 	int		i;
@@ -985,28 +980,29 @@ static void PF_findradius (void)
 	rad = G_FLOAT(OFS_PARM1);
 	rad *= rad;
 
-	ent = NEXT_EDICT(qcvm->edicts);
-	for (i = 1; i < qcvm->num_edicts; i++, ent = NEXT_EDICT(ent))
+	ED_FlushHotFields ();
+	for (i = 1; i < qcvm->num_edicts; i++)
 	{
 		float d, lensq;
-		if (ent->free)
+		if (hot->free[i])
 			continue;
-		if (ent->v.solid == SOLID_NOT)
+		if (hot->solid[i] == SOLID_NOT)
 			continue;
 
-		d = org[0] - (ent->v.origin[0] + (ent->v.mins[0] + ent->v.maxs[0]) * 0.5);
+		d = org[0] - (hot->origin[i][0] + hot->bboxofs[i][0] * 0.5);
 		lensq = d * d;
 		if (lensq > rad)
 			continue;
-		d = org[1] - (ent->v.origin[1] + (ent->v.mins[1] + ent->v.maxs[1]) * 0.5);
+		d = org[1] - (hot->origin[i][1] + hot->bboxofs[i][1] * 0.5);
 		lensq += d * d;
 		if (lensq > rad)
 			continue;
-		d = org[2] - (ent->v.origin[2] + (ent->v.mins[2] + ent->v.maxs[2]) * 0.5);
+		d = org[2] - (hot->origin[i][2] + hot->bboxofs[i][2] * 0.5);
 		lensq += d * d;
 		if (lensq > rad)
 			continue;
 
+		ent = EDICT_NUM(i);
 		ent->v.chain = EDICT_TO_PROG(chain);
 		chain = ent;
 	}
@@ -1086,11 +1082,22 @@ static void PF_Find (void)
 	if (!s)
 		PR_RunError ("PF_Find: bad search string");
 
+	if (pr_findindex.value)
+	{
+		int found = ED_FindIndexed (e, f, s);
+		if (found >= 0)
+		{
+			RETURN_EDICT(EDICT_NUM(found));
+			return;
+		}
+	}
+
+	ED_FlushHotFields ();
 	for (e++ ; e < qcvm->num_edicts ; e++)
 	{
-		ed = EDICT_NUM(e);
-		if (ed->free)
+		if (qcvm->hot.free[e])
 			continue;
+		ed = EDICT_NUM(e);
 		t = E_STRING(ed,f);
 		if (!t)
 			continue;
@@ -1131,7 +1138,7 @@ static void PF_precache_sound (void)
 	{
 		if (!sv.sound_precache[i])
 		{
-			sv.sound_precache[i] = s;
+			sv.sound_precache[i] = PR_IsTempString (s) ? Hunk_Strdup (s, "precache") : s;
 			return;
 		}
 		if (!strcmp(sv.sound_precache[i], s))
@@ -1156,7 +1163,7 @@ static void PF_precache_model (void)
 	{
 		if (!sv.model_precache[i])
 		{
-			sv.model_precache[i] = s;
+			sv.model_precache[i] = PR_IsTempString (s) ? Hunk_Strdup (s, "precache") : s;
 			sv.models[i] = Mod_ForName (s, true);
 			return;
 		}
@@ -1287,6 +1294,12 @@ static void PF_lightstyle (void)
 	}
 
 // change the string in sv
+// (temp strings get reclaimed, keep our own copy for clients that connect later)
+	if (PR_IsTempString (val))
+	{
+		q_strlcpy (sv.tempstyles[style], val, MAX_STYLESTRING);
+		val = sv.tempstyles[style];
+	}
 	sv.lightstyles[style] = val;
 
 // send message to all clients on this server
@@ -1718,7 +1731,10 @@ static void PF_changelevel (void)
 	svs.changelevel_issued = true;
 
 	s = G_STRING(OFS_PARM0);
-	Cbuf_AddText (va("changelevel %s\n",s));
+	if (sv_context->instance)
+		SV_InstanceChangelevel (s);
+	else
+		Cbuf_AddText (va("changelevel %s\n",s));
 }
 
 /*
@@ -3087,13 +3103,14 @@ static void PF_sprintf(void)
 }
 
 //string tokenizing (gah)
+//per thread, server instances tokenize from their worker threads
 #define MAXQCTOKENS 64
-static struct {
+static THREAD_LOCAL struct {
 	char *token;
 	unsigned int start;
 	unsigned int end;
 } qctoken[MAXQCTOKENS];
-static unsigned int qctoken_count;
+static THREAD_LOCAL unsigned int qctoken_count;
 
 static void PF_ArgC(void)
 {
@@ -38,6 +38,12 @@ const int type_size[NUM_TYPE_SIZES] = {
 
 static ddef_t	*ED_FieldAtOfs (int ofs);
 static qboolean	ED_ParseEpair (void *base, ddef_t *key, const char *s, qboolean zoned);
+static void		PR_StringMapFree (prstringmap_t *map);
+static void		PR_FreeTempStrings (prtempstrings_t *ts);
+static void		PR_KeepTempString (int slot);
+static void		PR_TempStringTest_f (void);
+static void		ED_FreeFindIndexes (void);
+static qboolean	PR_IsValidString (const char *p);
 
 cvar_t	nomonsters = {"nomonsters", "0", CVAR_NONE};
 cvar_t	gamecfg = {"gamecfg", "0", CVAR_NONE};
@@ -211,6 +217,8 @@ edict_t *ED_Alloc (void)
 		if (e->freetime < 2 || qcvm->time - e->freetime > 0.5)
 		{
 			ED_ClearEdict (e);
+			ED_SyncHotFields (e);
+			ED_TouchFindIndex (e);
 			return e;
 		}
 	}
@@ -221,6 +229,8 @@ edict_t *ED_Alloc (void)
 	e = EDICT_NUM(qcvm->num_edicts++);
 	memset(e, 0, qcvm->edict_size); // ericw -- switched sv.edicts to malloc(), so we are accessing uninitialized memory and must fully zero it, not just ED_ClearEdict
 	e->baseline.scale = ENTSCALE_DEFAULT;
+	ED_SyncHotFields (e);
+	ED_TouchFindIndex (e);
 
 	return e;
 }
@@ -252,6 +262,185 @@ void ED_Free (edict_t *ed)
 	ed->scale = ENTSCALE_DEFAULT;
 
 	ed->freetime = qcvm->time;
+	ED_SyncHotFields (ed);
+	ED_TouchFindIndex (ed);
+}
+
+/*
+===============================================================================
+
+HOT FIELDS
+
+Engine loops that walk every edict only look at a few fields, but each
+edict is edict_size bytes apart. qcvm->hot keeps packed copies of those
+fields. The engine writes rows through when it frees, allocates or links
+an edict, and after running its physics. QC stores to mirrored fields
+only mark the row, and ED_FlushHotFields refreshes marked rows before a
+scan.
+
+===============================================================================
+*/
+
+byte ed_hotfield[ED_HOTFIELDTABLE];
+
+/*
+=================
+ED_InitHotFieldTable
+=================
+*/
+static void ED_InitHotFieldTable (void)
+{
+	static const size_t vecs[] =
+	{
+		offsetof (entvars_t, origin),
+		offsetof (entvars_t, mins),
+		offsetof (entvars_t, maxs),
+	};
+	static const size_t floats[] =
+	{
+		offsetof (entvars_t, solid),
+		offsetof (entvars_t, modelindex),
+	};
+	size_t i;
+
+	for (i = 0; i < countof (vecs); i++)
+	{
+		ed_hotfield[vecs[i] / 4 + 0] = 1;
+		ed_hotfield[vecs[i] / 4 + 1] = 1;
+		ed_hotfield[vecs[i] / 4 + 2] = 1;
+	}
+	for (i = 0; i < countof (floats); i++)
+		ed_hotfield[floats[i] / 4] = 1;
+}
+
+static void ED_StoreHotFields (edicthot_t *hot, int num, const edict_t *ed)
+{
+	hot->free[num] = ed->free;
+	hot->solid[num] = ed->v.solid;
+	hot->modelindex[num] = ed->v.modelindex;
+	VectorCopy (ed->v.origin, hot->origin[num]);
+	VectorAdd (ed->v.mins, ed->v.maxs, hot->bboxofs[num]);
+}
+
+static int ED_HotIndex (const edict_t *ed)
+{
+	return (int)(((const byte *)ed - (const byte *)qcvm->edicts) / qcvm->edict_size);
+}
+
+/*
+=================
+ED_SyncHotFields
+
+Copies ed's mirrored fields now
+=================
+*/
+void ED_SyncHotFields (edict_t *ed)
+{
+	edicthot_t	*hot = &qcvm->hot;
+	int			num = ED_HotIndex (ed);
+
+	if ((unsigned int)num >= (unsigned int)hot->capacity)
+		hot->alldirty = true;
+	else
+		ED_StoreHotFields (hot, num, ed);
+}
+
+/*
+=================
+ED_MarkHotFields
+
+Queues ed for the next ED_FlushHotFields
+=================
+*/
+void ED_MarkHotFields (edict_t *ed)
+{
+	edicthot_t	*hot = &qcvm->hot;
+	int			num = ED_HotIndex (ed);
+
+	if ((unsigned int)num >= (unsigned int)hot->capacity)
+		hot->alldirty = true;
+	else if (!hot->isdirty[num])
+	{
+		hot->isdirty[num] = 1;
+		VEC_PUSH (hot->dirty, num);
+	}
+}
+
+/*
+=================
+ED_InvalidateHotFields
+
+For code that rewrites edicts in bulk
+=================
+*/
+void ED_InvalidateHotFields (void)
+{
+	qcvm->hot.alldirty = true;
+	ED_FreeFindIndexes ();
+}
+
+/*
+=================
+ED_FlushHotFields
+
+Brings qcvm->hot up to date, call before reading it
+=================
+*/
+void ED_FlushHotFields (void)
+{
+	edicthot_t	*hot = &qcvm->hot;
+	size_t		i, count;
+	int			num;
+
+	if (hot->capacity < qcvm->max_edicts)
+	{
+		byte *buf;
+
+		free (hot->origin);
+		hot->capacity = qcvm->max_edicts;
+		buf = (byte *) calloc (hot->capacity, 2 * sizeof (vec3_t) + 2 * sizeof (float) + 2);
+		if (!buf)
+			Sys_Error ("ED_FlushHotFields: out of memory (%d edicts)", hot->capacity);
+		hot->origin		= (vec3_t *) buf;	buf += hot->capacity * sizeof (vec3_t);
+		hot->bboxofs	= (vec3_t *) buf;	buf += hot->capacity * sizeof (vec3_t);
+		hot->solid		= (float *) buf;	buf += hot->capacity * sizeof (float);
+		hot->modelindex	= (float *) buf;	buf += hot->capacity * sizeof (float);
+		hot->free		= buf;				buf += hot->capacity;
+		hot->isdirty	= buf;
+		hot->alldirty	= true;
+	}
+
+	if (hot->alldirty)
+	{
+		edict_t *ed = qcvm->edicts;
+		for (num = 0; num < qcvm->num_edicts; num++, ed = NEXT_EDICT (ed))
+			ED_StoreHotFields (hot, num, ed);
+		for (i = 0, count = VEC_SIZE (hot->dirty); i < count; i++)
+			hot->isdirty[hot->dirty[i]] = 0;
+		VEC_CLEAR (hot->dirty);
+		hot->alldirty = false;
+		return;
+	}
+
+	for (i = 0, count = VEC_SIZE (hot->dirty); i < count; i++)
+	{
+		num = hot->dirty[i];
+		hot->isdirty[num] = 0;
+		ED_StoreHotFields (hot, num, EDICT_NUM (num));
+	}
+	VEC_CLEAR (hot->dirty);
+}
+
+/*
+=================
+ED_FreeHotFields
+=================
+*/
+static void ED_FreeHotFields (edicthot_t *hot)
+{
+	free (hot->origin);
+	VEC_FREE (hot->dirty);
+	memset (hot, 0, sizeof (*hot));
 }
 
 //===========================================================================
@@ -290,6 +479,362 @@ static ddef_t *ED_FieldAtOfs (int ofs)
 	return &qcvm->fielddefs[ofs];
 }
 
+/*
+===============================================================================
+
+FIND INDEXES
+
+PF_Find scans every edict with strcmp. Once a string field has been
+searched FINDINDEX_MINQUERIES times, it gets an index from value to the
+sorted list of edicts holding it. QC stores to the field, ED_Alloc,
+ED_Free and engine writes queue an edict. Queued edicts are moved to
+their new bucket before the next lookup, so results match the scan.
+Only progs strings are keyed by value: temp and zone strings can change
+contents without a store, so edicts holding one go on a dynamic list
+that every lookup compares with strcmp.
+
+===============================================================================
+*/
+
+cvar_t pr_findindex = {"pr_findindex", "1", CVAR_NONE};
+
+/*
+=================
+ED_FindKey
+
+Returns the progs string in field ofs of ed, NULL if the field holds
+a temp or zone string (*dynamic is set) or a bad string
+=================
+*/
+static const char *ED_FindKey (edict_t *ed, int ofs, qboolean *dynamic)
+{
+	int num = ((int *)&ed->v)[ofs];
+
+	*dynamic = false;
+	if (num >= 0 && num < qcvm->stringssize)
+		return qcvm->strings + num;
+	if (num < 0 && num >= -qcvm->numknownstrings && qcvm->knownstrings[-1 - num])
+		*dynamic = true;
+	return NULL;
+}
+
+static int ED_FindBucket (edfindindex_t *idx, const char *key, qboolean create)
+{
+	unsigned	pos, mask;
+
+	if (create && (idx->numbuckets + 1) * 4 > idx->maxbuckets * 3)
+	{
+		edfindbucket_t	*old = idx->buckets;
+		int				i, j, oldmax = idx->maxbuckets;
+
+		idx->maxbuckets = oldmax ? oldmax * 2 : 64;
+		idx->buckets = (edfindbucket_t *) calloc (idx->maxbuckets, sizeof (*idx->buckets));
+		if (!idx->buckets)
+			Sys_Error ("ED_FindBucket: out of memory");
+		mask = idx->maxbuckets - 1;
+		for (i = 0; i < oldmax; i++)
+		{
+			if (!old[i].key)
+				continue;
+			for (pos = COM_HashString (old[i].key) & mask; idx->buckets[pos].key; pos = (pos + 1) & mask)
+				;
+			idx->buckets[pos] = old[i];
+			for (j = 0; j < (int) VEC_SIZE (old[i].ents); j++)
+				idx->entbucket[old[i].ents[j]] = pos;
+		}
+		free (old);
+	}
+
+	if (!idx->maxbuckets)
+		return -1;
+
+	mask = idx->maxbuckets - 1;
+	for (pos = COM_HashString (key) & mask; idx->buckets[pos].key; pos = (pos + 1) & mask)
+		if (!strcmp (idx->buckets[pos].key, key))
+			return pos;
+
+	if (!create)
+		return -1;
+
+	idx->buckets[pos].key = strdup (key);
+	idx->numbuckets++;
+	return pos;
+}
+
+static void ED_FindSortedInsert (int **ents, int num)
+{
+	int i;
+
+	VEC_PUSH (*ents, num);
+	for (i = VEC_SIZE (*ents) - 1; i > 0 && (*ents)[i - 1] > num; i--)
+		(*ents)[i] = (*ents)[i - 1];
+	(*ents)[i] = num;
+}
+
+static void ED_FindSortedRemove (int *ents, int num)
+{
+	int i, count;
+
+	count = VEC_SIZE (ents);
+	for (i = 0; i < count && ents[i] != num; i++)
+		;
+	if (i < count)
+	{
+		memmove (ents + i, ents + i + 1, (count - i - 1) * sizeof (ents[0]));
+		VEC_POP (ents);
+	}
+}
+
+static void ED_FindInsert (edfindindex_t *idx, int num)
+{
+	const char		*key;
+	qboolean		dynamic;
+	int				pos;
+
+	key = ED_FindKey (EDICT_NUM (num), idx->ofs, &dynamic);
+	if (dynamic)
+	{
+		ED_FindSortedInsert (&idx->dynamic, num);
+		idx->entbucket[num] = -2;
+		return;
+	}
+	if (!key)
+		return;
+
+	pos = ED_FindBucket (idx, key, true);
+	ED_FindSortedInsert (&idx->buckets[pos].ents, num);
+	idx->entbucket[num] = pos;
+}
+
+static void ED_FindRemove (edfindindex_t *idx, int num)
+{
+	if (idx->entbucket[num] == -2)
+		ED_FindSortedRemove (idx->dynamic, num);
+	else if (idx->entbucket[num] >= 0)
+		ED_FindSortedRemove (idx->buckets[idx->entbucket[num]].ents, num);
+	idx->entbucket[num] = -1;
+}
+
+static void ED_DropFindIndex (edfindindex_t *idx)
+{
+	int i;
+
+	for (i = 0; i < idx->maxbuckets; i++)
+	{
+		free (idx->buckets[i].key);
+		VEC_FREE (idx->buckets[i].ents);
+	}
+	free (idx->buckets);
+	free (idx->entbucket);
+	free (idx->ispending);
+	VEC_FREE (idx->pending);
+	VEC_FREE (idx->dynamic);
+	if (qcvm->find.fieldindex && idx->built)
+		qcvm->find.fieldindex[idx->ofs] = 0;
+
+	i = idx->ofs;
+	memset (idx, 0, sizeof (*idx));
+	idx->ofs = i;
+}
+
+static void ED_BuildFindIndex (edfindindex_t *idx)
+{
+	int num;
+
+	if (!qcvm->find.fieldindex)
+	{
+		qcvm->find.fieldindex = (byte *) calloc (qcvm->progs->entityfields, 1);
+		if (!qcvm->find.fieldindex)
+			Sys_Error ("ED_BuildFindIndex: out of memory");
+	}
+
+	idx->entbucket = (int *) malloc (qcvm->max_edicts * sizeof (int));
+	idx->ispending = (byte *) calloc (qcvm->max_edicts, 1);
+	if (!idx->entbucket || !idx->ispending)
+		Sys_Error ("ED_BuildFindIndex: out of memory");
+	for (num = 0; num < qcvm->max_edicts; num++)
+		idx->entbucket[num] = -1;
+
+	for (num = 1; num < qcvm->num_edicts; num++)
+		if (!EDICT_NUM (num)->free)
+			ED_FindInsert (idx, num);
+
+	idx->built = true;
+	qcvm->find.fieldindex[idx->ofs] = 1 + (idx - qcvm->find.indexes);
+	qcvm->find.builds++;
+}
+
+static void ED_UpdateFindIndex (edfindindex_t *idx)
+{
+	size_t	i, count;
+	int		num;
+
+	for (i = 0, count = VEC_SIZE (idx->pending); i < count; i++)
+	{
+		num = idx->pending[i];
+		idx->ispending[num] = 0;
+		ED_FindRemove (idx, num);
+		if (num < qcvm->num_edicts && !EDICT_NUM (num)->free)
+			ED_FindInsert (idx, num);
+	}
+	qcvm->find.updates += count;
+	VEC_CLEAR (idx->pending);
+}
+
+static void ED_QueueFindIndex (edfindindex_t *idx, int num)
+{
+	if (!idx->ispending[num])
+	{
+		idx->ispending[num] = 1;
+		VEC_PUSH (idx->pending, num);
+	}
+}
+
+static int ED_FindFirstAfter (const int *ents, int count, int start)
+{
+	int lo, hi, mid;
+
+	for (lo = 0, hi = count; lo < hi; )
+	{
+		mid = (lo + hi) / 2;
+		if (ents[mid] <= start)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/*
+=================
+ED_FindIndexed
+
+Returns the first edict after start whose string field at ofs equals s,
+0 if there is none, or -1 if the caller has to scan
+=================
+*/
+int ED_FindIndexed (int start, int ofs, const char *s)
+{
+	edfind_t		*find = &qcvm->find;
+	edfindindex_t	*idx;
+	edfindbucket_t	*b;
+	ddef_t			*def;
+	int				i, lo, pos, count, found;
+
+	for (i = 0; i < find->numindexes; i++)
+		if (find->indexes[i].ofs == ofs)
+			break;
+	if (i == find->numindexes)
+	{
+		def = ED_FieldAtOfs (ofs);
+		if (i == MAX_FINDINDEXES || !def || (def->type & ~DEF_SAVEGLOBAL) != ev_string)
+		{
+			find->misses++;
+			return -1;
+		}
+		find->numindexes++;
+		memset (&find->indexes[i], 0, sizeof (find->indexes[i]));
+		find->indexes[i].ofs = ofs;
+	}
+	idx = &find->indexes[i];
+
+	if (!idx->built)
+	{
+		if (++idx->queries < FINDINDEX_MINQUERIES)
+		{
+			find->misses++;
+			return -1;
+		}
+		ED_BuildFindIndex (idx);
+	}
+	ED_UpdateFindIndex (idx);
+
+	// first keyed edict after start
+	found = 0;
+	pos = ED_FindBucket (idx, s, false);
+	if (pos >= 0)
+	{
+		b = &idx->buckets[pos];
+		count = VEC_SIZE (b->ents);
+		lo = ED_FindFirstAfter (b->ents, count, start);
+		if (lo < count && b->ents[lo] < qcvm->num_edicts)
+		{
+			if (strcmp (E_STRING (EDICT_NUM (b->ents[lo]), ofs), s))
+			{	// something wrote the field behind our back
+				Con_DPrintf ("ED_FindIndexed: stale index for field %d, dropping it\n", ofs);
+				ED_DropFindIndex (idx);
+				find->misses++;
+				return -1;
+			}
+			found = b->ents[lo];
+		}
+	}
+
+	// an earlier edict holding a temp or zone string with the same contents
+	count = VEC_SIZE (idx->dynamic);
+	for (lo = ED_FindFirstAfter (idx->dynamic, count, start); lo < count; lo++)
+	{
+		i = idx->dynamic[lo];
+		if (i >= qcvm->num_edicts || (found && i > found))
+			break;
+		if (!strcmp (E_STRING (EDICT_NUM (i), ofs), s))
+		{
+			found = i;
+			break;
+		}
+	}
+
+	find->hits++;
+	return found;
+}
+
+/*
+=================
+ED_FindIndexStore
+
+QC is about to store to field ofs of ed
+=================
+*/
+void ED_FindIndexStore (edict_t *ed, int ofs)
+{
+	ED_QueueFindIndex (&qcvm->find.indexes[qcvm->find.fieldindex[ofs] - 1], NUM_FOR_EDICT (ed));
+}
+
+/*
+=================
+ED_TouchFindIndex
+
+The engine changed ed in some way the indexes can't see
+=================
+*/
+void ED_TouchFindIndex (edict_t *ed)
+{
+	int i, num;
+
+	if (!qcvm->find.fieldindex)
+		return;
+	num = ((byte *)ed - (byte *)qcvm->edicts) / qcvm->edict_size;
+	for (i = 0; i < qcvm->find.numindexes; i++)
+		if (qcvm->find.indexes[i].built)
+			ED_QueueFindIndex (&qcvm->find.indexes[i], num);
+}
+
+/*
+=================
+ED_FreeFindIndexes
+=================
+*/
+static void ED_FreeFindIndexes (void)
+{
+	int i;
+
+	for (i = 0; i < qcvm->find.numindexes; i++)
+		ED_DropFindIndex (&qcvm->find.indexes[i]);
+	free (qcvm->find.fieldindex);
+	qcvm->find.fieldindex = NULL;
+	qcvm->find.numindexes = 0;
+}
+
 /*
 ============
 ED_FindField
@@ -364,7 +909,7 @@ static ddef_t *ED_FindGlobal (const char *name)
 ED_FindFunction
 ============
 */
-static dfunction_t *ED_FindFunction (const char *fn_name)
+dfunction_t *ED_FindFunction (const char *fn_name)
 {
 	dfunction_t		*func;
 	int				i;
@@ -429,7 +974,7 @@ Returns a string describing *data in a type specific manner
 */
 static const char *PR_ValueString (int type, eval_t *val)
 {
-	static char	line[512];
+	static THREAD_LOCAL char	line[512];
 	char		fmt[64];
 	const char	*str;
 	ddef_t		*def;
@@ -490,7 +1035,7 @@ Easier to parse than PR_ValueString
 */
 static const char *PR_UglyValueString (int type, eval_t *val)
 {
-	static char	line[1024];
+	static THREAD_LOCAL char	line[1024];
 	ddef_t		*def;
 	dfunction_t	*f;
 
@@ -616,7 +1161,7 @@ padded to 20 field width
 */
 const char *PR_GlobalString (int ofs)
 {
-	static char	line[512];
+	static THREAD_LOCAL char	line[512];
 	static const int lastchari = Q_COUNTOF(line) - 2;
 	const char	*s;
 	int		i;
@@ -647,7 +1192,7 @@ const char *PR_GlobalString (int ofs)
 
 const char *PR_GlobalStringNoContents (int ofs)
 {
-	static char	line[512];
+	static THREAD_LOCAL char	line[512];
 	static const int lastchari = Q_COUNTOF(line) - 2;
 	int		i;
 	ddef_t		*def;
@@ -724,7 +1269,7 @@ ED_FieldValueString
 */
 const char *ED_FieldValueString (edict_t *ed, ddef_t *d)
 {
-	static char str[1024];
+	static THREAD_LOCAL char str[1024];
 	int ofs = d->ofs*4;
 	eval_t *val = (eval_t *)((char *)&ed->v + ofs);
 
@@ -1071,6 +1616,16 @@ static void ED_Count (void)
 	Con_Printf ("view      :%3i\n", models);
 	Con_Printf ("touch     :%3i\n", solid);
 	Con_Printf ("step      :%3i\n", step);
+	Con_Printf ("strings   :%3i (%i slots)\n", qcvm->knownstringmap.count, qcvm->numknownstrings);
+	Con_Printf ("strmap    :%3i/%i, %" SDL_PRIu64 " lookups, %" SDL_PRIu64 " hits, %.2f probes/lookup\n",
+		qcvm->knownstringmap.used, qcvm->knownstringmap.capacity,
+		qcvm->knownstringmap.lookups, qcvm->knownstringmap.hits,
+		qcvm->knownstringmap.lookups ? (double) qcvm->knownstringmap.probes / qcvm->knownstringmap.lookups : 0.0);
+	Con_Printf ("tempstr   :%3i KB in %i chunks, %" SDL_PRIu64 " reclaimed, %" SDL_PRIu64 " kept alive\n",
+		qcvm->tempstrings.numchunks * (PR_TEMPSTRING_CHUNKSIZE / 1024), qcvm->tempstrings.numchunks,
+		qcvm->tempstrings.reclaimed, qcvm->tempstrings.kept);
+	Con_Printf ("findindex :%3i fields, %" SDL_PRIu64 " hits, %" SDL_PRIu64 " misses, %" SDL_PRIu64 " builds, %" SDL_PRIu64 " updates\n",
+		qcvm->find.numindexes, qcvm->find.hits, qcvm->find.misses, qcvm->find.builds, qcvm->find.updates);
 	PR_PopQCVM(oldqcvm);
 }
 
@@ -1414,6 +1969,11 @@ const char *ED_ParseEdict (const char *data, edict_t *ent)
 
 	if (!init)
 		ED_Free (ent);
+	else
+	{
+		ED_MarkHotFields (ent);
+		ED_TouchFindIndex (ent);
+	}
 
 	return data;
 }
@@ -1643,10 +2203,18 @@ void PR_ClearProgs(qcvm_t *vm)
 	qcvm = NULL;
 	PR_SwitchQCVM(vm);
 	PR_ShutdownExtensions();
+	PR_ProfileFree(qcvm);
+	PR_AotFree(qcvm);
 
 	if (qcvm->knownstrings)
 		Z_Free ((void *)qcvm->knownstrings);
+	PR_StringMapFree (&qcvm->knownstringmap);
+	PR_FreeTempStrings (&qcvm->tempstrings);
+	ED_FreeHotFields (&qcvm->hot);
+	ED_FreeFindIndexes ();
 	free(qcvm->edicts); // ericw -- sv.edicts switched to use malloc()
+	if (qcvm->code != qcvm->statements)
+		free(qcvm->code);
 	if (qcvm->fielddefs != (ddef_t *)((byte *)qcvm->progs + qcvm->progs->ofs_fielddefs))
 		free(qcvm->fielddefs);
 	memset(qcvm, 0, sizeof(*qcvm));
@@ -2175,6 +2743,8 @@ qboolean PR_LoadProgs (const char *filename, qboolean fatal)
 		Z_Free ((void *)qcvm->knownstrings);
 	qcvm->knownstrings = NULL;
 	qcvm->firstfreeknownstring = NULL;
+	PR_StringMapFree (&qcvm->knownstringmap);
+	PR_FreeTempStrings (&qcvm->tempstrings);
 	PR_SetEngineString("");
 
 	qcvm->globaldefs = (ddef_t *)((byte *)qcvm->progs + qcvm->progs->ofs_globaldefs);
@@ -2244,10 +2814,13 @@ qboolean PR_LoadProgs (const char *filename, qboolean fatal)
 	PR_FindSavegameFields ();
 	PR_FindEntityFields ();
 	PR_FindFunctionRanges ();
+	PR_FuseStatements ();
 	PR_FillOffsetTables ();
 
 	qcvm->effects_mask = PR_FindSupportedEffects ();
 
+	PR_AotLoad ();
+
 	return true;
 }
 
@@ -2278,6 +2851,15 @@ void PR_Init (void)
 	Cmd_AddCommand ("edicts", ED_PrintEdicts);
 	Cmd_AddCommand ("edictcount", ED_Count);
 	Cmd_AddCommand ("profile", PR_Profile_f);
+	Cmd_AddCommand ("profile_dump", PR_ProfileDump_f);
+	Cmd_AddCommand ("profile_reset", PR_ProfileReset_f);
+	Cmd_AddCommand ("pr_bench", PR_Bench_f);
+	Cmd_AddCommand ("pr_tempstringtest", PR_TempStringTest_f);
+	Cvar_RegisterVariable (&pr_profile);
+	Cvar_RegisterVariable (&pr_superops);
+	Cvar_RegisterVariable (&pr_findindex);
+	PR_AotInit ();
+	ED_InitHotFieldTable ();
 	Cvar_RegisterVariable (&nomonsters);
 	Cvar_SetCallback (&nomonsters, ED_Nomonsters_f);
 	Cvar_RegisterVariable (&gamecfg);
@@ -2332,6 +2914,135 @@ int SAVE_NUM_FOR_EDICT (savedata_t *save, edict_t *e)
 
 
 #define	PR_STRING_ALLOCSLOTS	256
+#define	PR_STRINGMAP_MINSIZE	1024
+
+static const char pr_deletedstring[1];	// marks removed entries in knownstringmap
+
+/*
+=================
+PR_StringMapFind
+
+Returns the knownstrings slot holding the given pointer, or -1
+=================
+*/
+static int PR_StringMapFind (const char *s)
+{
+	prstringmap_t *map = &qcvm->knownstringmap;
+	unsigned pos, mask;
+
+	map->lookups++;
+	if (!map->capacity)
+		return -1;
+
+	mask = map->capacity - 1;
+	for (pos = COM_HashBlock (&s, sizeof (s)) & mask; map->keys[pos]; pos = (pos + 1) & mask)
+	{
+		map->probes++;
+		if (map->keys[pos] == s)
+		{
+			map->hits++;
+			return map->slots[pos];
+		}
+	}
+
+	return -1;
+}
+
+/*
+=================
+PR_StringMapRehash
+=================
+*/
+static void PR_StringMapRehash (int capacity)
+{
+	prstringmap_t *map = &qcvm->knownstringmap;
+	const char **oldkeys = map->keys;
+	int *oldslots = map->slots;
+	int i, oldcapacity = map->capacity;
+	unsigned pos, mask;
+
+	map->capacity = capacity;
+	map->used = map->count;
+	map->keys = (const char **) calloc (capacity, sizeof (*map->keys));
+	map->slots = (int *) malloc (capacity * sizeof (*map->slots));
+	if (!map->keys || !map->slots)
+		Sys_Error ("PR_StringMapRehash: out of memory (%d entries)", capacity);
+
+	mask = capacity - 1;
+	for (i = 0; i < oldcapacity; i++)
+	{
+		if (!oldkeys[i] || oldkeys[i] == pr_deletedstring)
+			continue;
+		for (pos = COM_HashBlock (&oldkeys[i], sizeof (oldkeys[i])) & mask; map->keys[pos]; pos = (pos + 1) & mask)
+			;
+		map->keys[pos] = oldkeys[i];
+		map->slots[pos] = oldslots[i];
+	}
+
+	free ((void *) oldkeys);
+	free (oldslots);
+}
+
+/*
+=================
+PR_StringMapAdd
+=================
+*/
+static void PR_StringMapAdd (const char *s, int slot)
+{
+	prstringmap_t *map = &qcvm->knownstringmap;
+	unsigned pos, mask;
+
+	// keep the load factor (deleted markers included) under 3/4
+	if ((map->used + 1) * 4 > map->capacity * 3)
+		PR_StringMapRehash (q_max (Q_nextPow2 ((map->count + 1) * 2), PR_STRINGMAP_MINSIZE));
+
+	mask = map->capacity - 1;
+	for (pos = COM_HashBlock (&s, sizeof (s)) & mask; map->keys[pos] && map->keys[pos] != pr_deletedstring; pos = (pos + 1) & mask)
+		;
+	if (!map->keys[pos])
+		map->used++;
+	map->keys[pos] = s;
+	map->slots[pos] = slot;
+	map->count++;
+}
+
+/*
+=================
+PR_StringMapRemove
+=================
+*/
+static void PR_StringMapRemove (const char *s, int slot)
+{
+	prstringmap_t *map = &qcvm->knownstringmap;
+	unsigned pos, mask;
+
+	if (!map->capacity)
+		return;
+
+	mask = map->capacity - 1;
+	for (pos = COM_HashBlock (&s, sizeof (s)) & mask; map->keys[pos]; pos = (pos + 1) & mask)
+	{
+		if (map->keys[pos] == s && map->slots[pos] == slot)
+		{
+			map->keys[pos] = pr_deletedstring;
+			map->count--;
+			return;
+		}
+	}
+}
+
+/*
+=================
+PR_StringMapFree
+=================
+*/
+static void PR_StringMapFree (prstringmap_t *map)
+{
+	free ((void *) map->keys);
+	free (map->slots);
+	memset (map, 0, sizeof (*map));
+}
 
 static int PR_AllocStringSlot (void)
 {
@@ -2393,6 +3104,8 @@ void PR_ClearEngineString (int num)
 	if (num < 0 && num >= -qcvm->numknownstrings)
 	{
 		num = -1 - num;
+		if (PR_IsValidString (qcvm->knownstrings[num]))
+			PR_StringMapRemove (qcvm->knownstrings[num], num);
 		qcvm->knownstrings[num] = (const char*) qcvm->firstfreeknownstring;
 		qcvm->firstfreeknownstring = &qcvm->knownstrings[num];
 	}
@@ -2411,15 +3124,16 @@ int PR_SetEngineString (const char *s)
 	if (s >= qcvm->strings && s <= qcvm->strings + qcvm->stringssize - 2)
 		return (int)(s - qcvm->strings);
 #endif
-	for (i = 0; i < qcvm->numknownstrings; i++)
-	{
-		if (qcvm->knownstrings[i] == s)
-			return -1 - i;
-	}
+	i = PR_StringMapFind (s);
+	if (i >= 0)
+		return -1 - i;
 	// new unknown engine string
 	//Con_DPrintf ("PR_SetEngineString: new engine string %p\n", s);
 	i = PR_AllocStringSlot ();
 	qcvm->knownstrings[i] = s;
+	PR_StringMapAdd (s, i);
+	if (s == qcvm->tempstrings.last)
+		PR_KeepTempString (i);
 	return -1 - i;
 }
 
@@ -2431,11 +3145,349 @@ int PR_AllocString (int size, char **ptr)
 		return 0;
 	i = PR_AllocStringSlot ();
 	qcvm->knownstrings[i] = (char *)Hunk_AllocName(size, "string");
+	PR_StringMapAdd (qcvm->knownstrings[i], i);
 	if (ptr)
 		*ptr = (char *) qcvm->knownstrings[i];
 	return -1 - i;
 }
 
+/*
+===============================================================================
+
+TEMP STRINGS
+
+Builtins build their results in PR_GetTempString buffers. These come from
+chunks grouped into generations, one per host frame that runs QC. Buffers
+handed to PR_SetEngineString are trimmed to the string's length and their
+slot is remembered. When a generation is PR_TEMPSTRING_GENERATIONS frames
+old, strings still stored in a global or an entity field are copied into
+the newest generation. The rest release their knownstrings slot and the
+chunks are reused.
+
+===============================================================================
+*/
+
+#define	PR_TEMPSTRING_MAXFREE	16	// spare chunks kept around after a spike
+
+/*
+=================
+PR_GetTempString
+=================
+*/
+char *PR_GetTempString (void)
+{
+	prtempstrings_t	*ts = &qcvm->tempstrings;
+	prtempchunk_t	*chunk = ts->chunks[ts->gen];
+
+	if (!chunk || chunk->used + STRINGTEMP_LENGTH > PR_TEMPSTRING_CHUNKSIZE)
+	{
+		if (ts->freechunks)
+		{
+			chunk = ts->freechunks;
+			ts->freechunks = chunk->next;
+			ts->numfreechunks--;
+		}
+		else
+		{
+			chunk = (prtempchunk_t *) malloc (sizeof (*chunk));
+			if (!chunk)
+				Sys_Error ("PR_GetTempString: out of memory");
+			ts->numchunks++;
+		}
+		chunk->used = 0;
+		chunk->next = ts->chunks[ts->gen];
+		ts->chunks[ts->gen] = chunk;
+	}
+
+	ts->last = chunk->data + chunk->used;
+	chunk->used += STRINGTEMP_LENGTH;
+
+	return ts->last;
+}
+
+/*
+=================
+PR_KeepTempString
+
+The latest temp buffer was registered as slot: give back its unused tail
+and track it for reclaiming
+=================
+*/
+static void PR_KeepTempString (int slot)
+{
+	prtempstrings_t	*ts = &qcvm->tempstrings;
+	prtempchunk_t	*chunk = ts->chunks[ts->gen];
+	size_t			len;
+
+	len = strlen (ts->last) + 1;
+	if (len < STRINGTEMP_LENGTH)
+		chunk->used = (ts->last - chunk->data) + len;
+	ts->last = NULL;
+
+	VEC_PUSH (ts->slots[ts->gen], slot);
+}
+
+static qboolean PR_InTempChunks (const prtempchunk_t *chunk, const char *s)
+{
+	for (; chunk; chunk = chunk->next)
+		if (s >= chunk->data && s < chunk->data + chunk->used)
+			return true;
+	return false;
+}
+
+/*
+=================
+PR_IsTempString
+=================
+*/
+qboolean PR_IsTempString (const char *s)
+{
+	int i;
+
+	for (i = 0; i < PR_TEMPSTRING_GENERATIONS; i++)
+		if (PR_InTempChunks (qcvm->tempstrings.chunks[i], s))
+			return true;
+	return false;
+}
+
+/*
+=================
+PR_MarkStringRefs
+
+Flags the knownstrings slots referenced from globals and entity fields.
+Every word is checked, not just the ones with an ev_string def: array
+elements past their def, compiler temps and fields declared as another
+type can hold string indexes too. A float that happens to decode as a
+live slot only keeps that string around a little longer.
+=================
+*/
+static void PR_MarkStringRefs (byte *bits, int numslots)
+{
+	int		i, j, num, numfields;
+	int		*words;
+	edict_t	*ed;
+
+#define MARK(n) do { num = -1 - (n); if (num >= 0 && num < numslots) bits[num >> 3] |= 1 << (num & 7); } while (0)
+
+	memset (bits, 0, (numslots + 7) >> 3);
+
+	words = (int *) qcvm->globals;
+	for (i = 0; i < qcvm->progs->numglobals; i++)
+		MARK (words[i]);
+
+	numfields = qcvm->progs->entityfields;
+	for (i = 0; i < qcvm->num_edicts; i++)
+	{
+		ed = EDICT_NUM (i);
+		if (ed->free)
+			continue;
+		words = (int *) &ed->v;
+		for (j = 0; j < numfields; j++)
+			MARK (words[j]);
+	}
+
+#undef MARK
+}
+
+/*
+=================
+PR_AdvanceTempStrings
+
+Called when entering QC from the engine; starts a new generation once
+per host frame and reclaims the oldest one
+=================
+*/
+void PR_AdvanceTempStrings (void)
+{
+	prtempstrings_t	*ts = &qcvm->tempstrings;
+	prtempchunk_t	*chunks, *next;
+	int				*slots;
+	int				i, slot, oldest;
+	size_t			count;
+
+	if (ts->framecount == host_framecount)
+		return;
+	ts->framecount = host_framecount;
+
+	oldest = (ts->gen + 1) % PR_TEMPSTRING_GENERATIONS;
+	chunks = ts->chunks[oldest];
+	slots = ts->slots[oldest];
+	ts->chunks[oldest] = NULL;
+	ts->slots[oldest] = NULL;
+	ts->gen = oldest;
+	ts->last = NULL;
+
+	count = VEC_SIZE (slots);
+	if (count)
+	{
+		if (ts->referencedsize < qcvm->numknownstrings)
+		{
+			ts->referencedsize = qcvm->maxknownstrings;
+			ts->referenced = (byte *) realloc (ts->referenced, (ts->referencedsize + 7) >> 3);
+			if (!ts->referenced)
+				Sys_Error ("PR_AdvanceTempStrings: out of memory");
+		}
+		PR_MarkStringRefs (ts->referenced, qcvm->numknownstrings);
+
+		for (i = 0; i < (int) count; i++)
+		{
+			const char *str;
+
+			slot = slots[i];
+			str = qcvm->knownstrings[slot];
+			if (!PR_IsValidString (str) || !PR_InTempChunks (chunks, str))
+				continue;	// no longer ours
+
+			if (ts->referenced[slot >> 3] & (1 << (slot & 7)))
+			{	// still in use, move it to the new generation
+				char *copy = PR_GetTempString ();
+				q_strlcpy (copy, str, STRINGTEMP_LENGTH);
+				PR_StringMapRemove (str, slot);
+				qcvm->knownstrings[slot] = copy;
+				PR_StringMapAdd (copy, slot);
+				PR_KeepTempString (slot);
+				ts->kept++;
+			}
+			else
+			{
+				PR_ClearEngineString (-1 - slot);
+				ts->reclaimed++;
+			}
+		}
+		VEC_FREE (slots);
+	}
+
+	for (; chunks; chunks = next)
+	{
+		next = chunks->next;
+		if (ts->numfreechunks >= PR_TEMPSTRING_MAXFREE)
+		{
+			free (chunks);
+			ts->numchunks--;
+			continue;
+		}
+		chunks->next = ts->freechunks;
+		ts->freechunks = chunks;
+		ts->numfreechunks++;
+	}
+}
+
+/*
+=================
+PR_TempStringValue
+
+Like PR_GetString, but returns NULL instead of erroring out
+=================
+*/
+static const char *PR_TempStringValue (int num)
+{
+	if (num >= 0 || num < -qcvm->numknownstrings || !PR_IsValidString (qcvm->knownstrings[-1 - num]))
+		return NULL;
+	return qcvm->knownstrings[-1 - num];
+}
+
+/*
+=================
+PR_TempStringTest_f
+
+pr_tempstringtest: stores temp strings where only a conservative scan
+finds them, in the elements of a string arr[4] global (only arr[0] has a
+def, and the parm slots used here have none at all) and in a vector field
+of the world, then runs more generations than they live for while other
+temp strings churn the knownstrings slots. Fails if any of them changed.
+=================
+*/
+static void PR_TempStringTest_f (void)
+{
+	int			*arr, *field, saved[4], savedfield;
+	int			i, j, frames, failures;
+	char		*s, expect[64];
+	const char	*val;
+
+	if (!sv.active)
+	{
+		Con_Printf ("Server not active\n");
+		return;
+	}
+
+	PR_SwitchQCVM (&sv.qcvm);
+
+	arr = (int *) qcvm->globals + OFS_PARM0;
+	field = (int *) &EDICT_NUM (0)->v + offsetof (entvars_t, origin) / 4 + 1;
+	memcpy (saved, arr, sizeof (saved));
+	savedfield = *field;
+
+	for (i = 0; i < 5; i++)
+	{
+		s = PR_GetTempString ();
+		q_snprintf (s, STRINGTEMP_LENGTH, "pr_tempstringtest %d", i);
+		if (i < 4)
+			arr[i] = PR_SetEngineString (s);
+		else
+			*field = PR_SetEngineString (s);
+	}
+
+	frames = PR_TEMPSTRING_GENERATIONS * 4;
+	for (i = 0; i < frames; i++)
+	{
+		for (j = 0; j < 64; j++)
+		{
+			s = PR_GetTempString ();
+			q_snprintf (s, STRINGTEMP_LENGTH, "churn %d.%d", i, j);
+			PR_SetEngineString (s);
+		}
+		qcvm->tempstrings.framecount = host_framecount - 1;	// as if a frame went by
+		PR_AdvanceTempStrings ();
+	}
+
+	failures = 0;
+	for (i = 0; i < 5; i++)
+	{
+		q_snprintf (expect, sizeof (expect), "pr_tempstringtest %d", i);
+		val = PR_TempStringValue (i < 4 ? arr[i] : *field);
+		if (!val || strcmp (val, expect))
+		{
+			Con_Printf ("%s: got \"%s\", expected \"%s\"\n", i < 4 ? va ("arr[%d]", i) : "world.origin_y", val ? val : "(reclaimed)", expect);
+			failures++;
+		}
+	}
+
+	memcpy (arr, saved, sizeof (saved));
+	*field = savedfield;
+
+	Con_Printf ("pr_tempstringtest: %s after %d frames\n", failures ? "FAILED" : "passed", frames);
+
+	PR_SwitchQCVM (NULL);
+}
+
+/*
+=================
+PR_FreeTempStrings
+=================
+*/
+static void PR_FreeTempStrings (prtempstrings_t *ts)
+{
+	prtempchunk_t	*chunk, *next;
+	int				i;
+
+	for (i = 0; i < PR_TEMPSTRING_GENERATIONS; i++)
+	{
+		for (chunk = ts->chunks[i]; chunk; chunk = next)
+		{
+			next = chunk->next;
+			free (chunk);
+		}
+		VEC_FREE (ts->slots[i]);
+	}
+	for (chunk = ts->freechunks; chunk; chunk = next)
+	{
+		next = chunk->next;
+		free (chunk);
+	}
+	free (ts->referenced);
+	memset (ts, 0, sizeof (*ts));
+}
+
 //===========================================================================
 
 void SaveData_Init (savedata_t *save)
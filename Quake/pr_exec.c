@@ -211,10 +211,335 @@ static void PR_StackTrace (void)
 }
 
 
+/*
+==============================================================================
+
+FUNCTION-LEVEL PROFILER
+
+When pr_profile is set, wall-time is accumulated per call stack in a tree of
+nodes keyed by (parent node, function), so that it can be exported in the
+collapsed stack format understood by flamegraph tools. Builtins don't get
+frames of their own, so their cost ends up in the calling QC function.
+==============================================================================
+*/
+
+cvar_t	pr_profile = {"pr_profile", "0", CVAR_NONE};
+
+#define PROFILE_MAX_NODES		(1 << 20)
+#define PROFILE_UNTRACKED		-2		// node limit reached, time goes to the parent
+
+typedef struct prprofnode_s
+{
+	int			func;
+	int			parent;		// -1 if called directly by the engine
+	int			next;		// next node in the same hash bucket
+	int			calls;
+	uint64_t	total;		// inclusive time, in performance counter ticks
+	uint64_t	self;		// exclusive time (including builtins)
+} prprofnode_t;
+
+typedef struct prprofframe_s
+{
+	int			node;
+	uint64_t	start;
+	uint64_t	children;	// inclusive time of tracked callees
+} prprofframe_t;
+
+typedef struct prprofiler_s
+{
+	prprofnode_t	*nodes;		// dynamic array
+	int				*buckets;
+	int				numbuckets;	// power of two
+	prprofframe_t	frames[MAX_STACK_DEPTH + 1];	// indexed by qcvm->depth
+} prprofiler_t;
+
+static uint32_t PR_ProfileHash (int parent, int func)
+{
+	uint32_t h = (uint32_t)parent * 0x9E3779B1u ^ (uint32_t)func * 0x85EBCA77u;
+	return h ^ (h >> 15);
+}
+
+/*
+============
+PR_ProfileRehash
+============
+*/
+static void PR_ProfileRehash (prprofiler_t *prof, int numbuckets)
+{
+	int i, count, b;
+
+	free (prof->buckets);
+	prof->numbuckets = numbuckets;
+	prof->buckets = (int *) malloc (numbuckets * sizeof (int));
+	if (!prof->buckets)
+		Sys_Error ("PR_ProfileRehash: out of memory");
+	for (i = 0; i < numbuckets; i++)
+		prof->buckets[i] = -1;
+
+	count = VEC_SIZE (prof->nodes);
+	for (i = 0; i < count; i++)
+	{
+		b = PR_ProfileHash (prof->nodes[i].parent, prof->nodes[i].func) & (numbuckets - 1);
+		prof->nodes[i].next = prof->buckets[b];
+		prof->buckets[b] = i;
+	}
+}
+
+/*
+============
+PR_ProfileFindNode
+============
+*/
+static int PR_ProfileFindNode (prprofiler_t *prof, int parent, int func)
+{
+	int b, i;
+	prprofnode_t node;
+
+	b = PR_ProfileHash (parent, func) & (prof->numbuckets - 1);
+	for (i = prof->buckets[b]; i >= 0; i = prof->nodes[i].next)
+		if (prof->nodes[i].func == func && prof->nodes[i].parent == parent)
+			return i;
+
+	i = VEC_SIZE (prof->nodes);
+	if (i >= PROFILE_MAX_NODES)
+		return PROFILE_UNTRACKED;
+
+	memset (&node, 0, sizeof (node));
+	node.func = func;
+	node.parent = parent;
+	node.next = prof->buckets[b];
+	VEC_PUSH (prof->nodes, node);
+	prof->buckets[b] = i;
+
+	if (i + 1 > prof->numbuckets)
+		PR_ProfileRehash (prof, prof->numbuckets * 2);
+
+	return i;
+}
+
+/*
+============
+PR_ProfileUpdate
+
+Only called at depth 0, so the profiler always sees complete call stacks
+============
+*/
+static void PR_ProfileUpdate (void)
+{
+	qcvm->profiling = pr_profile.value != 0.f;
+	if (qcvm->profiling && !qcvm->profiler)
+	{
+		qcvm->profiler = (prprofiler_t *) calloc (1, sizeof (prprofiler_t));
+		if (!qcvm->profiler)
+			Sys_Error ("PR_ProfileUpdate: out of memory");
+		PR_ProfileRehash (qcvm->profiler, 4096);
+	}
+}
+
+/*
+============
+PR_ProfileEnter
+============
+*/
+static void PR_ProfileEnter (dfunction_t *f)
+{
+	prprofiler_t	*prof = qcvm->profiler;
+	prprofframe_t	*frame = &prof->frames[qcvm->depth];
+	int				parent = qcvm->depth > 1 ? prof->frames[qcvm->depth - 1].node : -1;
+
+	if (parent == PROFILE_UNTRACKED)
+		frame->node = PROFILE_UNTRACKED;
+	else
+		frame->node = PR_ProfileFindNode (prof, parent, (int)(f - qcvm->functions));
+	frame->children = 0;
+	frame->start = SDL_GetPerformanceCounter ();
+}
+
+/*
+============
+PR_ProfileLeave
+============
+*/
+static void PR_ProfileLeave (void)
+{
+	prprofiler_t	*prof = qcvm->profiler;
+	prprofframe_t	*frame = &prof->frames[qcvm->depth];
+	prprofnode_t	*node;
+	uint64_t		elapsed;
+
+	if (frame->node == PROFILE_UNTRACKED)
+		return;
+
+	elapsed = SDL_GetPerformanceCounter () - frame->start;
+	node = &prof->nodes[frame->node];
+	node->calls++;
+	node->total += elapsed;
+	node->self += elapsed > frame->children ? elapsed - frame->children : 0;
+
+	if (qcvm->depth > 1)
+		prof->frames[qcvm->depth - 1].children += elapsed;
+}
+
+/*
+============
+PR_ProfileFree
+============
+*/
+void PR_ProfileFree (qcvm_t *vm)
+{
+	if (!vm->profiler)
+		return;
+	VEC_FREE (vm->profiler->nodes);
+	free (vm->profiler->buckets);
+	free (vm->profiler);
+	vm->profiler = NULL;
+	vm->profiling = false;
+}
+
+/*
+============
+PR_ProfileReset_f
+============
+*/
+void PR_ProfileReset_f (void)
+{
+	if (!sv.active || !sv.qcvm.profiler || sv.qcvm.depth)
+		return;
+	VEC_CLEAR (sv.qcvm.profiler->nodes);
+	PR_ProfileRehash (sv.qcvm.profiler, sv.qcvm.profiler->numbuckets);
+}
+
+typedef struct
+{
+	int			func;
+	int			calls;
+	uint64_t	total;
+	uint64_t	self;
+} prproffunc_t;
+
+static int PR_CompareProfFuncs (const void *a, const void *b)
+{
+	const prproffunc_t *fa = (const prproffunc_t *) a;
+	const prproffunc_t *fb = (const prproffunc_t *) b;
+	if (fa->self != fb->self)
+		return fa->self < fb->self ? 1 : -1;
+	return fa->func - fb->func;
+}
+
+/*
+============
+PR_PrintTimeProfile
+
+Per-function totals, derived from the call tree. Inclusive time is only
+counted for the outermost instance of a recursive function.
+============
+*/
+static void PR_PrintTimeProfile (int count)
+{
+	prprofiler_t	*prof = qcvm->profiler;
+	prprofnode_t	*node;
+	prproffunc_t	*funcs;
+	double			scale = 1000.0 / SDL_GetPerformanceFrequency ();
+	int				i, numnodes, parent;
+
+	funcs = (prproffunc_t *) calloc (qcvm->progs->numfunctions, sizeof (*funcs));
+	if (!funcs)
+		return;
+	for (i = 0; i < qcvm->progs->numfunctions; i++)
+		funcs[i].func = i;
+
+	numnodes = VEC_SIZE (prof->nodes);
+	for (i = 0; i < numnodes; i++)
+	{
+		node = &prof->nodes[i];
+		funcs[node->func].calls += node->calls;
+		funcs[node->func].self += node->self;
+		for (parent = node->parent; parent >= 0; parent = prof->nodes[parent].parent)
+			if (prof->nodes[parent].func == node->func)
+				break;
+		if (parent < 0)
+			funcs[node->func].total += node->total;
+	}
+
+	qsort (funcs, qcvm->progs->numfunctions, sizeof (*funcs), PR_CompareProfFuncs);
+
+	Con_Printf ("   self ms  total ms    calls function\n");
+	for (i = 0; i < count && i < qcvm->progs->numfunctions && funcs[i].self; i++)
+		Con_Printf ("%10.3f%10.3f%9i %s\n", funcs[i].self * scale, funcs[i].total * scale,
+			funcs[i].calls, PR_GetString (qcvm->functions[funcs[i].func].s_name));
+
+	free (funcs);
+}
+
+/*
+============
+PR_ProfileDump_f
+
+Writes the call tree in collapsed stack format ("a;b;c <microseconds>")
+============
+*/
+void PR_ProfileDump_f (void)
+{
+	prprofiler_t	*prof;
+	prprofnode_t	*node;
+	int				chain[MAX_STACK_DEPTH];
+	int				i, j, depth, numnodes, written;
+	double			scale = 1000000.0 / SDL_GetPerformanceFrequency ();
+	char			relname[MAX_OSPATH];
+	char			name[MAX_OSPATH];
+	FILE			*f;
+
+	if (!sv.active)
+		return;
+	prof = sv.qcvm.profiler;
+	if (!prof || !VEC_SIZE (prof->nodes))
+	{
+		Con_Printf ("No profile data (set pr_profile 1 first)\n");
+		return;
+	}
+
+	q_strlcpy (relname, Cmd_Argc () >= 2 ? Cmd_Argv (1) : "qcprofile.folded", sizeof (relname));
+	COM_AddExtension (relname, ".folded", sizeof (relname));
+	q_snprintf (name, sizeof (name), "%s/%s", com_gamedir, relname);
+	f = Sys_fopen (name, "w");
+	if (!f)
+	{
+		Con_Printf ("ERROR: couldn't open file %s.\n", relname);
+		return;
+	}
+
+	PR_SwitchQCVM (&sv.qcvm);
+
+	written = 0;
+	numnodes = VEC_SIZE (prof->nodes);
+	for (i = 0; i < numnodes; i++)
+	{
+		uint64_t usec;
+		node = &prof->nodes[i];
+		usec = (uint64_t)(node->self * scale + 0.5);
+		if (!usec)
+			continue;
+
+		for (j = i, depth = 0; j >= 0 && depth < MAX_STACK_DEPTH; j = prof->nodes[j].parent)
+			chain[depth++] = prof->nodes[j].func;
+		while (depth-- > 0)
+			fprintf (f, depth ? "%s;" : "%s", PR_GetString (qcvm->functions[chain[depth]].s_name));
+		fprintf (f, " %" SDL_PRIu64 "\n", usec);
+		written++;
+	}
+
+	PR_SwitchQCVM (NULL);
+	fclose (f);
+
+	Con_Printf ("Wrote %d stacks to %s\n", written, relname);
+}
+
 /*
 ============
 PR_Profile_f
 
+Prints the top functions by wall-time if pr_profile has collected any data,
+by statement count otherwise
 ============
 */
 void PR_Profile_f (void)
@@ -228,6 +553,13 @@ void PR_Profile_f (void)
 
 	PR_SwitchQCVM(&sv.qcvm);
 
+	if (qcvm->profiler && VEC_SIZE (qcvm->profiler->nodes))
+	{
+		PR_PrintTimeProfile (Cmd_Argc () >= 2 ? Q_atoi (Cmd_Argv (1)) : 10);
+		PR_SwitchQCVM(NULL);
+		return;
+	}
+
 	num = 0;
 	do
 	{
@@ -267,6 +599,8 @@ void PR_RunError (const char *error, ...)
 	va_list	argptr;
 	char	string[1024];
 
+	PR_AotRunError ();
+
 	va_start (argptr, error);
 	q_vsnprintf (string, sizeof(string), error, argptr);
 	va_end (argptr);
@@ -288,7 +622,7 @@ PR_EnterFunction
 Returns the new program statement counter
 ====================
 */
-static int PR_EnterFunction (dfunction_t *f)
+int PR_EnterFunction (dfunction_t *f)
 {
 	int	i, j, c, o;
 
@@ -319,6 +653,8 @@ static int PR_EnterFunction (dfunction_t *f)
 	}
 
 	qcvm->xfunction = f;
+	if (qcvm->profiling)
+		PR_ProfileEnter (f);
 	return f->first_statement - 1;	// offset the s++
 }
 
@@ -327,7 +663,7 @@ static int PR_EnterFunction (dfunction_t *f)
 PR_LeaveFunction
 ====================
 */
-static int PR_LeaveFunction (void)
+int PR_LeaveFunction (void)
 {
 	int	i, c;
 
@@ -343,6 +679,9 @@ static int PR_LeaveFunction (void)
 	for (i = 0; i < c; i++)
 		((int *)qcvm->globals)[qcvm->xfunction->parm_start + i] = qcvm->localstack[qcvm->localstack_used + i];
 
+	if (qcvm->profiling)
+		PR_ProfileLeave ();
+
 	// up stack
 	qcvm->depth--;
 	qcvm->xfunction = qcvm->stack[qcvm->depth].f;
@@ -354,7 +693,7 @@ static int PR_LeaveFunction (void)
 PR_CheckBuiltinExtension
 ====================
 */
-static void PR_CheckBuiltinExtension (dfunction_t *func)
+void PR_CheckBuiltinExtension (dfunction_t *func)
 {
 	uint32_t builtin = -func->first_statement;
 	uint32_t extnum = qcvm->builtin_ext[builtin];
@@ -381,6 +720,175 @@ static void PR_CheckBuiltinExtension (dfunction_t *func)
 	);
 }
 
+/*
+===============================================================================
+
+SUPERINSTRUCTIONS
+
+PR_FuseStatements builds the copy of the statements that PR_ExecuteProgram
+actually runs, with common two-statement idioms merged into one internal
+opcode: a compare feeding IF/IFNOT, ADDRESS feeding STOREP, and LOAD
+feeding STORE. The second statement of a pair keeps its opcode but is
+never dispatched, so a pair is only formed when nothing jumps to it.
+Statement numbers, profile counts and the runaway limit are unchanged.
+
+===============================================================================
+*/
+
+enum
+{
+	OPX_EQ_F_IF = OP_BITOR + 1,	// compare + IF/IFNOT on its result
+	OPX_NE_F_IF,
+	OPX_LE_IF,
+	OPX_GE_IF,
+	OPX_LT_IF,
+	OPX_GT_IF,
+	OPX_EQ_E_IF,
+	OPX_NE_E_IF,
+	OPX_NOT_F_IF,
+	OPX_NOT_ENT_IF,
+	OPX_ADDRESS_STOREP,			// ADDRESS + STOREP_F/S/ENT/FLD/FNC through it
+	OPX_ADDRESS_STOREP_V,
+	OPX_LOAD_STORE,				// LOAD_F/S/ENT/FLD/FNC + STORE of the loaded value
+	OPX_LOAD_STORE_V,
+
+	OPX_COUNT,
+	OPX_INVALID = 0xffff		// replaces opcodes the progs used from our internal range
+};
+
+cvar_t	pr_superops = {"pr_superops", "1", CVAR_NONE};	// takes effect on the next progs load
+
+/*
+====================
+PR_FusedOp
+
+Returns the superinstruction for a statement pair, or 0
+====================
+*/
+static int PR_FusedOp (const dstatement_t *a, const dstatement_t *b)
+{
+	switch (b->op)
+	{
+	case OP_IF:
+	case OP_IFNOT:
+		if (b->a != a->c)
+			return 0;
+		switch (a->op)
+		{
+		case OP_EQ_F:	return OPX_EQ_F_IF;
+		case OP_NE_F:	return OPX_NE_F_IF;
+		case OP_LE:		return OPX_LE_IF;
+		case OP_GE:		return OPX_GE_IF;
+		case OP_LT:		return OPX_LT_IF;
+		case OP_GT:		return OPX_GT_IF;
+		case OP_EQ_E:	return OPX_EQ_E_IF;
+		case OP_NE_E:	return OPX_NE_E_IF;
+		case OP_NOT_F:	return OPX_NOT_F_IF;
+		case OP_NOT_ENT:return OPX_NOT_ENT_IF;
+		default:		return 0;
+		}
+
+	case OP_STOREP_F:
+	case OP_STOREP_ENT:
+	case OP_STOREP_FLD:
+	case OP_STOREP_S:
+	case OP_STOREP_FNC:
+		return (a->op == OP_ADDRESS && b->b == a->c) ? OPX_ADDRESS_STOREP : 0;
+	case OP_STOREP_V:
+		return (a->op == OP_ADDRESS && b->b == a->c) ? OPX_ADDRESS_STOREP_V : 0;
+
+	case OP_STORE_F:
+	case OP_STORE_ENT:
+	case OP_STORE_FLD:
+	case OP_STORE_S:
+	case OP_STORE_FNC:
+		if (b->a != a->c)
+			return 0;
+		switch (a->op)
+		{
+		case OP_LOAD_F:
+		case OP_LOAD_FLD:
+		case OP_LOAD_ENT:
+		case OP_LOAD_S:
+		case OP_LOAD_FNC:
+			return OPX_LOAD_STORE;
+		default:
+			return 0;
+		}
+	case OP_STORE_V:
+		return (a->op == OP_LOAD_V && b->a == a->c) ? OPX_LOAD_STORE_V : 0;
+
+	default:
+		return 0;
+	}
+}
+
+/*
+====================
+PR_FuseStatements
+====================
+*/
+void PR_FuseStatements (void)
+{
+	int				i, t, numstatements, numfused;
+	byte			*target;
+	dstatement_t	*code;
+
+	if (qcvm->code && qcvm->code != qcvm->statements)
+		free (qcvm->code);
+	qcvm->code = qcvm->statements;
+	if (!pr_superops.value)
+		return;
+
+	numstatements = qcvm->progs->numstatements;
+	code = (dstatement_t *) malloc (numstatements * sizeof (*code));
+	target = (byte *) calloc (numstatements, 1);
+	if (!code || !target)
+		Sys_Error ("PR_FuseStatements: out of memory");
+	memcpy (code, qcvm->statements, numstatements * sizeof (*code));
+
+	for (i = 0; i < qcvm->progs->numfunctions; i++)
+	{
+		t = qcvm->functions[i].first_statement;
+		if (t > 0 && t < numstatements)
+			target[t] = 1;
+	}
+	for (i = 0; i < numstatements; i++)
+	{
+		switch (code[i].op)
+		{
+		case OP_GOTO:
+			t = i + code[i].a;
+			break;
+		case OP_IF:
+		case OP_IFNOT:
+			t = i + code[i].b;
+			break;
+		default:
+			if (code[i].op > OP_BITOR)
+				code[i].op = OPX_INVALID;
+			continue;
+		}
+		if (t >= 0 && t < numstatements)
+			target[t] = 1;
+	}
+
+	for (i = 0, numfused = 0; i + 1 < numstatements; i++)
+	{
+		int op;
+		if (target[i + 1] || !(op = PR_FusedOp (&qcvm->statements[i], &qcvm->statements[i + 1])))
+			continue;
+		code[i].op = op;
+		numfused++;
+		i++;
+	}
+
+	free (target);
+	qcvm->code = code;
+
+	Con_DPrintf ("%d statement pairs fused (%.1f%%)\n", numfused, numstatements ? 200.0 * numfused / numstatements : 0.0);
+}
+
 /*
 ====================
 PR_ExecuteProgram
@@ -392,10 +900,24 @@ The interpretation main loop
 #define OPB ((eval_t *)&qcvm->globals[(unsigned short)st->b])
 #define OPC ((eval_t *)&qcvm->globals[(unsigned short)st->c])
 
+// vectors move as 12 raw bytes instead of three float copies
+#define PR_MOVEVEC(dst, src) memcpy ((dst), (src), 3 * sizeof (float))
+
+// compare whose result feeds the following IF/IFNOT: store it, then branch on it
+#define FUSED_IF(cond)										\
+	{														\
+		int result = (cond);								\
+		OPC->_float = result;								\
+		profile++;											\
+		st++;												\
+		if (result == (st->op == OP_IF))					\
+			st += st->b - 1;	/* -1 to offset the st++ */	\
+	}
+
 void PR_ExecuteProgram (func_t fnum)
 {
 	eval_t		*ptr;
-	dstatement_t	*st;
+	dstatement_t	*st, *code;
 	dfunction_t	*f, *newf;
 	int profile, startprofile;
 	edict_t		*ed;
@@ -414,8 +936,17 @@ void PR_ExecuteProgram (func_t fnum)
 
 // make a stack frame
 	exitdepth = qcvm->depth;
+	if (!exitdepth)
+	{
+		PR_ProfileUpdate ();
+		PR_AdvanceTempStrings ();
+	}
 
-	st = &qcvm->statements[PR_EnterFunction(f)];
+	if (qcvm->aotfuncs && qcvm->aotfuncs[fnum] && PR_AotExecute (f))
+		return;
+
+	code = qcvm->code;
+	st = &code[PR_EnterFunction(f)];
 	startprofile = profile = 0;
 
     while (1)
@@ -424,12 +955,16 @@ void PR_ExecuteProgram (func_t fnum)
 
 	if (++profile > 0x1000000) /* was 100000 */
 	{
-		qcvm->xstatement = st - qcvm->statements;
+		qcvm->xstatement = st - code;
 		PR_RunError("runaway loop error");
 	}
 
 	if (qcvm->trace)
-		PR_PrintStatement(st);
+	{
+		PR_PrintStatement(&qcvm->statements[st - code]);
+		if (st->op > OP_BITOR && st->op < OPX_COUNT)
+			PR_PrintStatement(&qcvm->statements[st - code + 1]);
+	}
 
 	switch (st->op)
 	{
@@ -561,9 +1096,7 @@ void PR_ExecuteProgram (func_t fnum)
 		OPB->_int = OPA->_int;
 		break;
 	case OP_STORE_V:
-		OPB->vector[0] = OPA->vector[0];
-		OPB->vector[1] = OPA->vector[1];
-		OPB->vector[2] = OPA->vector[2];
+		PR_MOVEVEC (OPB, OPA);
 		break;
 
 	case OP_STOREP_F:
@@ -576,9 +1109,7 @@ void PR_ExecuteProgram (func_t fnum)
 		break;
 	case OP_STOREP_V:
 		ptr = (eval_t *)((byte *)qcvm->edicts + OPB->_int);
-		ptr->vector[0] = OPA->vector[0];
-		ptr->vector[1] = OPA->vector[1];
-		ptr->vector[2] = OPA->vector[2];
+		PR_MOVEVEC (ptr, OPA);
 		break;
 
 	case OP_ADDRESS:
@@ -588,10 +1119,16 @@ void PR_ExecuteProgram (func_t fnum)
 #endif
 		if (ed == (edict_t *)qcvm->edicts && sv.state == ss_active)
 		{
-			qcvm->xstatement = st - qcvm->statements;
+			qcvm->xstatement = st - code;
 			PR_RunError("assignment to world entity");
 		}
+		if (pr_aot_tracking)
+			PR_AotTouch (ed);
 		OPC->_int = (byte *)((int *)&ed->v + OPB->_int) - (byte *)qcvm->edicts;
+		if ((unsigned int)OPB->_int < ED_HOTFIELDTABLE && ed_hotfield[OPB->_int])
+			ED_MarkHotFields (ed);
+		if (qcvm->find.fieldindex && (unsigned int)OPB->_int < (unsigned int)qcvm->progs->entityfields && qcvm->find.fieldindex[OPB->_int])
+			ED_FindIndexStore (ed, OPB->_int);
 		break;
 
 	case OP_LOAD_F:
@@ -612,9 +1149,7 @@ void PR_ExecuteProgram (func_t fnum)
 		NUM_FOR_EDICT(ed);	// Make sure it's in range
 #endif
 		ptr = (eval_t *)((int *)&ed->v + OPB->_int);
-		OPC->vector[0] = ptr->vector[0];
-		OPC->vector[1] = ptr->vector[1];
-		OPC->vector[2] = ptr->vector[2];
+		PR_MOVEVEC (OPC, ptr);
 		break;
 
 	case OP_IFNOT:
@@ -642,7 +1177,7 @@ void PR_ExecuteProgram (func_t fnum)
 	case OP_CALL8:
 		qcvm->xfunction->profile += profile - startprofile;
 		startprofile = profile;
-		qcvm->xstatement = st - qcvm->statements;
+		qcvm->xstatement = st - code;
 		qcvm->argc = st->op - OP_CALL0;
 		if (!OPA->function)
 			PR_RunError("NULL function");
@@ -652,23 +1187,27 @@ void PR_ExecuteProgram (func_t fnum)
 			int i = -newf->first_statement;
 			if (i >= qcvm->numbuiltins)
 				PR_RunError("Bad builtin call number %d", i);
+			if (pr_aot_tracking)
+				PR_AotBuiltin (i);
 			PR_CheckBuiltinExtension (newf);
 			qcvm->builtins[i]();
 			break;
 		}
-		// Normal function
-		st = &qcvm->statements[PR_EnterFunction(newf)];
+		// Normal function, native code only as pr_aot allows
+		if (qcvm->aotfuncs && qcvm->aotfuncs[OPA->function] && PR_AotExecute (newf))
+			break;
+		st = &code[PR_EnterFunction(newf)];
 		break;
 
 	case OP_DONE:
 	case OP_RETURN:
 		qcvm->xfunction->profile += profile - startprofile;
 		startprofile = profile;
-		qcvm->xstatement = st - qcvm->statements;
+		qcvm->xstatement = st - code;
 		qcvm->globals[OFS_RETURN] = qcvm->globals[(unsigned short)st->a];
 		qcvm->globals[OFS_RETURN + 1] = qcvm->globals[(unsigned short)st->a + 1];
 		qcvm->globals[OFS_RETURN + 2] = qcvm->globals[(unsigned short)st->a + 2];
-		st = &qcvm->statements[PR_LeaveFunction()];
+		st = &code[PR_LeaveFunction()];
 		if (qcvm->depth == exitdepth)
 		{ // Done
 			return;
@@ -677,14 +1216,75 @@ void PR_ExecuteProgram (func_t fnum)
 
 	case OP_STATE:
 		ed = PROG_TO_EDICT(pr_global_struct->self);
+		if (pr_aot_tracking)
+			PR_AotTouch (ed);
 		ed->v.nextthink = pr_global_struct->time + 0.1;
 		ed->v.frame = OPA->_float;
 		ed->v.think = OPB->function;
 		break;
 
+	case OPX_EQ_F_IF:	FUSED_IF (OPA->_float == OPB->_float); break;
+	case OPX_NE_F_IF:	FUSED_IF (OPA->_float != OPB->_float); break;
+	case OPX_LE_IF:		FUSED_IF (OPA->_float <= OPB->_float); break;
+	case OPX_GE_IF:		FUSED_IF (OPA->_float >= OPB->_float); break;
+	case OPX_LT_IF:		FUSED_IF (OPA->_float < OPB->_float); break;
+	case OPX_GT_IF:		FUSED_IF (OPA->_float > OPB->_float); break;
+	case OPX_EQ_E_IF:	FUSED_IF (OPA->_int == OPB->_int); break;
+	case OPX_NE_E_IF:	FUSED_IF (OPA->_int != OPB->_int); break;
+	case OPX_NOT_F_IF:	FUSED_IF (!OPA->_float); break;
+	case OPX_NOT_ENT_IF:FUSED_IF (PROG_TO_EDICT(OPA->edict) == qcvm->edicts); break;
+
+	case OPX_ADDRESS_STOREP:
+	case OPX_ADDRESS_STOREP_V:
+		ed = PROG_TO_EDICT(OPA->edict);
+#ifdef PARANOID
+		NUM_FOR_EDICT(ed);	// Make sure it's in range
+#endif
+		if (ed == (edict_t *)qcvm->edicts && sv.state == ss_active)
+		{
+			qcvm->xstatement = st - code;
+			PR_RunError("assignment to world entity");
+		}
+		if (pr_aot_tracking)
+			PR_AotTouch (ed);
+		OPC->_int = (byte *)((int *)&ed->v + OPB->_int) - (byte *)qcvm->edicts;
+		if ((unsigned int)OPB->_int < ED_HOTFIELDTABLE && ed_hotfield[OPB->_int])
+			ED_MarkHotFields (ed);
+		if (qcvm->find.fieldindex && (unsigned int)OPB->_int < (unsigned int)qcvm->progs->entityfields && qcvm->find.fieldindex[OPB->_int])
+			ED_FindIndexStore (ed, OPB->_int);
+		profile++;
+		ptr = (eval_t *)((byte *)qcvm->edicts + OPC->_int);
+		if (st++->op == OPX_ADDRESS_STOREP_V)
+			PR_MOVEVEC (ptr, OPA);
+		else
+			ptr->_int = OPA->_int;
+		break;
+
+	case OPX_LOAD_STORE:
+		ed = PROG_TO_EDICT(OPA->edict);
+#ifdef PARANOID
+		NUM_FOR_EDICT(ed);	// Make sure it's in range
+#endif
+		OPC->_int = ((eval_t *)((int *)&ed->v + OPB->_int))->_int;
+		profile++;
+		st++;
+		OPB->_int = OPA->_int;
+		break;
+
+	case OPX_LOAD_STORE_V:
+		ed = PROG_TO_EDICT(OPA->edict);
+#ifdef PARANOID
+		NUM_FOR_EDICT(ed);	// Make sure it's in range
+#endif
+		PR_MOVEVEC (OPC, (int *)&ed->v + OPB->_int);
+		profile++;
+		st++;
+		PR_MOVEVEC (OPB, OPA);
+		break;
+
 	default:
-		qcvm->xstatement = st - qcvm->statements;
-		PR_RunError("Bad opcode %i", st->op);
+		qcvm->xstatement = st - code;
+		PR_RunError("Bad opcode %i", qcvm->statements[qcvm->xstatement].op);
 	}
     }	/* end of while(1) loop */
 }
@@ -692,3 +1292,118 @@ void PR_ExecuteProgram (func_t fnum)
 #undef OPA
 #undef OPB
 #undef OPC
+#undef FUSED_IF
+
+static struct
+{
+	qcvm_t			*vm;		// NULL when no benchmark is running
+	dstatement_t	*code;
+	qcaotfunc_t		*aotfuncs;
+	float			*globals;
+} pr_bench;
+
+/*
+============
+PR_RestoreBench
+
+Puts back the statements, native functions and globals pr_bench swapped out
+============
+*/
+static void PR_RestoreBench (void)
+{
+	pr_bench.vm->code = pr_bench.code;
+	pr_bench.vm->aotfuncs = pr_bench.aotfuncs;
+	memcpy (pr_bench.vm->globals, pr_bench.globals, pr_bench.vm->progs->numglobals * sizeof (float));
+}
+
+/*
+============
+PR_AbortBench
+
+Called from Host_Error, a run that errors out longjmps past PR_Bench_f
+============
+*/
+void PR_AbortBench (void)
+{
+	if (!pr_bench.vm)
+		return;
+	PR_RestoreBench ();
+	free (pr_bench.globals);
+	pr_bench.vm = NULL;
+	pr_bench.globals = NULL;
+}
+
+/*
+============
+PR_Bench_f
+
+pr_bench <function> [runs]: times a server QC function with and without
+superinstructions. The function really runs, so it should either have no
+side effects or come from progs built for benchmarking. QC globals are
+restored after each pass, edict fields are not.
+============
+*/
+void PR_Bench_f (void)
+{
+	dfunction_t	*f;
+	double		start, elapsed[2];
+	int			i, pass, runs, profile[2];
+
+	if (Cmd_Argc () < 2)
+	{
+		Con_Printf ("Usage: %s <function> [runs]\n", Cmd_Argv (0));
+		return;
+	}
+	if (!sv.active)
+	{
+		Con_Printf ("Server not active\n");
+		return;
+	}
+
+	PR_SwitchQCVM (&sv.qcvm);
+
+	f = ED_FindFunction (Cmd_Argv (1));
+	if (!f || f->first_statement < 0)
+	{
+		Con_Printf ("No QC function \"%s\"\n", Cmd_Argv (1));
+		PR_SwitchQCVM (NULL);
+		return;
+	}
+	runs = Cmd_Argc () >= 3 ? q_max (Q_atoi (Cmd_Argv (2)), 1) : 1000;
+
+	pr_bench.globals = (float *) malloc (qcvm->progs->numglobals * sizeof (float));
+	if (!pr_bench.globals)
+		Sys_Error ("PR_Bench_f: out of memory");
+	memcpy (pr_bench.globals, qcvm->globals, qcvm->progs->numglobals * sizeof (float));
+	pr_bench.code = qcvm->code;
+	pr_bench.aotfuncs = qcvm->aotfuncs;
+	pr_bench.vm = qcvm;
+
+	// interpreter only, plain statements first
+	for (pass = 0; pass < 2; pass++)
+	{
+		qcvm->code = pass ? pr_bench.code : qcvm->statements;
+		qcvm->aotfuncs = NULL;
+		profile[pass] = f->profile;
+		start = Sys_DoubleTime ();
+		for (i = 0; i < runs; i++)
+			PR_ExecuteProgram (f - qcvm->functions);
+		elapsed[pass] = Sys_DoubleTime () - start;
+		profile[pass] = f->profile - profile[pass];
+		PR_RestoreBench ();
+	}
+	free (pr_bench.globals);
+	pr_bench.globals = NULL;
+	pr_bench.vm = NULL;
+
+	Con_Printf ("%s: %d run%s, %d own statements/run\n", Cmd_Argv (1), PLURAL (runs), profile[0] / runs);
+	Con_Printf ("  plain: %8.3f ms (%.1f ns/statement)\n", elapsed[0] * 1000.0, profile[0] ? elapsed[0] * 1e9 / profile[0] : 0.0);
+	if (qcvm->code == qcvm->statements)
+		Con_Printf ("  fused: n/a (pr_superops is 0)\n");
+	else
+		Con_Printf ("  fused: %8.3f ms (%.1f%%)\n", elapsed[1] * 1000.0, elapsed[0] > 0.0 ? 100.0 * elapsed[1] / elapsed[0] : 100.0);
+	if (profile[0] != profile[1])
+		Con_Warning ("statement counts differ: %d plain, %d fused\n", profile[0], profile[1]);
+
+	PR_SwitchQCVM (NULL);
+}
@@ -92,6 +92,101 @@ typedef struct prhashtable_s
 	int			*indices;
 } prhashtable_t;
 
+typedef struct prstringmap_s	// engine string pointer -> knownstrings slot
+{
+	int			capacity;	// power of two
+	int			used;		// live entries + deleted markers
+	int			count;		// live entries
+	const char	**keys;
+	int			*slots;
+
+	uint64_t	lookups;
+	uint64_t	probes;
+	uint64_t	hits;
+} prstringmap_t;
+
+#define	STRINGTEMP_LENGTH			1024	// size of a PR_GetTempString buffer
+#define	PR_TEMPSTRING_GENERATIONS	4		// frames a temp string lives unless something still references it
+#define	PR_TEMPSTRING_CHUNKSIZE		(64 * 1024)
+
+typedef struct prtempchunk_s
+{
+	struct prtempchunk_s	*next;
+	size_t					used;
+	char					data[PR_TEMPSTRING_CHUNKSIZE];
+} prtempchunk_t;
+
+typedef struct prtempstrings_s	// see PR_AdvanceTempStrings
+{
+	prtempchunk_t	*chunks[PR_TEMPSTRING_GENERATIONS];	// newest chunk first
+	int				*slots[PR_TEMPSTRING_GENERATIONS];	// knownstrings slots handed out per generation
+	int				gen;			// generation currently being filled
+	int				framecount;		// host_framecount when it was started
+	char			*last;			// latest buffer, trimmed once it's registered
+	prtempchunk_t	*freechunks;
+	int				numfreechunks;
+	int				numchunks;
+	byte			*referenced;	// scratch bitset over knownstrings
+	int				referencedsize;
+
+	uint64_t		reclaimed;
+	uint64_t		kept;
+} prtempstrings_t;
+
+typedef struct edicthot_s	// see ED_FlushHotFields
+{
+	int			capacity;		// rows allocated, resized to max_edicts on flush
+	qboolean	alldirty;		// rebuild every row on the next flush
+	int			*dirty;			// edicts written by QC since the last flush
+	byte		*isdirty;
+	byte		*free;
+	float		*solid;
+	float		*modelindex;
+	vec3_t		*origin;
+	vec3_t		*bboxofs;		// mins + maxs
+} edicthot_t;
+
+#define	MAX_FINDINDEXES			8
+#define	FINDINDEX_MINQUERIES	4	// finds on a field before it gets indexed
+
+typedef struct edfindbucket_s
+{
+	char		*key;			// string value, NULL = empty slot
+	int			*ents;			// edict numbers in ascending order
+} edfindbucket_t;
+
+typedef struct edfindindex_s	// see ED_FindIndexed
+{
+	int				ofs;		// field offset
+	int				queries;	// finds since the index was last dropped
+	qboolean		built;
+	edfindbucket_t	*buckets;	// open addressing, power of two
+	int				numbuckets;
+	int				maxbuckets;
+	int				*entbucket;	// bucket each edict is in, -1 = none, -2 = dynamic
+	int				*dynamic;	// edicts holding temp or zone strings, ascending
+	int				*pending;	// edicts whose field may have changed
+	byte			*ispending;
+} edfindindex_t;
+
+typedef struct edfind_s
+{
+	edfindindex_t	indexes[MAX_FINDINDEXES];
+	int				numindexes;
+	byte			*fieldindex;	// index + 1 per field offset for built indexes, 0 = none
+
+	uint64_t		hits;
+	uint64_t		misses;
+	uint64_t		builds;
+	uint64_t		updates;
+} edfind_t;
+
+typedef struct qcaotctx_s qcaotctx_t;		// see pr_aot.c
+typedef void (*qcaotfunc_t) (qcaotctx_t *ctx);
+
+#define	ED_HOTFIELDTABLE	(sizeof (entvars_t) / 4)
+extern byte ed_hotfield[ED_HOTFIELDTABLE];	// nonzero for entvars_t offsets mirrored in edicthot_t
+
 struct pr_extfuncs_s
 {
 /*ssqc*/
@@ -205,6 +300,7 @@ typedef struct qcvm_s
 	dprograms_t		*progs;
 	dfunction_t		*functions;
 	dstatement_t	*statements;
+	dstatement_t	*code;		/* statements as the interpreter runs them, see PR_FuseStatements */
 	float			*globals;	/* same as pr_global_struct */
 	ddef_t			*fielddefs;	//yay reflection.
 
@@ -223,6 +319,9 @@ typedef struct qcvm_s
 
 	unsigned short	crc;
 
+	qboolean		profiling;	/* pr_profile was set when the outermost function was entered */
+	struct prprofiler_s	*profiler;
+
 	struct pr_extfuncs_s extfuncs;
 	struct pr_extglobals_s extglobals;
 	struct pr_extfields_s extfields;
@@ -239,6 +338,8 @@ typedef struct qcvm_s
 	int				maxknownstrings;
 	int				numknownstrings;
 	const char		**firstfreeknownstring; // free list (singly linked)
+	prstringmap_t	knownstringmap;
+	prtempstrings_t	tempstrings;
 
 	unsigned char	*knownzone;
 	size_t			knownzonesize;
@@ -268,6 +369,8 @@ typedef struct qcvm_s
 	edict_t		*edicts;			// can NOT be array indexed, because
 									// edict_t is variable sized, but can
 									// be used to reference the world ent
+	edicthot_t	hot;				// packed copies of the fields engine scans look at
+	edfind_t	find;				// string field indexes for PF_Find
 
 	int			numentityfields;
 	int			*entityfieldofs;
@@ -279,6 +382,10 @@ typedef struct qcvm_s
 
 	int			maxglobalofs;
 	int			*ofstoglobal;		// index of global at offset, or -1
+
+	void		*aotlib;			// compiled progs from pr_aot_export, if any
+	qcaotfunc_t	*aotfuncs;			// native code for each function, or NULL
+	qcaotctx_t	*aotctx;
 } qcvm_t;
 
 typedef struct savedata_s
@@ -314,6 +421,10 @@ void PR_PopQCVM(qcvm_t *oldvm);
 void PR_Init (void);
 
 void PR_ExecuteProgram (func_t fnum);
+void PR_FuseStatements (void);
+int PR_EnterFunction (dfunction_t *f);
+int PR_LeaveFunction (void);
+void PR_CheckBuiltinExtension (dfunction_t *func);
 void PR_ClearProgs(qcvm_t *vm);
 qboolean PR_LoadProgs (const char *filename, qboolean fatal);
 void PR_EnableExtensions (void);
@@ -326,13 +437,47 @@ const char *PR_GetString (int num);
 int PR_SetEngineString (const char *s);
 void PR_ClearEngineString (int num);
 int PR_AllocString (int bufferlength, char **ptr);
+char *PR_GetTempString (void);
+qboolean PR_IsTempString (const char *s);
+void PR_AdvanceTempStrings (void);
 
 void PR_Profile_f (void);
+void PR_ProfileDump_f (void);
+void PR_ProfileReset_f (void);
+void PR_ProfileFree (qcvm_t *vm);
+void PR_Bench_f (void);
+void PR_AbortBench (void);
+extern cvar_t pr_profile;
+extern cvar_t pr_superops;
+
+void PR_AotInit (void);
+void PR_AotLoad (void);
+void PR_AotFree (qcvm_t *vm);
+qboolean PR_AotExecute (dfunction_t *f);
+void PR_AotRun (dfunction_t *f);
+void PR_AotRunError (void);
+void PR_AotBuiltin (int num);
+void PR_AotTouch (edict_t *ed);
+float PR_AotRandom (float num);
+void PR_AotAbort (void);
+extern THREAD_LOCAL qboolean pr_aot_tracking;	// a compared call wants PR_AotTouch before entity writes
+extern cvar_t pr_aot;
 
 edict_t *ED_Alloc (void);
 void ED_Free (edict_t *ed);
+dfunction_t *ED_FindFunction (const char *fn_name);
 void ED_ClearEdict (edict_t *e);
 
+void ED_SyncHotFields (edict_t *ed);
+void ED_MarkHotFields (edict_t *ed);
+void ED_InvalidateHotFields (void);
+void ED_FlushHotFields (void);
+
+int ED_FindIndexed (int start, int ofs, const char *s);
+void ED_FindIndexStore (edict_t *ed, int ofs);
+void ED_TouchFindIndex (edict_t *ed);
+extern cvar_t pr_findindex;
+
 qboolean ED_IsRelevantField (edict_t *ed, ddef_t *d);
 const char *ED_FieldValueString (edict_t *ed, ddef_t *d);
 void ED_Print (edict_t *ed);
@@ -103,6 +103,10 @@ void S_ExtraUpdate (void);
 void S_BlockSound (void);
 void S_UnblockSound (void);
 
+/* guards channels, raw samples and dma state against the mixer thread */
+void S_LockMixer (void);
+void S_UnlockMixer (void);
+
 sfx_t *S_PrecacheSound (const char *sample);
 void S_TouchSound (const char *sample);
 void S_ClearPrecache (void);
@@ -110,6 +114,7 @@ void S_BeginPrecaching (void);
 void S_EndPrecaching (void);
 void S_PaintChannels (int endtime);
 void S_InitPaintChannels (void);
+void S_MixTest_f (void);
 float S_GetLoFreqLevel (void);
 float S_GetHiFreqLevel (void);
 
@@ -164,6 +169,7 @@ extern	int		total_channels;
 extern	int		soundtime;
 extern	int		paintedtime;
 extern	int		s_rawend;
+extern	qboolean	snd_threaded;	/* mixing happens on a separate thread */
 
 extern	vec3_t		listener_origin;
 extern	vec3_t		listener_forward;
@@ -175,6 +181,9 @@ extern	cvar_t		snd_mixspeed;
 extern	cvar_t		snd_filterquality;
 extern	cvar_t		sfxvolume;
 extern	cvar_t		loadas8bit;
+extern	cvar_t		snd_mixthread;
+extern	cvar_t		snd_resample;
+extern	cvar_t		snd_diskcache;
 
 #define	MAX_RAW_SAMPLES	8192
 extern	portable_samplepair_t	s_rawsamples[MAX_RAW_SAMPLES];
@@ -252,6 +252,7 @@ typedef struct
 
 #include "cmd.h"
 #include "crc.h"
+#include "tasks.h"
 
 #include "platform.h"
 #if defined(SDL_FRAMEWORK) || defined(NO_SDL_CONFIG)
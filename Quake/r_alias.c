@@ -35,9 +35,7 @@ const float	r_avertexnormals[NUMVERTEXNORMALS][3] = {
 #include "anorms.h"
 };
 
-extern vec3_t	lightcolor; //johnfitz -- replaces "float shadelight" for lit support
-
-static float	entalpha; //johnfitz
+extern THREAD_LOCAL vec3_t	lightcolor; //johnfitz -- replaces "float shadelight" for lit support
 
 //johnfitz -- struct for passing lerp information to drawing functions
 typedef struct {
@@ -76,6 +74,24 @@ struct ibuf_s {
 	aliasinstance_t inst[MAX_ALIAS_INSTANCES];
 } ibuf;
 
+// per-entity setup is spread over the worker threads in chunks, each entity
+// writing its own slot, then batched into ibuf in the original order
+#define ALIAS_SETUP_CHUNK 32
+
+typedef struct aliassetup_s {
+	entity_t		*ent;
+	aliashdr_t		*hdr;
+	qboolean		visible;
+	aliasinstance_t	inst;
+} aliassetup_t;
+
+static struct {
+	aliassetup_t	*setups;
+	int				count;
+	int				maxcount;
+	qboolean		showtris;
+} aliassetup;
+
 /*
 =================
 R_SetupAliasFrame -- johnfitz -- rewritten to support lerping
@@ -87,10 +103,7 @@ void R_SetupAliasFrame (entity_t *e, aliashdr_t *paliashdr, lerpdata_t *lerpdata
 	int frame = e->frame;
 
 	if ((frame >= paliashdr->numframes) || (frame < 0))
-	{
-		Con_DPrintf ("R_AliasSetupFrame: no such frame %d for '%s'\n", frame, e->model->name);
-		frame = 0;
-	}
+		frame = 0; // warned about in R_DrawAliasModels_Real
 
 	posenum = paliashdr->frames[frame].firstpose;
 	numposes = paliashdr->frames[frame].numposes;
@@ -467,22 +480,23 @@ static qboolean R_Alias_CanAddToBatch (const entity_t *e)
 
 /*
 =================
-R_DrawAliasModel_Real
+R_SetupAliasInstance
+
+Sets up lerping, lighting and instance data for one entity,
+returns false if it shouldn't be drawn.
+Runs on worker threads: must not touch the console, the cache or GL.
 =================
 */
-static void R_DrawAliasModel_Real (entity_t *e, qboolean showtris)
+static qboolean R_SetupAliasInstance (entity_t *e, aliashdr_t *paliashdr, qboolean showtris, aliasinstance_t *instance)
 {
-	aliashdr_t	*paliashdr;
 	lerpdata_t	lerpdata;
 	float		fovscale = 1.0f;
 	float		model_matrix[16];
-	aliasinstance_t	*instance;
+	float		entalpha; //johnfitz
 
 	//
 	// setup pose/lerp data -- do it first so we don't miss updates due to culling
 	//
-	paliashdr = (aliashdr_t *)Mod_Extradata (e->model);
-
 	R_SetupAliasFrame (e, paliashdr, &lerpdata);
 	R_SetupEntityTransform (e, &lerpdata);
 
@@ -509,7 +523,7 @@ static void R_DrawAliasModel_Real (entity_t *e, qboolean showtris)
 	// cull it
 	//
 	if (R_CullModelForEntity(e))
-		return;
+		return false;
 
 	//
 	// transform it
@@ -527,32 +541,22 @@ static void R_DrawAliasModel_Real (entity_t *e, qboolean showtris)
 		entalpha = ENTALPHA_DECODE(e->alpha);
 
 	if (entalpha == 0)
-		return;
+		return false;
 
 	//
 	// set up lighting
 	//
-	rs_aliaspolys += paliashdr->numtris;
 	R_SetupAliasLighting (e);
 
-	//
-	// draw it
-	//
-
 	if (r_fullbright_cheatsafe || showtris)
 		lightcolor[0] = lightcolor[1] = lightcolor[2] = 0.5f;
 
 	if (showtris)
 		entalpha = 1.f;
 
-	if (!R_Alias_CanAddToBatch (e))
-		R_FlushAliasInstances (showtris);
-
-	if (!ibuf.count)
-		ibuf.ent = e;
-
-	instance = &ibuf.inst[ibuf.count++];
-
+	//
+	// fill in instance data
+	//
 	MatrixTranspose4x3 (model_matrix, instance->worldmatrix);
 
 	instance->lightcolor[0] = lightcolor[0];
@@ -573,6 +577,79 @@ static void R_DrawAliasModel_Real (entity_t *e, qboolean showtris)
 		instance->pose1 *= paliashdr->numbones;
 		instance->pose2 *= paliashdr->numbones;
 	}
+
+	return true;
+}
+
+/*
+=================
+R_SetupAliasInstancesTask
+=================
+*/
+static void R_SetupAliasInstancesTask (int index, void *unused)
+{
+	int i, end;
+
+	i = index * ALIAS_SETUP_CHUNK;
+	end = q_min (i + ALIAS_SETUP_CHUNK, aliassetup.count);
+	for (; i < end; i++)
+	{
+		aliassetup_t *setup = &aliassetup.setups[i];
+		setup->visible = R_SetupAliasInstance (setup->ent, setup->hdr, aliassetup.showtris, &setup->inst);
+	}
+}
+
+/*
+=================
+R_DrawAliasModels_Real
+=================
+*/
+static void R_DrawAliasModels_Real (entity_t **ents, int count, qboolean showtris)
+{
+	aliassetup_t	*setup;
+	int				i;
+
+	if (count > aliassetup.maxcount)
+	{
+		aliassetup.maxcount = q_max (count, aliassetup.maxcount * 2);
+		aliassetup.setups = (aliassetup_t *) realloc (aliassetup.setups, sizeof (aliassetup.setups[0]) * aliassetup.maxcount);
+		if (!aliassetup.setups)
+			Sys_Error ("R_DrawAliasModels: out of memory on %d entities", aliassetup.maxcount);
+	}
+
+	// Mod_Extradata may have to reload the model, so it stays on this thread
+	for (i = 0; i < count; i++)
+	{
+		entity_t *e = ents[i];
+		setup = &aliassetup.setups[i];
+		setup->ent = e;
+		setup->hdr = (aliashdr_t *)Mod_Extradata (e->model);
+		if ((e->frame >= setup->hdr->numframes) || (e->frame < 0))
+			Con_DPrintf ("R_AliasSetupFrame: no such frame %d for '%s'\n", e->frame, e->model->name);
+	}
+
+	aliassetup.count = count;
+	aliassetup.showtris = showtris;
+	Tasks_ParallelFor (R_SetupAliasInstancesTask, (count + ALIAS_SETUP_CHUNK - 1) / ALIAS_SETUP_CHUNK, NULL);
+
+	for (i = 0; i < count; i++)
+	{
+		setup = &aliassetup.setups[i];
+		if (!setup->visible)
+			continue;
+
+		rs_aliaspolys += setup->hdr->numtris;
+
+		if (!R_Alias_CanAddToBatch (setup->ent))
+			R_FlushAliasInstances (showtris);
+
+		if (!ibuf.count)
+			ibuf.ent = setup->ent;
+
+		ibuf.inst[ibuf.count++] = setup->inst;
+	}
+
+	R_FlushAliasInstances (showtris);
 }
 
 /*
@@ -582,10 +659,7 @@ R_DrawAliasModels
 */
 void R_DrawAliasModels (entity_t **ents, int count)
 {
-	int i;
-	for (i = 0; i < count; i++)
-		R_DrawAliasModel_Real (ents[i], false);
-	R_FlushAliasInstances (false);
+	R_DrawAliasModels_Real (ents, count, false);
 }
 
 /*
@@ -595,8 +669,5 @@ R_DrawAliasModels_ShowTris
 */
 void R_DrawAliasModels_ShowTris (entity_t **ents, int count)
 {
-	int i;
-	for (i = 0; i < count; i++)
-		R_DrawAliasModel_Real (ents[i], true);
-	R_FlushAliasInstances (true);
+	R_DrawAliasModels_Real (ents, count, true);
 }
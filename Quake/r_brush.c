@@ -35,11 +35,28 @@ typedef struct {
 	int				*allocated;
 } chart_t;
 
+// lit surfaces are packed in fixed-size chunks of the sorted list, each into
+// its own run of blocks, so chunks can be packed in parallel and the result
+// does not depend on the number of worker threads
+#define LMPACK_CHUNK	8192
+
+typedef struct {
+	chart_t			chart;
+	int				first;			// first index into lit_surf_order[0]
+	int				count;
+	int				numblocks;
+	int				firstblock;		// index of the first block in lightmaps
+	int				samples;
+} lmpack_t;
+
 #define MAX_SANITY_LIGHTMAPS (1u<<20)
 lightmap_t		*lightmaps;
 int				lightmap_count;
-int				last_lightmap_allocated;
-chart_t			lightmap_chart;
+lmpack_t		*lightmap_packs;
+int				lightmap_numpacks;
+int				lightmap_maxpacks;
+short			lightmap_blacksize[2];
+short			lightmap_blackofs[2];
 msurface_t		**lit_surfs;
 int				*lit_surf_order[2];
 int				num_lightmap_samples;
@@ -167,10 +184,10 @@ static qboolean Chart_Add (chart_t *chart, int w, int h, short *outx, short *out
 
 /*
 ========================
-AllocBlock -- returns a texture number and the position inside it
+AllocBlock -- returns a block number local to the pack and the position inside it
 ========================
 */
-static int AllocBlock (int w, int h, short *x, short *y)
+static int AllocBlock (lmpack_t *pack, int w, int h, short *x, short *y)
 {
 	int		texnum;
 
@@ -179,27 +196,24 @@ static int AllocBlock (int w, int h, short *x, short *y)
 	// This makes AllocBlock much faster on large levels (can shave off 3+ seconds
 	// of load time on a level with 180 lightmaps), at a cost of not quite packing
 	// lightmaps as tightly vs. not doing this (uses ~5% more lightmaps)
-	for (texnum=last_lightmap_allocated ; texnum<MAX_SANITY_LIGHTMAPS ; texnum++)
+	for (texnum=q_max (pack->numblocks-1, 0) ; texnum<MAX_SANITY_LIGHTMAPS ; texnum++)
 	{
-		if (texnum == lightmap_count)
+		if (texnum == pack->numblocks)
 		{
-			lightmap_count++;
-			lightmaps = (lightmap_t *) realloc(lightmaps, sizeof(*lightmaps)*lightmap_count);
-			memset(&lightmaps[texnum], 0, sizeof(lightmaps[texnum]));
+			pack->numblocks++;
 			// as we're only tracking one texture, we don't need multiple copies any more.
-			Chart_Init (&lightmap_chart, LMBLOCK_WIDTH, LMBLOCK_HEIGHT);
+			Chart_Init (&pack->chart, LMBLOCK_WIDTH, LMBLOCK_HEIGHT);
 			// reserve 1 texel for unlit water surfaces in maps with lit water
-			if (lightmap_count == 1)
+			if (pack->numblocks == 1 && pack == &lightmap_packs[0])
 			{
-				lightmap_chart.x = 1;
-				lightmap_chart.allocated[0] = 1;
+				pack->chart.x = 1;
+				pack->chart.allocated[0] = 1;
 			}
 		}
 
-		if (!Chart_Add (&lightmap_chart, w, h, x, y))
+		if (!Chart_Add (&pack->chart, w, h, x, y))
 			continue;
 
-		last_lightmap_allocated = texnum;
 		return texnum;
 	}
 
@@ -309,13 +323,48 @@ static void GL_FreeLightmapData (void)
 	VEC_CLEAR (lit_surfs);
 
 	lightmap_texture = NULL; // freed by the texture manager
-	last_lightmap_allocated = 0;
+	lightmap_numpacks = 0;
 	lightmap_count = 0;
 	lightmap_width = 0;
 	lightmap_height = 0;
 	num_lightmap_samples = 0;
 }
 
+/*
+==================
+GL_PackLitSurfacesTask
+==================
+*/
+static void GL_PackLitSurfacesTask (int index, void *unused)
+{
+	lmpack_t	*pack = &lightmap_packs[index];
+	msurface_t	*surf;
+	short		blackofs[2];
+	int			i;
+
+	// the first pack starts with the shared block for surfaces without samples
+	if (index == 0)
+	{
+		AllocBlock (pack, lightmap_blacksize[0]+1, lightmap_blacksize[1]+1, &blackofs[0], &blackofs[1]);
+		lightmap_blackofs[0] = blackofs[0];
+		lightmap_blackofs[1] = blackofs[1];
+	}
+
+	for (i = pack->first; i < pack->first + pack->count; i++)
+	{
+		int smax, tmax;
+
+		surf = lit_surfs[lit_surf_order[0][i]];
+		smax = (surf->extents[0]>>4)+1;
+		tmax = (surf->extents[1]>>4)+1;
+		smax *= GL_NumLightmapTaps (surf);
+		pack->samples += smax * tmax;
+
+		if (surf->samples)
+			surf->lightmaptexturenum = AllocBlock (pack, smax, tmax, &surf->light_s, &surf->light_t);
+	}
+}
+
 /*
 ==================
 GL_PackLitSurfaces
@@ -325,8 +374,7 @@ static void GL_PackLitSurfaces (void)
 {
 	int			i, j, k, pass, bins[256];
 	int			maxblack[2] = {0, 0};
-	short		blackofs[2];
-	int			blacklm;
+	int			numsurfs;
 	msurface_t *surf;
 
 	// generate surface list
@@ -359,73 +407,117 @@ static void GL_PackLitSurfaces (void)
 		}
 	}
 
-	blacklm = AllocBlock (maxblack[0]+1, maxblack[1]+1, &blackofs[0], &blackofs[1]);
+	lightmap_blacksize[0] = maxblack[0];
+	lightmap_blacksize[1] = maxblack[1];
+	numsurfs = VEC_SIZE (lit_surfs);
 
-	if (VEC_SIZE (lit_surfs) == 0)
-		return;
+	if (numsurfs > 0)
+	{
+		lit_surf_order[0] = (int *) realloc (lit_surf_order[0], sizeof (lit_surf_order[0][0]) * numsurfs);
+		lit_surf_order[1] = (int *) realloc (lit_surf_order[1], sizeof (lit_surf_order[1][0]) * numsurfs);
 
-	lit_surf_order[0] = (int *) realloc (lit_surf_order[0], sizeof (lit_surf_order[0][0]) * VEC_SIZE (lit_surfs));
-	lit_surf_order[1] = (int *) realloc (lit_surf_order[1], sizeof (lit_surf_order[1][0]) * VEC_SIZE (lit_surfs));
+		if (!lit_surf_order[0] || !lit_surf_order[1])
+			Sys_Error ("GL_PackLitSurfaces: out of memory (%d surfs)", numsurfs);
 
-	if (!lit_surf_order[0] || !lit_surf_order[1])
-		Sys_Error ("GL_PackLitSurfaces: out of memory (%" SDL_PRIu64 " surfs)", (uint64_t) VEC_SIZE (lit_surfs));
+		for (i = 0; i < numsurfs; i++)
+			lit_surf_order[0][i] = i;
 
-	for (i = 0, j = VEC_SIZE (lit_surfs); i < j; i++)
-		lit_surf_order[0][i] = i;
+		// generate surface order (radix sort: 2 passes x 8-bits)
+		for (pass = 0; pass < 2; pass++)
+		{
+			memset (bins, 0, sizeof (bins));
 
-	// generate surface order (radix sort: 2 passes x 8-bits)
-	for (pass = 0; pass < 2; pass++)
-	{
-		memset (bins, 0, sizeof (bins));
+			// count keys
+			for (i = 0; i < numsurfs; i++)
+			{
+				int idx = lit_surf_order[pass][i];
+				surf = lit_surfs[idx];
+				k = surf->light_s & 255;
+				++bins[k];
+			}
 
-		// count keys
-		for (i = 0, j = VEC_SIZE (lit_surfs); i < j; i++)
-		{
-			int idx = lit_surf_order[pass][i];
-			surf = lit_surfs[idx];
-			k = surf->light_s & 255;
-			++bins[k];
-		}
+			// generate offsets (prefix sum)
+			for (i = 0, j = 0; i < countof(bins); i++)
+			{
+				int tmp = bins[i];
+				bins[i] = j;
+				j += tmp;
+			}
 
-		// generate offsets (prefix sum)
-		for (i = 0, j = 0; i < countof(bins); i++)
-		{
-			int tmp = bins[i];
-			bins[i] = j;
-			j += tmp;
+			// reorder
+			for (i = 0; i < numsurfs; i++)
+			{
+				int idx = lit_surf_order[pass][i];
+				surf = lit_surfs[idx];
+				k = surf->light_s & 255;
+				surf->light_s >>= 8;
+				lit_surf_order[pass ^ 1][bins[k]++] = idx;
+			}
 		}
+	}
 
-		// reorder
-		for (i = 0, j = VEC_SIZE (lit_surfs); i < j; i++)
-		{
-			int idx = lit_surf_order[pass][i];
-			surf = lit_surfs[idx];
-			k = surf->light_s & 255;
-			surf->light_s >>= 8;
-			lit_surf_order[pass ^ 1][bins[k]++] = idx;
-		}
+	// split the sorted list into chunks, there is always at least one
+	// for the block shared by surfaces without samples
+	lightmap_numpacks = q_max ((numsurfs + LMPACK_CHUNK - 1) / LMPACK_CHUNK, 1);
+	if (lightmap_numpacks > lightmap_maxpacks)
+	{
+		lightmap_packs = (lmpack_t *) realloc (lightmap_packs, sizeof (*lightmap_packs) * lightmap_numpacks);
+		if (!lightmap_packs)
+			Sys_Error ("GL_PackLitSurfaces: out of memory (%d packs)", lightmap_numpacks);
+		memset (&lightmap_packs[lightmap_maxpacks], 0, sizeof (*lightmap_packs) * (lightmap_numpacks - lightmap_maxpacks));
+		lightmap_maxpacks = lightmap_numpacks;
+	}
+	for (i = 0; i < lightmap_numpacks; i++)
+	{
+		lmpack_t *pack = &lightmap_packs[i];
+		pack->first = i * LMPACK_CHUNK;
+		pack->count = q_min (numsurfs - pack->first, LMPACK_CHUNK);
+		pack->numblocks = 0;
+		pack->samples = 0;
 	}
 
 	// pack surfaces in sort order
-	for (i = 0, j = VEC_SIZE (lit_surfs); i < j; i++)
+	Tasks_ParallelFor (GL_PackLitSurfacesTask, lightmap_numpacks, NULL);
+
+	// lay out the blocks of each pack one after another
+	for (i = 0; i < lightmap_numpacks; i++)
 	{
-		int smax, tmax;
+		lightmap_packs[i].firstblock = lightmap_count;
+		lightmap_count += lightmap_packs[i].numblocks;
+		num_lightmap_samples += lightmap_packs[i].samples;
+	}
 
-		surf = lit_surfs[lit_surf_order[0][i]];
-		smax = (surf->extents[0]>>4)+1;
-		tmax = (surf->extents[1]>>4)+1;
-		smax *= GL_NumLightmapTaps (surf);
-		num_lightmap_samples += smax * tmax;
+	lightmaps = (lightmap_t *) calloc (lightmap_count, sizeof (*lightmaps));
+	if (!lightmaps)
+		Sys_Error ("GL_PackLitSurfaces: out of memory (%d lightmaps)", lightmap_count);
+}
+
+/*
+==================
+GL_FillLightmapsTask
 
+Moves the surfaces of a pack to their final block and fills their samples
+==================
+*/
+static void GL_FillLightmapsTask (int index, void *unused)
+{
+	lmpack_t	*pack = &lightmap_packs[index];
+	msurface_t	*surf;
+	int			i;
+
+	for (i = pack->first; i < pack->first + pack->count; i++)
+	{
+		surf = lit_surfs[lit_surf_order[0][i]];
 		if (surf->samples)
 		{
-			surf->lightmaptexturenum = AllocBlock (smax, tmax, &surf->light_s, &surf->light_t);
+			surf->lightmaptexturenum += pack->firstblock;
+			GL_FillSurfaceLightmap (surf);
 		}
 		else
 		{
-			surf->lightmaptexturenum = blacklm;
-			surf->light_s = blackofs[0];
-			surf->light_t = blackofs[1];
+			surf->lightmaptexturenum = 0;
+			surf->light_s = lightmap_blackofs[0];
+			surf->light_t = lightmap_blackofs[1];
 		}
 	}
 }
@@ -440,8 +532,9 @@ with all the surfaces from all brush models
 */
 void GL_BuildLightmaps (void)
 {
-	int			i, j, xblocks, yblocks, lmsize;
+	int			i, xblocks, yblocks, lmsize;
 	lightmap_t	*lm;
+	double		time1, time2, time3;
 
 	r_framecount = 1; // no dlightcache
 
@@ -463,7 +556,9 @@ void GL_BuildLightmaps (void)
 	}
 
 	// allocate lightmap blocks
+	time1 = Sys_DoubleTime ();
 	GL_PackLitSurfaces ();
+	time2 = Sys_DoubleTime ();
 
 	// determine combined texture size and allocate memory for it
 	xblocks = (int) ceil (sqrt (lightmap_count));
@@ -508,8 +603,8 @@ void GL_BuildLightmaps (void)
 			lightmap_data[i] = 0xff808080u;
 
 	// fill lightmap samples
-	for (i = 0, j = VEC_SIZE (lit_surfs); i < j; i++)
-		GL_FillSurfaceLightmap (lit_surfs[i]);
+	Tasks_ParallelFor (GL_FillLightmapsTask, lightmap_numpacks, NULL);
+	time3 = Sys_DoubleTime ();
 
 	lightmap_texture =
 		TexMgr_LoadImage (cl.worldmodel, "lightmap", lightmap_width, lightmap_height,
@@ -517,6 +612,10 @@ void GL_BuildLightmaps (void)
 			TEXPREF_ALPHA | TEXPREF_LINEAR | TEXPREF_NOPICMIP
 		);
 
+	Con_DPrintf ("Lightmap build:  %.1f ms pack, %.1f ms fill, %.1f ms upload (%d surf%s in %d chunk%s)\n",
+		(time2 - time1) * 1000.0, (time3 - time2) * 1000.0, (Sys_DoubleTime () - time3) * 1000.0,
+		PLURAL ((int) VEC_SIZE (lit_surfs)), PLURAL (lightmap_numpacks));
+
 	//johnfitz -- warn about exceeding old limits
 	//GLQuake limit was 64 textures of 128x128. Estimate how many 128x128 textures we would need
 	//given that we are using lightmap_count of LMBLOCK_WIDTH x LMBLOCK_HEIGHT
@@ -32,7 +32,50 @@ static int	ramp1[8] = {0x6f, 0x6d, 0x6b, 0x69, 0x67, 0x65, 0x63, 0x61};
 static int	ramp2[8] = {0x6f, 0x6e, 0x6d, 0x6c, 0x6b, 0x6a, 0x68, 0x66};
 static int	ramp3[8] = {0x6d, 0x6b, 6, 5, 4, 3};
 
-particle_t	*particles;
+/*
+Particles are stored per type, as structure-of-arrays pools, so the
+per-frame update runs one branch-free loop per type instead of switching
+on every particle. Emitters fill in a particle_t and hand it to
+R_SpawnParticle, which scatters it into the pool for its type. Each
+particle keeps a spawn sequence number so drawing can still follow spawn
+order where blending depends on it.
+*/
+typedef struct
+{
+	int			count;
+	int			capacity;
+	float		*org[3];
+	float		*vel[3];
+	float		*ramp;
+	float		*spawn;
+	float		*die;
+	unsigned	*seq;		// spawn order, increasing within a pool
+	byte		*color;
+} partpool_t;
+
+typedef struct
+{
+	float		velscale[3];	// vel += vel * velscale * frametime
+	float		gravscale;		// vel[2] += gravscale * grav
+	float		rampscale;		// ramp += rampscale * frametime
+	float		ramplimit;		// particle dies once its ramp reaches this
+	const int	*ramptable;		// color = ramptable[(int)ramp], or NULL
+} partbehavior_t;
+
+static const partbehavior_t partbehaviors[pt_numtypes] =
+{
+	/* pt_static   */ {{ 0,  0,  0},  0,  0, 0, NULL},
+	/* pt_grav     */ {{ 0,  0,  0}, -1,  0, 0, NULL},
+	/* pt_slowgrav */ {{ 0,  0,  0}, -1,  0, 0, NULL},
+	/* pt_fire     */ {{ 0,  0,  0},  1,  5, 6, ramp3},
+	/* pt_explode  */ {{ 4,  4,  4}, -1, 10, 8, ramp1},
+	/* pt_explode2 */ {{-1, -1, -1}, -1, 15, 8, ramp2},
+	/* pt_blob     */ {{ 4,  4,  4}, -1,  0, 0, NULL},
+	/* pt_blob2    */ {{-4, -4,  0}, -1,  0, 0, NULL},
+};
+
+static partpool_t	partpools[pt_numtypes];
+static unsigned		partseq;
 int			r_numparticles, r_numactiveparticles;
 
 static float uvscale;
@@ -70,18 +113,95 @@ static void R_SetParticleTexture_f (cvar_t *var)
 
 /*
 ===============
-R_AllocParticle
+R_GrowParticlePool
 ===============
 */
-particle_t *R_AllocParticle (void)
+static void R_GrowParticlePool (partpool_t *pool)
 {
-	if (r_numactiveparticles < r_numparticles)
+	partpool_t	old = *pool;
+	float		*block;
+	int			i, capacity;
+
+	capacity = q_max (pool->capacity * 2, 256);
+	capacity = q_min (capacity, (r_numparticles + 3) & ~3);
+
+	// one block per pool: 9 float arrays, the sequence numbers, then the colors
+	block = (float *) malloc (capacity * (10 * sizeof (float) + 1));
+	if (!block)
+		Sys_Error ("R_GrowParticlePool: out of memory on %d particles", capacity);
+
+	for (i = 0; i < 3; i++)
+	{
+		pool->org[i] = block + capacity * i;
+		pool->vel[i] = block + capacity * (3 + i);
+	}
+	pool->ramp = block + capacity * 6;
+	pool->spawn = block + capacity * 7;
+	pool->die = block + capacity * 8;
+	pool->seq = (unsigned *) (block + capacity * 9);
+	pool->color = (byte *) (block + capacity * 10);
+	pool->capacity = capacity;
+
+	if (old.capacity)
 	{
-		particle_t *p = &particles[r_numactiveparticles++];
-		p->spawn = cl.time - 0.001;
-		return p;
+		for (i = 0; i < 3; i++)
+		{
+			memcpy (pool->org[i], old.org[i], old.count * sizeof (float));
+			memcpy (pool->vel[i], old.vel[i], old.count * sizeof (float));
+		}
+		memcpy (pool->ramp, old.ramp, old.count * sizeof (float));
+		memcpy (pool->spawn, old.spawn, old.count * sizeof (float));
+		memcpy (pool->die, old.die, old.count * sizeof (float));
+		memcpy (pool->seq, old.seq, old.count * sizeof (unsigned));
+		memcpy (pool->color, old.color, old.count);
+		free (old.org[0]);
 	}
-	return NULL;
+}
+
+/*
+===============
+R_AllocParticle
+
+clears p for an emitter to fill in, returns false if the particle limit is reached
+===============
+*/
+static qboolean R_AllocParticle (particle_t *p)
+{
+	if (r_numactiveparticles >= r_numparticles)
+		return false;
+	memset (p, 0, sizeof (*p));
+	return true;
+}
+
+/*
+===============
+R_SpawnParticle
+
+copies a particle filled in by an emitter into the pool for its type
+===============
+*/
+static void R_SpawnParticle (const particle_t *p)
+{
+	partpool_t	*pool = &partpools[p->type];
+	int			i;
+
+	if (pool->count == pool->capacity)
+		R_GrowParticlePool (pool);
+
+	i = pool->count++;
+	r_numactiveparticles++;
+
+	pool->org[0][i] = p->org[0];
+	pool->org[1][i] = p->org[1];
+	pool->org[2][i] = p->org[2];
+	pool->vel[0][i] = p->vel[0];
+	pool->vel[1][i] = p->vel[1];
+	pool->vel[2][i] = p->vel[2];
+	pool->ramp[i] = p->ramp;
+	pool->spawn[i] = cl.time - 0.001;
+	pool->die[i] = p->die;
+	pool->seq[i] = partseq++;
+	pool->color[i] = p->color;
 }
 
 /*
@@ -106,9 +226,7 @@ void R_InitParticles (void)
 		r_numparticles = MAX_PARTICLES;
 	}
 
-	particles = (particle_t *)
-			Hunk_AllocName (r_numparticles * sizeof(particle_t), "particles");
-	r_numactiveparticles = 0;
+	R_ClearParticles ();
 
 	Cvar_RegisterVariable (&r_particles); //johnfitz
 	Cvar_SetCallback (&r_particles, R_SetParticleTexture_f);
@@ -126,7 +244,7 @@ static float	beamlength = 16;
 void R_EntityParticles (entity_t *ent)
 {
 	int		i;
-	particle_t	*p;
+	particle_t	p;
 	float		angle;
 	float		sp, sy, cp, cy;
 //	float		sr, cr;
@@ -163,16 +281,18 @@ void R_EntityParticles (entity_t *ent)
 		forward[1] = cp*sy;
 		forward[2] = -sp;
 
-		if (!(p = R_AllocParticle ()))
+		if (!R_AllocParticle (&p))
 			return;
 
-		p->die = cl.time + 0.01;
-		p->color = 0x6f;
-		p->type = pt_explode;
+		p.die = cl.time + 0.01;
+		p.color = 0x6f;
+		p.type = pt_explode;
 
-		p->org[0] = ent->origin[0] + r_avertexnormals[i][0]*dist + forward[0]*beamlength;
-		p->org[1] = ent->origin[1] + r_avertexnormals[i][1]*dist + forward[1]*beamlength;
-		p->org[2] = ent->origin[2] + r_avertexnormals[i][2]*dist + forward[2]*beamlength;
+		p.org[0] = ent->origin[0] + r_avertexnormals[i][0]*dist + forward[0]*beamlength;
+		p.org[1] = ent->origin[1] + r_avertexnormals[i][1]*dist + forward[1]*beamlength;
+		p.org[2] = ent->origin[2] + r_avertexnormals[i][2]*dist + forward[2]*beamlength;
+
+		R_SpawnParticle (&p);
 	}
 }
 
@@ -183,6 +303,10 @@ R_ClearParticles
 */
 void R_ClearParticles (void)
 {
+	int i;
+
+	for (i = 0; i < pt_numtypes; i++)
+		partpools[i].count = 0;
 	r_numactiveparticles = 0;
 }
 
@@ -221,34 +345,36 @@ R_ParticleExplosion
 void R_ParticleExplosion (vec3_t org)
 {
 	int			i, j;
-	particle_t	*p;
+	particle_t	p;
 
 	for (i=0 ; i<1024 ; i++)
 	{
-		if (!(p = R_AllocParticle ()))
+		if (!R_AllocParticle (&p))
 			return;
 
-		p->die = cl.time + 5;
-		p->color = ramp1[0];
-		p->ramp = rand()&3;
+		p.die = cl.time + 5;
+		p.color = ramp1[0];
+		p.ramp = rand()&3;
 		if (i & 1)
 		{
-			p->type = pt_explode;
+			p.type = pt_explode;
 			for (j=0 ; j<3 ; j++)
 			{
-				p->org[j] = org[j] + ((rand()%32)-16);
-				p->vel[j] = (rand()%512)-256;
+				p.org[j] = org[j] + ((rand()%32)-16);
+				p.vel[j] = (rand()%512)-256;
 			}
 		}
 		else
 		{
-			p->type = pt_explode2;
+			p.type = pt_explode2;
 			for (j=0 ; j<3 ; j++)
 			{
-				p->org[j] = org[j] + ((rand()%32)-16);
-				p->vel[j] = (rand()%512)-256;
+				p.org[j] = org[j] + ((rand()%32)-16);
+				p.vel[j] = (rand()%512)-256;
 			}
 		}
+
+		R_SpawnParticle (&p);
 	}
 }
 
@@ -260,24 +386,26 @@ R_ParticleExplosion2
 void R_ParticleExplosion2 (vec3_t org, int colorStart, int colorLength)
 {
 	int			i, j;
-	particle_t	*p;
+	particle_t	p;
 	int			colorMod = 0;
 
 	for (i=0; i<512; i++)
 	{
-		if (!(p = R_AllocParticle ()))
+		if (!R_AllocParticle (&p))
 			return;
 
-		p->die = cl.time + 0.3;
-		p->color = colorStart + (colorMod % colorLength);
+		p.die = cl.time + 0.3;
+		p.color = colorStart + (colorMod % colorLength);
 		colorMod++;
 
-		p->type = pt_blob;
+		p.type = pt_blob;
 		for (j=0 ; j<3 ; j++)
 		{
-			p->org[j] = org[j] + ((rand()%32)-16);
-			p->vel[j] = (rand()%512)-256;
+			p.org[j] = org[j] + ((rand()%32)-16);
+			p.vel[j] = (rand()%512)-256;
 		}
+
+		R_SpawnParticle (&p);
 	}
 }
 
@@ -289,35 +417,37 @@ R_BlobExplosion
 void R_BlobExplosion (vec3_t org)
 {
 	int			i, j;
-	particle_t	*p;
+	particle_t	p;
 
 	for (i=0 ; i<1024 ; i++)
 	{
-		if (!(p = R_AllocParticle ()))
+		if (!R_AllocParticle (&p))
 			return;
 
-		p->die = cl.time + 1 + (rand()&8)*0.05;
+		p.die = cl.time + 1 + (rand()&8)*0.05;
 
 		if (i & 1)
 		{
-			p->type = pt_blob;
-			p->color = 66 + rand()%6;
+			p.type = pt_blob;
+			p.color = 66 + rand()%6;
 			for (j=0 ; j<3 ; j++)
 			{
-				p->org[j] = org[j] + ((rand()%32)-16);
-				p->vel[j] = (rand()%512)-256;
+				p.org[j] = org[j] + ((rand()%32)-16);
+				p.vel[j] = (rand()%512)-256;
 			}
 		}
 		else
 		{
-			p->type = pt_blob2;
-			p->color = 150 + rand()%6;
+			p.type = pt_blob2;
+			p.color = 150 + rand()%6;
 			for (j=0 ; j<3 ; j++)
 			{
-				p->org[j] = org[j] + ((rand()%32)-16);
-				p->vel[j] = (rand()%512)-256;
+				p.org[j] = org[j] + ((rand()%32)-16);
+				p.vel[j] = (rand()%512)-256;
 			}
 		}
+
+		R_SpawnParticle (&p);
 	}
 }
 
@@ -329,48 +459,50 @@ R_RunParticleEffect
 void R_RunParticleEffect (vec3_t org, vec3_t dir, int color, int count)
 {
 	int			i, j;
-	particle_t	*p;
+	particle_t	p;
 
 	for (i=0 ; i<count ; i++)
 	{
-		if (!(p = R_AllocParticle ()))
+		if (!R_AllocParticle (&p))
 			return;
 
 		if (count == 1024)
 		{	// rocket explosion
-			p->die = cl.time + 5;
-			p->color = ramp1[0];
-			p->ramp = rand()&3;
+			p.die = cl.time + 5;
+			p.color = ramp1[0];
+			p.ramp = rand()&3;
 			if (i & 1)
 			{
-				p->type = pt_explode;
+				p.type = pt_explode;
 				for (j=0 ; j<3 ; j++)
 				{
-					p->org[j] = org[j] + ((rand()%32)-16);
-					p->vel[j] = (rand()%512)-256;
+					p.org[j] = org[j] + ((rand()%32)-16);
+					p.vel[j] = (rand()%512)-256;
 				}
 			}
 			else
 			{
-				p->type = pt_explode2;
+				p.type = pt_explode2;
 				for (j=0 ; j<3 ; j++)
 				{
-					p->org[j] = org[j] + ((rand()%32)-16);
-					p->vel[j] = (rand()%512)-256;
+					p.org[j] = org[j] + ((rand()%32)-16);
+					p.vel[j] = (rand()%512)-256;
 				}
 			}
 		}
 		else
 		{
-			p->die = cl.time + 0.1*(rand()%5);
-			p->color = (color&~7) + (rand()&7);
-			p->type = pt_slowgrav;
+			p.die = cl.time + 0.1*(rand()%5);
+			p.color = (color&~7) + (rand()&7);
+			p.type = pt_slowgrav;
 			for (j=0 ; j<3 ; j++)
 			{
-				p->org[j] = org[j] + ((rand()&15)-8);
-				p->vel[j] = dir[j]*15;// + (rand()%300)-150;
+				p.org[j] = org[j] + ((rand()&15)-8);
+				p.vel[j] = dir[j]*15;// + (rand()%300)-150;
 			}
 		}
+
+		R_SpawnParticle (&p);
 	}
 }
 
@@ -382,7 +514,7 @@ R_LavaSplash
 void R_LavaSplash (vec3_t org)
 {
 	int			i, j, k;
-	particle_t	*p;
+	particle_t	p;
 	float		vel;
 	vec3_t		dir;
 
@@ -390,24 +522,26 @@ void R_LavaSplash (vec3_t org)
 		for (j=-16 ; j<16 ; j++)
 			for (k=0 ; k<1 ; k++)
 			{
-				if (!(p = R_AllocParticle ()))
+				if (!R_AllocParticle (&p))
 					return;
 
-				p->die = cl.time + 2 + (rand()&31) * 0.02;
-				p->color = 224 + (rand()&7);
-				p->type = pt_slowgrav;
+				p.die = cl.time + 2 + (rand()&31) * 0.02;
+				p.color = 224 + (rand()&7);
+				p.type = pt_slowgrav;
 
 				dir[0] = j*8 + (rand()&7);
 				dir[1] = i*8 + (rand()&7);
 				dir[2] = 256;
 
-				p->org[0] = org[0] + dir[0];
-				p->org[1] = org[1] + dir[1];
-				p->org[2] = org[2] + (rand()&63);
+				p.org[0] = org[0] + dir[0];
+				p.org[1] = org[1] + dir[1];
+				p.org[2] = org[2] + (rand()&63);
 
 				VectorNormalize (dir);
 				vel = 50 + (rand()&63);
-				VectorScale (dir, vel, p->vel);
+				VectorScale (dir, vel, p.vel);
+
+				R_SpawnParticle (&p);
 			}
 }
 
@@ -419,7 +553,7 @@ R_TeleportSplash
 void R_TeleportSplash (vec3_t org)
 {
 	int			i, j, k;
-	particle_t	*p;
+	particle_t	p;
 	float		vel;
 	vec3_t		dir;
 
@@ -429,24 +563,26 @@ void R_TeleportSplash (vec3_t org)
 		{
 			for (k=-24 ; k<32 ; k+=4)
 			{
-				if (!(p = R_AllocParticle ()))
+				if (!R_AllocParticle (&p))
 					return;
 
-				p->die = cl.time + 0.2 + (rand()&7) * 0.02;
-				p->color = 7 + (rand()&7);
-				p->type = pt_slowgrav;
+				p.die = cl.time + 0.2 + (rand()&7) * 0.02;
+				p.color = 7 + (rand()&7);
+				p.type = pt_slowgrav;
 
 				dir[0] = j*8;
 				dir[1] = i*8;
 				dir[2] = k*8;
 
-				p->org[0] = org[0] + i + (rand()&3);
-				p->org[1] = org[1] + j + (rand()&3);
-				p->org[2] = org[2] + k + (rand()&3);
+				p.org[0] = org[0] + i + (rand()&3);
+				p.org[1] = org[1] + j + (rand()&3);
+				p.org[2] = org[2] + k + (rand()&3);
 
 				VectorNormalize (dir);
 				vel = 50 + (rand()&63);
-				VectorScale (dir, vel, p->vel);
+				VectorScale (dir, vel, p.vel);
+
+				R_SpawnParticle (&p);
 			}
 		}
 	}
@@ -464,7 +600,7 @@ void R_RocketTrail (vec3_t start, vec3_t end, int type)
 	vec3_t		vec;
 	float		len;
 	int			j;
-	particle_t	*p;
+	particle_t	p;
 	int			dec;
 	static int	tracercount;
 
@@ -482,169 +618,267 @@ void R_RocketTrail (vec3_t start, vec3_t end, int type)
 	{
 		len -= dec;
 
-		if (!(p = R_AllocParticle ()))
+		if (!R_AllocParticle (&p))
 			return;
 
-		VectorCopy (vec3_origin, p->vel);
-		p->die = cl.time + 2;
+		VectorCopy (vec3_origin, p.vel);
+		p.die = cl.time + 2;
 
 		switch (type)
 		{
 			case 0:	// rocket trail
-				p->ramp = (rand()&3);
-				p->color = ramp3[(int)p->ramp];
-				p->type = pt_fire;
+				p.ramp = (rand()&3);
+				p.color = ramp3[(int)p.ramp];
+				p.type = pt_fire;
 				for (j=0 ; j<3 ; j++)
-					p->org[j] = start[j] + ((rand()%6)-3);
+					p.org[j] = start[j] + ((rand()%6)-3);
 				break;
 
 			case 1:	// smoke smoke
-				p->ramp = (rand()&3) + 2;
-				p->color = ramp3[(int)p->ramp];
-				p->type = pt_fire;
+				p.ramp = (rand()&3) + 2;
+				p.color = ramp3[(int)p.ramp];
+				p.type = pt_fire;
 				for (j=0 ; j<3 ; j++)
-					p->org[j] = start[j] + ((rand()%6)-3);
+					p.org[j] = start[j] + ((rand()%6)-3);
 				break;
 
 			case 2:	// blood
-				p->type = pt_grav;
-				p->color = 67 + (rand()&3);
+				p.type = pt_grav;
+				p.color = 67 + (rand()&3);
 				for (j=0 ; j<3 ; j++)
-					p->org[j] = start[j] + ((rand()%6)-3);
+					p.org[j] = start[j] + ((rand()%6)-3);
 				break;
 
 			case 3:
 			case 5:	// tracer
-				p->die = cl.time + 0.5;
-				p->type = pt_static;
+				p.die = cl.time + 0.5;
+				p.type = pt_static;
 				if (type == 3)
-					p->color = 52 + ((tracercount&4)<<1);
+					p.color = 52 + ((tracercount&4)<<1);
 				else
-					p->color = 230 + ((tracercount&4)<<1);
+					p.color = 230 + ((tracercount&4)<<1);
 
 				tracercount++;
 
-				VectorCopy (start, p->org);
+				VectorCopy (start, p.org);
 				if (tracercount & 1)
 				{
-					p->vel[0] = 30*vec[1];
-					p->vel[1] = 30*-vec[0];
+					p.vel[0] = 30*vec[1];
+					p.vel[1] = 30*-vec[0];
 				}
 				else
 				{
-					p->vel[0] = 30*-vec[1];
-					p->vel[1] = 30*vec[0];
+					p.vel[0] = 30*-vec[1];
+					p.vel[1] = 30*vec[0];
 				}
 				break;
 
 			case 4:	// slight blood
-				p->type = pt_grav;
-				p->color = 67 + (rand()&3);
+				p.type = pt_grav;
+				p.color = 67 + (rand()&3);
 				for (j=0 ; j<3 ; j++)
-					p->org[j] = start[j] + ((rand()%6)-3);
+					p.org[j] = start[j] + ((rand()%6)-3);
 				len -= 3;
 				break;
 
 			case 6:	// voor trail
-				p->color = 9*16 + 8 + (rand()&3);
-				p->type = pt_static;
-				p->die = cl.time + 0.3;
+				p.color = 9*16 + 8 + (rand()&3);
+				p.type = pt_static;
+				p.die = cl.time + 0.3;
 				for (j=0 ; j<3 ; j++)
-					p->org[j] = start[j] + ((rand()&15)-8);
+					p.org[j] = start[j] + ((rand()&15)-8);
 				break;
 		}
 
+		R_SpawnParticle (&p);
 		VectorAdd (start, vec, start);
 	}
 }
 
 /*
 ===============
-CL_RunParticles -- johnfitz -- all the particle behavior, separated from R_DrawParticles
+R_CopyParticle
 ===============
 */
-void CL_RunParticles (void)
+static inline void R_CopyParticle (partpool_t *pool, int to, int from)
 {
-	particle_t		*p;
-	int				i, cur, active;
-	float			time1, time2, time3, dvel, frametime, grav;
-	extern	cvar_t	sv_gravity;
+	pool->org[0][to] = pool->org[0][from];
+	pool->org[1][to] = pool->org[1][from];
+	pool->org[2][to] = pool->org[2][from];
+	pool->vel[0][to] = pool->vel[0][from];
+	pool->vel[1][to] = pool->vel[1][from];
+	pool->vel[2][to] = pool->vel[2][from];
+	pool->ramp[to] = pool->ramp[from];
+	pool->spawn[to] = pool->spawn[from];
+	pool->die[to] = pool->die[from];
+	pool->seq[to] = pool->seq[from];
+	pool->color[to] = pool->color[from];
+}
 
-	frametime = cl.time - cl.oldtime;
-	time3 = frametime * 15;
-	time2 = frametime * 10;
-	time1 = frametime * 5;
-	grav = frametime * sv_gravity.value * 0.05;
-	dvel = 4*frametime;
+/*
+===============
+R_UpdateParticle -- scalar path, also handles the tail of the SIMD loop
+===============
+*/
+static inline void R_UpdateParticle (partpool_t *pool, const partbehavior_t *b, int i,
+	float frametime, const float *velscale, float grav, float rampstep)
+{
+	pool->org[0][i] += pool->vel[0][i]*frametime;
+	pool->org[1][i] += pool->vel[1][i]*frametime;
+	pool->org[2][i] += pool->vel[2][i]*frametime;
+
+	pool->vel[0][i] += pool->vel[0][i]*velscale[0];
+	pool->vel[1][i] += pool->vel[1][i]*velscale[1];
+	pool->vel[2][i] += pool->vel[2][i]*velscale[2];
+	pool->vel[2][i] += grav;
 
-	for (cur = active = 0, p = particles; cur < r_numactiveparticles; cur++, p++)
+	if (b->ramptable)
 	{
-		if (p->die < cl.time || p->spawn > cl.time)
-			continue;
+		pool->ramp[i] += rampstep;
+		if (pool->ramp[i] >= b->ramplimit)
+			pool->die[i] = -1;
+		else
+			pool->color[i] = b->ramptable[(int)pool->ramp[i]];
+	}
+}
+
+/*
+===============
+R_RunParticlePool
+
+integrates one pool and drops dead particles, keeping the survivors in order.
+particles whose ramp runs out are flagged this frame and dropped the next,
+like the original per-particle code.
+===============
+*/
+static void R_RunParticlePool (partpool_t *pool, const partbehavior_t *b, float frametime, float grav)
+{
+	float	velscale[3], rampstep;
+	int		i, active;
 
-		p->org[0] += p->vel[0]*frametime;
-		p->org[1] += p->vel[1]*frametime;
-		p->org[2] += p->vel[2]*frametime;
+	velscale[0] = b->velscale[0] * frametime;
+	velscale[1] = b->velscale[1] * frametime;
+	velscale[2] = b->velscale[2] * frametime;
+	rampstep = b->rampscale * frametime;
+	grav *= b->gravscale;
 
-		switch (p->type)
+	i = active = 0;
+
+#ifdef USE_SSE2
+	if (use_simd)
+	{
+		__m128d	time = _mm_set1_pd (cl.time);
+		__m128	ft = _mm_set1_ps (frametime);
+		__m128	vs0 = _mm_set1_ps (velscale[0]);
+		__m128	vs1 = _mm_set1_ps (velscale[1]);
+		__m128	vs2 = _mm_set1_ps (velscale[2]);
+		__m128	g = _mm_set1_ps (grav);
+		__m128	step = _mm_set1_ps (rampstep);
+		__m128	limit = _mm_set1_ps (b->ramplimit);
+		__m128	minusone = _mm_set1_ps (-1.f);
+
+		for (; i + 4 <= pool->count; i += 4)
 		{
-		case pt_static:
-			break;
-		case pt_fire:
-			p->ramp += time1;
-			if (p->ramp >= 6)
-				p->die = -1;
-			else
-				p->color = ramp3[(int)p->ramp];
-			p->vel[2] += grav;
-			break;
-
-		case pt_explode:
-			p->ramp += time2;
-			if (p->ramp >=8)
-				p->die = -1;
-			else
-				p->color = ramp1[(int)p->ramp];
-			for (i=0 ; i<3 ; i++)
-				p->vel[i] += p->vel[i]*dvel;
-			p->vel[2] -= grav;
-			break;
-
-		case pt_explode2:
-			p->ramp += time3;
-			if (p->ramp >=8)
-				p->die = -1;
-			else
-				p->color = ramp2[(int)p->ramp];
-			for (i=0 ; i<3 ; i++)
-				p->vel[i] -= p->vel[i]*frametime;
-			p->vel[2] -= grav;
-			break;
-
-		case pt_blob:
-			for (i=0 ; i<3 ; i++)
-				p->vel[i] += p->vel[i]*dvel;
-			p->vel[2] -= grav;
-			break;
-
-		case pt_blob2:
-			for (i=0 ; i<2 ; i++)
-				p->vel[i] -= p->vel[i]*dvel;
-			p->vel[2] -= grav;
-			break;
-
-		case pt_grav:
-		case pt_slowgrav:
-			p->vel[2] -= grav;
-			break;
+			__m128	die, spawn, v0, v1, v2, o, ramp, expired;
+			int		alive, lane;
+
+			// alive = die >= cl.time && spawn <= cl.time, compared in double precision like the scalar code
+			die = _mm_loadu_ps (pool->die + i);
+			spawn = _mm_loadu_ps (pool->spawn + i);
+			alive =
+				(_mm_movemask_pd (_mm_cmpge_pd (_mm_cvtps_pd (die), time)) |
+				 _mm_movemask_pd (_mm_cmpge_pd (_mm_cvtps_pd (_mm_movehl_ps (die, die)), time)) << 2) &
+				(_mm_movemask_pd (_mm_cmple_pd (_mm_cvtps_pd (spawn), time)) |
+				 _mm_movemask_pd (_mm_cmple_pd (_mm_cvtps_pd (_mm_movehl_ps (spawn, spawn)), time)) << 2);
+			if (!alive)
+				continue;
+
+			v0 = _mm_loadu_ps (pool->vel[0] + i);
+			v1 = _mm_loadu_ps (pool->vel[1] + i);
+			v2 = _mm_loadu_ps (pool->vel[2] + i);
+
+			o = _mm_loadu_ps (pool->org[0] + i);
+			_mm_storeu_ps (pool->org[0] + i, _mm_add_ps (o, _mm_mul_ps (v0, ft)));
+			o = _mm_loadu_ps (pool->org[1] + i);
+			_mm_storeu_ps (pool->org[1] + i, _mm_add_ps (o, _mm_mul_ps (v1, ft)));
+			o = _mm_loadu_ps (pool->org[2] + i);
+			_mm_storeu_ps (pool->org[2] + i, _mm_add_ps (o, _mm_mul_ps (v2, ft)));
+
+			v0 = _mm_add_ps (v0, _mm_mul_ps (v0, vs0));
+			v1 = _mm_add_ps (v1, _mm_mul_ps (v1, vs1));
+			v2 = _mm_add_ps (v2, _mm_mul_ps (v2, vs2));
+			v2 = _mm_add_ps (v2, g);
+			_mm_storeu_ps (pool->vel[0] + i, v0);
+			_mm_storeu_ps (pool->vel[1] + i, v1);
+			_mm_storeu_ps (pool->vel[2] + i, v2);
+
+			if (b->ramptable)
+			{
+				ramp = _mm_add_ps (_mm_loadu_ps (pool->ramp + i), step);
+				expired = _mm_cmpge_ps (ramp, limit);
+				_mm_storeu_ps (pool->ramp + i, ramp);
+				_mm_storeu_ps (pool->die + i, _mm_or_ps (_mm_and_ps (expired, minusone), _mm_andnot_ps (expired, die)));
+				for (lane = 0; lane < 4; lane++)
+					if (pool->ramp[i + lane] < b->ramplimit)
+						pool->color[i + lane] = b->ramptable[(int)pool->ramp[i + lane]];
+			}
+
+			// stream compaction, nothing to move while no particle has died yet
+			if (alive == 15 && active == i)
+			{
+				active += 4;
+				continue;
+			}
+			for (lane = 0; lane < 4; lane++)
+			{
+				if (alive & (1 << lane))
+				{
+					if (active != i + lane)
+						R_CopyParticle (pool, active, i + lane);
+					active++;
+				}
+			}
 		}
+	}
+#endif
 
-		if (cur != active)
-			particles[active] = *p;
+	for (; i < pool->count; i++)
+	{
+		if (pool->die[i] < cl.time || pool->spawn[i] > cl.time)
+			continue;
+
+		R_UpdateParticle (pool, b, i, frametime, velscale, grav, rampstep);
+
+		if (i != active)
+			R_CopyParticle (pool, active, i);
 		active++;
 	}
 
-	r_numactiveparticles = active;
+	pool->count = active;
+}
+
+/*
+===============
+CL_RunParticles -- johnfitz -- all the particle behavior, separated from R_DrawParticles
+===============
+*/
+void CL_RunParticles (void)
+{
+	int				i;
+	float			frametime, grav;
+	extern	cvar_t	sv_gravity;
+
+	frametime = cl.time - cl.oldtime;
+	grav = frametime * sv_gravity.value * 0.05;
+
+	r_numactiveparticles = 0;
+	for (i = 0; i < pt_numtypes; i++)
+	{
+		if (!partpools[i].count)
+			continue;
+		R_RunParticlePool (&partpools[i], &partbehaviors[i], frametime, grav);
+		r_numactiveparticles += partpools[i].count;
+	}
 }
 
 /*
@@ -670,6 +904,31 @@ static void R_FlushParticleBatch (void)
 	numpartverts = 0;
 }
 
+/*
+===============
+R_AddParticleVert
+===============
+*/
+static void R_AddParticleVert (const partpool_t *pool, int i, qboolean showtris)
+{
+	static GLubyte	color[4] = {255, 255, 255, 255};
+	particlevert_t	*v;
+	GLubyte			*c;
+
+	if (numpartverts == countof(partverts))
+		R_FlushParticleBatch ();
+
+	v = &partverts[numpartverts++];
+	v->pos[0] = pool->org[0][i];
+	v->pos[1] = pool->org[1][i];
+	v->pos[2] = pool->org[2][i];
+
+	//johnfitz -- particle transparency and fade out
+	c = showtris ? color : (GLubyte *) &d_8to24table[pool->color[i]];
+	*(uint32_t*)&v->color = *(uint32_t*)c;
+	//johnfitz
+}
+
 /*
 ===============
 R_DrawParticles_Real -- johnfitz -- moved all non-drawing code to CL_RunParticles
@@ -677,14 +936,12 @@ R_DrawParticles_Real -- johnfitz -- moved all non-drawing code to CL_RunParticle
 */
 static void R_DrawParticles_Real (qboolean alpha, qboolean showtris)
 {
-	particle_t		*p;
-	particlevert_t	*v;
-	GLubyte			color[4] = {255, 255, 255, 255}, *c; //johnfitz -- particle transparency
+	partpool_t		*pool;
 	extern	cvar_t	r_particles; //johnfitz
 	//float			alpha; //johnfitz -- particle transparency
 	float			scalex, scaley;
 	qboolean		dither, oit;
-	int				i;
+	int				i, type, best, next[pt_numtypes];
 
 	if (!r_particles.value)
 		return;
@@ -717,23 +974,35 @@ static void R_DrawParticles_Real (qboolean alpha, qboolean showtris)
 		GL_SetState (GLS_BLEND_OPAQUE | GLS_CULL_NONE | GLS_ATTRIBS (2) | GLS_INSTANCED_ATTRIBS (2));
 
 	numpartverts = 0;
-	for (i = 0, p = particles; i < r_numactiveparticles; i++, p++)
+	if (oit)
 	{
-		if (numpartverts == countof(partverts))
-			R_FlushParticleBatch ();
-
-		v = &partverts[numpartverts++];
-		VectorCopy (p->org, v->pos);
-
-		//johnfitz -- particle transparency and fade out
-		c = showtris ? color : (GLubyte *) &d_8to24table[(int)p->color];
-		*(uint32_t*)&v->color = *(uint32_t*)c;
-		v->color[0] = c[0];
-		v->color[1] = c[1];
-		v->color[2] = c[2];
-		//alpha = CLAMP(0, p->die + 0.5 - cl.time, 1);
-		v->color[3] = c[3]; //(int)(alpha * 255);
-		//johnfitz
+		// order independent, draw pool by pool
+		for (type = 0; type < pt_numtypes; type++)
+		{
+			pool = &partpools[type];
+			for (i = 0; i < pool->count; i++)
+				R_AddParticleVert (pool, i, showtris);
+		}
+	}
+	else
+	{
+		// merge the pools back into spawn order, blending and
+		// coplanar depth ties depend on submission order
+		memset (next, 0, sizeof (next));
+		for (;;)
+		{
+			best = -1;
+			for (type = 0; type < pt_numtypes; type++)
+			{
+				if (next[type] >= partpools[type].count)
+					continue;
+				if (best < 0 || (int)(partpools[type].seq[next[type]] - partpools[best].seq[next[best]]) < 0)
+					best = type;
+			}
+			if (best < 0)
+				break;
+			R_AddParticleVert (&partpools[best], next[best]++, showtris);
+		}
 	}
 
 	R_FlushParticleBatch ();
@@ -32,11 +32,20 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 //=============================================================================
 
+#define LIGHTCACHE_PROBES	8
+
 typedef struct lightcache_s {
 	int					surfidx; // < 0: black surface; == 0: no cache; > 0: 1+index of surface
 	vec3_t				pos;
 	short				ds;
 	short				dt;
+
+	// light grid corners resolved by R_LightGridPoint
+	int					gridgen; // light grid generation, 0 = no cache
+	int					numprobes;
+	vec3_t				gridpos;
+	struct lightprobe_s	*probes[LIGHTCACHE_PROBES];
+	float				weights[LIGHTCACHE_PROBES];
 } lightcache_t;
 
 //johnfitz -- for lerping
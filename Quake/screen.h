@@ -36,6 +36,10 @@ void SCR_CenterPrint (const char *str);
 void SCR_BeginLoadingPlaque (void);
 void SCR_EndLoadingPlaque (void);
 
+void SCR_CaptureFrame (void);
+double SCR_CaptureFrameTime (void);
+void SCR_ShutdownCapture (void);
+
 int SCR_ModalMessage (const char *text, float timeout); //johnfitz -- added timeout
 
 extern	float		scr_con_current;
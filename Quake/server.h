@@ -40,6 +40,19 @@ typedef struct
 
 typedef enum {ss_loading, ss_active} server_state_t;
 
+typedef struct areanode_s
+{
+	int		axis;		// -1 = leaf node
+	float	dist;
+	struct areanode_s	*children[2];
+	link_t	trigger_edicts;
+	link_t	solid_edicts;
+} areanode_t;
+
+// Note: changing this can affect droptofloor
+#define	AREA_DEPTH	4
+#define	AREA_NODES	(2<<AREA_DEPTH)
+
 typedef struct
 {
 	qboolean	active;				// false if only a net client
@@ -53,6 +66,9 @@ typedef struct
 
 	qcvm_t		qcvm;				// Spike: entire qcvm state
 
+	areanode_t	areanodes[AREA_NODES];	// world partitioning for SV_LinkEdict/SV_Move
+	int			numareanodes;
+
 	char		name[64];			// map name
 	char		modelname[64];		// maps/<name>.bsp, for model_precache[0]
 	struct qmodel_s	*worldmodel;
@@ -60,6 +76,7 @@ typedef struct
 	struct qmodel_s	*models[MAX_MODELS];
 	const char	*sound_precache[MAX_SOUNDS];	// NULL terminated
 	const char	*lightstyles[MAX_LIGHTSTYLES];
+	char		tempstyles[MAX_LIGHTSTYLES][MAX_STYLESTRING];	// copies of temp strings passed to lightstyle
 	server_state_t	state;			// some actions are only valid during load
 
 	sizebuf_t	datagram;
@@ -259,12 +276,33 @@ extern	cvar_t	coop;
 extern	cvar_t	fraglimit;
 extern	cvar_t	timelimit;
 
-extern	server_static_t	svs;				// persistant server info
-extern	server_t		sv;					// local server
+/*
+Every server in the process has its own context. sv_maincontext is the
+regular local, listen or dedicated server; sv_instance adds more that only
+run a world (own qcvm, edicts and area nodes) on a worker thread each.
+sv, svs, host_client and sv_player name the fields of the context that is
+current on the calling thread.
+*/
+typedef struct server_context_s
+{
+	server_static_t	statics;			// persistant server info
+	server_t		server;				// local server
+	client_t		*client;			// host_client
+	edict_t			*player;			// sv_player
+
+	byte			*checkpvs;			// PF_checkclient, malloc'd
+	int				checkpvs_capacity;
 
-extern	client_t	*host_client;
+	struct svinstance_s	*instance;		// NULL for sv_maincontext
+} server_context_t;
 
-extern	edict_t		*sv_player;
+extern	server_context_t	sv_maincontext;
+extern	THREAD_LOCAL server_context_t	*sv_context;
+
+#define	svs			(sv_context->statics)
+#define	sv			(sv_context->server)
+#define	host_client	(sv_context->client)
+#define	sv_player	(sv_context->player)
 
 //===========================================================
 
@@ -307,4 +345,14 @@ void SV_RunClients (void);
 void SV_SaveSpawnparms (void);
 void SV_SpawnServer (const char *server);
 
+void SV_PushContext (server_context_t *ctx, server_context_t **old);
+void SV_PopContext (server_context_t *old);
+void SV_BeginInstanceFrames (void);
+void SV_WaitInstanceFrames (void);
+void SV_EndInstanceFrames (void);
+void SV_ShutdownInstances (void);
+FUNC_NORETURN void SV_AbortInstance (const char *message);
+void SV_InstanceCommand (const char *text);
+void SV_InstanceChangelevel (const char *mapname);
+
 #endif	/* QUAKE_SERVER_H */
@@ -34,6 +34,7 @@ static void S_SoundList (void);
 static void S_Update_ (void);
 void S_StopAllSounds (qboolean clear);
 static void S_StopAllSoundsC (void);
+static void S_LoadTest_f (void);
 
 void S_SetUnderwaterIntensity (float intensity);
 
@@ -47,6 +48,13 @@ int		total_channels;
 static int	snd_blocked = 0;
 static qboolean	snd_initialized = false;
 
+qboolean		snd_threaded = false;	// S_Update_ runs on snd_thread instead of the main loop
+static SDL_mutex	*snd_mutex = NULL;
+static SDL_Thread	*snd_thread = NULL;
+static SDL_atomic_t	snd_thread_quit;
+
+#define SND_MIXTHREAD_INTERVAL	5	// milliseconds between mixer thread updates
+
 static dma_t	sn;
 volatile dma_t	*shm = NULL;
 
@@ -85,6 +93,11 @@ cvar_t		snd_waterfx = {"snd_waterfx", "1", CVAR_ARCHIVE};
 
 cvar_t		snd_filterquality = {"snd_filterquality", "5", CVAR_ARCHIVE};
 
+cvar_t		snd_mixthread = {"snd_mixthread", "1", CVAR_ARCHIVE};
+
+cvar_t		snd_resample = {"snd_resample", "1", CVAR_ARCHIVE};	// 0: nearest sample, 1: windowed sinc
+cvar_t		snd_diskcache = {"snd_diskcache", "0", CVAR_ARCHIVE};
+
 static	cvar_t	nosound = {"nosound", "0", CVAR_NONE};
 static	cvar_t	ambient_level = {"ambient_level", "0.3", CVAR_NONE};
 static	cvar_t	ambient_fade = {"ambient_fade", "100", CVAR_NONE};
@@ -125,6 +138,162 @@ static void SND_Callback_snd_filterquality (cvar_t *var)
 	}
 }
 
+/*
+================
+S_LockMixer
+
+Serializes access to the channels, the raw sample buffer and the dma
+position between the main thread and the mixer thread.  The mutex is
+recursive, so the public entry points can nest freely.
+================
+*/
+void S_LockMixer (void)
+{
+	if (snd_mutex)
+		SDL_LockMutex (snd_mutex);
+}
+
+void S_UnlockMixer (void)
+{
+	if (snd_mutex)
+		SDL_UnlockMutex (snd_mutex);
+}
+
+/*
+================
+S_MixerThread
+
+Keeps the dma buffer topped up independently of the host frame rate, so
+long frames (map loads, vid_restart, hitches) don't starve the device.
+Sound data lives in the cache, so the cache is locked while painting to
+keep the main thread from flushing or moving it under our feet.
+================
+*/
+static int S_MixerThread (void *unused)
+{
+	while (!SDL_AtomicGet (&snd_thread_quit))
+	{
+		S_LockMixer ();
+		Cache_Lock ();
+		S_Update_ ();
+		Cache_Unlock ();
+		S_UnlockMixer ();
+
+		SDL_Delay (SND_MIXTHREAD_INTERVAL);
+	}
+
+	return 0;
+}
+
+static void S_StartMixerThread (void)
+{
+	if (snd_thread || !sound_started || !snd_mixthread.value)
+		return;
+
+	SDL_AtomicSet (&snd_thread_quit, 0);
+	snd_threaded = true;
+	snd_thread = SDL_CreateThread (S_MixerThread, "Mixer", NULL);
+	if (!snd_thread)
+	{
+		snd_threaded = false;
+		Con_Warning ("Couldn't create mixer thread: %s\n", SDL_GetError ());
+	}
+}
+
+static void S_StopMixerThread (void)
+{
+	if (!snd_thread)
+		return;
+
+	SDL_AtomicSet (&snd_thread_quit, 1);
+	SDL_WaitThread (snd_thread, NULL);
+	snd_thread = NULL;
+	snd_threaded = false;
+}
+
+/*
+================
+S_UncacheSounds
+
+Drops all loaded sound data so it is converted again on next use
+================
+*/
+static void S_UncacheSounds (void)
+{
+	int		i;
+
+	S_LockMixer ();
+	for (i = 0; i < num_sfx; i++)
+	{
+		if (Cache_Check (&known_sfx[i].cache))
+			Cache_Free (&known_sfx[i].cache, false);
+	}
+	S_UnlockMixer ();
+}
+
+static void SND_Callback_snd_resample (cvar_t *var)
+{
+	S_UncacheSounds ();
+}
+
+/*
+================
+S_LoadTest_f
+
+Times reloading every known sound from scratch, optionally several times
+================
+*/
+static void S_LoadTest_f (void)
+{
+	int		i, pass, passes, loaded, bytes;
+	double	start, best, total, elapsed;
+	sfxcache_t	*sc;
+
+	if (!sound_started || !shm)
+	{
+		Con_Printf ("sound system not started\n");
+		return;
+	}
+
+	passes = Cmd_Argc () > 1 ? q_max (atoi (Cmd_Argv (1)), 1) : 1;
+	best = total = 0.0;
+	loaded = bytes = 0;
+
+	for (pass = 0; pass < passes; pass++)
+	{
+		S_UncacheSounds ();
+
+		loaded = bytes = 0;
+		start = Sys_DoubleTime ();
+		for (i = 0; i < num_sfx; i++)
+		{
+			sc = S_LoadSound (&known_sfx[i]);
+			if (!sc)
+				continue;
+			loaded++;
+			bytes += sc->length * sc->width;
+		}
+		elapsed = Sys_DoubleTime () - start;
+
+		total += elapsed;
+		if (!pass || elapsed < best)
+			best = elapsed;
+	}
+
+	Con_Printf ("%d sounds, %.1f KB at %d Hz (snd_resample %g, snd_diskcache %g)\n",
+		loaded, bytes / 1024.0, shm->speed, snd_resample.value, snd_diskcache.value);
+	Con_Printf ("%d pass%s: %.2f ms avg, %.2f ms best\n",
+		passes, passes == 1 ? "" : "es", total * 1000.0 / passes, best * 1000.0);
+}
+
+static void SND_Callback_snd_mixthread (cvar_t *var)
+{
+	if (var->value)
+		S_StartMixerThread ();
+	else
+		S_StopMixerThread ();
+}
+
 /*
 ================
 S_Startup
@@ -178,6 +347,9 @@ void S_Init (void)
 	Cvar_RegisterVariable(&snd_mixspeed);
 	Cvar_RegisterVariable(&snd_filterquality);
 	Cvar_RegisterVariable(&snd_waterfx);
+	Cvar_RegisterVariable(&snd_mixthread);
+	Cvar_RegisterVariable(&snd_resample);
+	Cvar_RegisterVariable(&snd_diskcache);
 
 	if (safemode || COM_CheckParm("-nosound"))
 		return;
@@ -189,6 +361,8 @@ void S_Init (void)
 	Cmd_AddCommand("stopsound", S_StopAllSoundsC);
 	Cmd_AddCommand("soundlist", S_SoundList);
 	Cmd_AddCommand("soundinfo", S_SoundInfo_f);
+	Cmd_AddCommand("snd_mixtest", S_MixTest_f);
+	Cmd_AddCommand("snd_loadtest", S_LoadTest_f);
 
 	i = COM_CheckParm("-sndspeed");
 	if (i && i < com_argc-1)
@@ -210,6 +384,12 @@ void S_Init (void)
 
 	Cvar_SetCallback(&sfxvolume, SND_Callback_sfxvolume);
 	Cvar_SetCallback(&snd_filterquality, &SND_Callback_snd_filterquality);
+	Cvar_SetCallback(&snd_mixthread, SND_Callback_snd_mixthread);
+	Cvar_SetCallback(&snd_resample, SND_Callback_snd_resample);
+
+	snd_mutex = SDL_CreateMutex ();
+	if (!snd_mutex)
+		Sys_Error ("S_Init: couldn't create mixer mutex: %s", SDL_GetError ());
 
 	SND_InitScaletable ();
 
@@ -232,6 +412,8 @@ void S_Init (void)
 	S_CodecInit ();
 
 	S_StopAllSounds (true);
+
+	S_StartMixerThread ();
 }
 
 
@@ -243,6 +425,8 @@ void S_Shutdown (void)
 	if (!sound_started)
 		return;
 
+	S_StopMixerThread ();
+
 	sound_started = 0;
 	snd_blocked = 0;
 
@@ -435,7 +619,7 @@ void SND_Spatialize (channel_t *ch)
 // Start a sound effect
 // =======================================================================
 
-void S_StartSound (int entnum, int entchannel, sfx_t *sfx, vec3_t origin, float fvol, float attenuation)
+static void S_StartSound_ (int entnum, int entchannel, sfx_t *sfx, vec3_t origin, float fvol, float attenuation)
 {
 	channel_t	*target_chan, *check;
 	sfxcache_t	*sc;
@@ -529,10 +713,22 @@ void S_StartSound (int entnum, int entchannel, sfx_t *sfx, vec3_t origin, float
 	}
 }
 
+void S_StartSound (int entnum, int entchannel, sfx_t *sfx, vec3_t origin, float fvol, float attenuation)
+{
+	// load before locking so the mixer thread isn't held up by file I/O
+	if (sound_started && sfx && !nosound.value)
+		S_LoadSound (sfx);
+
+	S_LockMixer ();
+	S_StartSound_ (entnum, entchannel, sfx, origin, fvol, attenuation);
+	S_UnlockMixer ();
+}
+
 void S_StopSound (int entnum, int entchannel)
 {
 	int	i;
 
+	S_LockMixer ();
 	for (i = 0; i < MAX_DYNAMIC_CHANNELS; i++)
 	{
 		if (snd_channels[i].entnum == entnum
@@ -540,9 +736,10 @@ void S_StopSound (int entnum, int entchannel)
 		{
 			snd_channels[i].end = 0;
 			snd_channels[i].sfx = NULL;
-			return;
+			break;
 		}
 	}
+	S_UnlockMixer ();
 }
 
 void S_StopAllSounds (qboolean clear)
@@ -552,6 +749,8 @@ void S_StopAllSounds (qboolean clear)
 	if (!sound_started)
 		return;
 
+	S_LockMixer ();
+
 	total_channels = MAX_DYNAMIC_CHANNELS + NUM_AMBIENTS;	// no statics
 
 	for (i = 0; i < MAX_CHANNELS; i++)
@@ -564,6 +763,8 @@ void S_StopAllSounds (qboolean clear)
 
 	if (clear)
 		S_ClearBuffer ();
+
+	S_UnlockMixer ();
 }
 
 static void S_StopAllSoundsC (void)
@@ -578,9 +779,14 @@ void S_ClearBuffer (void)
 	if (!sound_started || !shm)
 		return;
 
+	S_LockMixer ();
+
 	SNDDMA_LockBuffer ();
 	if (! shm->buffer)
+	{
+		S_UnlockMixer ();
 		return;
+	}
 
 	s_rawend = 0;
 
@@ -593,6 +799,8 @@ void S_ClearBuffer (void)
 	memset (s_rawsamples, 0, sizeof (s_rawsamples));
 
 	SNDDMA_Submit ();
+
+	S_UnlockMixer ();
 }
 
 
@@ -601,7 +809,7 @@ void S_ClearBuffer (void)
 S_StaticSound
 =================
 */
-void S_StaticSound (sfx_t *sfx, vec3_t origin, float vol, float attenuation)
+static void S_StaticSound_ (sfx_t *sfx, vec3_t origin, float vol, float attenuation)
 {
 	channel_t	*ss;
 	sfxcache_t		*sc;
@@ -637,6 +845,16 @@ void S_StaticSound (sfx_t *sfx, vec3_t origin, float vol, float attenuation)
 	SND_Spatialize (ss);
 }
 
+void S_StaticSound (sfx_t *sfx, vec3_t origin, float vol, float attenuation)
+{
+	if (sound_started && sfx)
+		S_LoadSound (sfx);
+
+	S_LockMixer ();
+	S_StaticSound_ (sfx, origin, vol, attenuation);
+	S_UnlockMixer ();
+}
+
 
 //=============================================================================
 
@@ -824,10 +1042,36 @@ void S_Update (vec3_t origin, vec3_t forward, vec3_t right, vec3_t up)
 	int			total;
 	channel_t	*ch;
 	channel_t	*combine;
+	sfx_t		*reload[MAX_CHANNELS];
+	int			numreload;
 
 	if (!sound_started || (snd_blocked > 0))
 		return;
 
+// the mixer thread only plays sounds that are resident, so bring back
+// anything the cache has evicted since the last frame, without holding
+// the mixer lock during the load
+	numreload = 0;
+	if (snd_threaded)
+	{
+		S_LockMixer ();
+		for (i = NUM_AMBIENTS, ch = snd_channels + NUM_AMBIENTS; i < total_channels; i++, ch++)
+		{
+			if (!ch->sfx || Cache_Check (&ch->sfx->cache))
+				continue;
+			for (j = 0; j < numreload && reload[j] != ch->sfx; j++)
+				;
+			if (j == numreload)
+				reload[numreload++] = ch->sfx;
+		}
+		S_UnlockMixer ();
+
+		for (i = 0; i < numreload; i++)
+			S_LoadSound (reload[i]);
+	}
+
+	S_LockMixer ();
+
 	VectorCopy(origin, listener_origin);
 	VectorCopy(forward, listener_forward);
 	VectorCopy(right, listener_right);
@@ -844,6 +1088,8 @@ void S_Update (vec3_t origin, vec3_t forward, vec3_t right, vec3_t up)
 	{
 		if (!ch->sfx)
 			continue;
+		if (snd_threaded && !Cache_Check (&ch->sfx->cache))
+			continue;
 		SND_Spatialize(ch);	// respatialize channel
 		if (!ch->leftvol && !ch->rightvol)
 			continue;
@@ -912,7 +1158,10 @@ void S_Update (vec3_t origin, vec3_t forward, vec3_t right, vec3_t up)
 //	BGM_Update();	// moved to the main loop just before S_Update ()
 
 // mix some sound
-	S_Update_();
+	if (!snd_threaded)
+		S_Update_();
+
+	S_UnlockMixer ();
 }
 
 static void GetSoundtime (void)
@@ -948,6 +1197,8 @@ void S_ExtraUpdate (void)
 {
 	if (snd_noextraupdate.value)
 		return;		// don't pollute timings
+	if (snd_threaded)
+		return;		// the mixer thread keeps up on its own
 	S_Update_();
 }
 
@@ -988,6 +1239,7 @@ void S_BlockSound (void)
 /* FIXME: do we really need the blocking at the
  * driver level?
  */
+	S_LockMixer ();
 	if (sound_started && snd_blocked == 0)	/* ++snd_blocked == 1 */
 	{
 		snd_blocked  = 1;
@@ -995,18 +1247,21 @@ void S_BlockSound (void)
 		if (shm)
 			SNDDMA_BlockSound();
 	}
+	S_UnlockMixer ();
 }
 
 void S_UnblockSound (void)
 {
 	if (!sound_started || !snd_blocked)
 		return;
+	S_LockMixer ();
 	if (snd_blocked == 1)			/* --snd_blocked == 0 */
 	{
 		snd_blocked  = 0;
 		SNDDMA_UnblockSound();
 		S_ClearBuffer ();
 	}
+	S_UnlockMixer ();
 }
 
 /*
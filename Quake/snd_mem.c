@@ -23,26 +23,189 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "quakedef.h"
 
+/*
+===============================================================================
+
+WINDOWED-SINC RESAMPLER
+
+Each output sample is a RESAMPLE_TAPS-point dot product of the input with
+a Blackman-windowed sinc, picked from a table of RESAMPLE_PHASES sub-sample
+positions.  When decimating, the cutoff is lowered to the output nyquist.
+
+===============================================================================
+*/
+
+#define RESAMPLE_TAPS		16
+#define RESAMPLE_PHASES		256
+#define RESAMPLE_FRACBITS	16
+#define RESAMPLE_LEAD		(RESAMPLE_TAPS/2 - 1)	// taps before the sample position
+
+static float	resample_kernel[RESAMPLE_PHASES][RESAMPLE_TAPS];
+static float	resample_ratio;
+
+/*
+================
+S_BuildResampleKernel
+================
+*/
+static void S_BuildResampleKernel (float ratio)
+{
+	double	cutoff, x, n, w, sinc, sum;
+	int		p, t;
+
+	if (resample_ratio == ratio)
+		return;
+	resample_ratio = ratio;
+
+	cutoff = ratio > 1.f ? 1.0 / ratio : 1.0;
+
+	for (p = 0; p < RESAMPLE_PHASES; p++)
+	{
+		sum = 0.0;
+		for (t = 0; t < RESAMPLE_TAPS; t++)
+		{
+			x = (t - RESAMPLE_LEAD) - p / (double)RESAMPLE_PHASES;
+			n = x + RESAMPLE_TAPS/2;
+			w = 0.42 - 0.5*cos(2*M_PI*n/RESAMPLE_TAPS) + 0.08*cos(4*M_PI*n/RESAMPLE_TAPS);
+			sinc = x == 0.0 ? 1.0 : sin(M_PI*cutoff*x) / (M_PI*cutoff*x);
+			resample_kernel[p][t] = sinc * w;
+			sum += resample_kernel[p][t];
+		}
+	// unity gain at DC for every phase
+		for (t = 0; t < RESAMPLE_TAPS; t++)
+			resample_kernel[p][t] /= sum;
+	}
+}
+
+/*
+================
+S_ResampleSinc_C
+
+in is padded with RESAMPLE_LEAD samples in front and RESAMPLE_TAPS after.
+The four partial sums mirror the SSE2 lanes so both paths agree exactly.
+================
+*/
+static void S_ResampleSinc_C (const float *in, float *out, int outcount, uint64_t step)
+{
+	uint64_t	pos;
+	int			i, t;
+
+	for (i = 0, pos = 0; i < outcount; i++, pos += step)
+	{
+		const float *src = in + (pos >> RESAMPLE_FRACBITS);
+		const float *k = resample_kernel[(pos >> (RESAMPLE_FRACBITS - 8)) & (RESAMPLE_PHASES - 1)];
+		float acc[4];
+
+		for (t = 0; t < 4; t++)
+			acc[t] = src[t] * k[t];
+		for (t = 4; t < RESAMPLE_TAPS; t += 4)
+		{
+			acc[0] += src[t+0] * k[t+0];
+			acc[1] += src[t+1] * k[t+1];
+			acc[2] += src[t+2] * k[t+2];
+			acc[3] += src[t+3] * k[t+3];
+		}
+		out[i] = (acc[0] + acc[2]) + (acc[1] + acc[3]);
+	}
+}
+
+#ifdef USE_SSE2
+static void S_ResampleSinc_SSE2 (const float *in, float *out, int outcount, uint64_t step)
+{
+	uint64_t	pos;
+	int			i, t;
+
+	for (i = 0, pos = 0; i < outcount; i++, pos += step)
+	{
+		const float *src = in + (pos >> RESAMPLE_FRACBITS);
+		const float *k = resample_kernel[(pos >> (RESAMPLE_FRACBITS - 8)) & (RESAMPLE_PHASES - 1)];
+		__m128 acc = _mm_mul_ps (_mm_loadu_ps (src), _mm_loadu_ps (k));
+
+		for (t = 4; t < RESAMPLE_TAPS; t += 4)
+			acc = _mm_add_ps (acc, _mm_mul_ps (_mm_loadu_ps (src + t), _mm_loadu_ps (k + t)));
+
+		acc = _mm_add_ps (acc, _mm_movehl_ps (acc, acc));
+		acc = _mm_add_ss (acc, _mm_shuffle_ps (acc, acc, _MM_SHUFFLE (1, 1, 1, 1)));
+		_mm_store_ss (out + i, acc);
+	}
+}
+#endif
+
+/*
+================
+S_ResampleSinc
+
+Fills the cache's data with outcount samples converted from data.
+Looping sounds are padded with their loop start so the seam stays smooth.
+================
+*/
+static void S_ResampleSinc (sfxcache_t *sc, int inrate, int inwidth, int incount, int outcount, const byte *data)
+{
+	float		*in, *out, v;
+	uint64_t	step;
+	int			i, sample, padcount;
+
+	padcount = RESAMPLE_LEAD + incount + RESAMPLE_TAPS;
+	in = (float *) calloc (padcount + outcount, sizeof (float));
+	if (!in)
+		Sys_Error ("S_ResampleSinc: out of memory (%" SDL_PRIu64 " bytes)", (uint64_t)((padcount + outcount) * sizeof (float)));
+	out = in + padcount;
+
+	for (i = 0; i < incount; i++)
+	{
+		if (inwidth == 2)
+			sample = LittleShort (((const short *)data)[i]);
+		else
+			sample = (int)(data[i] - 128) << 8;
+		in[RESAMPLE_LEAD + i] = sample;
+	}
+	if (sc->loopstart >= 0 && sc->loopstart < outcount)
+	{
+		int loopin = (int)(sc->loopstart * ((float)inrate / shm->speed));
+		for (i = 0; i < RESAMPLE_TAPS && loopin + i < incount; i++)
+			in[RESAMPLE_LEAD + incount + i] = in[RESAMPLE_LEAD + loopin + i];
+	}
+
+	S_BuildResampleKernel ((float)inrate / shm->speed);
+	step = (uint64_t)(((double)inrate / shm->speed) * (1 << RESAMPLE_FRACBITS) + 0.5);
+
+#ifdef USE_SSE2
+	if (use_simd)
+		S_ResampleSinc_SSE2 (in, out, outcount, step);
+	else
+#endif
+		S_ResampleSinc_C (in, out, outcount, step);
+
+	for (i = 0; i < outcount; i++)
+	{
+		v = out[i];
+		sample = (int)(v >= 0.f ? v + 0.5f : v - 0.5f);
+		sample = CLAMP (-32768, sample, 32767);
+		if (sc->width == 2)
+			((short *)sc->data)[i] = sample;
+		else
+			((signed char *)sc->data)[i] = sample >> 8;
+	}
+
+	free (in);
+}
+
 /*
 ================
 ResampleSfx
 ================
 */
-static void ResampleSfx (sfx_t *sfx, int inrate, int inwidth, byte *data)
+static void ResampleSfx (sfxcache_t *sc, int inrate, int inwidth, byte *data)
 {
-	int		outcount;
+	int		outcount, incount;
 	int		srcsample;
 	float	stepscale;
 	int		i;
 	int		sample, samplefrac, fracstep;
-	sfxcache_t	*sc;
-
-	sc = (sfxcache_t *) Cache_Check (&sfx->cache);
-	if (!sc)
-		return;
 
 	stepscale = (float)inrate / shm->speed;	// this is usually 0.5, 1, or 2
 
+	incount = sc->length;
 	outcount = sc->length / stepscale;
 	sc->length = outcount;
 	if (sc->loopstart != -1)
@@ -63,6 +226,10 @@ static void ResampleSfx (sfx_t *sfx, int inrate, int inwidth, byte *data)
 		for (i = 0; i < outcount; i++)
 			((signed char *)sc->data)[i] = (int)( (unsigned char)(data[i]) - 128);
 	}
+	else if (stepscale != 1 && snd_resample.value)
+	{
+		S_ResampleSinc (sc, inrate, inwidth, incount, outcount, data);
+	}
 	else
 	{
 // general case
@@ -85,11 +252,165 @@ static void ResampleSfx (sfx_t *sfx, int inrate, int inwidth, byte *data)
 	}
 }
 
+/*
+===============================================================================
+
+RESAMPLED SOUND DISK CACHE
+
+Converted samples are kept under <gamedir>/sndcache, keyed by a hash of
+the source file plus everything that affects the conversion, so a sound
+only goes through ResampleSfx once per output format.
+
+===============================================================================
+*/
+
+#define SNDCACHE_IDENT		(('C'<<24)+('D'<<16)+('N'<<8)+'S')
+#define SNDCACHE_VERSION	1
+
+typedef struct
+{
+	int			ident;
+	int			version;
+	unsigned	srchash;	// COM_HashBlock of the source file
+	int			speed;		// output rate
+	int			width;		// output sample width
+	int			as8bit;		// loadas8bit setting
+	int			resample;	// snd_resample mode
+	int			length;
+	int			loopstart;
+	int			datasize;
+} sndcachehdr_t;
+
+static void S_SoundCachePath (const sfx_t *s, char *path, size_t pathsize)
+{
+	q_snprintf (path, pathsize, "%s/sndcache/%s.pcm", com_gamedir, s->name);
+}
+
+/*
+================
+S_ReadSoundCache
+
+Returns a malloc'd copy of the converted sound, or NULL on a miss
+================
+*/
+static sfxcache_t *S_ReadSoundCache (sfx_t *s, unsigned srchash)
+{
+	char			path[MAX_OSPATH];
+	sndcachehdr_t	hdr;
+	sfxcache_t		*sc;
+	FILE			*f;
+
+	S_SoundCachePath (s, path, sizeof (path));
+	f = Sys_fopen (path, "rb");
+	if (!f)
+		return NULL;
+
+	sc = NULL;
+	if (fread (&hdr, sizeof (hdr), 1, f) == 1 &&
+		hdr.ident == SNDCACHE_IDENT &&
+		hdr.version == SNDCACHE_VERSION &&
+		hdr.srchash == srchash &&
+		hdr.speed == shm->speed &&
+		hdr.as8bit == (loadas8bit.value != 0) &&
+		(hdr.width == 1 || hdr.width == 2) &&
+		hdr.resample == (int)snd_resample.value &&
+		hdr.length > 0 && hdr.datasize == hdr.length * hdr.width &&
+		hdr.loopstart >= -1 && hdr.loopstart < hdr.length)
+	{
+		sc = (sfxcache_t *) malloc (hdr.datasize + sizeof (sfxcache_t));
+		if (sc)
+		{
+			sc->length = hdr.length;
+			sc->loopstart = hdr.loopstart;
+			sc->speed = hdr.speed;
+			sc->width = hdr.width;
+			sc->stereo = 0;
+			if (fread (sc->data, hdr.datasize, 1, f) != 1)
+			{
+				free (sc);
+				sc = NULL;
+			}
+		}
+	}
+
+	fclose (f);
+	return sc;
+}
+
+/*
+================
+S_WriteSoundCache
+================
+*/
+static void S_WriteSoundCache (const sfx_t *s, const sfxcache_t *sc, unsigned srchash)
+{
+	char			path[MAX_OSPATH];
+	sndcachehdr_t	hdr;
+	FILE			*f;
+
+	hdr.ident = SNDCACHE_IDENT;
+	hdr.version = SNDCACHE_VERSION;
+	hdr.srchash = srchash;
+	hdr.speed = sc->speed;
+	hdr.width = sc->width;
+	hdr.as8bit = loadas8bit.value != 0;
+	hdr.resample = (int)snd_resample.value;
+	hdr.length = sc->length;
+	hdr.loopstart = sc->loopstart;
+	hdr.datasize = sc->length * sc->width;
+
+	S_SoundCachePath (s, path, sizeof (path));
+	COM_CreatePath (path);
+	f = Sys_fopen (path, "wb");
+	if (!f)
+		return;
+
+	if (fwrite (&hdr, sizeof (hdr), 1, f) != 1 || fwrite (sc->data, hdr.datasize, 1, f) != 1)
+	{
+		fclose (f);
+		Sys_remove (path);
+		return;
+	}
+
+	fclose (f);
+}
+
 //=============================================================================
 
+/*
+==============
+S_StoreSound
+
+Copies a converted sound into the cache and frees it
+==============
+*/
+static sfxcache_t *S_StoreSound (sfx_t *s, sfxcache_t *temp)
+{
+	sfxcache_t	*sc;
+	int			size;
+
+	size = temp->length * temp->width + sizeof (sfxcache_t);
+
+	Cache_Lock ();
+	sc = (sfxcache_t *) Cache_Check (&s->cache);
+	if (!sc)
+	{
+		sc = (sfxcache_t *) Cache_Alloc (&s->cache, size, s->name);
+		if (sc)
+			memcpy (sc, temp, size);
+	}
+	Cache_Unlock ();
+
+	free (temp);
+	return sc;
+}
+
 /*
 ==============
 S_LoadSound
+
+Decoding and resampling work on a private buffer, only the copy into the
+cache is locked, so the mixer thread keeps running during loads
 ==============
 */
 sfxcache_t *S_LoadSound (sfx_t *s)
@@ -99,6 +420,7 @@ sfxcache_t *S_LoadSound (sfx_t *s)
 	wavinfo_t	info;
 	int		len;
 	float	stepscale;
+	unsigned	srchash;
 	sfxcache_t	*sc;
 
 // see if still in memory
@@ -122,6 +444,18 @@ sfxcache_t *S_LoadSound (sfx_t *s)
 		return NULL;
 	}
 
+	srchash = 0;
+	if (snd_diskcache.value)
+	{
+		srchash = COM_HashBlock (data, com_filesize);
+		sc = S_ReadSoundCache (s, srchash);
+		if (sc)
+		{
+			free (data);
+			return S_StoreSound (s, sc);
+		}
+	}
+
 	info = GetWavinfo (s->name, data, com_filesize);
 	if (info.channels != 1)
 	{
@@ -149,10 +483,11 @@ sfxcache_t *S_LoadSound (sfx_t *s)
 		return NULL;
 	}
 
-	sc = (sfxcache_t *) Cache_Alloc ( &s->cache, len + sizeof(sfxcache_t), s->name);
+	sc = (sfxcache_t *) malloc (len + sizeof(sfxcache_t));
 	if (!sc)
 	{
 		free (data);
+		Con_Printf ("%s is too large (%d bytes)\n", s->name, len);
 		return NULL;
 	}
 
@@ -162,11 +497,14 @@ sfxcache_t *S_LoadSound (sfx_t *s)
 	sc->width = info.width;
 	sc->stereo = info.channels;
 
-	ResampleSfx (s, sc->speed, sc->width, data + info.dataofs);
+	ResampleSfx (sc, sc->speed, sc->width, data + info.dataofs);
 
 	free (data);
 
-	return sc;
+	if (snd_diskcache.value)
+		S_WriteSoundCache (s, sc, srchash);
+
+	return S_StoreSound (s, sc);
 }
 
 
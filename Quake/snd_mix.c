@@ -200,6 +200,7 @@ static void S_MakeBlackmanWindowKernel(float *kernel, int M, float f_c)
 typedef struct {
 	float *memory;  // kernelsize floats
 	float *kernel;  // kernelsize floats
+	float *input;   // kernelsize + PAINTBUFFER_SIZE floats, scratch for S_ApplyFilter
 	int kernelsize; // M+1, rounded up to be a multiple of 16
 	int M;			// M value used to make kernel, even
 	int parity;		// 0-3
@@ -212,6 +213,7 @@ static void S_UpdateFilter(filter_t *filter, int M, float f_c)
 	{
 		if (filter->memory != NULL) free(filter->memory);
 		if (filter->kernel != NULL) free(filter->kernel);
+		if (filter->input != NULL) free(filter->input);
 
 		filter->M = M;
 		filter->f_c = f_c;
@@ -221,9 +223,10 @@ static void S_UpdateFilter(filter_t *filter, int M, float f_c)
 		filter->kernelsize = (M + 1) + 16 - ((M + 1) % 16);
 		filter->memory = (float *) calloc(filter->kernelsize, sizeof(float));
 		filter->kernel = (float *) calloc(filter->kernelsize, sizeof(float));
+		filter->input = (float *) malloc((filter->kernelsize + PAINTBUFFER_SIZE) * sizeof(float));
 
-		if (!filter->memory || !filter->kernel)
-			Sys_Error ("S_UpdateFilter: out of memory (%" SDL_PRIu64 " bytes)", (uint64_t)(filter->kernelsize * sizeof (float)));
+		if (!filter->memory || !filter->kernel || !filter->input)
+			Sys_Error ("S_UpdateFilter: out of memory (%" SDL_PRIu64 " bytes)", (uint64_t)((filter->kernelsize + PAINTBUFFER_SIZE) * sizeof (float)));
 
 		S_MakeBlackmanWindowKernel(filter->kernel, M, f_c);
 	}
@@ -239,22 +242,20 @@ As an optimization, it decimates the audio to 11025Hz (setting every sample
 position that's not a multiple of 4 to 0), then convoluting with the filter
 kernel is 4x faster, because we can skip 3/4 of the input samples that are
 known to be 0 and skip 3/4 of the filter kernel.
+
+The input scratch buffer is owned by the filter rather than taken from
+the hunk, since this may run on the mixer thread (count is at most
+PAINTBUFFER_SIZE).
 ==============
 */
 static void S_ApplyFilter(filter_t *filter, int *data, int stride, int count)
 {
 	int i, j;
-	size_t inputsize;
-	float *input;
+	float *input = filter->input;
 	const int kernelsize = filter->kernelsize;
 	const float *kernel = filter->kernel;
-	int mark;
 	int parity;
 
-	mark = Hunk_LowMark ();
-	inputsize = sizeof(float) * (filter->kernelsize + count);
-	input = (float *) Hunk_AllocNoFill (inputsize);
-
 // set up the input buffer
 // memory holds the previous filter->kernelsize samples of input.
 	memcpy(input, filter->memory, filter->kernelsize * sizeof(float));
@@ -292,8 +293,6 @@ static void S_ApplyFilter(filter_t *filter, int *data, int stride, int count)
 	}
 
 	filter->parity = parity;
-
-	Hunk_FreeToLowMark (mark);
 }
 
 /*
@@ -418,6 +417,282 @@ float S_GetHiFreqLevel (void)
 /*
 ===============================================================================
 
+MIXING KERNELS
+
+The SSE2 versions produce exactly the same output as the C ones: products are
+formed with _mm_madd_epi16, which is exact as long as the factors fit in 16
+bits (checked before use), and halving keeps C's round-toward-zero division.
+===============================================================================
+*/
+
+static void S_Paint8_C (portable_samplepair_t *out, const byte *sfx, const int *lscale, const int *rscale, int count)
+{
+	int i;
+	for (i = 0; i < count; i++)
+	{
+		out[i].left += lscale[sfx[i]];
+		out[i].right += rscale[sfx[i]];
+	}
+}
+
+static void S_Paint16_C (portable_samplepair_t *out, const short *sfx, int leftvol, int rightvol, int count)
+{
+	int i;
+	for (i = 0; i < count; i++)
+	{
+	// this was causing integer overflow as observed in quakespasm
+	// with the warpspasm mod moved >>8 to left/right volume above.
+	//	left = (data * leftvol) >> 8;
+	//	right = (data * rightvol) >> 8;
+		out[i].left += sfx[i] * leftvol;
+		out[i].right += sfx[i] * rightvol;
+	}
+}
+
+// clip each sample to 0dB, then reduce by 6dB
+static void S_ClipPaintBuffer_C (portable_samplepair_t *out, int count)
+{
+	int i;
+	for (i = 0; i < count; i++)
+	{
+		out[i].left = CLAMP(-32768 * 256, out[i].left, 32767 * 256) / 2;
+		out[i].right = CLAMP(-32768 * 256, out[i].right, 32767 * 256) / 2;
+	}
+}
+
+// lower music by 6db to match sfx
+static void S_AddRawSamples_C (portable_samplepair_t *out, const portable_samplepair_t *raw, int count)
+{
+	int i;
+	for (i = 0; i < count; i++)
+	{
+		out[i].left += raw[i].left / 2;
+		out[i].right += raw[i].right / 2;
+	}
+}
+
+#ifdef USE_SSE2
+/*
+==============
+S_MixPairs_SSE2
+
+Each 32-bit lane of 'pairs' holds two 16-bit factors for one source sample,
+which _mm_madd_epi16 multiplies with the matching halves of vl/vr and sums.
+The resulting left/right values for 4 samples are added to the paintbuffer.
+==============
+*/
+static inline void S_MixPairs_SSE2 (portable_samplepair_t *out, __m128i pairs, __m128i vl, __m128i vr)
+{
+	__m128i	l = _mm_madd_epi16 (pairs, vl);
+	__m128i	r = _mm_madd_epi16 (pairs, vr);
+	__m128i	*dst = (__m128i *) out;
+
+	_mm_storeu_si128 (dst + 0, _mm_add_epi32 (_mm_loadu_si128 (dst + 0), _mm_unpacklo_epi32 (l, r)));
+	_mm_storeu_si128 (dst + 1, _mm_add_epi32 (_mm_loadu_si128 (dst + 1), _mm_unpackhi_epi32 (l, r)));
+}
+
+static inline __m128i S_HalveTowardZero_SSE2 (__m128i v)
+{
+	return _mm_srai_epi32 (_mm_add_epi32 (v, _mm_srli_epi32 (v, 31)), 1);
+}
+
+static void S_Paint8_SSE2 (portable_samplepair_t *out, const byte *sfx, const int *lscale, const int *rscale, int count)
+{
+	// snd_scaletable rows are linear: row[j] == (signed char)j * row[1]
+	int		lvol = lscale[1];
+	int		rvol = rscale[1];
+	int		i = 0;
+
+	// data * vol == data * (vol & 255) + (data << 8) * (vol >> 8)
+	if ((lvol >> 8) == (short)(lvol >> 8) && (rvol >> 8) == (short)(rvol >> 8))
+	{
+		__m128i vl = _mm_set1_epi32 ((int)(((unsigned)lvol >> 8) << 16) | (lvol & 255));
+		__m128i vr = _mm_set1_epi32 ((int)(((unsigned)rvol >> 8) << 16) | (rvol & 255));
+
+		for (; i + 16 <= count; i += 16)
+		{
+			__m128i b = _mm_loadu_si128 ((const __m128i *)(sfx + i));
+			__m128i w0 = _mm_srai_epi16 (_mm_unpacklo_epi8 (b, b), 8);
+			__m128i w1 = _mm_srai_epi16 (_mm_unpackhi_epi8 (b, b), 8);
+			__m128i s0 = _mm_slli_epi16 (w0, 8);
+			__m128i s1 = _mm_slli_epi16 (w1, 8);
+
+			S_MixPairs_SSE2 (out + i +  0, _mm_unpacklo_epi16 (w0, s0), vl, vr);
+			S_MixPairs_SSE2 (out + i +  4, _mm_unpackhi_epi16 (w0, s0), vl, vr);
+			S_MixPairs_SSE2 (out + i +  8, _mm_unpacklo_epi16 (w1, s1), vl, vr);
+			S_MixPairs_SSE2 (out + i + 12, _mm_unpackhi_epi16 (w1, s1), vl, vr);
+		}
+	}
+
+	S_Paint8_C (out + i, sfx + i, lscale, rscale, count - i);
+}
+
+static void S_Paint16_SSE2 (portable_samplepair_t *out, const short *sfx, int leftvol, int rightvol, int count)
+{
+	int i = 0;
+
+	if (leftvol == (short)leftvol && rightvol == (short)rightvol)
+	{
+		__m128i vl = _mm_set1_epi32 (leftvol & 0xffff);
+		__m128i vr = _mm_set1_epi32 (rightvol & 0xffff);
+		__m128i zero = _mm_setzero_si128 ();
+
+		for (; i + 8 <= count; i += 8)
+		{
+			__m128i w = _mm_loadu_si128 ((const __m128i *)(sfx + i));
+			S_MixPairs_SSE2 (out + i + 0, _mm_unpacklo_epi16 (w, zero), vl, vr);
+			S_MixPairs_SSE2 (out + i + 4, _mm_unpackhi_epi16 (w, zero), vl, vr);
+		}
+	}
+
+	S_Paint16_C (out + i, sfx + i, leftvol, rightvol, count - i);
+}
+
+static void S_ClipPaintBuffer_SSE2 (portable_samplepair_t *out, int count)
+{
+	const __m128i	lo = _mm_set1_epi32 (-32768 * 256);
+	const __m128i	hi = _mm_set1_epi32 (32767 * 256);
+	__m128i			*p = (__m128i *) out;
+	int				i;
+
+	for (i = 0; i + 2 <= count; i += 2, p++)
+	{
+		__m128i v = _mm_loadu_si128 (p);
+		__m128i m = _mm_cmpgt_epi32 (v, hi);
+		v = _mm_or_si128 (_mm_and_si128 (m, hi), _mm_andnot_si128 (m, v));
+		m = _mm_cmplt_epi32 (v, lo);
+		v = _mm_or_si128 (_mm_and_si128 (m, lo), _mm_andnot_si128 (m, v));
+		_mm_storeu_si128 (p, S_HalveTowardZero_SSE2 (v));
+	}
+
+	S_ClipPaintBuffer_C (out + i, count - i);
+}
+
+static void S_AddRawSamples_SSE2 (portable_samplepair_t *out, const portable_samplepair_t *raw, int count)
+{
+	int i;
+
+	for (i = 0; i + 2 <= count; i += 2)
+	{
+		__m128i v = _mm_loadu_si128 ((const __m128i *)(raw + i));
+		__m128i d = _mm_loadu_si128 ((const __m128i *)(out + i));
+		_mm_storeu_si128 ((__m128i *)(out + i), _mm_add_epi32 (d, S_HalveTowardZero_SSE2 (v)));
+	}
+
+	S_AddRawSamples_C (out + i, raw + i, count - i);
+}
+#endif // defined(USE_SSE2)
+
+static void S_ClipPaintBuffer (portable_samplepair_t *out, int count)
+{
+#ifdef USE_SSE2
+	if (use_simd)
+		S_ClipPaintBuffer_SSE2 (out, count);
+	else
+#endif
+		S_ClipPaintBuffer_C (out, count);
+}
+
+static void S_AddRawSamples (portable_samplepair_t *out, const portable_samplepair_t *raw, int count)
+{
+#ifdef USE_SSE2
+	if (use_simd)
+		S_AddRawSamples_SSE2 (out, raw, count);
+	else
+#endif
+		S_AddRawSamples_C (out, raw, count);
+}
+
+/*
+==============
+S_MixTest_f
+
+Checks the SIMD mixing kernels against the C ones on random input
+and reports the time spent in each
+==============
+*/
+void S_MixTest_f (void)
+{
+#ifdef USE_SSE2
+	const int				count = PAINTBUFFER_SIZE - 3;	// exercise the scalar tails, too
+	const int				iters = Cmd_Argc () >= 2 ? q_max (Q_atoi (Cmd_Argv (1)), 1) : 1000;
+	portable_samplepair_t	*ref, *out, *raw, *init;
+	byte					*data8;
+	short					*data16;
+	int						i, j, lvol, rvol, errors;
+	int						vol = sfxvolume.value * 256;
+	double					t0, t1, t2;
+
+	ref = (portable_samplepair_t *) malloc (count * sizeof (*ref));
+	out = (portable_samplepair_t *) malloc (count * sizeof (*out));
+	raw = (portable_samplepair_t *) malloc (count * sizeof (*raw));
+	init = (portable_samplepair_t *) malloc (count * sizeof (*init));
+	data8 = (byte *) malloc (count);
+	data16 = (short *) malloc (count * sizeof (short));
+	if (!ref || !out || !raw || !init || !data8 || !data16)
+		Sys_Error ("S_MixTest_f: out of memory");
+
+	for (i = 0; i < count; i++)
+	{
+		data8[i] = rand () & 255;
+		data16[i] = (short)((rand () << 8) ^ rand ());
+		init[i].left = (rand () << 12) ^ rand ();
+		init[i].right = (rand () << 12) ^ rand ();
+		raw[i].left = (short)((rand () << 8) ^ rand ()) * 3;
+		raw[i].right = (short)((rand () << 8) ^ rand ()) * 3;
+	}
+	init[0].left = -32768 * 256 - 1;
+	init[0].right = 32767 * 256 + 1;
+
+	#define MIXTEST(name, cfunc, simdfunc)											\
+		errors = 0;																	\
+		t1 = t2 = 0.0;																\
+		for (j = 0; j < iters; j++)													\
+		{																			\
+			lvol = j & 255;															\
+			rvol = (j * 7 + 33) & 255;												\
+			memcpy (ref, init, count * sizeof (*ref));								\
+			memcpy (out, init, count * sizeof (*out));								\
+			t0 = Sys_DoubleTime ();													\
+			cfunc;																	\
+			t1 += Sys_DoubleTime () - t0;											\
+			t0 = Sys_DoubleTime ();													\
+			simdfunc;																\
+			t2 += Sys_DoubleTime () - t0;											\
+			errors += memcmp (ref, out, count * sizeof (*out)) != 0;				\
+		}																			\
+		Con_Printf ("%-8s %s  C %7.3f ms  SSE2 %7.3f ms\n", name,					\
+			errors ? "MISMATCH" : "ok      ", t1 * 1000.0, t2 * 1000.0);
+
+	MIXTEST ("8-bit",
+		S_Paint8_C (ref, data8, snd_scaletable[lvol >> 3], snd_scaletable[rvol >> 3], count),
+		S_Paint8_SSE2 (out, data8, snd_scaletable[lvol >> 3], snd_scaletable[rvol >> 3], count));
+	MIXTEST ("16-bit",
+		S_Paint16_C (ref, data16, lvol * vol / 256, rvol * vol / 256, count),
+		S_Paint16_SSE2 (out, data16, lvol * vol / 256, rvol * vol / 256, count));
+	MIXTEST ("clip",
+		S_ClipPaintBuffer_C (ref, count),
+		S_ClipPaintBuffer_SSE2 (out, count));
+	MIXTEST ("music",
+		S_AddRawSamples_C (ref, raw, count),
+		S_AddRawSamples_SSE2 (out, raw, count));
+
+	#undef MIXTEST
+
+	free (ref);
+	free (out);
+	free (raw);
+	free (init);
+	free (data8);
+	free (data16);
+#else
+	Con_Printf ("No SIMD mixing kernels in this build\n");
+#endif
+}
+
+/*
+===============================================================================
+
 CHANNEL MIXING
 
 ===============================================================================
@@ -453,7 +728,12 @@ void S_PaintChannels (int endtime)
 				continue;
 			if (!ch->leftvol && !ch->rightvol)
 				continue;
-			sc = S_LoadSound (ch->sfx);
+		// the mixer thread can't load sounds (S_Update reloads them on the
+		// main thread), it only plays what is resident in the cache
+			if (snd_threaded)
+				sc = (sfxcache_t *) Cache_Check (&ch->sfx->cache);
+			else
+				sc = S_LoadSound (ch->sfx);
 			if (!sc)
 				continue;
 
@@ -498,11 +778,7 @@ void S_PaintChannels (int endtime)
 	// clip each sample to 0dB, then reduce by 6dB (to leave some headroom for
 	// the lowpass filter and the music). the lowpass will smooth out the
 	// clipping
-		for (i=0; i<end-paintedtime; i++)
-		{
-			paintbuffer[i].left = CLAMP(-32768 * 256, paintbuffer[i].left, 32767 * 256) / 2;
-			paintbuffer[i].right = CLAMP(-32768 * 256, paintbuffer[i].right, 32767 * 256) / 2;
-		}
+		S_ClipPaintBuffer (paintbuffer, end - paintedtime);
 
 	// apply a lowpass filter
 		if (sndspeed.value == 11025 && shm->speed == 44100)
@@ -523,12 +799,12 @@ void S_PaintChannels (int endtime)
 
 			stop = (end < s_rawend) ? end : s_rawend;
 
-			for (i = paintedtime; i < stop; i++)
+			for (i = paintedtime; i < stop; i += count)
 			{
 				s = i & (MAX_RAW_SAMPLES - 1);
+				count = q_min (stop - i, MAX_RAW_SAMPLES - s);
 			// lower music by 6db to match sfx
-				paintbuffer[i - paintedtime].left += s_rawsamples[s].left / 2;
-				paintbuffer[i - paintedtime].right += s_rawsamples[s].right / 2;
+				S_AddRawSamples (paintbuffer + i - paintedtime, s_rawsamples + s, count);
 			}
 			//	if (i != end)
 			//		Con_Printf ("partial stream\n");
@@ -547,6 +823,8 @@ void SND_InitScaletable (void)
 	int		i, j;
 	int		scale;
 
+	S_LockMixer ();	// the mixer thread reads the table while painting
+
 	for (i = 0; i < 32; i++)
 	{
 		scale = i * 8 * 256 * sfxvolume.value;
@@ -562,15 +840,15 @@ void SND_InitScaletable (void)
 			snd_scaletable[i][j] = ((j < 128) ?  j : j - 256) * scale;
 		}
 	}
+
+	S_UnlockMixer ();
 }
 
 
 static void SND_PaintChannelFrom8 (channel_t *ch, sfxcache_t *sc, int count, int paintbufferstart)
 {
-	int	data;
 	int		*lscale, *rscale;
 	unsigned char	*sfx;
-	int		i;
 
 	if (ch->leftvol > 255)
 		ch->leftvol = 255;
@@ -581,23 +859,20 @@ static void SND_PaintChannelFrom8 (channel_t *ch, sfxcache_t *sc, int count, int
 	rscale = snd_scaletable[ch->rightvol >> 3];
 	sfx = (unsigned char *)sc->data + ch->pos;
 
-	for (i = 0; i < count; i++)
-	{
-		data = sfx[i];
-		paintbuffer[paintbufferstart + i].left += lscale[data];
-		paintbuffer[paintbufferstart + i].right += rscale[data];
-	}
+#ifdef USE_SSE2
+	if (use_simd)
+		S_Paint8_SSE2 (paintbuffer + paintbufferstart, sfx, lscale, rscale, count);
+	else
+#endif
+		S_Paint8_C (paintbuffer + paintbufferstart, sfx, lscale, rscale, count);
 
 	ch->pos += count;
 }
 
 static void SND_PaintChannelFrom16 (channel_t *ch, sfxcache_t *sc, int count, int paintbufferstart)
 {
-	int	data;
-	int	left, right;
 	int	leftvol, rightvol;
 	signed short	*sfx;
-	int	i;
 
 	leftvol = ch->leftvol * snd_vol;
 	rightvol = ch->rightvol * snd_vol;
@@ -605,18 +880,12 @@ static void SND_PaintChannelFrom16 (channel_t *ch, sfxcache_t *sc, int count, in
 	rightvol /= 256;
 	sfx = (signed short *)sc->data + ch->pos;
 
-	for (i = 0; i < count; i++)
-	{
-		data = sfx[i];
-	// this was causing integer overflow as observed in quakespasm
-	// with the warpspasm mod moved >>8 to left/right volume above.
-	//	left = (data * leftvol) >> 8;
-	//	right = (data * rightvol) >> 8;
-		left = data * leftvol;
-		right = data * rightvol;
-		paintbuffer[paintbufferstart + i].left += left;
-		paintbuffer[paintbufferstart + i].right += right;
-	}
+#ifdef USE_SSE2
+	if (use_simd)
+		S_Paint16_SSE2 (paintbuffer + paintbufferstart, sfx, leftvol, rightvol, count);
+	else
+#endif
+		S_Paint16_C (paintbuffer + paintbufferstart, sfx, leftvol, rightvol, count);
 
 	ch->pos += count;
 }
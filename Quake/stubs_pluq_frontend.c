@@ -100,10 +100,8 @@ void CL_KeepaliveMessage (void) {}
 // ============================================================================
 
 // Server globals (needed by various client code for null checks)
-server_t sv = {0};
-server_static_t svs = {0};
-client_t *host_client = NULL;
-edict_t *sv_player = NULL;
+server_context_t sv_maincontext = {0};
+THREAD_LOCAL server_context_t *sv_context = &sv_maincontext;
 THREAD_LOCAL globalvars_t *pr_global_struct = NULL;
 
 // Time variables (managed by main loop)
@@ -182,6 +180,7 @@ void SV_ReadClientMessage (void) {}
 void SV_RunClients (void) {}
 void SV_SaveSpawnparms (void) {}
 void SV_SpawnServer (const char *server) {}
+void SV_ShutdownInstances (void) {}
 void SV_ClearDatagram (void) {}
 void SV_SendClientMessages (void) {}
 void SV_LinkEdict (edict_t *ent, qboolean touch_triggers) {}
@@ -243,6 +242,7 @@ void Host_ShutdownServer (qboolean crash) {}
 void Host_WriteConfiguration (void) {}
 void Host_InvokeOnMainThread (void (*func)(void *), void *data) {}
 void Host_Quit_f (void) { Sys_Quit(); }
+qboolean Host_IsHeadless (void) { return false; }
 void Host_EndGame (const char *message, ...)
 {
 	va_list argptr;
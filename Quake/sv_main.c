@@ -23,12 +23,18 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 // sv_main.c -- server main program
 
 #include "quakedef.h"
+#include <setjmp.h>
 
-server_t	sv;
-server_static_t	svs;
+server_context_t	sv_maincontext;
+THREAD_LOCAL server_context_t	*sv_context = &sv_maincontext;
 
 static char	localmodels[MAX_MODELS][8];	// inline model names for precache
 
+static void SV_ClearInstanceMemory (void);
+static void SV_Instance_f (void);
+static void SV_InstanceKill_f (void);
+static void SV_Instances_f (void);
+
 int		sv_protocol = PROTOCOL_RMQ; //johnfitz
 
 extern cvar_t nomonsters;
@@ -179,6 +185,9 @@ void SV_Init (void)
 	Cvar_RegisterVariable (&sv_autosave_interval);
 
 	Cmd_AddCommand ("sv_protocol", &SV_Protocol_f); //johnfitz
+	Cmd_AddCommand ("sv_instance", SV_Instance_f);
+	Cmd_AddCommand ("sv_instance_kill", SV_InstanceKill_f);
+	Cmd_AddCommand ("sv_instances", SV_Instances_f);
 
 	for (i=0 ; i<MAX_MODELS ; i++)
 		sprintf (localmodels[i], "*%i", i);
@@ -698,6 +707,7 @@ void SV_WriteEntitiesToClient (edict_t	*clent, sizebuf_t *msg)
 	float	miss, dist, size;
 	eval_t	*val;
 	edict_t	*ent;
+	const float	*modelindex;
 
 // find the client's PVS
 	VectorAdd (clent->v.origin, clent->v.view_ofs, org);
@@ -721,17 +731,20 @@ void SV_WriteEntitiesToClient (edict_t	*clent, sizebuf_t *msg)
 	numents = 1;
 
 // add all other entities that touch the pvs
+	ED_FlushHotFields ();
+	modelindex = qcvm->hot.modelindex;
 	ent = NEXT_EDICT(qcvm->edicts);
 	for (e=1 ; e<qcvm->num_edicts ; e++, ent = NEXT_EDICT(ent))
 	{
 		if (ent != clent)	// clent already added before the loop
 		{
 			// ignore ents without visible models
-			if (!ent->v.modelindex || !PR_GetString(ent->v.model)[0])
+			// (check the packed copy first so most edicts are never touched)
+			if (!modelindex[e] || !PR_GetString(ent->v.model)[0])
 				continue;
 
 			//johnfitz -- don't send model>255 entities if protocol is 15
-			if (sv.protocol == PROTOCOL_NETQUAKE && (int)ent->v.modelindex & 0xFF00)
+			if (sv.protocol == PROTOCOL_NETQUAKE && (int)modelindex[e] & 0xFF00)
 				continue;
 
 			// ignore if not touching a PV leaf
@@ -1925,7 +1938,7 @@ void SV_SpawnServer (const char *server)
 //
 // tell all connected clients that we are going to a new level
 //
-	if (sv.active)
+	if (sv.active && !sv_context->instance)
 	{
 		SV_SendReconnect ();
 	}
@@ -1947,7 +1960,10 @@ void SV_SpawnServer (const char *server)
 // set up the new server
 //
 	//memset (&sv, 0, sizeof(sv));
-	Host_ClearMemory ();
+	if (sv_context->instance)
+		SV_ClearInstanceMemory ();
+	else
+		Host_ClearMemory ();
 
 	q_strlcpy (sv.name, server, sizeof(sv.name));
 	if (developer.value || map_checks.value)
@@ -2034,6 +2050,7 @@ void SV_SpawnServer (const char *server)
 	ent->v.modelindex = 1;		// world model
 	ent->v.solid = SOLID_BSP;
 	ent->v.movetype = MOVETYPE_PUSH;
+	ED_InvalidateHotFields ();
 
 	if (coop.value)
 		pr_global_struct->coop = coop.value;
@@ -2080,3 +2097,500 @@ void SV_SpawnServer (const char *server)
 		SV_PrintMapChecklist ();
 }
 
+
+/*
+==============================================================================
+
+SERVER INSTANCES
+
+sv_instance <slot> <map> starts another server in the same process. Each
+one has its own server_context_t, so its own qcvm, edicts and area nodes,
+plus a hunk arena that takes everything SV_SpawnServer would put on the
+hunk. Loaded models and pak file indexes are shared: the instance pins the
+model cache entries its sv.models point into and keeps private copies of
+the qmodel_t structs, so the main server's map changes can't pull them away.
+
+Instances have no network clients, they only run the world. Every one of
+them ticks on a worker thread while the main server runs its own frame.
+Their console output, localcmd and cvar_set text and changelevels are kept
+in the instance and handled on the main thread in SV_EndInstanceFrames.
+
+==============================================================================
+*/
+
+#define	MAX_SERVER_INSTANCES	16
+
+typedef struct svinstance_s
+{
+	int					slot;
+	hunkarena_t			*arena;		// takes hunk allocations while the context is current
+	struct modcache_s	**pins;		// dynamic array, cache entries behind sv.models
+	jmp_buf				abort;		// SV_AbortInstance lands here
+	qboolean			ticking;	// in SV_InstanceTick rather than on the main thread
+	qboolean			failed;		// freed by SV_ServiceInstance
+	char				*console;	// dynamic array, output waiting for the main thread
+	char				*commands;	// dynamic array, see SV_InstanceCommand
+	char				nextmap[MAX_QPATH];
+} svinstance_t;
+
+static server_context_t	*sv_instances[MAX_SERVER_INSTANCES];
+static server_context_t	*sv_ticking[MAX_SERVER_INSTANCES];
+static taskbatch_t		*sv_instancebatch;
+
+/*
+================
+SV_InstancePrint
+================
+*/
+static void SV_InstancePrint (const char *text)
+{
+	Vec_Append ((void **) &sv_context->instance->console, 1, text, strlen (text));
+}
+
+/*
+================
+SV_SetContext
+================
+*/
+static void SV_SetContext (server_context_t *ctx)
+{
+	sv_context = ctx;
+	Hunk_SwitchArena (ctx->instance ? ctx->instance->arena : NULL);
+	con_redirect = ctx->instance ? SV_InstancePrint : NULL;
+}
+
+/*
+================
+SV_PushContext
+
+Makes sv, svs, host_client and sv_player refer to another server on this
+thread, along with its hunk arena and console buffer
+================
+*/
+void SV_PushContext (server_context_t *ctx, server_context_t **old)
+{
+	*old = sv_context;
+	SV_SetContext (ctx);
+}
+
+/*
+================
+SV_PopContext
+================
+*/
+void SV_PopContext (server_context_t *old)
+{
+	SV_SetContext (old);
+}
+
+/*
+================
+SV_InstanceCommand
+
+localcmd and cvar_set text from an instance, executed by the main
+command buffer after the frame
+================
+*/
+void SV_InstanceCommand (const char *text)
+{
+	Vec_Append ((void **) &sv_context->instance->commands, 1, text, strlen (text));
+}
+
+/*
+================
+SV_InstanceChangelevel
+================
+*/
+void SV_InstanceChangelevel (const char *mapname)
+{
+	q_strlcpy (sv_context->instance->nextmap, mapname, sizeof (sv_context->instance->nextmap));
+}
+
+/*
+================
+SV_AbortInstance
+
+Host_Error for an instance: only that instance goes down
+================
+*/
+void SV_AbortInstance (const char *message)
+{
+	svinstance_t *inst = sv_context->instance;
+
+	if (!inst->ticking)
+		Mod_AbortLoad ();
+	Con_Printf ("Host_Error: %s\n", message);
+	inst->failed = true;
+	longjmp (inst->abort, 1);
+}
+
+/*
+================
+SV_ReleaseInstanceModels
+================
+*/
+static void SV_ReleaseInstanceModels (svinstance_t *inst)
+{
+	size_t i;
+
+	for (i = 0; i < VEC_SIZE (inst->pins); i++)
+		Mod_UnpinCache (inst->pins[i]);
+	VEC_FREE (inst->pins);
+}
+
+/*
+================
+SV_IsolateInstanceModels
+
+Pins the cache entries behind sv.models and points sv.models at copies of
+the mod_known slots, which belong to the main server and the client
+================
+*/
+static void SV_IsolateInstanceModels (void)
+{
+	svinstance_t		*inst = sv_context->instance;
+	struct modcache_s	*pin;
+	qmodel_t			*copies;
+	int					i, count;
+
+	for (count = 1; count < MAX_MODELS && sv.model_precache[count]; count++)
+		;
+	copies = (qmodel_t *) Hunk_AllocName (count * sizeof (qmodel_t), "models");
+	for (i = 1; i < count; i++)
+	{
+		if (!sv.models[i])
+			continue;
+		if (sv.models[i]->name[0] != '*' && sv.models[i]->type != mod_alias)
+		{
+			pin = Mod_PinCache (sv.models[i]);
+			if (!pin)
+				Host_Error ("%s is not in the model cache, server instances need mod_cachesize > 0", sv.models[i]->name);
+			VEC_PUSH (inst->pins, pin);
+		}
+		copies[i] = *sv.models[i];
+		sv.models[i] = &copies[i];
+	}
+	sv.worldmodel = sv.models[1];
+}
+
+/*
+================
+SV_ClearInstanceMemory
+
+What Host_ClearMemory does for the main server
+================
+*/
+static void SV_ClearInstanceMemory (void)
+{
+	svinstance_t *inst = sv_context->instance;
+
+	PR_ClearProgs (&sv.qcvm);
+	SV_ReleaseInstanceModels (inst);
+
+	Hunk_SwitchArena (NULL);
+	Hunk_FreeArena (inst->arena);
+	Hunk_BeginArena ();
+	inst->arena = Hunk_EndArena ();
+	Hunk_SwitchArena (inst->arena);
+
+	memset (&sv, 0, sizeof (sv));
+}
+
+/*
+================
+SV_SpawnInstance
+================
+*/
+static void SV_SpawnInstance (server_context_t *ctx, const char *mapname)
+{
+	svinstance_t		*inst = ctx->instance;
+	server_context_t	*old;
+	modsnapshot_t		*known;
+	double				frametime = host_frametime;
+
+	known = Mod_SaveKnown ();
+	SV_PushContext (ctx, &old);
+	if (!setjmp (inst->abort))
+	{
+		PR_SwitchQCVM (&sv.qcvm);
+		if (sv.active)
+			SV_SaveSpawnparms ();
+		SV_SpawnServer (mapname);
+		if (sv.active)
+			SV_IsolateInstanceModels ();
+		else
+			inst->failed = true;
+	}
+	PR_SwitchQCVM (NULL);
+	SV_PopContext (old);
+	Mod_RestoreKnown (known);
+	host_frametime = frametime;
+}
+
+/*
+================
+SV_FreeInstance
+================
+*/
+static void SV_FreeInstance (int slot)
+{
+	server_context_t	*ctx = sv_instances[slot], *old;
+	svinstance_t		*inst = ctx->instance;
+
+	SV_PushContext (ctx, &old);
+	PR_ClearProgs (&sv.qcvm);
+	SV_PopContext (old);
+
+	SV_ReleaseInstanceModels (inst);
+	Hunk_FreeArena (inst->arena);
+	VEC_FREE (inst->console);
+	VEC_FREE (inst->commands);
+	free (ctx->statics.clients);
+	free (ctx->checkpvs);
+	free (inst);
+	free (ctx);
+
+	sv_instances[slot] = NULL;
+}
+
+/*
+================
+SV_ServiceInstance
+
+Main thread work an instance left behind: its changelevel, console output
+and commands, or shutting it down after an error
+================
+*/
+static void SV_ServiceInstance (int slot)
+{
+	server_context_t	*ctx = sv_instances[slot];
+	svinstance_t		*inst = ctx->instance;
+	char				mapname[MAX_QPATH];
+	char				*line, *end;
+
+	if (inst->nextmap[0] && !inst->failed)
+	{
+		q_strlcpy (mapname, inst->nextmap, sizeof (mapname));
+		inst->nextmap[0] = '\0';
+		SV_SpawnInstance (ctx, mapname);
+	}
+
+	if (VEC_SIZE (inst->console))
+	{
+		VEC_PUSH (inst->console, '\0');
+		for (line = inst->console; *line; line = end)
+		{
+			end = strchr (line, '\n');
+			end = end ? end + 1 : line + strlen (line);
+			Con_Printf ("[%d] %.*s", inst->slot, (int)(end - line), line);
+		}
+		VEC_CLEAR (inst->console);
+	}
+
+	if (VEC_SIZE (inst->commands))
+	{
+		VEC_PUSH (inst->commands, '\0');
+		Cbuf_AddText (inst->commands);
+		VEC_CLEAR (inst->commands);
+	}
+
+	if (inst->failed)
+	{
+		Con_Printf ("Server instance %d shut down\n", inst->slot);
+		SV_FreeInstance (slot);
+	}
+}
+
+/*
+================
+SV_InstanceTick
+
+Task function, runs one frame of an instance on whichever thread picks it up
+================
+*/
+static void SV_InstanceTick (int index, void *data)
+{
+	server_context_t	*ctx = sv_ticking[index], *old;
+	svinstance_t		*inst = ctx->instance;
+
+	SV_PushContext (ctx, &old);
+	inst->ticking = true;
+	if (!setjmp (inst->abort))
+	{
+		PR_SwitchQCVM (&sv.qcvm);
+		pr_global_struct->frametime = host_frametime;
+		SV_ClearDatagram ();
+		SZ_Clear (&sv.reliable_datagram);	// no clients to pass it on to
+		if (!sv.paused)
+			SV_Physics ();
+	}
+	PR_SwitchQCVM (NULL);
+	inst->ticking = false;
+	SV_PopContext (old);
+}
+
+/*
+================
+SV_BeginInstanceFrames
+
+Starts this frame's instance ticks on the worker pool, the main server
+runs its own frame in the meantime
+================
+*/
+void SV_BeginInstanceFrames (void)
+{
+	int i, count;
+
+	for (i = 0, count = 0; i < MAX_SERVER_INSTANCES; i++)
+		if (sv_instances[i] && sv_instances[i]->server.active && !sv_instances[i]->instance->failed)
+			sv_ticking[count++] = sv_instances[i];
+
+	if (count)
+		sv_instancebatch = Tasks_Submit (SV_InstanceTick, count, NULL);
+}
+
+/*
+================
+SV_WaitInstanceFrames
+
+Also called by Host_Error, which can leave the main server frame while the
+instances are still ticking
+================
+*/
+void SV_WaitInstanceFrames (void)
+{
+	if (sv_instancebatch)
+	{
+		Tasks_Wait (sv_instancebatch);
+		sv_instancebatch = NULL;
+	}
+}
+
+/*
+================
+SV_EndInstanceFrames
+================
+*/
+void SV_EndInstanceFrames (void)
+{
+	int i;
+
+	SV_WaitInstanceFrames ();
+
+	for (i = 0; i < MAX_SERVER_INSTANCES; i++)
+		if (sv_instances[i])
+			SV_ServiceInstance (i);
+}
+
+/*
+================
+SV_ShutdownInstances
+================
+*/
+void SV_ShutdownInstances (void)
+{
+	int i;
+
+	for (i = 0; i < MAX_SERVER_INSTANCES; i++)
+		if (sv_instances[i])
+			SV_FreeInstance (i);
+}
+
+/*
+================
+SV_Instance_f
+
+sv_instance <slot> <map>: starts a server instance, or moves a running one
+to another map
+================
+*/
+static void SV_Instance_f (void)
+{
+	server_context_t	*ctx;
+	svinstance_t		*inst;
+	int					slot;
+
+	if (Cmd_Argc () != 3)
+	{
+		Con_Printf ("usage: sv_instance <1-%d> <map>\n", MAX_SERVER_INSTANCES);
+		return;
+	}
+
+	slot = Q_atoi (Cmd_Argv (1));
+	if (slot < 1 || slot > MAX_SERVER_INSTANCES)
+	{
+		Con_Printf ("sv_instance: slot must be between 1 and %d\n", MAX_SERVER_INSTANCES);
+		return;
+	}
+
+	ctx = sv_instances[slot - 1];
+	if (!ctx)
+	{
+		ctx = (server_context_t *) calloc (1, sizeof (*ctx));
+		inst = (svinstance_t *) calloc (1, sizeof (*inst));
+		if (!ctx || !inst)
+			Sys_Error ("SV_Instance_f: out of memory");
+		ctx->instance = inst;
+		ctx->statics.maxclients = ctx->statics.maxclientslimit = 1;
+		ctx->statics.clients = (client_t *) calloc (1, sizeof (client_t));
+		if (!ctx->statics.clients)
+			Sys_Error ("SV_Instance_f: out of memory");
+		inst->slot = slot;
+		Hunk_BeginArena ();
+		inst->arena = Hunk_EndArena ();
+		sv_instances[slot - 1] = ctx;
+	}
+
+	inst = ctx->instance;
+	inst->nextmap[0] = '\0';
+	SV_SpawnInstance (ctx, Cmd_Argv (2));
+	SV_ServiceInstance (slot - 1);
+}
+
+/*
+================
+SV_InstanceKill_f
+================
+*/
+static void SV_InstanceKill_f (void)
+{
+	int slot;
+
+	if (Cmd_Argc () != 2)
+	{
+		Con_Printf ("usage: sv_instance_kill <slot>\n");
+		return;
+	}
+
+	slot = Q_atoi (Cmd_Argv (1));
+	if (slot < 1 || slot > MAX_SERVER_INSTANCES || !sv_instances[slot - 1])
+	{
+		Con_Printf ("sv_instance_kill: no server instance %s\n", Cmd_Argv (1));
+		return;
+	}
+
+	SV_FreeInstance (slot - 1);
+}
+
+/*
+================
+SV_Instances_f
+================
+*/
+static void SV_Instances_f (void)
+{
+	server_context_t	*ctx;
+	int					i, count;
+
+	for (i = 0, count = 0; i < MAX_SERVER_INSTANCES; i++)
+	{
+		ctx = sv_instances[i];
+		if (!ctx)
+			continue;
+		Con_Printf ("%2d: %-16s %5d edicts %8.1fs %6.1f MiB\n", i + 1, ctx->server.name,
+			ctx->server.qcvm.num_edicts, ctx->server.qcvm.time,
+			Hunk_ArenaSize (ctx->instance->arena) / 1048576.0);
+		count++;
+	}
+	Con_Printf ("%d server instance%s\n", PLURAL (count));
+}
@@ -1228,12 +1228,14 @@ void SV_Physics (void)
 	int	i;
 	int	entity_cap; // For sv_freezenonclients 
 	edict_t	*ent;
+	edicthot_t	*hot = &qcvm->hot;
 
 // let the progs know that a new frame has started
 	pr_global_struct->self = EDICT_TO_PROG(qcvm->edicts);
 	pr_global_struct->other = EDICT_TO_PROG(qcvm->edicts);
 	pr_global_struct->time = qcvm->time;
 	PR_ExecuteProgram (pr_global_struct->StartFrame);
+	ED_FlushHotFields ();
 
 //SV_CheckAllEnts ();
 
@@ -1250,7 +1252,7 @@ void SV_Physics (void)
 	//for (i=0 ; i<sv.num_edicts ; i++, ent = NEXT_EDICT(ent))
 	for (i=0 ; i<entity_cap ; i++, ent = NEXT_EDICT(ent))
 	{
-		if (ent->free)
+		if (hot->free[i])
 			continue;
 
 		if (pr_global_struct->force_retouch)
@@ -1288,6 +1290,8 @@ void SV_Physics (void)
 				ent->sendinterval = true;
 		}
 	//johnfitz
+
+		ED_SyncHotFields (ent);
 	}
 
 	if (pr_global_struct->force_retouch)
@@ -118,6 +118,15 @@ void *Sys_LoadLibrary (const char *path);
 void *Sys_GetLibraryFunction (void *lib, const char *func);
 void Sys_CloseLibrary (void *lib);
 
+void *Sys_ReserveMemory (size_t size);
+/* reserves address space without backing it, returns NULL on failure */
+qboolean Sys_CommitMemory (void *ptr, size_t size);
+/* makes part of a reservation usable, zero filled */
+void Sys_DiscardMemory (void *ptr, size_t size);
+/* lets the OS reclaim committed pages; they stay usable, contents undefined */
+void Sys_ReleaseMemory (void *ptr, size_t size);
+/* gives a whole reservation back, ptr and size as passed to Sys_ReserveMemory */
+
 //
 // system IO
 //
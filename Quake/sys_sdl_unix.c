@@ -34,6 +34,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #endif
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <time.h>
 #include <dirent.h>
@@ -970,6 +971,27 @@ void *Sys_GetLibraryFunction (void *lib, const char *func)
 	return dlsym (lib, func);
 }
 
+void *Sys_ReserveMemory (size_t size)
+{
+	void *ptr = mmap (NULL, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	return ptr != MAP_FAILED ? ptr : NULL;
+}
+
+qboolean Sys_CommitMemory (void *ptr, size_t size)
+{
+	return mprotect (ptr, size, PROT_READ | PROT_WRITE) == 0;
+}
+
+void Sys_DiscardMemory (void *ptr, size_t size)
+{
+	madvise (ptr, size, MADV_DONTNEED);
+}
+
+void Sys_ReleaseMemory (void *ptr, size_t size)
+{
+	munmap (ptr, size);
+}
+
 void Sys_CloseLibrary (void *lib)
 {
 	dlclose (lib);
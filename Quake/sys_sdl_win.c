@@ -1236,6 +1236,26 @@ void *Sys_GetLibraryFunction (void *lib, const char *func)
 	return GetProcAddress ((HMODULE) lib, func);
 }
 
+void *Sys_ReserveMemory (size_t size)
+{
+	return VirtualAlloc (NULL, size, MEM_RESERVE, PAGE_NOACCESS);
+}
+
+qboolean Sys_CommitMemory (void *ptr, size_t size)
+{
+	return VirtualAlloc (ptr, size, MEM_COMMIT, PAGE_READWRITE) != NULL;
+}
+
+void Sys_DiscardMemory (void *ptr, size_t size)
+{
+	VirtualAlloc (ptr, size, MEM_RESET, PAGE_READWRITE);
+}
+
+void Sys_ReleaseMemory (void *ptr, size_t size)
+{
+	VirtualFree (ptr, 0, MEM_RELEASE);
+}
+
 void Sys_CloseLibrary (void *lib)
 {
 	FreeLibrary ((HMODULE) lib);
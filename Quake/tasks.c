@@ -0,0 +1,309 @@
+/*
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+// tasks.c -- worker thread pool
+//
+// Work is submitted as batches of independent items. Workers claim items
+// in index order; a thread waiting on a batch runs unclaimed items itself
+// instead of blocking, so everything still works with zero workers.
+
+#include "quakedef.h"
+
+#define MAX_TASK_WORKERS	16
+
+struct taskbatch_s
+{
+	taskfunc_t			func;
+	void				*data;
+	int					count;
+	int					users;		// workers currently running items, guarded by task_mutex
+	SDL_atomic_t		next;		// next unclaimed item
+	SDL_atomic_t		remaining;	// items not finished yet
+	SDL_atomic_t		*done;		// per-item completion flags
+	struct taskbatch_s	*nextbatch;
+};
+
+static SDL_Thread		*task_threads[MAX_TASK_WORKERS];
+static int				task_numworkers;
+static SDL_mutex		*task_mutex;
+static SDL_cond			*task_wake;		// new work, or shutdown
+static SDL_cond			*task_done;		// an item or a worker finished
+static taskbatch_t		*task_queue;	// batches that may still have unclaimed items
+static qboolean			task_quit;
+
+/*
+================
+Tasks_RunOne
+
+Claims and runs the next item of a batch, returns false if none are left
+================
+*/
+static qboolean Tasks_RunOne (taskbatch_t *batch)
+{
+	int index = SDL_AtomicAdd (&batch->next, 1);
+	if (index >= batch->count)
+		return false;
+
+	batch->func (index, batch->data);
+
+	SDL_LockMutex (task_mutex);
+	SDL_AtomicSet (&batch->done[index], 1);
+	SDL_AtomicAdd (&batch->remaining, -1);
+	SDL_CondBroadcast (task_done);
+	SDL_UnlockMutex (task_mutex);
+
+	return true;
+}
+
+/*
+================
+Tasks_Unlink -- task_mutex must be held
+================
+*/
+static void Tasks_Unlink (taskbatch_t *batch)
+{
+	taskbatch_t **link;
+
+	for (link = &task_queue; *link; link = &(*link)->nextbatch)
+	{
+		if (*link == batch)
+		{
+			*link = batch->nextbatch;
+			break;
+		}
+	}
+}
+
+/*
+================
+Tasks_Worker
+================
+*/
+static int Tasks_Worker (void *unused)
+{
+	taskbatch_t *batch;
+
+	SDL_LockMutex (task_mutex);
+	while (!task_quit)
+	{
+		batch = task_queue;
+		if (!batch)
+		{
+			SDL_CondWait (task_wake, task_mutex);
+			continue;
+		}
+		if (SDL_AtomicGet (&batch->next) >= batch->count)
+		{
+			Tasks_Unlink (batch);
+			continue;
+		}
+
+		batch->users++;
+		SDL_UnlockMutex (task_mutex);
+		while (Tasks_RunOne (batch))
+			;
+		SDL_LockMutex (task_mutex);
+		batch->users--;
+		SDL_CondBroadcast (task_done);
+	}
+	SDL_UnlockMutex (task_mutex);
+
+	return 0;
+}
+
+/*
+================
+Tasks_Init
+================
+*/
+void Tasks_Init (void)
+{
+	int i;
+
+	task_mutex = SDL_CreateMutex ();
+	task_wake = SDL_CreateCond ();
+	task_done = SDL_CreateCond ();
+	if (!task_mutex || !task_wake || !task_done)
+		Sys_Error ("Tasks_Init: could not create synchronization objects");
+
+	// -threads counts the main thread too
+	i = COM_CheckParm ("-threads");
+	if (i && i < com_argc - 1)
+		task_numworkers = Q_atoi (com_argv[i + 1]) - 1;
+	else
+		task_numworkers = SDL_GetCPUCount () - 1;
+	task_numworkers = CLAMP (0, task_numworkers, MAX_TASK_WORKERS);
+
+	for (i = 0; i < task_numworkers; i++)
+	{
+		task_threads[i] = SDL_CreateThread (Tasks_Worker, "Worker", NULL);
+		if (!task_threads[i])
+		{
+			Sys_Printf ("Couldn't create worker thread: %s\n", SDL_GetError ());
+			break;
+		}
+	}
+	task_numworkers = i;
+}
+
+/*
+================
+Tasks_Shutdown
+================
+*/
+void Tasks_Shutdown (void)
+{
+	int i;
+
+	if (!task_mutex)
+		return;
+
+	SDL_LockMutex (task_mutex);
+	task_quit = true;
+	SDL_CondBroadcast (task_wake);
+	SDL_UnlockMutex (task_mutex);
+
+	for (i = 0; i < task_numworkers; i++)
+		SDL_WaitThread (task_threads[i], NULL);
+	task_numworkers = 0;
+
+	SDL_DestroyCond (task_done);
+	SDL_DestroyCond (task_wake);
+	SDL_DestroyMutex (task_mutex);
+	task_done = task_wake = NULL;
+	task_mutex = NULL;
+}
+
+/*
+================
+Tasks_NumWorkers
+================
+*/
+int Tasks_NumWorkers (void)
+{
+	return task_numworkers;
+}
+
+/*
+================
+Tasks_Submit
+
+Queues count calls to func and returns immediately.
+Every batch must be finished with Tasks_Wait.
+================
+*/
+taskbatch_t *Tasks_Submit (taskfunc_t func, int count, void *data)
+{
+	taskbatch_t *batch, **link;
+
+	count = q_max (count, 0);
+	batch = (taskbatch_t *) calloc (1, sizeof (*batch));
+	if (!batch)
+		Sys_Error ("Tasks_Submit: out of memory");
+	batch->done = (SDL_atomic_t *) calloc (q_max (count, 1), sizeof (batch->done[0]));
+	if (!batch->done)
+		Sys_Error ("Tasks_Submit: out of memory on %d items", count);
+	batch->func = func;
+	batch->data = data;
+	batch->count = count;
+	SDL_AtomicSet (&batch->remaining, count);
+
+	if (task_numworkers > 0 && count > 0)
+	{
+		SDL_LockMutex (task_mutex);
+		for (link = &task_queue; *link; link = &(*link)->nextbatch)
+			;
+		*link = batch;
+		SDL_CondBroadcast (task_wake);
+		SDL_UnlockMutex (task_mutex);
+	}
+
+	return batch;
+}
+
+/*
+================
+Tasks_WaitItem
+
+Returns once the given item has finished, running other items meanwhile
+================
+*/
+void Tasks_WaitItem (taskbatch_t *batch, int index)
+{
+	if (index < 0 || index >= batch->count)
+		Sys_Error ("Tasks_WaitItem: bad index %d", index);
+
+	while (!SDL_AtomicGet (&batch->done[index]))
+	{
+		if (Tasks_RunOne (batch))
+			continue;
+
+		// everything is claimed, the item is running on a worker
+		SDL_LockMutex (task_mutex);
+		while (!SDL_AtomicGet (&batch->done[index]))
+			SDL_CondWait (task_done, task_mutex);
+		SDL_UnlockMutex (task_mutex);
+	}
+}
+
+/*
+================
+Tasks_Wait
+
+Finishes all items of a batch and frees it
+================
+*/
+void Tasks_Wait (taskbatch_t *batch)
+{
+	while (Tasks_RunOne (batch))
+		;
+
+	if (task_mutex)
+	{
+		SDL_LockMutex (task_mutex);
+		while (SDL_AtomicGet (&batch->remaining) > 0 || batch->users > 0)
+			SDL_CondWait (task_done, task_mutex);
+		Tasks_Unlink (batch);
+		SDL_UnlockMutex (task_mutex);
+	}
+
+	free (batch->done);
+	free (batch);
+}
+
+/*
+================
+Tasks_ParallelFor
+
+Runs count calls to func across the workers and the calling thread
+================
+*/
+void Tasks_ParallelFor (taskfunc_t func, int count, void *data)
+{
+	int i;
+
+	if (task_numworkers <= 0 || count <= 1)
+	{
+		for (i = 0; i < count; i++)
+			func (i, data);
+		return;
+	}
+
+	Tasks_Wait (Tasks_Submit (func, count, data));
+}
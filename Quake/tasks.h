@@ -0,0 +1,42 @@
+/*
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#ifndef _TASKS_H_
+#define _TASKS_H_
+
+// tasks.h -- worker thread pool
+
+// Called once per item of a batch, possibly from several threads at once.
+// Task functions must not touch the hunk, the console or any GL state,
+// except through a server context (SV_PushContext), which gives the thread
+// its own hunk arena and console buffer.
+typedef void (*taskfunc_t) (int index, void *data);
+
+typedef struct taskbatch_s taskbatch_t;
+
+void		Tasks_Init (void);
+void		Tasks_Shutdown (void);
+int			Tasks_NumWorkers (void);
+
+taskbatch_t	*Tasks_Submit (taskfunc_t func, int count, void *data);
+void		Tasks_WaitItem (taskbatch_t *batch, int index);
+void		Tasks_Wait (taskbatch_t *batch);
+void		Tasks_ParallelFor (taskfunc_t func, int count, void *data);
+
+#endif /* _TASKS_H_ */
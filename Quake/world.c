@@ -56,9 +56,10 @@ HULL BOXES
 */
 
 
-static	hull_t		box_hull;
-static	mclipnode_t	box_clipnodes[6]; //johnfitz -- was dclipnode_t
-static	mplane_t	box_planes[6];
+// per thread, server instances trace from their worker threads
+static THREAD_LOCAL	hull_t		box_hull;
+static THREAD_LOCAL	mclipnode_t	box_clipnodes[6]; //johnfitz -- was dclipnode_t
+static THREAD_LOCAL	mplane_t	box_planes[6];
 
 /*
 ===================
@@ -107,6 +108,9 @@ BSP trees instead of being compared directly.
 */
 hull_t	*SV_HullForBox (vec3_t mins, vec3_t maxs)
 {
+	if (!box_hull.clipnodes)
+		SV_InitBoxHull ();
+
 	box_planes[0].dist = maxs[0];
 	box_planes[1].dist = mins[0];
 	box_planes[2].dist = maxs[1];
@@ -183,22 +187,6 @@ ENTITY AREA CHECKING
 ===============================================================================
 */
 
-typedef struct areanode_s
-{
-	int		axis;		// -1 = leaf node
-	float	dist;
-	struct areanode_s	*children[2];
-	link_t	trigger_edicts;
-	link_t	solid_edicts;
-} areanode_t;
-
-// Note: changing this can affect droptofloor
-#define	AREA_DEPTH	4
-#define	AREA_NODES	(2<<AREA_DEPTH)
-
-static	areanode_t	sv_areanodes[AREA_NODES];
-static	int			sv_numareanodes;
-
 /*
 ===============
 SV_CreateAreaNode
@@ -211,8 +199,8 @@ areanode_t *SV_CreateAreaNode (int depth, vec3_t mins, vec3_t maxs)
 	vec3_t		size;
 	vec3_t		mins1, maxs1, mins2, maxs2;
 
-	anode = &sv_areanodes[sv_numareanodes];
-	sv_numareanodes++;
+	anode = &sv.areanodes[sv.numareanodes];
+	sv.numareanodes++;
 
 	ClearLink (&anode->trigger_edicts);
 	ClearLink (&anode->solid_edicts);
@@ -254,8 +242,8 @@ void SV_ClearWorld (void)
 {
 	SV_InitBoxHull ();
 
-	memset (sv_areanodes, 0, sizeof(sv_areanodes));
-	sv_numareanodes = 0;
+	memset (sv.areanodes, 0, sizeof(sv.areanodes));
+	sv.numareanodes = 0;
 	SV_CreateAreaNode (0, sv.worldmodel->mins, sv.worldmodel->maxs);
 }
 
@@ -345,7 +333,7 @@ void SV_TouchLinks (edict_t *ent)
 	list = (edict_t **) Hunk_AllocNoFill (qcvm->num_edicts*sizeof(edict_t *));
 
 	listcount = 0;
-	SV_AreaTriggerEdicts (ent, sv_areanodes, list, &listcount, qcvm->num_edicts);
+	SV_AreaTriggerEdicts (ent, sv.areanodes, list, &listcount, qcvm->num_edicts);
 
 	for (i = 0; i < listcount; i++)
 	{
@@ -508,11 +496,13 @@ void SV_LinkEdict (edict_t *ent, qboolean touch_triggers)
 	if (ent->v.modelindex)
 		SV_FindTouchedLeafs (ent, sv.worldmodel->nodes);
 
+	ED_SyncHotFields (ent);
+
 	if (ent->v.solid == SOLID_NOT)
 		return;
 
 // find the first node that the ent's box crosses
-	node = sv_areanodes;
+	node = sv.areanodes;
 	while (1)
 	{
 		if (node->axis == -1)
@@ -965,7 +955,7 @@ trace_t SV_Move (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, e
 	SV_MoveBounds ( start, clip.mins2, clip.maxs2, end, clip.boxmins, clip.boxmaxs );
 
 // clip to entities
-	SV_ClipToLinks ( sv_areanodes, &clip );
+	SV_ClipToLinks ( sv.areanodes, &clip );
 
 	return clip.trace;
 }
@@ -23,28 +23,55 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "quakedef.h"
 
-#define	DYNAMIC_SIZE	(4 * 1024 * 1024) // ericw -- was 512KB (64-bit) / 384KB (32-bit)
-
 #define	ZONEID	0x1d4a11
-#define MINFRAGMENT	64
 
 typedef struct memblock_s
 {
-	int	size;		// including the header and possibly tiny fragments
-	int	tag;		// a tag of 0 is a free block
-	int	id;		// should be ZONEID
-	int	pad;		// pad to 64 bit boundary
-	struct	memblock_s	*next, *prev;
+	int		size;		// bytes requested by the caller
+	short	tag;		// a tag of 0 is a free block
+	short	cls;		// size class, ZONE_SYSTEM for blocks that came from malloc
+	int		id;			// should be ZONEID
+	int		traceid;	// allocation number while zone_trace is recording
 } memblock_t;
 
-typedef struct
+#define	ZONE_SYSTEM		-1
+#define	ZONE_SLABSIZE	(64 * 1024)
+#ifndef NDEBUG
+#define	ZONE_TRASHSIZE	4		// space for memory trash tester
+#else
+#define	ZONE_TRASHSIZE	0
+#endif
+
+typedef struct zoneclass_s
+{
+	int			size;		// largest request served by this class
+	int			chunksize;	// including header, multiple of 16
+	memblock_t	*free;		// free chunks, linked through their data
+	int			numslabs;
+	int			used;
+	int			peak;
+	uint64_t	allocs;
+} zoneclass_t;
+
+static zoneclass_t zone_classes[] =
+{
+	{ 16 }, { 32 }, { 48 }, { 64 }, { 96 }, { 128 }, { 192 }, { 256 },
+};
+
+#define	ZONE_MAXSMALL	256		// largest request served from slabs
+static byte zone_classforsize[ZONE_MAXSMALL / 16 + 1];
+
+static struct
 {
-	int		size;		// total bytes malloced, including header
-	memblock_t	blocklist;	// start / end cap for linked list
-	memblock_t	*rover;
-} memzone_t;
+	int			used;
+	int			peak;
+	size_t		bytes;
+	size_t		peakbytes;
+	uint64_t	allocs;
+} zone_system;
 
 void Cache_FreeLow (int new_low_hunk);
+static byte *Cache_Bottom (void);
 
 
 /*
@@ -52,18 +79,113 @@ void Cache_FreeLow (int new_low_hunk);
 
 						ZONE MEMORY ALLOCATION
 
-There is never any space between memblocks, and there will never be two
-contiguous free memblocks.
+Requests up to ZONE_MAXSMALL bytes are rounded up to a size class and
+served from that class's free list. The list is refilled a whole
+ZONE_SLABSIZE slab at a time, and slabs are never given back. Larger
+requests go straight to malloc.
 
-The rover can be left pointing at a non-empty block
+Every block starts with a memblock_t so that Z_Free can tell the two
+apart and catch bad or double frees. Debug builds also append a ZONEID
+trash marker that is checked on free.
 
 The zone calls are pretty much only used for small strings and structures,
 all big things are allocated on the hunk.
 ==============================================================================
 */
 
-static memzone_t	*mainzone;
+typedef struct ztraceop_s
+{
+	int			traceid;
+	int			size;		// -1 = free
+} ztraceop_t;
+
+static ztraceop_t	*zone_trace;	// dynamic array, recorded while zone_tracing is set
+static qboolean		zone_tracing;
+static int			zone_tracecount;
+
+static void Z_TraceOp (memblock_t *block, int size)
+{
+	ztraceop_t op;
+
+	if (size >= 0)
+		block->traceid = ++zone_tracecount;
+	else if (!block->traceid)
+		return;		// allocated before the trace started
+	op.traceid = block->traceid;
+	op.size = size;
+	VEC_PUSH (zone_trace, op);
+}
+
+static void Z_CheckBlock (memblock_t *block, const char *func)
+{
+	if (block->id != ZONEID)
+		Sys_Error ("%s: pointer without ZONEID", func);
+	if (block->tag == 0)
+		Sys_Error ("%s: pointer was already freed", func);
+#ifndef NDEBUG
+	if (*(int *)((byte *)(block + 1) + block->size) != ZONEID)
+		Sys_Error ("%s: memory trashed past the end of a %i byte block", func, block->size);
+#endif
+}
+
+static void Z_InitClasses (void)
+{
+	int i, j;
+
+	for (i = 0, j = 0; i < (int) countof (zone_classforsize); i++)
+	{
+		while (zone_classes[j].size < i * 16)
+			j++;
+		zone_classforsize[i] = j;
+	}
+	for (i = 0; i < (int) countof (zone_classes); i++)
+		zone_classes[i].chunksize = (sizeof (memblock_t) + zone_classes[i].size + ZONE_TRASHSIZE + 15) & ~15;
+}
+
+static void Z_NewSlab (zoneclass_t *zc)
+{
+	byte	*slab, *p;
+	int		i, count;
+
+	slab = (byte *) malloc (ZONE_SLABSIZE);
+	if (!slab)
+		Sys_Error ("Z_NewSlab: failed on allocation of %i bytes", ZONE_SLABSIZE);
+	zc->numslabs++;
+
+	count = ZONE_SLABSIZE / zc->chunksize;
+	for (i = count - 1, p = slab + i * zc->chunksize; i >= 0; i--, p -= zc->chunksize)
+	{
+		memblock_t *block = (memblock_t *) p;
+		block->id = ZONEID;
+		block->tag = 0;
+		block->cls = zc - zone_classes;
+		*(memblock_t **)(block + 1) = zc->free;
+		zc->free = block;
+	}
+}
+
+
+/*
+========================
+Z_Lock
+
+Server instances tick on worker threads and allocate QC strings and
+find lists from the zone, so the free lists and counters are guarded.
+========================
+*/
+static SDL_mutex *zone_mutex;
+
+static void Z_Lock (void)
+{
+	if (zone_mutex)
+		SDL_LockMutex (zone_mutex);
+}
 
+static void Z_Unlock (void)
+{
+	if (zone_mutex)
+		SDL_UnlockMutex (zone_mutex);
+}
 
 /*
 ========================
@@ -72,120 +194,86 @@ Z_Free
 */
 void Z_Free (void *ptr)
 {
-	memblock_t	*block, *other;
+	memblock_t	*block;
+	zoneclass_t	*zc;
 
 	if (!ptr)
 		Sys_Error ("Z_Free: NULL pointer");
 
-	block = (memblock_t *) ( (byte *)ptr - sizeof(memblock_t));
-	if (block->id != ZONEID)
-		Sys_Error ("Z_Free: freed a pointer without ZONEID");
-	if (block->tag == 0)
-		Sys_Error ("Z_Free: freed a freed pointer");
+	block = (memblock_t *) ptr - 1;
+	Z_CheckBlock (block, "Z_Free");
+
+	Z_Lock ();
+	if (zone_tracing)
+		Z_TraceOp (block, -1);
 
 	block->tag = 0;		// mark as free
 
-	other = block->prev;
-	if (!other->tag)
-	{	// merge with previous free block
-		other->size += block->size;
-		other->next = block->next;
-		other->next->prev = other;
-		if (block == mainzone->rover)
-			mainzone->rover = other;
-		block = other;
+	if (block->cls == ZONE_SYSTEM)
+	{
+		zone_system.used--;
+		zone_system.bytes -= block->size;
+		Z_Unlock ();
+		free (block);
+		return;
 	}
 
-	other = block->next;
-	if (!other->tag)
-	{	// merge the next free block onto the end
-		block->size += other->size;
-		block->next = other->next;
-		block->next->prev = block;
-		if (other == mainzone->rover)
-			mainzone->rover = block;
-	}
+	zc = &zone_classes[block->cls];
+	zc->used--;
+	*(memblock_t **)(block + 1) = zc->free;
+	zc->free = block;
+	Z_Unlock ();
 }
 
 
 static void *Z_TagMalloc (int size, int tag)
 {
-	int		extra;
-	memblock_t	*start, *rover, *newblock, *base;
+	memblock_t	*block;
+	zoneclass_t	*zc;
 
 	if (!tag)
 		Sys_Error ("Z_TagMalloc: tried to use a 0 tag");
+	if (size < 0)
+		return NULL;
 
-//
-// scan through the block list looking for the first free block
-// of sufficient size
-//
-	size += sizeof(memblock_t);	// account for size of block header
-	size += 4;					// space for memory trash tester
-	size = (size + 7) & ~7;		// align to 8-byte boundary
-
-	base = rover = mainzone->rover;
-	start = base->prev;
-
-	do
+	if (size <= ZONE_MAXSMALL)
 	{
-		if (rover == start)	// scaned all the way around the list
+		zc = &zone_classes[zone_classforsize[(size + 15) >> 4]];
+		Z_Lock ();
+		if (!zc->free)
+			Z_NewSlab (zc);
+		block = zc->free;
+		zc->free = *(memblock_t **)(block + 1);
+		zc->allocs++;
+		zc->peak = q_max (zc->peak, ++zc->used);
+	}
+	else
+	{
+		block = (memblock_t *) malloc (sizeof (memblock_t) + size + ZONE_TRASHSIZE);
+		if (!block)
 			return NULL;
-		if (rover->tag)
-			base = rover = rover->next;
-		else
-			rover = rover->next;
-	} while (base->tag || base->size < size);
-
-//
-// found a block big enough
-//
-	extra = base->size - size;
-	if (extra >  MINFRAGMENT)
-	{	// there will be a free fragment after the allocated block
-		newblock = (memblock_t *) ((byte *)base + size );
-		newblock->size = extra;
-		newblock->tag = 0;			// free block
-		newblock->prev = base;
-		newblock->id = ZONEID;
-		newblock->next = base->next;
-		newblock->next->prev = newblock;
-		base->next = newblock;
-		base->size = size;
+		block->id = ZONEID;
+		block->cls = ZONE_SYSTEM;
+		Z_Lock ();
+		zone_system.allocs++;
+		zone_system.peak = q_max (zone_system.peak, ++zone_system.used);
+		zone_system.bytes += size;
+		zone_system.peakbytes = q_max (zone_system.peakbytes, zone_system.bytes);
 	}
 
-	base->tag = tag;				// no longer a free block
-
-	mainzone->rover = base->next;	// next allocation will start looking here
-
-	base->id = ZONEID;
+	block->tag = tag;
+	block->size = size;
+	block->traceid = 0;
+	if (zone_tracing)
+		Z_TraceOp (block, size);
+	Z_Unlock ();
 
+#ifndef NDEBUG
 // marker for memory trash testing
-	*(int *)((byte *)base + base->size - 4) = ZONEID;
-
-	return (void *) ((byte *)base + sizeof(memblock_t));
-}
-
-/*
-========================
-Z_CheckHeap
-========================
-*/
-static void Z_CheckHeap (void)
-{
-	memblock_t	*block;
+	*(int *)((byte *)(block + 1) + size) = ZONEID;
+#endif
 
-	for (block = mainzone->blocklist.next ; ; block = block->next)
-	{
-		if (block->next == &mainzone->blocklist)
-			break;			// all blocks have been hit
-		if ( (byte *)block + block->size != (byte *)block->next)
-			Sys_Error ("Z_CheckHeap: block size does not touch the next block");
-		if ( block->next->prev != block)
-			Sys_Error ("Z_CheckHeap: next block doesn't have proper back link");
-		if (!block->tag && !block->next->tag)
-			Sys_Error ("Z_CheckHeap: two consecutive free blocks");
-	}
+	return (void *) (block + 1);
 }
 
 
@@ -198,7 +286,6 @@ void *Z_Malloc (int size)
 {
 	void	*buf;
 
-	Z_CheckHeap ();	// DEBUG
 	buf = Z_TagMalloc (size, 1);
 	if (!buf)
 		Sys_Error ("Z_Malloc: failed on allocation of %i bytes",size);
@@ -215,33 +302,39 @@ Z_Realloc
 void *Z_Realloc(void *ptr, int size)
 {
 	int old_size;
-	void *old_ptr;
+	void *new_ptr;
 	memblock_t *block;
 
 	if (!ptr)
 		return Z_Malloc (size);
 
-	block = (memblock_t *) ((byte *) ptr - sizeof (memblock_t));
-	if (block->id != ZONEID)
-		Sys_Error ("Z_Realloc: realloced a pointer without ZONEID");
-	if (block->tag == 0)
-		Sys_Error ("Z_Realloc: realloced a freed pointer");
+	block = (memblock_t *) ptr - 1;
+	Z_CheckBlock (block, "Z_Realloc");
 
 	old_size = block->size;
-	old_size -= (4 + (int)sizeof(memblock_t));	/* see Z_TagMalloc() */
-	old_ptr = ptr;
 
-	Z_Free (ptr);
-	ptr = Z_TagMalloc (size, 1);
-	if (!ptr)
+	// still fits the same size class, no need to move
+	if (block->cls != ZONE_SYSTEM && size >= 0 && size <= zone_classes[block->cls].size && !zone_tracing)
+	{
+		if (old_size < size)
+			memset ((byte *)ptr + old_size, 0, size - old_size);
+		block->size = size;
+#ifndef NDEBUG
+		*(int *)((byte *)ptr + size) = ZONEID;
+#endif
+		return ptr;
+	}
+
+	new_ptr = Z_TagMalloc (size, 1);
+	if (!new_ptr)
 		Sys_Error ("Z_Realloc: failed on allocation of %i bytes", size);
 
-	if (ptr != old_ptr)
-		memmove (ptr, old_ptr, q_min(old_size, size));
+	memcpy (new_ptr, ptr, q_min(old_size, size));
 	if (old_size < size)
-		memset ((byte *)ptr + old_size, 0, size - old_size);
+		memset ((byte *)new_ptr + old_size, 0, size - old_size);
+	Z_Free (ptr);
 
-	return ptr;
+	return new_ptr;
 }
 
 char *Z_Strdup (const char *s)
@@ -255,29 +348,165 @@ char *Z_Strdup (const char *s)
 
 /*
 ========================
-Z_Print
+Z_Print_f
 ========================
 */
-void Z_Print (memzone_t *zone)
+static void Z_Print_f (void)
 {
-	memblock_t	*block;
+	int			i, slots, totalslabs;
+	zoneclass_t	*zc;
+
+	Con_Printf ("class  slabs   used/slots   peak      allocs\n");
+	for (i = 0, totalslabs = 0; i < (int) countof (zone_classes); i++)
+	{
+		zc = &zone_classes[i];
+		slots = zc->numslabs * (ZONE_SLABSIZE / zc->chunksize);
+		totalslabs += zc->numslabs;
+		Con_Printf ("%5i %6i %6i/%-6i %6i %11" SDL_PRIu64 "  %3i%%\n",
+			zc->size, zc->numslabs, zc->used, slots, zc->peak, zc->allocs,
+			slots ? zc->used * 100 / slots : 0);
+	}
+	Con_Printf ("slabs: %i KB\n", totalslabs * (ZONE_SLABSIZE / 1024));
+	Con_Printf ("system: %i blocks, %i KB (peak %i blocks, %i KB), %" SDL_PRIu64 " allocs\n",
+		zone_system.used, (int)(zone_system.bytes / 1024),
+		zone_system.peak, (int)(zone_system.peakbytes / 1024), zone_system.allocs);
+}
+
+/*
+========================
+Z_Trace_f
 
-	Con_Printf ("zone size: %i  location: %p\n",mainzone->size,mainzone);
+zone_trace start
+zone_trace stop [file]
 
-	for (block = zone->blocklist.next ; ; block = block->next)
+Records every zone allocation and free, e.g. around a map load, for zone_bench
+========================
+*/
+static void Z_Trace_f (void)
+{
+	char	path[MAX_OSPATH];
+	FILE	*f;
+
+	if (Cmd_Argc () >= 2 && !q_strcasecmp (Cmd_Argv (1), "start"))
+	{
+		VEC_CLEAR (zone_trace);
+		zone_tracecount = 0;
+		zone_tracing = true;
+		Con_Printf ("zone trace started\n");
+		return;
+	}
+
+	if (Cmd_Argc () < 2 || q_strcasecmp (Cmd_Argv (1), "stop"))
+	{
+		Con_Printf ("usage: %s start | stop [file]\n", Cmd_Argv (0));
+		return;
+	}
+
+	zone_tracing = false;
+	q_snprintf (path, sizeof (path), "%s/%s", com_gamedir, Cmd_Argc () >= 3 ? Cmd_Argv (2) : "zone.trace");
+	f = Sys_fopen (path, "wb");
+	if (!f)
+	{
+		Con_Printf ("Couldn't write %s\n", path);
+		return;
+	}
+	fwrite (zone_trace, sizeof (zone_trace[0]), VEC_SIZE (zone_trace), f);
+	fclose (f);
+	Con_Printf ("Wrote %" SDL_PRIu64 " operations to %s\n", (uint64_t) VEC_SIZE (zone_trace), path);
+	VEC_FREE (zone_trace);
+}
+
+/*
+========================
+Z_Bench_f
+
+zone_bench [file] [passes]
+
+Replays a zone_trace recording through Z_TagMalloc/Z_Free and through the
+C library allocator
+========================
+*/
+static void Z_Bench_f (void)
+{
+	const char	*name = Cmd_Argc () >= 2 ? Cmd_Argv (1) : "zone.trace";
+	int			passes = Cmd_Argc () >= 3 ? q_max (1, Q_atoi (Cmd_Argv (2))) : 10;
+	ztraceop_t	*ops;
+	void		**live;
+	int			i, pass, method, count, maxid, length;
+	double		times[2];
+	FILE		*f;
+
+	length = COM_FOpenFile (name, &f, NULL);
+	if (length < 0)
+	{
+		Con_Printf ("Couldn't load %s\n", name);
+		return;
+	}
+	count = length / sizeof (*ops);
+	ops = (ztraceop_t *) malloc (count * sizeof (*ops));
+	if (!ops || fread (ops, sizeof (*ops), count, f) != (size_t) count)
 	{
-		Con_Printf ("block:%p    size:%7i    tag:%3i\n",
-			block, block->size, block->tag);
-
-		if (block->next == &zone->blocklist)
-			break;			// all blocks have been hit
-		if ( (byte *)block + block->size != (byte *)block->next)
-			Con_Printf ("ERROR: block size does not touch the next block\n");
-		if ( block->next->prev != block)
-			Con_Printf ("ERROR: next block doesn't have proper back link\n");
-		if (!block->tag && !block->next->tag)
-			Con_Printf ("ERROR: two consecutive free blocks\n");
+		fclose (f);
+		free (ops);
+		Con_Printf ("Couldn't read %s\n", name);
+		return;
 	}
+	fclose (f);
+
+	for (i = 0, maxid = 0; i < count; i++)
+		maxid = q_max (maxid, ops[i].traceid);
+	live = (void **) calloc (maxid + 1, sizeof (*live));
+	if (!live)
+	{
+		free (ops);
+		Con_Printf ("zone_bench: out of memory\n");
+		return;
+	}
+
+	for (method = 0; method < 2; method++)
+	{
+		times[method] = Sys_DoubleTime ();
+		for (pass = 0; pass < passes; pass++)
+		{
+			for (i = 0; i < count; i++)
+			{
+				void **p = &live[ops[i].traceid];
+				if (ops[i].size >= 0)
+				{
+					if (*p)
+						continue;
+					*p = method ? malloc (q_max (ops[i].size, 1)) : Z_TagMalloc (ops[i].size, 1);
+				}
+				else if (*p)
+				{
+					if (method)
+						free (*p);
+					else
+						Z_Free (*p);
+					*p = NULL;
+				}
+			}
+			// release whatever the trace left allocated
+			for (i = 0; i <= maxid; i++)
+			{
+				if (!live[i])
+					continue;
+				if (method)
+					free (live[i]);
+				else
+					Z_Free (live[i]);
+				live[i] = NULL;
+			}
+		}
+		times[method] = Sys_DoubleTime () - times[method];
+	}
+
+	Con_Printf ("%i operations x %i passes\n", count, passes);
+	Con_Printf ("zone:   %8.3f ms (%.1f ns/op)\n", times[0] * 1000.0, times[0] * 1e9 / q_max (1, count * passes));
+	Con_Printf ("malloc: %8.3f ms (%.1f ns/op)\n", times[1] * 1000.0, times[1] * 1e9 / q_max (1, count * passes));
+
+	free (live);
+	free (ops);
 }
 
 
@@ -298,17 +527,33 @@ typedef struct hunkseg_s
 	int					base;
 	int					size;
 	int					used;
-	int					pad; // pad to power of 2
+	int					reserved; // address space behind the segment, 0 = fixed size
 } hunkseg_t;
 
 #define MAX_SEGMENTS	8
+#define HUNK_RESERVE	(sizeof (void *) >= 8 ? 1024 * 1024 * 1024 : 256 * 1024 * 1024)
+#define HUNK_GRANULE	(1024 * 1024)		// commit/discard granularity of reserved segments
+#define HUNK_GROWSTEP	(8 * 1024 * 1024)	// minimum commit when a reserved segment grows
 #define SEG_MEM(seg)	((byte *) ((seg) + 1))
 #define LASTSEG			(hunk_segments[hunk_numsegments-1])
 
 static int				hunk_low_used;
+static int				hunk_peak_low;		// since the last Hunk_ReportPeaks
+static int				hunk_peak_top;		// highest offset used by the cache
 static int				hunk_numsegments;
 static hunkseg_t		*hunk_segments[MAX_SEGMENTS];
 
+#define ARENA_MINSEG	(256 * 1024)
+#define ARENA_MAXSEG	(8 * 1024 * 1024)
+
+struct hunkarena_s
+{
+	int					used;		// like hunk_low_used, over the arena's own segments
+	hunkseg_t			**segments;	// malloc'd, fixed size
+};
+
+static THREAD_LOCAL hunkarena_t	*hunk_arena;	// receives this thread's hunk allocations while set
+
 typedef enum
 {
 	HF_UNINIT			= 0,
@@ -529,32 +774,136 @@ static int Hunk_SegForPtr (const void *ptr)
 
 /*
 ===================
-Hunk_AllocInternal
+Hunk_ReserveSegment
+
+Reserves address space for a segment that commits memory as it grows,
+returns NULL if the platform won't give us the range
 ===================
 */
-static void *Hunk_AllocInternal (int size, const char *name, hunkflags_t flags)
+static hunkseg_t *Hunk_ReserveSegment (int base, int minsize)
 {
 	hunkseg_t	*seg;
-	hunk_t		*h;
-	int			i;
+	size_t		reserve, commit;
 
-#ifdef PARANOID
-	Hunk_Check ();
-#endif
+	reserve = q_min ((size_t) HUNK_RESERVE, (size_t) INT_MAX - base);
+	if (reserve < sizeof (hunkseg_t) + (size_t) minsize)
+		return NULL;
 
-	if (size == 0)
+	seg = (hunkseg_t *) Sys_ReserveMemory (reserve);
+	if (!seg)
 		return NULL;
 
-	if (size < 0)
-		Sys_Error ("Hunk_Alloc: bad size: %i", size);
+	commit = q_max (sizeof (hunkseg_t) + minsize, (size_t) HUNK_GROWSTEP);
+	commit = (commit + HUNK_GRANULE - 1) & ~(size_t)(HUNK_GRANULE - 1);
+	commit = q_min (commit, reserve);
+	if (!Sys_CommitMemory (seg, commit))
+	{
+		Sys_ReleaseMemory (seg, reserve);
+		return NULL;
+	}
 
-	size = sizeof(hunk_t) + ((size+15)&~15);
+	seg->base = base;
+	seg->size = commit - sizeof (hunkseg_t);
+	seg->reserved = reserve - sizeof (hunkseg_t);
+
+	return seg;
+}
+
+/*
+===================
+Hunk_GrowSegment
+
+Commits more of a reserved segment so that it holds at least needed bytes
+===================
+*/
+static qboolean Hunk_GrowSegment (hunkseg_t *seg, int needed)
+{
+	size_t oldcommit, newcommit;
+
+	if (needed > seg->reserved)
+		return false;
+
+	oldcommit = sizeof (hunkseg_t) + seg->size;
+	newcommit = sizeof (hunkseg_t) + q_max (needed, seg->size + HUNK_GROWSTEP);
+	newcommit = (newcommit + HUNK_GRANULE - 1) & ~(size_t)(HUNK_GRANULE - 1);
+	newcommit = q_min (newcommit, sizeof (hunkseg_t) + seg->reserved);
+
+	if (!Sys_CommitMemory ((byte *) seg + oldcommit, newcommit - oldcommit))
+		return false;
+
+	seg->size = newcommit - sizeof (hunkseg_t);
+	Con_DPrintf ("Hunk segment at %i grown to %.2lf MiB\n", seg->base, seg->size / 1048576.0);
+
+	return true;
+}
+
+/*
+===================
+Hunk_ArenaAlloc
+===================
+*/
+static hunk_t *Hunk_ArenaAlloc (hunkarena_t *arena, int size)
+{
+	hunkseg_t	*seg = NULL;
+	size_t		i, count = VEC_SIZE (arena->segments);
+
+	for (i = 0; i < count; i++)
+	{
+		seg = arena->segments[i];
+		if (arena->used >= seg->base + seg->size)
+			continue;
+		if ((arena->used - seg->base) + size <= seg->size)
+			break;
+		arena->used = seg->base + seg->size;
+	}
+
+	if (i == count)
+	{
+		int base = 0, segsize = ARENA_MINSEG;
+
+		if (count)
+		{
+			base = VEC_LAST (arena->segments)->base + VEC_LAST (arena->segments)->size;
+			segsize = q_min (VEC_LAST (arena->segments)->size * 2, ARENA_MAXSEG);
+		}
+		segsize = q_max (segsize, size);
+
+		seg = (hunkseg_t *) malloc (sizeof (hunkseg_t) + segsize);
+		if (!seg)
+			Sys_Error ("Hunk_Alloc: failed on %i bytes", size);
+		seg->base = base;
+		seg->size = segsize;
+		seg->used = 0;
+		seg->reserved = 0;
+		VEC_PUSH (arena->segments, seg);
+		arena->used = base;
+	}
+
+	arena->used += size;
+	seg->used = arena->used - seg->base;
+
+	return (hunk_t *) (SEG_MEM (seg) + seg->used - size);
+}
+
+/*
+===================
+Hunk_AllocLow
+===================
+*/
+static hunk_t *Hunk_AllocLow (int size)
+{
+	hunkseg_t	*seg;
+	hunk_t		*h;
+	int			i;
 
 	i = Hunk_SegForOfs (hunk_low_used);
 
 	// skip segments that can't handle this request (adjusting hunk_low_used)
+	// unless it's a reserved last segment that can grow in place
 	while (i < hunk_numsegments && (hunk_low_used - hunk_segments[i]->base) + size > hunk_segments[i]->size)
 	{
+		if (i == hunk_numsegments - 1 && Hunk_GrowSegment (hunk_segments[i], (hunk_low_used - hunk_segments[i]->base) + size))
+			break;
 		hunk_low_used = hunk_segments[i]->base + hunk_segments[i]->size;
 		i++;
 	}
@@ -567,23 +916,32 @@ static void *Hunk_AllocInternal (int size, const char *name, hunkflags_t flags)
 		if (hunk_numsegments == MAX_SEGMENTS)
 			Sys_Error ("Hunk_Alloc: segment overflow");
 
+		Cache_Lock ();
 		Cache_Flush ();
+		Cache_Unlock ();
 
 		newbase = LASTSEG->base + LASTSEG->size;
 		newsize = LASTSEG->size * 2;
 		newsize = q_max (newsize, size);
 
-		Sys_Printf ("Allocating new hunk segment: %.2lf MiB\n", newsize / 1048576.0);
-
-		seg = (hunkseg_t *) malloc (sizeof (hunkseg_t) + newsize);
-		if (!seg)
+		seg = Hunk_ReserveSegment (newbase, size);
+		if (seg)
+			Sys_Printf ("Reserved new hunk segment: %.2lf MiB\n", seg->reserved / 1048576.0);
+		else
 		{
-			Sys_Error ("Hunk_Alloc: failed on %i bytes", size);
-			return NULL;
-		}
+			Sys_Printf ("Allocating new hunk segment: %.2lf MiB\n", newsize / 1048576.0);
 
-		seg->base = newbase;
-		seg->size = newsize;
+			seg = (hunkseg_t *) malloc (sizeof (hunkseg_t) + newsize);
+			if (!seg)
+			{
+				Sys_Error ("Hunk_Alloc: failed on %i bytes", size);
+				return NULL;
+			}
+
+			seg->base = newbase;
+			seg->size = newsize;
+			seg->reserved = 0;
+		}
 		seg->used = 0;
 
 		hunk_segments[hunk_numsegments++] = seg;
@@ -594,8 +952,40 @@ static void *Hunk_AllocInternal (int size, const char *name, hunkflags_t flags)
 	h = (hunk_t *) (SEG_MEM (seg) + hunk_low_used - seg->base);
 	hunk_low_used += size;
 	seg->used = hunk_low_used - seg->base;
+	hunk_peak_low = q_max (hunk_peak_low, hunk_low_used);
 
+	Cache_Lock ();
 	Cache_FreeLow (hunk_low_used);
+	Cache_Unlock ();
+
+	return h;
+}
+
+/*
+===================
+Hunk_AllocInternal
+===================
+*/
+static void *Hunk_AllocInternal (int size, const char *name, hunkflags_t flags)
+{
+	hunk_t		*h;
+
+#ifdef PARANOID
+	Hunk_Check ();
+#endif
+
+	if (size == 0)
+		return NULL;
+
+	if (size < 0)
+		Sys_Error ("Hunk_Alloc: bad size: %i", size);
+
+	size = sizeof(hunk_t) + ((size+15)&~15);
+
+	if (hunk_arena)
+		h = Hunk_ArenaAlloc (hunk_arena, size);
+	else
+		h = Hunk_AllocLow (size);
 
 	if (flags & HF_CLEAR)
 		memset (h, 0, size);
@@ -652,6 +1042,8 @@ void *Hunk_AllocNoFill (int size)
 
 int	Hunk_LowMark (void)
 {
+	if (hunk_arena)
+		return hunk_arena->used;
 	return hunk_low_used;
 }
 
@@ -659,6 +1051,16 @@ void Hunk_FreeToLowMark (int mark)
 {
 	int i;
 
+	if (hunk_arena)
+	{
+		if (mark < 0 || mark > hunk_arena->used)
+			Sys_Error ("Hunk_FreeToLowMark: bad arena mark %i", mark);
+		hunk_arena->used = mark;
+		for (i = 0; i < (int) VEC_SIZE (hunk_arena->segments); i++)
+			hunk_arena->segments[i]->used = q_max (0, q_min (mark - hunk_arena->segments[i]->base, hunk_arena->segments[i]->size));
+		return;
+	}
+
 	if (mark < 0 || mark > hunk_low_used)
 		Sys_Error ("Hunk_FreeToLowMark: bad mark %i", mark);
 
@@ -667,6 +1069,170 @@ void Hunk_FreeToLowMark (int mark)
 		hunk_segments[i]->used = q_max (0, hunk_low_used - hunk_segments[i]->base);
 }
 
+/*
+===================
+Hunk_DiscardFree
+
+Gives the pages between the low mark and the cache back to the OS.
+Too slow for the temporary marks taken every frame, called on map change.
+===================
+*/
+void Hunk_DiscardFree (void)
+{
+	int i;
+
+	if (hunk_arena)
+		return;
+
+	// the cache can't move into the range while it's being discarded
+	Cache_Lock ();
+	for (i = Hunk_SegForOfs (hunk_low_used); i < hunk_numsegments; i++)
+	{
+		hunkseg_t	*seg = hunk_segments[i];
+		size_t		begin, end;
+		byte		*bottom;
+
+		if (!seg->reserved)
+			continue;
+
+		begin = sizeof (hunkseg_t) + seg->used;
+		end = sizeof (hunkseg_t) + seg->size;
+		if (seg == LASTSEG && (bottom = Cache_Bottom ()) != NULL)
+			end = bottom - (byte *) seg;
+		begin = (begin + HUNK_GRANULE - 1) & ~(size_t)(HUNK_GRANULE - 1);
+		end &= ~(size_t)(HUNK_GRANULE - 1);
+		if (end > begin)
+			Sys_DiscardMemory ((byte *) seg + begin, end - begin);
+	}
+	Cache_Unlock ();
+}
+
+/*
+===================
+Hunk_ReportPeaks
+
+Logs the high-water marks since the previous call and starts over
+===================
+*/
+void Hunk_ReportPeaks (const char *label)
+{
+	int i, committed;
+
+	for (i = 0, committed = 0; i < hunk_numsegments; i++)
+		committed += hunk_segments[i]->size;
+
+	Sys_Printf ("hunk: %s peak low %.2lf MiB, peak cache top %.2lf MiB, %.2lf MiB in %i segment%s\n",
+		label, hunk_peak_low / 1048576.0, hunk_peak_top / 1048576.0,
+		committed / 1048576.0, PLURAL (hunk_numsegments));
+
+	hunk_peak_low = hunk_low_used;
+	hunk_peak_top = 0;
+}
+
+/*
+===================
+Hunk_BeginArena
+
+Redirects hunk allocations to a new arena until Hunk_EndArena
+===================
+*/
+void Hunk_BeginArena (void)
+{
+	if (hunk_arena)
+		Sys_Error ("Hunk_BeginArena: already in an arena");
+	hunk_arena = (hunkarena_t *) calloc (1, sizeof (*hunk_arena));
+	if (!hunk_arena)
+		Sys_Error ("Hunk_BeginArena: out of memory");
+}
+
+/*
+===================
+Hunk_EndArena
+
+Returns the arena that was filled since Hunk_BeginArena, minus any
+segments above its final mark
+===================
+*/
+hunkarena_t *Hunk_EndArena (void)
+{
+	hunkarena_t *arena = hunk_arena;
+
+	if (!arena)
+		Sys_Error ("Hunk_EndArena: not in an arena");
+	hunk_arena = NULL;
+
+	while (VEC_SIZE (arena->segments) > 1 && VEC_LAST (arena->segments)->base >= arena->used)
+	{
+		free (VEC_LAST (arena->segments));
+		VEC_POP (arena->segments);
+	}
+
+	return arena;
+}
+
+/*
+===================
+Hunk_AbortArena
+===================
+*/
+void Hunk_AbortArena (void)
+{
+	if (hunk_arena)
+	{
+		Hunk_FreeArena (hunk_arena);
+		hunk_arena = NULL;
+	}
+}
+
+/*
+===================
+Hunk_SwitchArena
+
+Points this thread's hunk allocations at an existing arena (or back at the
+hunk for NULL) and returns the previous one
+===================
+*/
+hunkarena_t *Hunk_SwitchArena (hunkarena_t *arena)
+{
+	hunkarena_t *old = hunk_arena;
+
+	hunk_arena = arena;
+
+	return old;
+}
+
+/*
+===================
+Hunk_FreeArena
+===================
+*/
+void Hunk_FreeArena (hunkarena_t *arena)
+{
+	size_t i;
+
+	if (!arena)
+		return;
+	for (i = 0; i < VEC_SIZE (arena->segments); i++)
+		free (arena->segments[i]);
+	VEC_FREE (arena->segments);
+	free (arena);
+}
+
+/*
+===================
+Hunk_ArenaSize
+===================
+*/
+size_t Hunk_ArenaSize (const hunkarena_t *arena)
+{
+	size_t i, size = sizeof (*arena);
+
+	for (i = 0; i < VEC_SIZE (arena->segments); i++)
+		size += sizeof (hunkseg_t) + arena->segments[i]->size;
+
+	return size;
+}
+
 char *Hunk_Strdup (const char *s, const char *name)
 {
 	size_t sz = strlen(s) + 1;
@@ -697,6 +1263,25 @@ cache_system_t *Cache_TryAlloc (int size, qboolean nobottom);
 
 cache_system_t	cache_head;
 
+/*
+===========
+Cache_Bottom
+
+Lowest cache block, or NULL if the cache is empty
+===========
+*/
+static byte *Cache_Bottom (void)
+{
+	return cache_head.next != &cache_head ? (byte *) cache_head.next : NULL;
+}
+
+static cache_system_t *Cache_NoteTop (cache_system_t *cs)
+{
+	int top = (byte *) cs + cs->size - SEG_MEM (LASTSEG) + LASTSEG->base;
+	hunk_peak_top = q_max (hunk_peak_top, top);
+	return cs;
+}
+
 /*
 ===========
 Cache_Move
@@ -804,7 +1389,7 @@ cache_system_t *Cache_TryAlloc (int size, qboolean nobottom)
 		new_cs->prev = new_cs->next = &cache_head;
 
 		Cache_MakeLRU (new_cs);
-		return new_cs;
+		return Cache_NoteTop (new_cs);
 	}
 
 // search from the bottom up for space
@@ -828,7 +1413,7 @@ cache_system_t *Cache_TryAlloc (int size, qboolean nobottom)
 
 				Cache_MakeLRU (new_cs);
 
-				return new_cs;
+				return Cache_NoteTop (new_cs);
 			}
 		}
 
@@ -851,7 +1436,7 @@ cache_system_t *Cache_TryAlloc (int size, qboolean nobottom)
 
 		Cache_MakeLRU (new_cs);
 
-		return new_cs;
+		return Cache_NoteTop (new_cs);
 	}
 
 	return NULL;		// couldn't allocate
@@ -866,8 +1451,10 @@ Throw everything out, so new data will be demand cached
 */
 void Cache_Flush (void)
 {
+	Cache_Lock ();
 	while (cache_head.next != &cache_head)
 		Cache_Free ( cache_head.next->user, true); // reclaim the space //johnfitz -- added second argument
+	Cache_Unlock ();
 }
 
 /*
@@ -880,10 +1467,12 @@ void Cache_Print (void)
 {
 	cache_system_t	*cd;
 
+	Cache_Lock ();
 	for (cd = cache_head.next ; cd != &cache_head ; cd = cd->next)
 	{
 		Con_Printf ("%8i : %s\n", cd->size, cd->name);
 	}
+	Cache_Unlock ();
 }
 
 /*
@@ -897,6 +1486,29 @@ void Cache_Report (void)
 	Con_DPrintf ("%4.1f megabyte data cache\n", (Hunk_Size () - hunk_low_used) / (float)(1024*1024) );
 }
 
+/*
+============
+Cache_Lock
+
+The sound mixer thread reads sfx data straight out of the cache and
+touches the LRU list, so anything that links, unlinks or moves cache
+blocks must hold this lock.  Recursive.
+============
+*/
+static SDL_mutex *cache_mutex;
+
+void Cache_Lock (void)
+{
+	if (cache_mutex)
+		SDL_LockMutex (cache_mutex);
+}
+
+void Cache_Unlock (void)
+{
+	if (cache_mutex)
+		SDL_UnlockMutex (cache_mutex);
+}
+
 /*
 ============
 Cache_Init
@@ -908,6 +1520,10 @@ void Cache_Init (void)
 	cache_head.next = cache_head.prev = &cache_head;
 	cache_head.lru_next = cache_head.lru_prev = &cache_head;
 
+	cache_mutex = SDL_CreateMutex ();
+	if (!cache_mutex)
+		Sys_Error ("Cache_Init: couldn't create mutex: %s", SDL_GetError ());
+
 	Cmd_AddCommand ("flush", Cache_Flush);
 }
 
@@ -925,6 +1541,8 @@ void Cache_Free (cache_user_t *c, qboolean freetextures) //johnfitz -- added sec
 	if (!c->data)
 		Sys_Error ("Cache_Free: not allocated");
 
+	Cache_Lock ();
+
 	cs = ((cache_system_t *)c->data) - 1;
 
 	cs->prev->next = cs->next;
@@ -935,6 +1553,8 @@ void Cache_Free (cache_user_t *c, qboolean freetextures) //johnfitz -- added sec
 
 	Cache_UnlinkLRU (cs);
 
+	Cache_Unlock ();
+
 	//johnfitz -- if a model becomes uncached, free the gltextures.  This only works
 	//becuase the cache_user_t is the last component of the qmodel_t struct.  Should
 	//fail harmlessly if *c is actually part of an sfx_t struct.  I FEEL DIRTY
@@ -952,17 +1572,23 @@ Cache_Check
 void *Cache_Check (cache_user_t *c)
 {
 	cache_system_t	*cs;
+	void			*data;
 
-	if (!c->data)
-		return NULL;
+	Cache_Lock ();
 
-	cs = ((cache_system_t *)c->data) - 1;
+	data = c->data;
+	if (data)
+	{
+		cs = ((cache_system_t *)data) - 1;
 
-// move to head of LRU
-	Cache_UnlinkLRU (cs);
-	Cache_MakeLRU (cs);
+	// move to head of LRU
+		Cache_UnlinkLRU (cs);
+		Cache_MakeLRU (cs);
+	}
+
+	Cache_Unlock ();
 
-	return c->data;
+	return data;
 }
 
 
@@ -983,6 +1609,8 @@ void *Cache_Alloc (cache_user_t *c, int size, const char *name)
 
 	size = (size + sizeof(cache_system_t) + 15) & ~15;
 
+	Cache_Lock ();
+
 // find memory for it
 	while (1)
 	{
@@ -1002,31 +1630,14 @@ void *Cache_Alloc (cache_user_t *c, int size, const char *name)
 		Cache_Free (cache_head.lru_prev->user, true); //johnfitz -- added second argument
 	}
 
+	Cache_Unlock ();
+
 	return Cache_Check (c);
 }
 
 //============================================================================
 
 
-static void Memory_InitZone (memzone_t *zone, int size)
-{
-	memblock_t	*block;
-
-// set the entire zone to one free block
-
-	zone->blocklist.next = zone->blocklist.prev = block =
-		(memblock_t *)( (byte *)zone + sizeof(memzone_t) );
-	zone->blocklist.tag = 1;	// in use block
-	zone->blocklist.id = 0;
-	zone->blocklist.size = 0;
-	zone->rover = block;
-
-	block->prev = block->next = &zone->blocklist;
-	block->tag = 0;			// free block
-	block->id = ZONEID;
-	block->size = size - sizeof(memzone_t);
-}
-
 /*
 ========================
 Memory_Init
@@ -1034,9 +1645,6 @@ Memory_Init
 */
 void Memory_Init (void *buf, int size)
 {
-	int p;
-	int zonesize = DYNAMIC_SIZE;
-
 	hunk_segments[0] = (hunkseg_t *) buf;
 	hunk_segments[0]->base = 0;
 	hunk_segments[0]->size = size - sizeof (hunkseg_t);
@@ -1044,17 +1652,15 @@ void Memory_Init (void *buf, int size)
 	hunk_low_used = 0;
 
 	Cache_Init ();
-	p = COM_CheckParm ("-zone");
-	if (p)
-	{
-		if (p < com_argc-1)
-			zonesize = Q_atoi (com_argv[p+1]) * 1024;
-		else
-			Sys_Error ("Memory_Init: you must specify a size in KB after -zone");
-	}
-	mainzone = (memzone_t *) Hunk_AllocName (zonesize, "zone" );
-	Memory_InitZone (mainzone, zonesize);
+	Z_InitClasses ();
+
+	zone_mutex = SDL_CreateMutex ();
+	if (!zone_mutex)
+		Sys_Error ("Memory_Init: couldn't create mutex: %s", SDL_GetError ());
 
 	Cmd_AddCommand ("hunk_print", Hunk_Print_f); //johnfitz
+	Cmd_AddCommand ("zone_print", Z_Print_f);
+	Cmd_AddCommand ("zone_trace", Z_Trace_f);
+	Cmd_AddCommand ("zone_bench", Z_Bench_f);
 }
 
@@ -39,10 +39,15 @@ Hunk allocations should be given a name, so the Hunk_Print () function
 can display usage.
 Hunk allocations are guaranteed to be 16 byte aligned.
 
+Between Hunk_BeginArena and Hunk_EndArena, hunk allocations and marks go to
+a private arena instead, which stays valid until Hunk_FreeArena no matter
+where the hunk cursor is reset to. The current arena is per thread, and
+Hunk_SwitchArena re-enters one that was already ended.
+
 
 Z_??? Zone memory functions used for small, dynamic allocations like text
-strings from command input.  There is only about 48K for it, allocated at
-the very bottom of the hunk.
+strings from command input.  Small requests come from size-class slabs,
+larger ones from the system allocator; neither lives in the hunk.
 
 Cache_??? Cache memory is for objects that can be dynamically loaded and
 can usefully stay persistant between levels.  The size of the cache
@@ -63,8 +68,6 @@ client and server low hunk allocations
 
 startup hunk allocations
 
-Zone block
-
 ----- Bottom of Memory -----
 
 
@@ -92,6 +95,16 @@ char *Hunk_Strdup (const char *s, const char *name);
 
 int	Hunk_LowMark (void);
 void Hunk_FreeToLowMark (int mark);
+void Hunk_DiscardFree (void);		// returns freed hunk pages to the OS
+void Hunk_ReportPeaks (const char *label);	// logs high-water marks since the last report
+
+typedef struct hunkarena_s hunkarena_t;
+void Hunk_BeginArena (void);
+hunkarena_t *Hunk_EndArena (void);
+void Hunk_AbortArena (void);		// drops an arena left open by an error
+hunkarena_t *Hunk_SwitchArena (hunkarena_t *arena);	// returns the previous one
+void Hunk_FreeArena (hunkarena_t *arena);
+size_t Hunk_ArenaSize (const hunkarena_t *arena);
 
 void Hunk_Check (void);
 
@@ -114,5 +127,9 @@ void *Cache_Alloc (cache_user_t *c, int size, const char *name);
 
 void Cache_Report (void);
 
+void Cache_Lock (void);
+void Cache_Unlock (void);
+// guards the cache against the sound mixer thread, see Cache_Lock
+
 #endif	/* __ZZONE_H */
 